@@ -0,0 +1,469 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file bus.h
+ * @brief Wire format between the main board and the sub boards
+ *
+ * Every frame on the system bus starts with a packed header and ends with a CRC-16 over
+ * header and payload:
+ *
+ * ```
+ * +---------+------+-------+-------+----------+--------+---------+-------+
+ * | version | type | board | flags | sequence | length | payload | CRC16 |
+ * |    1    |  1   |   1   |   1   |    2     |   2    | length  |   2   |
+ * +---------+------+-------+-------+----------+--------+---------+-------+
+ * ```
+ *
+ * All multi-byte fields are little-endian, which is the native byte order of both the
+ * ESP32 and the STM32, so that the header can be used as a packed struct on both sides.
+ *
+ * The most frequent frame is the input report of a sub board. Its payload contains the
+ * time of the newest change, the number of inputs, a bitmap of the changed inputs and the
+ * changed values as zig-zag encoded variable-length integers. Usually these are deltas to the previous report, so
+ * that a knob being turned only costs one or two bytes per input. After a lost frame
+ * (gap in the sequence numbers) the main board asks for a resync and the next report
+ * contains absolute values of all inputs.
+ *
+ * Inputs are numbered per board as `slot * INPUT_COUNT + input`. The decoder delivers the
+ * changed inputs of a slot together, as one vector with a bit mask of the changed inputs.
+ * The sub board reports all axes of a joystick or touchpad in the same report, when one
+ * of them moves, so that a diagonal move stays one event all the way to the outputs.
+ *
+ * The system bus is a multi-master I2C bus. The main board is bus master most of the time
+ * and reads the input reports from the sub boards. But it never polls them: When inputs
+ * have changed, the sub board itself becomes master for a moment and writes its board
+ * number to the main board (attention message). Collisions are resolved by the I2C
+ * arbitration, so no extra signal lines are needed. As the I2C buffers on both sides are
+ * small, frames are read in chunks of `MY_BUS_CHUNK` bytes. A sub board with nothing to
+ * report answers with a single zero byte (which is no valid protocol version).
+ *
+ * When a board is found, the main board asks for its identity: the number of slots and a
+ * hash of its descriptor. The descriptor lists the control type and the value range of
+ * each input of each slot. It is only read when no descriptor with the same hash has been
+ * cached before, so that known boards are enumerated with a single short frame.
+ *
+ * Timestamps are taken from the free-running microsecond counter of the sub board. The
+ * main board regularly sends a time request and notes when it was sent and when the
+ * response was received. Together with the receive and send time of the sub board this
+ * gives the clock offset of each board (see `clock.h`), so that events of different
+ * boards can be merged in the order they happened.
+ *
+ * The newest value of a knob is all that matters, but a gate that opens and closes
+ * between two reports must not be lost. Therefore inputs that need every edge are sent as
+ * event reports instead, which contain each change with its own timestamp. They share the
+ * sequence numbers of the input reports and always carry absolute values. In the other
+ * direction, the main board sends output events for CV and gate outputs, stamped with the
+ * sub board time at which they shall take effect, so that the I2C latency does not turn
+ * into jitter at the output.
+ *
+ * Firmware updates are sent to all sub boards at once with the I2C general call address.
+ * The image is split into chunks of `UPDATE_CHUNK` bytes, each in its own CRC-protected
+ * frame. Chunks are grouped into windows of `UPDATE_WINDOW` chunks, which is one flash page
+ * of the STM32. After each window the main board asks every board which chunks it has
+ * received and sends the missing ones again. A board writes the window to flash once it
+ * is complete and only then moves on to the next one, so that an interrupted update can
+ * be resumed at the last written window.
+ */
+
+#pragma once
+
+#include "control.h"        // my_control::ControlType, my_control::INPUT_COUNT
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, int32_t
+
+namespace my_bus {
+
+constexpr uint8_t VERSION = 3;      ///< Protocol version, incremented on incompatible changes
+
+/**
+ * Frame type
+ */
+enum class Type : uint8_t {
+    input_report  = 1,              ///< Sub → main: Changed input values
+    resync        = 2,              ///< Main → sub: Send absolute values of all inputs next
+    identify      = 3,              ///< Main → sub: Send identity next
+    identity      = 4,              ///< Sub → main: Descriptor hash and number of slots
+    describe      = 5,              ///< Main → sub: Send descriptor next
+    descriptor    = 6,              ///< Sub → main: One `SlotDescriptor` per slot
+    time_request  = 7,              ///< Main → sub: Send timestamps next
+    time_response = 8,              ///< Sub → main: `TimeResponse`
+    update_begin  = 9,              ///< Main → all: `UpdateInfo` of a new firmware image
+    update_data   = 10,             ///< Main → all: `UpdateChunk`
+    update_status = 11,             ///< Main → sub: Send update report next
+    update_report = 12,             ///< Sub → main: `UpdateReport`
+    update_commit = 13,             ///< Main → all: Verify and install the received image
+    event_report  = 14,             ///< Sub → main: `InputEvent`s in the order they happened
+    output_events = 15,             ///< Main → sub: `OutputEvent`s to be scheduled
+};
+
+/**
+ * Frame flags
+ */
+enum Flags : uint8_t {
+    FLAG_ABSOLUTE  = 0x01,          ///< Input report contains absolute values instead of deltas
+    FLAG_IMMEDIATE = 0x02,          ///< Output events take effect on arrival, as the clock offset is unknown
+};
+
+/**
+ * Frame header
+ */
+struct __attribute__((packed)) Header {
+    uint8_t version;                ///< Protocol version
+    Type type;                      ///< Frame type
+    uint8_t board;                  ///< Address of the sub board
+    uint8_t flags;                  ///< Frame flags
+    uint16_t sequence;              ///< Sequence number, incremented per frame and direction
+    uint16_t length;                ///< Payload length
+};
+
+static_assert(sizeof(Header) == 8, "Bus header must be packed");
+
+/**
+ * Payload of an identity frame
+ */
+struct __attribute__((packed)) Identity {
+    uint32_t hash;                  ///< `my_hash::fnv1a()` of the descriptor payload
+    uint8_t slots;                  ///< Number of slots
+};
+
+/**
+ * Payload of a time response
+ */
+struct __attribute__((packed)) TimeResponse {
+    uint32_t receive_us;            ///< Sub board time when the time request was received
+    uint32_t transmit_us;           ///< Sub board time when the response was sent
+};
+
+/**
+ * Single change of an input in an event report
+ */
+struct __attribute__((packed)) InputEvent {
+    uint32_t time_us;               ///< Sub board time of the change
+    uint8_t input;                  ///< Input number
+    int32_t value;                  ///< New value
+};
+
+/**
+ * Scheduled value of an output in an output events frame. Outputs are numbered like the
+ * inputs, e.g. `slot * INPUT_COUNT + a1` for the CV output of a CV/gate slot.
+ */
+struct __attribute__((packed)) OutputEvent {
+    uint32_t time_us;               ///< Sub board time when the value takes effect
+    uint8_t output;                 ///< Output number
+    uint16_t value;                 ///< New 12-bit value, or 0/1 for gates
+    uint16_t slew;                  ///< Maximum change per millisecond, zero to jump
+};
+
+constexpr size_t UPDATE_CHUNK  = 16;    ///< Image bytes per update frame
+constexpr size_t UPDATE_WINDOW = 128;   ///< Chunks per acknowledged window
+
+/**
+ * Payload of an update begin frame
+ */
+struct __attribute__((packed)) UpdateInfo {
+    uint32_t size;                  ///< Image size in bytes
+    uint32_t crc;                   ///< CRC-32 of the image
+};
+
+/**
+ * Payload of an update data frame. The last chunk is padded with 0xFF.
+ */
+struct __attribute__((packed)) UpdateChunk {
+    uint16_t index;                 ///< Chunk number
+    uint8_t data[UPDATE_CHUNK];     ///< Image bytes
+};
+
+/**
+ * Update state of a sub board
+ */
+enum class UpdateState : uint8_t {
+    idle,                           ///< No update running
+    receiving,                      ///< Waiting for the chunks of the current window
+    busy,                           ///< Writing to flash, chunks are ignored
+    verified,                       ///< Image complete and valid, installation follows
+    failed,                         ///< Image too large or checksum mismatch
+};
+
+/**
+ * Payload of an update report
+ */
+struct __attribute__((packed)) UpdateReport {
+    UpdateState state;              ///< Update state
+    uint16_t base;                  ///< First chunk of the current window
+    uint8_t received[UPDATE_WINDOW / 8]; ///< Bitmap of the received chunks in the window
+};
+
+/**
+ * Capabilities of a single slot, as part of the descriptor
+ */
+struct __attribute__((packed)) SlotDescriptor {
+    my_control::ControlType type;   ///< Type of the plugged control
+    uint16_t range[my_control::INPUT_COUNT]; ///< Highest raw value of each input, zero if unused
+};
+
+/**
+ * Result of parsing a frame
+ */
+enum class Result : uint8_t {
+    ok,                             ///< Frame accepted
+    incomplete,                     ///< Not enough data for the frame
+    bad_version,                    ///< Unsupported protocol version
+    bad_crc,                        ///< Checksum mismatch
+    bad_payload,                    ///< Payload does not match the frame type
+    resync,                         ///< Frames have been lost, a resync must be requested
+};
+
+#ifndef MY_BUS_MAX_INPUTS
+#define MY_BUS_MAX_INPUTS 64        ///< Maximum number of inputs per sub board
+#endif
+
+#ifndef MY_BUS_MAX_BOARDS
+#define MY_BUS_MAX_BOARDS 32        ///< Maximum number of sub boards
+#endif
+
+#ifndef MY_BUS_CHUNK
+#define MY_BUS_CHUNK 32             ///< Bytes per I2C read, limited by the Arduino Wire buffer
+#endif
+
+constexpr uint8_t GENERAL_CALL  = 0x00; ///< I2C address of all sub boards at once
+constexpr uint8_t MAIN_ADDRESS  = 0x08; ///< I2C address of the main board for attention messages
+constexpr uint8_t BOARD_ADDRESS = 0x10; ///< I2C address of the first sub board
+constexpr uint8_t ALL_BOARDS    = 0xFF; ///< Board number in the header of broadcast frames
+
+constexpr size_t CRC_SIZE = 2;      ///< Size of the frame checksum
+constexpr size_t MAX_SLOTS = MY_BUS_MAX_INPUTS / my_control::INPUT_COUNT; ///< Maximum number of slots per sub board
+constexpr size_t MAX_EVENTS = 16;   ///< Maximum number of events per event report
+constexpr size_t MAX_OUTPUT_EVENTS = (MY_BUS_CHUNK - sizeof(Header) - CRC_SIZE) / sizeof(OutputEvent); ///< Output events per frame
+
+/**
+ * Largest possible input report: Timestamp and bitmap plus five bytes per value
+ */
+constexpr size_t MAX_FRAME = sizeof(Header) + 4 + 1 + (MY_BUS_MAX_INPUTS + 7) / 8 + MY_BUS_MAX_INPUTS * 5 + CRC_SIZE;
+
+static_assert(sizeof(Header) + MAX_SLOTS * sizeof(SlotDescriptor) + CRC_SIZE <= MAX_FRAME, "Descriptor must fit into a frame");
+static_assert(sizeof(Header) + MAX_EVENTS * sizeof(InputEvent) + CRC_SIZE <= MAX_FRAME, "Event report must fit into a frame");
+static_assert(MAX_OUTPUT_EVENTS > 0, "Output events must fit into the Wire buffer");
+static_assert(sizeof(Header) + sizeof(UpdateChunk) + CRC_SIZE <= MY_BUS_CHUNK, "Update chunk must fit into the Wire buffer");
+static_assert(sizeof(Header) + sizeof(UpdateReport) + CRC_SIZE <= MY_BUS_CHUNK, "Update report must fit into one read");
+
+/**
+ * CRC-16/CCITT-FALSE
+ *
+ * @param[in] data Bytes to check
+ * @param[in] size Number of bytes
+ * @param[in] crc Start value, or the result of a previous call to continue
+ * @returns Checksum
+ */
+uint16_t crc16(const uint8_t* data, size_t size, uint16_t crc = 0xFFFF) noexcept;
+
+/**
+ * CRC-32 (IEEE 802.3), used to verify firmware images
+ *
+ * @param[in] data Bytes to check
+ * @param[in] size Number of bytes
+ * @param[in] crc Zero, or the result of a previous call to continue
+ * @returns Checksum
+ */
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) noexcept;
+
+/**
+ * Write the header of a frame. The payload must be written directly after the header,
+ * followed by a call to `finish()`.
+ *
+ * @param[out] buffer Frame buffer
+ * @param[in] type Frame type
+ * @param[in] board Board address
+ * @param[in] flags Frame flags
+ * @param[in] sequence Sequence number
+ * @returns Pointer to the payload
+ */
+uint8_t* begin(uint8_t* buffer, Type type, uint8_t board, uint8_t flags, uint16_t sequence) noexcept;
+
+/**
+ * Write payload length and checksum of a frame.
+ *
+ * @param[in,out] buffer Frame buffer
+ * @param[in] length Payload length
+ * @returns Total frame size
+ */
+size_t finish(uint8_t* buffer, uint16_t length) noexcept;
+
+/**
+ * Validate a received frame.
+ *
+ * @param[in] data Received bytes
+ * @param[in] size Number of bytes
+ * @param[out] header Frame header
+ * @param[out] payload Pointer to the payload
+ * @returns Result code
+ */
+Result parse(const uint8_t* data, size_t size, Header& header, const uint8_t*& payload) noexcept;
+
+/**
+ * Input reports of a sub board. The inputs are set whenever they are read, but only
+ * the changed ones are sent.
+ */
+class Encoder {
+public:
+    /**
+     * @param[in] board Board address
+     * @param[in] inputs Number of inputs (`slots * INPUT_COUNT`)
+     */
+    Encoder(uint8_t board, uint8_t inputs) noexcept;
+
+    /**
+     * Set the current value of an input.
+     *
+     * @param[in] input Input number
+     * @param[in] value Current value
+     * @param[in] time_us Time when the value has been read
+     */
+    void set(uint8_t input, int32_t value, uint32_t time_us) noexcept {
+        if (input >= inputs || current[input] == value) return;
+        current[input] = value;
+        changed_us = time_us;
+    }
+
+    /**
+     * Record a value that has been sent in an event report, so that the absolute values
+     * of a resync agree with it.
+     *
+     * @param[in] input Input number
+     * @param[in] value Sent value
+     */
+    void track(uint8_t input, int32_t value) noexcept {
+        if (input >= inputs) return;
+        current[input] = value;
+        sent[input]    = value;
+    }
+
+    /**
+     * @returns true, if at least one input differs from the last report
+     */
+    bool changed() const noexcept;
+
+    /**
+     * Send absolute values of all inputs with the next report.
+     */
+    void resync() noexcept { absolute = true; }
+
+    /**
+     * Write an input report with all changed inputs.
+     *
+     * @param[out] buffer Frame buffer with at least `MAX_FRAME` bytes
+     * @returns Frame size or zero, if nothing has changed
+     */
+    size_t encode(uint8_t* buffer) noexcept;
+
+    /**
+     * Write an event report. Uses the same sequence numbers as the input reports.
+     *
+     * @param[out] buffer Frame buffer with at least `MAX_FRAME` bytes
+     * @param[in] events Events in the order they happened
+     * @param[in] count Number of events, at most `MAX_EVENTS`
+     * @returns Frame size
+     */
+    size_t encode(uint8_t* buffer, const InputEvent* events, size_t count) noexcept;
+
+    /**
+     * @returns Board address
+     */
+    uint8_t board() const noexcept { return _board; }
+
+private:
+    uint8_t _board;                             ///< Board address
+    uint8_t inputs;                             ///< Number of inputs
+    bool absolute;                              ///< Next report contains absolute values
+    uint16_t sequence;                          ///< Next sequence number
+    uint32_t changed_us;                        ///< Time of the newest change
+    int32_t current[MY_BUS_MAX_INPUTS];         ///< Current values
+    int32_t sent[MY_BUS_MAX_INPUTS];            ///< Values of the last report
+};
+
+/**
+ * Callback for decoded input values, called once per slot with changed inputs
+ *
+ * @param[in] context Context pointer given to `decode()`
+ * @param[in] board Board address
+ * @param[in] slot Slot number on that board
+ * @param[in] changed Bit mask of the changed inputs (bit 0 = input a)
+ * @param[in] values Current values of all `INPUT_COUNT` inputs of the slot
+ * @param[in] time_us Time of the change, converted by the offset given to `decode()`
+ */
+using Handler = void (*)(void* context, uint8_t board, uint8_t slot, uint8_t changed, const int32_t* values, uint32_t time_us) noexcept;
+
+/**
+ * Decodes the input reports of a single sub board on the main board.
+ */
+class Decoder {
+public:
+    Decoder() noexcept;
+
+    /**
+     * Decode an input or event report and call the handler for each changed slot. Delta
+     * reports are dropped until an absolute report has been received after a sequence gap.
+     * Event reports are always delivered, as their values are absolute.
+     *
+     * @param[in] header Frame header from `parse()`
+     * @param[in] payload Frame payload from `parse()`
+     * @param[in] handler Callback for changed values
+     * @param[in] context Context pointer for the callback
+     * @param[in] offset Clock offset subtracted from the timestamp (see `my_clock::Estimator`)
+     * @returns Result code, `resync` if a resync frame must be sent
+     */
+    Result decode(const Header& header, const uint8_t* payload, Handler handler, void* context, uint32_t offset = 0) noexcept;
+
+    /**
+     * @param[in] input Input number
+     * @returns Last known value
+     */
+    int32_t value(uint8_t input) const noexcept { return values[input]; }
+
+private:
+    Result decode_events(const Header& header, const uint8_t* payload, Handler handler, void* context, uint32_t offset) noexcept;
+    void deliver(uint8_t board, uint8_t slot, uint8_t changed, uint32_t time_us, Handler handler, void* context) const noexcept;
+
+    bool synced;                                ///< Absolute values have been received
+    uint16_t sequence;                          ///< Expected sequence number
+    int32_t values[MY_BUS_MAX_INPUTS];          ///< Last known values
+};
+
+/**
+ * Frames sent by the main board, so that the protocols on top of the system bus, like the
+ * firmware update, can also run against simulated sub boards.
+ */
+class Link {
+public:
+    virtual ~Link() noexcept = default;
+
+    /**
+     * Send a request frame without payload and read the response.
+     *
+     * @param[in] board Board number
+     * @param[in] type Request type
+     * @param[out] header Response header
+     * @param[out] payload Response payload, valid until the next call
+     * @returns false, if no valid response has been received
+     */
+    virtual bool request(uint8_t board, Type type, Header& header, const uint8_t*& payload) noexcept = 0;
+
+    /**
+     * Send a frame to all sub boards at once.
+     *
+     * @param[in] type Frame type
+     * @param[in] payload Frame payload
+     * @param[in] length Payload length
+     * @returns false, if no board has acknowledged the frame
+     */
+    virtual bool broadcast(Type type, const void* payload, uint16_t length) noexcept = 0;
+};
+
+} // namespace my_bus
@@ -0,0 +1,128 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file clock.h
+ * @brief Clock offset between the main board and a sub board
+ *
+ * Each board timestamps its events with its own free-running microsecond counter. To put
+ * events of different boards on one time line, the main board estimates the offset of
+ * each sub board's clock with the same four timestamps as NTP:
+ *
+ * ```
+ *   main  t1 ----request----> t2  sub
+ *   main  t4 <---response---- t3  sub
+ *
+ *   offset = ((t2 - t1) + (t3 - t4)) / 2
+ *   delay  = (t4 - t1) - (t3 - t2)
+ * ```
+ *
+ * The offset is exact when both directions take equally long. Samples delayed by bus
+ * traffic or interrupts are asymmetric, so only the sample with the lowest round-trip
+ * delay of the last `MY_CLOCK_SAMPLES` is used (NTP clock filter). Because the crystals
+ * of the boards differ by some ppm, the drift between two selected samples is tracked,
+ * too, so that the offset can be extrapolated between the sync exchanges.
+ *
+ * All timestamps are 32-bit microsecond counters and may wrap around. Offsets are kept
+ * modulo 2^32, so that boards switched on at very different times still work.
+ */
+
+#pragma once
+
+#include <cstdint>          // int32_t, uint8_t, uint32_t
+
+namespace my_clock {
+
+#ifndef MY_CLOCK_SAMPLES
+#define MY_CLOCK_SAMPLES 8          ///< Number of sync samples to pick the best one from
+#endif
+
+#ifndef MY_CLOCK_MIN_SPAN_US
+#define MY_CLOCK_MIN_SPAN_US 10000000 ///< Minimum time between two samples to measure the drift
+#endif
+
+/**
+ * Offset estimator for the clock of one remote board.
+ */
+class Estimator {
+public:
+    Estimator() noexcept;
+
+    /**
+     * Forget all samples, e.g. when the board has been replaced.
+     */
+    void reset() noexcept { *this = Estimator(); }
+
+    /**
+     * Add the timestamps of one sync exchange.
+     *
+     * @param[in] t1 Local time when the request was sent
+     * @param[in] t2 Remote time when the request was received
+     * @param[in] t3 Remote time when the response was sent
+     * @param[in] t4 Local time when the response was received
+     */
+    void sample(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4) noexcept;
+
+    /**
+     * @returns true, if at least one sample has been taken
+     */
+    bool valid() const noexcept { return count > 0; }
+
+    /**
+     * @param[in] now_us Current local time
+     * @returns Remote time minus local time (modulo 2^32)
+     */
+    uint32_t offset(uint32_t now_us) const noexcept;
+
+    /**
+     * Convert a remote timestamp into local time.
+     *
+     * @param[in] remote_us Remote timestamp
+     * @param[in] now_us Current local time
+     * @returns Local timestamp
+     */
+    uint32_t to_local(uint32_t remote_us, uint32_t now_us) const noexcept {
+        return remote_us - offset(now_us);
+    }
+
+    /**
+     * @returns Round-trip delay of the selected sample in microseconds
+     */
+    uint32_t delay() const noexcept { return best.delay; }
+
+    /**
+     * @returns Mean deviation of the recent samples from the estimate in microseconds
+     */
+    uint32_t jitter() const noexcept { return _jitter; }
+
+    /**
+     * @returns Measured drift of the remote clock in ppm
+     */
+    float drift_ppm() const noexcept { return drift * 1e6f; }
+
+private:
+    /**
+     * Result of one sync exchange
+     */
+    struct Sample {
+        uint32_t offset;            ///< Remote minus local time
+        uint32_t delay;             ///< Round-trip delay without the remote processing time
+        uint32_t local_us;          ///< Local time of the exchange
+    };
+
+    Sample samples[MY_CLOCK_SAMPLES];   ///< Recent samples (ring buffer)
+    uint8_t count;                      ///< Number of valid samples
+    uint8_t next;                       ///< Next entry in the ring buffer
+    Sample best;                        ///< Sample currently used for the estimate
+    Sample anchor;                      ///< Earlier sample to measure the drift against
+    float drift;                        ///< Drift of the remote clock (microseconds per microsecond)
+    uint32_t _jitter;                   ///< Mean deviation of the samples
+};
+
+} // namespace my_clock
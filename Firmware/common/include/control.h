@@ -0,0 +1,77 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file control.h
+ * @brief Basic control definitions shared by all boards
+ *
+ * These mirror the types in `Webconfig/types/control.ts`, but only contain the parts
+ * that the firmware needs to identify controls and their inputs. Everything else, like
+ * the names or the message templates, lives in the configuration of the main board.
+ */
+
+#pragma once
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t
+
+namespace my_control {
+
+/**
+ * Control type. Must be kept in sync with `controlTypes` in the web configuration.
+ */
+enum class ControlType : uint8_t {
+    button,                         ///< Push button
+    switch_,                        ///< Toggle switch
+    knob,                           ///< Potentiometer
+    fader,                          ///< Slide potentiometer
+    ribbon,                         ///< Ribbon controller
+    wheel,                          ///< Pitch or modulation wheel
+    cv_gate,                        ///< Control voltage and gate input/output
+    rotary,                         ///< Rotary encoder
+    rotary_button,                  ///< Rotary encoder with push button
+    joystick,                       ///< Joystick with up to three axes
+    touchpad,                       ///< Touchpad with position and pressure
+    display,                        ///< Display (output only)
+    generic,                        ///< Anything else
+};
+
+/**
+ * Input of a control. Each control has up to five inputs, though most only use one.
+ */
+enum class Input : uint8_t {
+    a,                              ///< Digital input A
+    b,                              ///< Digital input B
+    c,                              ///< Digital input C
+    a0,                             ///< Analog input 0
+    a1,                             ///< Analog input 1
+};
+
+constexpr size_t INPUT_COUNT = 5;   ///< Number of inputs per control
+
+/**
+ * @param[in] type Control type
+ * @returns true, if the inputs are the axes of one position, which must always be
+ *          processed together, so that a diagonal move is not split into two steps
+ */
+constexpr bool is_vector(ControlType type) noexcept {
+    return type == ControlType::joystick || type == ControlType::touchpad;
+}
+
+/**
+ * Reference to a single input of a configured control. The control is identified
+ * by its index in the configuration, not by its board and slot number, so that it
+ * can be used to directly index into tables of the control engine.
+ */
+struct InputRef {
+    uint16_t control;               ///< Index of the control in the configuration
+    Input    input;                 ///< Input of the control
+};
+
+} // namespace my_control
@@ -0,0 +1,144 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file format.h
+ * @brief Compiled message templates for serial, MQTT and MIDI data
+ *
+ * Several message types have a `data` template in their configuration, like
+ * `Volume {A0}` or `0xB0 0x07 {A0}`. A template consists of:
+ *
+ * - Hexadecimal bytes like `0xFF`, sent as they are
+ * - Placeholders of the control's inputs like `{A0}`, replaced by the input value
+ * - Any other text, sent as it is
+ *
+ * The template format decides how the placeholders are replaced. With `text` the value is
+ * written as a decimal number with the number of decimals and the decimal separator of the
+ * input. With `binary` the value is rounded and written as big-endian integer of one, two
+ * or four bytes, depending on the input's value range. Spaces between tokens are ignored
+ * in the binary format.
+ *
+ * Templates are compiled once when the configuration is loaded. Afterwards messages can
+ * be written straight into the output buffer and received messages can be matched against
+ * the template in a single pass, without creating any intermediate strings.
+ */
+
+#pragma once
+
+#include "control.h"        // my_control::INPUT_COUNT
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t
+#include <string>           // std::string
+#include <string_view>      // std::string_view
+#include <vector>           // std::vector
+
+namespace my_format {
+
+/**
+ * Data format, see `Webconfig/types/binary.ts`
+ */
+enum class Format : uint8_t {
+    text,                           ///< Human readable text
+    binary,                         ///< Raw bytes
+};
+
+/**
+ * Placeholder of a control input, taken from the input parameters
+ */
+struct Placeholder {
+    std::string name;               ///< Placeholder including the braces, e.g. `{A0}`
+    float from;                     ///< Lowest value
+    float to;                       ///< Highest value
+    uint8_t decimals;               ///< Number of decimals for the text format
+    char separator;                 ///< Decimal separator for the text format
+};
+
+/**
+ * Compiled message template
+ */
+class Template {
+public:
+    /**
+     * Compile a template. This never fails, as everything that is not understood is
+     * simply treated as literal text.
+     *
+     * @param[in] data Template string from the configuration
+     * @param[in] format Data format
+     * @param[in] placeholders Placeholders of all inputs of the control (`INPUT_COUNT` entries)
+     * @returns Compiled template
+     */
+    static Template compile(std::string_view data, Format format, const Placeholder* placeholders);
+
+    /**
+     * Write a message with the given values.
+     *
+     * @param[in] values Values of all inputs of the control
+     * @param[out] buffer Output buffer
+     * @param[in] size Buffer size
+     * @returns Number of bytes written or zero, if the buffer is too small
+     */
+    size_t encode(const float* values, uint8_t* buffer, size_t size) const noexcept;
+
+    /**
+     * Match a received message against the template and extract the input values.
+     * The message must match completely, including all literal parts.
+     *
+     * @param[in] data Received message
+     * @param[in] size Message size
+     * @param[out] values Values of all inputs, only changed where a placeholder matched
+     * @param[out] changed Bit mask of the inputs found in the message
+     * @returns true, if the message matches the template
+     */
+    bool decode(const uint8_t* data, size_t size, float* values, uint8_t& changed) const noexcept;
+
+    /**
+     * @returns Upper limit of the encoded message size
+     */
+    size_t max_size() const noexcept { return _max_size; }
+
+    /**
+     * @returns Bit mask of the inputs used in the template
+     */
+    uint8_t inputs() const noexcept { return _inputs; }
+
+    /**
+     * @returns Data format
+     */
+    Format format() const noexcept { return _format; }
+
+private:
+    /**
+     * Compiled template element
+     */
+    struct Op {
+        enum Kind : uint8_t {
+            literal,                ///< Copy bytes from `literals`
+            value,                  ///< Input value
+        } kind;
+
+        uint8_t input;              ///< Index of the input (value)
+        uint8_t width;              ///< Number of bytes (binary value)
+        bool is_signed;             ///< Negative values possible (binary value)
+        uint8_t decimals;           ///< Number of decimals (text value)
+        char separator;             ///< Decimal separator (text value)
+        uint16_t offset;            ///< Offset in `literals` (literal)
+        uint16_t length;            ///< Number of bytes (literal)
+    };
+
+    Template() noexcept = default;
+
+    Format _format = Format::text;  ///< Data format
+    uint8_t _inputs = 0;            ///< Bit mask of used inputs
+    size_t _max_size = 0;           ///< Upper limit of the message size
+    std::vector<Op> ops;            ///< Template elements
+    std::vector<uint8_t> literals;  ///< Literal bytes of all elements
+};
+
+} // namespace my_format
@@ -0,0 +1,71 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file hash.h
+ * @brief 32-bit FNV-1a hash
+ *
+ * One hash for everything that is looked up or compared by a short key: the descriptors
+ * of the sub boards (`bus.h`), the OSC addresses of the dispatcher (`osc.h`) and the paths
+ * of the web portal bundle (`http.h`). The bundle is written by `Webconfig/bin/deploy.ts`,
+ * which calculates the same hash and must be kept in line with this one.
+ *
+ * FNV-1a needs no table and can be calculated byte by byte in the same pass that reads
+ * the key. As it is `constexpr`, hashes of fixed keys cost nothing at run time.
+ */
+
+#pragma once
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint32_t
+#include <string_view>      // std::string_view
+
+namespace my_hash {
+
+constexpr uint32_t FNV_OFFSET = 2166136261u;    ///< Initial hash value
+constexpr uint32_t FNV_PRIME  = 16777619u;      ///< Multiplier per byte
+
+/**
+ * Hash a block of bytes. Longer data can be hashed in parts by passing the hash of the
+ * previous part.
+ *
+ * @param[in] data Bytes to hash
+ * @param[in] size Number of bytes
+ * @param[in] hash Hash of the previous part
+ * @returns Hash value
+ */
+constexpr uint32_t fnv1a(const uint8_t* data, size_t size, uint32_t hash = FNV_OFFSET) noexcept {
+    while (size--) {
+        hash ^= *data++;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/**
+ * Hash a string, e.g. an OSC address or a URI path.
+ *
+ * @param[in] string String to hash
+ * @returns Hash value
+ */
+constexpr uint32_t fnv1a(std::string_view string) noexcept {
+    uint32_t hash = FNV_OFFSET;
+
+    for (char c : string) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static_assert(fnv1a("") == FNV_OFFSET && fnv1a("a") == 0xe40c292cu, "FNV-1a test vectors");
+
+} // namespace my_hash
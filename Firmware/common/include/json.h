@@ -0,0 +1,252 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file json.h
+ * @brief Streaming JSON writer and pull parser
+ *
+ * The REST API of the web configuration portal exchanges the whole configuration as one
+ * JSON document (see `Webconfig/server/database.ts`), in which every control carries its
+ * own lists of MIDI, OSC, MQTT and serial messages. With a hundred controls or more such a
+ * document is far too large to be held in RAM as a tree of objects. Therefore it is never
+ * held in memory as a whole, but streamed piece by piece between the socket and the flash.
+ *
+ * `Writer` is called with one token after the other and collects the text in a small
+ * buffer, which is passed to a sink function whenever it is full. `Parser` works the other
+ * way around: It reads the text in small blocks from a source function and returns one
+ * token after the other. Strings are unescaped into a buffer of `MY_JSON_STRING` bytes,
+ * which is reused for every token. The parser also keeps track of the path of the current
+ * token, like `controls[3].midi[0].message`, so that a client can decide by the path what
+ * to do with a value and name it in error messages.
+ *
+ * Both need a fixed amount of memory, which only depends on the compile-time limits
+ * below, but not on the size of the document.
+ */
+
+#pragma once
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, uint32_t, int64_t
+#include <string_view>      // std::string_view
+
+namespace my_json {
+
+#ifndef MY_JSON_BUFFER
+#define MY_JSON_BUFFER 256          ///< Bytes read from the source or collected for the sink at once
+#endif
+
+#ifndef MY_JSON_STRING
+#define MY_JSON_STRING 256          ///< Maximum length of a string, key or number in the parser
+#endif
+
+#ifndef MY_JSON_DEPTH
+#define MY_JSON_DEPTH 16            ///< Maximum nesting of objects and arrays
+#endif
+
+#ifndef MY_JSON_PATH
+#define MY_JSON_PATH 128            ///< Maximum length of the token path in the parser
+#endif
+
+static_assert(MY_JSON_DEPTH < 32, "Writer keeps one bit per level");
+
+/**
+ * Receives the written text. Returns false to abort writing.
+ */
+typedef bool (*Sink)(void* context, const char* data, size_t size);
+
+/**
+ * Provides the text to be parsed. Returns the number of bytes read, zero at the end.
+ */
+typedef size_t (*Source)(void* context, char* buffer, size_t size);
+
+/**
+ * Streaming JSON writer. Calls must form a valid document, e.g. each value inside an
+ * object must be preceded by `key()`. Commas and escapes are inserted automatically.
+ */
+class Writer {
+public:
+    /**
+     * @param[in] sink Function receiving the text
+     * @param[in] context Context pointer passed to the sink
+     */
+    Writer(Sink sink, void* context) noexcept;
+
+    void begin_object() noexcept;
+    void end_object() noexcept;
+    void begin_array() noexcept;
+    void end_array() noexcept;
+    void key(std::string_view key) noexcept;
+    void string(std::string_view value) noexcept;
+    void integer(int64_t value) noexcept;
+    void number(double value) noexcept;
+    void boolean(bool value) noexcept;
+    void null() noexcept;
+
+    /**
+     * Write a number as it is, e.g. the original text of a parsed number.
+     */
+    void raw(std::string_view value) noexcept;
+
+    /**
+     * Pass the remaining text to the sink.
+     *
+     * @returns false, if the sink failed or the nesting was too deep
+     */
+    bool flush() noexcept;
+
+    /**
+     * @returns false, if the sink failed or the nesting was too deep
+     */
+    bool ok() const noexcept { return _ok; }
+
+private:
+    void separate() noexcept;
+    void push(char c) noexcept;
+    void write(std::string_view text) noexcept;
+    void quote(std::string_view text) noexcept;
+
+    Sink sink;                                  ///< Text receiver
+    void* context;                              ///< Context pointer of the sink
+    char buffer[MY_JSON_BUFFER];                ///< Collected text
+    size_t used;                                ///< Bytes in the buffer
+    uint32_t comma;                             ///< Bit per level, set when the next value needs a comma
+    uint8_t depth;                              ///< Current nesting
+    bool after_key;                             ///< Next value belongs to a key
+    bool _ok;                                   ///< No error so far
+};
+
+/**
+ * Token returned by the parser
+ */
+enum class Token : uint8_t {
+    begin_object,                   ///< `{`
+    end_object,                     ///< `}`
+    begin_array,                    ///< `[`
+    end_array,                      ///< `]`
+    key,                            ///< Key of an object member, in `string()`
+    string,                         ///< String value, in `string()`
+    number,                         ///< Number value, in `number()` and as text in `string()`
+    boolean,                        ///< `true` or `false`, in `boolean()`
+    null,                           ///< `null`
+    end,                            ///< End of the document
+    error,                          ///< Syntax error or limit exceeded, see `error()`
+};
+
+/**
+ * Streaming JSON pull parser. Call `next()` until it returns `Token::end` or `Token::error`.
+ */
+class Parser {
+public:
+    /**
+     * @param[in] source Function providing the text
+     * @param[in] context Context pointer passed to the source
+     */
+    Parser(Source source, void* context) noexcept;
+
+    /**
+     * Parse the next token.
+     *
+     * @returns Token type
+     */
+    Token next() noexcept;
+
+    /**
+     * Skip the value following a key or the rest of the object or array just begun.
+     *
+     * @returns false, if an error occurred
+     */
+    bool skip() noexcept;
+
+    /**
+     * @returns Key, string or number text of the last token, valid until the next call
+     */
+    std::string_view string() const noexcept { return {text, length}; }
+
+    /**
+     * @returns Value of the last number token
+     */
+    double number() const noexcept;
+
+    /**
+     * @returns Value of the last boolean token
+     */
+    bool boolean() const noexcept { return _boolean; }
+
+    /**
+     * Path of the last token, e.g. `controls[3].midi[0].message`. Array indices count
+     * from zero. Too long paths are cut off.
+     */
+    std::string_view path() const noexcept { return {_path, path_length}; }
+
+    /**
+     * @returns Nesting of the last token, zero at the top level
+     */
+    size_t depth() const noexcept { return _depth; }
+
+    /**
+     * @returns Description of the error, `nullptr` if none
+     */
+    const char* error() const noexcept { return _error; }
+
+private:
+    /**
+     * What may come next
+     */
+    enum class Expect : uint8_t {
+        value,                      ///< Any value
+        first_key,                  ///< Key or `}`
+        next_key,                   ///< `,` and key or `}`
+        first_value,                ///< Value or `]`
+        next_value,                 ///< `,` and value or `]`
+        done,                       ///< End of the document
+    };
+
+    /**
+     * Open object or array
+     */
+    struct Frame {
+        bool array;                 ///< Array, not object
+        uint16_t index;             ///< Index of the current array element
+        uint16_t path_length;       ///< Length of the path of the object or array itself
+    };
+
+    int peek() noexcept;
+    int get() noexcept;
+    int skip_space() noexcept;
+    Token fail(const char* message) noexcept;
+    Token value(int c) noexcept;
+    Token begin(bool array) noexcept;
+    Token end(bool array) noexcept;
+    bool parse_string() noexcept;
+    bool parse_number() noexcept;
+    bool parse_literal(const char* literal) noexcept;
+    void append(char c) noexcept;
+    void set_path(std::string_view key) noexcept;
+    void set_path(uint16_t index) noexcept;
+    void finish_value() noexcept;
+
+    Source source;                              ///< Text provider
+    void* context;                              ///< Context pointer of the source
+    char buffer[MY_JSON_BUFFER];                ///< Text read from the source
+    size_t position;                            ///< Next byte in the buffer
+    size_t available;                           ///< Bytes in the buffer
+    bool eof;                                   ///< Source is exhausted
+    char text[MY_JSON_STRING + 1];              ///< Key, string or number text of the last token, zero-terminated
+    size_t length;                              ///< Length of the text
+    bool overflow;                              ///< Text did not fit into the buffer
+    bool _boolean;                              ///< Value of the last boolean token
+    char _path[MY_JSON_PATH];                   ///< Path of the last token
+    size_t path_length;                         ///< Length of the path
+    Frame frames[MY_JSON_DEPTH];                ///< Open objects and arrays
+    size_t _depth;                              ///< Number of open objects and arrays
+    Expect expect;                              ///< What may come next
+    const char* _error;                         ///< Description of the error
+};
+
+} // namespace my_json
@@ -0,0 +1,169 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file mcp3208.h
+ * @brief Driver for the MCP3208 12-bit 8-channel SPI ADC (and compatibles)
+ *
+ * Each conversion is a three byte SPI transfer, with chip select going high in between.
+ * Doing one blocking transfer per channel wastes most of the time in the driver, so all
+ * eight conversions of a frame are started at once and complete in the background:
+ *
+ * - On the ESP32 all eight transactions are put into the queue of the SPI master driver,
+ *   which executes them back to back with DMA and toggles chip select in hardware.
+ * - On the STM32 the transfer complete interrupt of one channel immediately starts the
+ *   DMA transfer of the next channel.
+ * - On Linux recorded samples are replayed from a text file with one frame of eight
+ *   values per line, so that the code using the ADC can be run on a development machine.
+ *
+ * The results are double-buffered: `front()` always returns the last complete frame,
+ * while the next frame is being converted into the back buffer.
+ */
+
+#pragma once
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint16_t, uint32_t
+
+#if defined(ESP_PLATFORM)
+#include <driver/spi_master.h>  // spi_device_handle_t, spi_transaction_t
+#elif defined(ARDUINO_ARCH_STM32)
+#include <Arduino.h>            // PinName, SPI_HandleTypeDef, DMA_HandleTypeDef
+#elif defined(__linux__)
+#include <cstdio>               // FILE
+#include <string>               // std::string
+#endif
+
+namespace my_mcp3208 {
+
+constexpr size_t CHANNELS = 8;      ///< Number of channels
+
+/**
+ * Converted values of all channels
+ */
+struct Frame {
+    uint16_t values[CHANNELS];      ///< 12-bit values
+    uint32_t sequence;              ///< Frame counter
+};
+
+/**
+ * Hardware connection
+ */
+struct Config {
+#if defined(ESP_PLATFORM)
+    spi_host_device_t host = SPI2_HOST; ///< SPI controller
+    int mosi = 23;                  ///< GPIO of MOSI
+    int miso = 19;                  ///< GPIO of MISO
+    int sclk = 18;                  ///< GPIO of the clock
+    int cs = 5;                     ///< GPIO of chip select
+#elif defined(ARDUINO_ARCH_STM32)
+    PinName cs = PA_11;             ///< Chip select, the other pins are those of SPI1 (PB3, PB4, PB5)
+#elif defined(__linux__)
+    std::string path;               ///< Recorded samples to replay
+#endif
+    uint32_t clock_hz = 1000000;    ///< SPI clock, 2 MHz max. at 5 V, 1 MHz max. at 2.7 V
+};
+
+/**
+ * MCP3208 connected via SPI. Only one instance is possible on the STM32, because the
+ * HAL callbacks have no context pointer.
+ */
+class Mcp3208 {
+public:
+    /**
+     * Initialize the SPI driver. In case of an error the `error` attribute will contain
+     * the platform's error code.
+     *
+     * @param[in] config Hardware connection
+     * @returns Driver instance
+     */
+    static Mcp3208 open(const Config& config) noexcept;
+
+    /**
+     * Start converting the next frame, unless a conversion is still running.
+     *
+     * @returns false, if the conversion could not be started
+     */
+    bool start() noexcept;
+
+    /**
+     * Check whether the running conversion has finished. If so, the buffers are swapped.
+     *
+     * @returns true, if a new frame is available
+     */
+    bool poll() noexcept;
+
+    /**
+     * @returns Last complete frame
+     */
+    const Frame& front() const noexcept { return frames[current]; }
+
+#if defined(ARDUINO_ARCH_STM32)
+    /**
+     * Store the result of the current channel and start the next one, called from the
+     * SPI transfer complete interrupt.
+     */
+    void transfer_complete() noexcept;
+
+    SPI_HandleTypeDef spi;                      ///< SPI handle
+    DMA_HandleTypeDef dma_rx;                   ///< Receive DMA handle
+    DMA_HandleTypeDef dma_tx;                   ///< Transmit DMA handle
+#endif
+
+    /**
+     * @returns The error code from opening the driver
+     */
+    int error() const noexcept { return _error; }
+
+    Mcp3208(const Mcp3208&) = delete;
+    Mcp3208& operator=(const Mcp3208&) = delete;
+
+    /**
+     * Destructor – releases the SPI driver.
+     */
+    ~Mcp3208() noexcept;
+
+private:
+    Mcp3208(const Config& config) noexcept;
+
+    /**
+     * Command bytes of a single-ended conversion, with the result in the lower
+     * twelve bits of the second and third byte.
+     */
+    static void command(size_t channel, uint8_t* tx) noexcept {
+        tx[0] = static_cast<uint8_t>(0x06 | (channel >> 2));
+        tx[1] = static_cast<uint8_t>((channel & 0x03) << 6);
+        tx[2] = 0;
+    }
+
+    static uint16_t result(const uint8_t* rx) noexcept {
+        return static_cast<uint16_t>(((rx[1] & 0x0F) << 8) | rx[2]);
+    }
+
+    Frame frames[2];                            ///< Front and back buffer
+    volatile uint8_t current;                   ///< Index of the front buffer
+    volatile bool running;                      ///< Conversion in progress
+    int _error;                                 ///< Last error code
+
+#if defined(ESP_PLATFORM)
+    spi_device_handle_t device;                 ///< SPI device
+    spi_transaction_t transactions[CHANNELS];   ///< One transaction per channel
+    size_t pending;                             ///< Transactions not yet completed
+#elif defined(ARDUINO_ARCH_STM32)
+    PinName cs;                                 ///< Chip select
+    volatile uint8_t channel;                   ///< Channel being converted
+    volatile bool done;                         ///< Frame complete, not yet swapped
+    uint8_t tx[3];                              ///< Command bytes
+    uint8_t rx[3];                              ///< Result bytes
+#elif defined(__linux__)
+    FILE* file;                                 ///< Recorded samples
+#endif
+};
+
+} // namespace my_mcp3208
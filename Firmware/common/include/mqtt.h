@@ -0,0 +1,297 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file mqtt.h
+ * @brief Minimal MQTT 3.1.1 and 5.0 client for publishing control values
+ *
+ * This is not a general purpose MQTT client. It only implements what we need to send
+ * control values to a broker and receive values for controls with `receive` enabled,
+ * but tries to do so with as little overhead as possible:
+ *
+ * - All topics are registered once when the configuration is loaded. With MQTT 5 each
+ *   topic gets a topic alias (as far as the broker allows), so that the full topic name
+ *   is only sent once per connection. Later messages only carry the two byte alias.
+ * - Messages are always published with QoS 0. Nothing needs to be stored for retries.
+ * - Payloads are never copied when published immediately. The packet header is built on
+ *   the stack and sent together with the caller's buffer in a single gathered write.
+ * - Alternatively the newest value of each topic can be staged and all changed topics
+ *   be published in one batch, dropping all values that were overwritten in between.
+ *
+ * The network connection is abstracted by the `Transport` interface, so that the client
+ * can run on the ESP32 and on a Linux host alike.
+ */
+
+#pragma once
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, uint32_t
+#include <string>           // std::string
+#include <string_view>      // std::string_view
+#include <vector>           // std::vector
+
+namespace my_mqtt {
+
+/**
+ * Part of a gathered write.
+ */
+struct Slice {
+    const uint8_t* data;            ///< First byte
+    size_t size;                    ///< Number of bytes
+};
+
+/**
+ * Byte stream to the broker, usually a TCP connection.
+ */
+class Transport {
+public:
+    virtual ~Transport() noexcept = default;
+
+    /**
+     * Write all given slices as one contiguous byte stream.
+     *
+     * @param[in] slices Data to be written
+     * @param[in] count Number of slices
+     * @returns false, if the data could not be written completely
+     */
+    virtual bool write(const Slice* slices, size_t count) noexcept = 0;
+
+    /**
+     * Read available bytes without blocking.
+     *
+     * @param[out] buffer Receive buffer
+     * @param[in] size Buffer size
+     * @returns Number of bytes read, zero if nothing is available, negative on error
+     */
+    virtual int read(uint8_t* buffer, size_t size) noexcept = 0;
+};
+
+#if defined(ESP_PLATFORM) || defined(__linux__)
+/**
+ * Plain TCP transport using BSD sockets, which are available in ESP-IDF (lwIP) and on Linux.
+ */
+class SocketTransport : public Transport {
+public:
+    SocketTransport() noexcept = default;
+    ~SocketTransport() noexcept override;
+
+    /**
+     * Connect to the given host. Blocks until the connection is established or failed.
+     *
+     * @param[in] host IPv4 address or host name
+     * @param[in] port TCP port
+     * @returns true on success
+     */
+    bool connect(const std::string& host, uint16_t port) noexcept;
+
+    /**
+     * Close the connection.
+     */
+    void close() noexcept;
+
+    bool write(const Slice* slices, size_t count) noexcept override;
+    int read(uint8_t* buffer, size_t size) noexcept override;
+
+private:
+    int socket = -1;                ///< Socket file descriptor
+};
+#endif
+
+/**
+ * Protocol version
+ */
+enum class Version : uint8_t {
+    v3_1_1 = 4,                     ///< MQTT 3.1.1
+    v5     = 5,                     ///< MQTT 5.0
+};
+
+/**
+ * Connection state
+ */
+enum class State : uint8_t {
+    disconnected,                   ///< Not connected
+    connecting,                     ///< CONNECT sent, waiting for CONNACK
+    connected,                      ///< Connection accepted by the broker
+};
+
+/**
+ * Connection options
+ */
+struct Options {
+    Version version = Version::v5;  ///< Protocol version
+    std::string client_id;          ///< Client identifier
+    std::string username;           ///< User name or empty
+    std::string password;           ///< Password or empty
+    uint16_t keep_alive = 60;       ///< Keep alive interval in seconds
+};
+
+/**
+ * Handle of a registered topic
+ */
+typedef uint16_t topic_t;
+
+/**
+ * Callback for received messages. The topic and payload point into the receive buffer.
+ */
+using MessageHandler = void (*)(void* context, std::string_view topic, const uint8_t* payload, size_t size) noexcept;
+
+#ifndef MY_MQTT_SLOT_SIZE
+#define MY_MQTT_SLOT_SIZE 32        ///< Maximum payload size for staged messages
+#endif
+
+#ifndef MY_MQTT_RX_BUFFER
+#define MY_MQTT_RX_BUFFER 1024      ///< Size of the receive buffer (larger packets are dropped)
+#endif
+
+#ifndef MY_MQTT_BATCH_SIZE
+#define MY_MQTT_BATCH_SIZE 8        ///< Maximum number of packets combined in one write
+#endif
+
+constexpr size_t PUBLISH_SLICES = 5;                                ///< Maximum number of slices of one PUBLISH packet
+constexpr size_t MAX_SLICES = PUBLISH_SLICES * MY_MQTT_BATCH_SIZE;  ///< Maximum number of slices of one write
+
+/**
+ * MQTT client for a single broker connection. The client never blocks except for the
+ * writes to the transport, so `poll()` must be called regularly to receive messages
+ * and send keep-alive pings.
+ */
+class Client {
+public:
+    /**
+     * @param[in] transport Already connected transport
+     */
+    Client(Transport& transport) noexcept;
+
+    /**
+     * Register a topic for publishing. Should be called for all topics when the configuration
+     * is loaded, before connecting, though it can be called later at the cost of the topic
+     * possibly getting no alias.
+     *
+     * @param[in] topic Full topic name including the server prefix
+     * @returns Handle of the topic
+     */
+    topic_t add_topic(std::string_view topic);
+
+    /**
+     * Send the CONNECT packet. The connection is established when `state()` changes
+     * to `connected` after the CONNACK has been received in `poll()`.
+     *
+     * @param[in] options Connection options
+     * @param[in] now_ms Current time in milliseconds
+     * @returns false, if the packet could not be sent
+     */
+    bool connect(const Options& options, uint32_t now_ms) noexcept;
+
+    /**
+     * Send the DISCONNECT packet. The transport must be closed by the caller.
+     */
+    void disconnect() noexcept;
+
+    /**
+     * Subscribe to a topic filter with QoS 0.
+     *
+     * @param[in] filter Topic filter, may contain `+` and `#`
+     * @returns false, if the packet could not be sent
+     */
+    bool subscribe(std::string_view filter) noexcept;
+
+    /**
+     * Immediately publish a message with QoS 0. The payload is written to the transport
+     * directly from the given buffer.
+     *
+     * @param[in] topic Topic handle
+     * @param[in] payload Message payload
+     * @param[in] size Payload size
+     * @param[in] retain Retain flag
+     * @returns false, if not connected or the packet could not be sent
+     */
+    bool publish(topic_t topic, const uint8_t* payload, size_t size, bool retain = false) noexcept;
+
+    /**
+     * Stage a message for the next `flush()`. Only the newest staged value of each topic
+     * will be sent. Payloads larger than `MY_MQTT_SLOT_SIZE` are published immediately.
+     *
+     * @param[in] topic Topic handle
+     * @param[in] payload Message payload
+     * @param[in] size Payload size
+     * @param[in] retain Retain flag
+     * @returns false, if the payload was too large and could not be published directly
+     */
+    bool stage(topic_t topic, const uint8_t* payload, size_t size, bool retain = false) noexcept;
+
+    /**
+     * Publish all staged messages, combining several packets into one write.
+     *
+     * @returns false, if not connected or a write failed (the messages remain staged)
+     */
+    bool flush() noexcept;
+
+    /**
+     * Receive and handle incoming packets and send a ping when the connection was idle
+     * for too long.
+     *
+     * @param[in] now_ms Current time in milliseconds
+     * @param[in] handler Callback for received messages or `nullptr`
+     * @param[in] context Context pointer for the callback
+     * @returns false, if the connection was lost or a protocol error occurred
+     */
+    bool poll(uint32_t now_ms, MessageHandler handler = nullptr, void* context = nullptr) noexcept;
+
+    /**
+     * @returns Current connection state
+     */
+    State state() const noexcept { return _state; }
+
+private:
+    /**
+     * Registered topic with its alias and staging slot
+     */
+    struct Topic {
+        uint32_t offset;                        ///< Offset of the topic name in `strings`
+        uint16_t length;                        ///< Length of the topic name
+        uint16_t alias;                         ///< Topic alias or zero
+        bool alias_sent;                        ///< Alias has been mapped to the topic name
+        bool dirty;                             ///< Staged value not yet published
+        bool retain;                            ///< Retain flag of the staged value
+        uint8_t size;                           ///< Size of the staged value
+        uint8_t slot[MY_MQTT_SLOT_SIZE];        ///< Staged value
+    };
+
+    /**
+     * PUBLISH header, built on the stack when sending
+     */
+    struct PublishHeader {
+        uint8_t fixed[5];                       ///< Packet type and remaining length
+        uint8_t fixed_size;                     ///< Used bytes of `fixed`
+        uint8_t topic_length[2];                ///< Topic name length
+        uint8_t properties[4];                  ///< Property length and topic alias
+        uint8_t properties_size;                ///< Used bytes of `properties`
+    };
+
+    size_t build_publish(Topic& topic, const uint8_t* payload, size_t size, bool retain, PublishHeader& header, Slice* slices) noexcept;
+    bool send_packet(uint8_t type, const uint8_t* body, size_t size) noexcept;
+    bool handle_packet(uint8_t type, const uint8_t* data, size_t size, MessageHandler handler, void* context) noexcept;
+    void reset_aliases() noexcept;
+
+    Transport& transport;                       ///< Connection to the broker
+    State _state;                               ///< Connection state
+    Version version;                            ///< Negotiated protocol version
+    uint32_t keep_alive_ms;                     ///< Keep alive interval
+    uint16_t alias_maximum;                     ///< Maximum topic alias allowed by the broker
+    uint16_t packet_id;                         ///< Last packet identifier
+    uint32_t last_sent_ms;                      ///< Time of the last write for the keep alive
+    uint32_t now_ms;                            ///< Time of the last poll
+    std::string strings;                        ///< Topic names back to back
+    std::vector<Topic> topics;                  ///< Registered topics
+    std::vector<uint8_t> rx_buffer;             ///< Receive buffer
+    size_t rx_size;                             ///< Used bytes of the receive buffer
+    size_t rx_discard;                          ///< Bytes of an oversized packet still to be dropped
+};
+
+} // namespace my_mqtt
@@ -0,0 +1,249 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file serial.h
+ * @brief Sending and receiving control values over a serial connection
+ *
+ * Controls can send their values as text or binary messages over the serial port, e.g. to
+ * drive a hardware synthesizer. The messages are defined by the `data` templates of the
+ * control's serial configuration (see `format.h`). Text messages are terminated with a
+ * newline, binary messages are sent as they are.
+ *
+ * Writing never blocks. On the ESP32 the UART driver gets a large transmit buffer that is
+ * drained by the UART interrupt in the background, so that the control engine only copies
+ * the finished message once. On Linux a non-blocking TTY is used instead, so that the same
+ * code can be run on a development machine with a USB serial adapter or in the host tests
+ * with a pseudo terminal. As the kernel may take only a part of a message, the rest is kept
+ * in a buffer of the same size as the UART driver's and written with the next call.
+ */
+
+#pragma once
+
+#include "format.h"         // my_format::Template
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, uint32_t
+#include <string>           // std::string
+#include <vector>           // std::vector
+
+#if !defined(ESP_PLATFORM) && defined(__linux__)
+#include <sys/types.h>      // ssize_t
+#endif
+
+namespace my_serial {
+
+/**
+ * Parity, see `Webconfig/types/serial.ts`
+ */
+enum class Parity : uint8_t {
+    none,                           ///< No parity bit
+    even,                           ///< Even parity
+    odd,                            ///< Odd parity
+};
+
+/**
+ * Number of stop bits, see `Webconfig/types/serial.ts`
+ */
+enum class StopBits : uint8_t {
+    one,                            ///< 1 stop bit
+    one_half,                       ///< 1.5 stop bits (2 on Linux)
+    two,                            ///< 2 stop bits
+};
+
+/**
+ * Serial connection settings, see `Connections.usb.serial` in the web configuration
+ */
+struct Settings {
+    uint32_t speed = 115200;        ///< Baud rate
+    uint8_t word_length = 8;        ///< Data bits (5 to 8)
+    Parity parity = Parity::none;   ///< Parity
+    StopBits stop_bits = StopBits::one; ///< Stop bits
+};
+
+#ifndef MY_SERIAL_TX_BUFFER
+#define MY_SERIAL_TX_BUFFER 4096    ///< Size of the transmit buffer of the UART driver
+#endif
+
+#ifndef MY_SERIAL_RX_BUFFER
+#define MY_SERIAL_RX_BUFFER 256     ///< Size of the receive buffer for incoming messages
+#endif
+
+#if defined(ESP_PLATFORM) || defined(__linux__)
+/**
+ * Non-blocking serial port. On the ESP32 the device is the UART number (e.g. `"0"` for the
+ * UART connected to the USB bridge of most development boards), on Linux it is the path
+ * to the TTY device.
+ */
+class Port {
+public:
+    /**
+     * Open the serial port. In case of an error the `error` attribute will contain the
+     * platform's error code (`esp_err_t` or `errno`).
+     *
+     * @param[in] device Device name
+     * @param[in] settings Connection settings
+     * @returns Port instance
+     */
+    static Port open(const std::string& device, Settings settings) noexcept;
+
+    /**
+     * Queue the given bytes for sending. Either all bytes are queued or none at all.
+     *
+     * @param[in] data Bytes to send
+     * @param[in] size Number of bytes
+     * @returns false, if the transmit buffer has not enough room
+     */
+    bool write(const uint8_t* data, size_t size) noexcept;
+
+    /**
+     * Read available bytes without blocking. On Linux this also writes what is left of
+     * earlier messages.
+     *
+     * @param[out] buffer Receive buffer
+     * @param[in] size Buffer size
+     * @returns Number of bytes read
+     */
+    size_t read(uint8_t* buffer, size_t size) noexcept;
+
+    /**
+     * Explicitly close the port. Otherwise it will be closed when the object gets destroyed.
+     */
+    void close() noexcept;
+
+    /**
+     * @returns The error code from opening the port
+     */
+    int error() noexcept { return _error; }
+
+    Port(const Port&) = delete;
+    Port& operator=(const Port&) = delete;
+
+    /**
+     * Destructor – automatically closes the port.
+     */
+    ~Port() noexcept;
+
+private:
+    /**
+     * Constructor – automatically opens the port.
+     */
+    Port(const std::string& device, Settings settings) noexcept;
+
+#if !defined(ESP_PLATFORM)
+    ssize_t drain() noexcept;
+#endif
+
+    int handle;                     ///< UART number or file descriptor, -1 if closed
+    int _error;                     ///< Last error code
+
+#if !defined(ESP_PLATFORM)
+    std::vector<uint8_t> backlog;   ///< Bytes not yet taken by the kernel, at most `MY_SERIAL_TX_BUFFER`
+#endif
+};
+
+/**
+ * Callback for received values
+ *
+ * @param[in] context Context pointer given to `poll()`
+ * @param[in] control Index of the control in the configuration
+ * @param[in] changed Bit mask of the received inputs
+ * @param[in] values Values of all inputs, only valid where the bit is set
+ */
+using Handler = void (*)(void* context, uint16_t control, uint8_t changed, const float* values) noexcept;
+
+/**
+ * Sends and receives the serial messages of all controls.
+ *
+ * Messages are added when the configuration is loaded, followed by `compile()`. `send()`
+ * has the signature of `my_output::Sender`, so that the engine can be added as destination
+ * of the output scheduler with `Engine::sender` as callback.
+ */
+class Engine {
+public:
+    /**
+     * @param[in] port Open serial port
+     */
+    Engine(Port& port) noexcept;
+
+    /**
+     * Add a serial message of a control.
+     *
+     * @param[in] control Index of the control in the configuration
+     * @param[in] message Compiled template
+     * @param[in] send Send the message when the value changes
+     * @param[in] receive Update the value when the message is received
+     */
+    void add(uint16_t control, my_format::Template message, bool send, bool receive);
+
+    /**
+     * Build the lookup tables after all messages have been added.
+     */
+    void compile();
+
+    /**
+     * Send all messages of a control that use one of the changed inputs.
+     *
+     * @param[in] control Index of the control in the configuration
+     * @param[in] changed Bit mask of the changed inputs
+     * @param[in] values Values of all inputs
+     * @returns Number of bytes sent or zero, if the port cannot take the data right now
+     *          or no message uses the changed inputs (see `inputs()`)
+     */
+    size_t send(uint16_t control, uint8_t changed, const float* values) noexcept;
+
+    /**
+     * Inputs used by the messages sent for a control, to be passed to
+     * `my_output::Scheduler::add_route()`, so that `send()` is only called for values
+     * that are actually sent.
+     *
+     * @param[in] control Index of the control in the configuration
+     * @returns Bit mask of the inputs
+     */
+    uint8_t inputs(uint16_t control) const noexcept;
+
+    /**
+     * Static trampoline for `my_output::Scheduler`, with the engine as context pointer.
+     */
+    static size_t sender(void* context, uint16_t control, uint8_t changed, const float* values) noexcept;
+
+    /**
+     * Read received bytes and call the handler for each message that matches a template.
+     *
+     * @param[in] handler Callback for received values
+     * @param[in] context Context pointer for the callback
+     */
+    void poll(Handler handler, void* context) noexcept;
+
+private:
+    /**
+     * Serial message of a control
+     */
+    struct Message {
+        uint16_t control;                       ///< Index of the control
+        bool send;                              ///< Send enabled
+        bool receive;                           ///< Receive enabled
+        my_format::Template data;               ///< Compiled template
+    };
+
+    bool match_line(const uint8_t* data, size_t size, Handler handler, void* context) noexcept;
+    size_t match_binary(Handler handler, void* context) noexcept;
+
+    Port& port;                                 ///< Serial port
+    std::vector<Message> messages;              ///< All messages sorted by control
+    std::vector<uint32_t> control_first;        ///< First message of each control (plus end marker)
+    std::vector<uint8_t> tx_buffer;             ///< Scratch buffer for outgoing messages
+    uint8_t rx_buffer[MY_SERIAL_RX_BUFFER];     ///< Received bytes not yet matched
+    size_t rx_size;                             ///< Used bytes of the receive buffer
+    size_t binary_size;                         ///< Largest binary message to be received
+    bool receive_text;                          ///< At least one text message to be received
+};
+#endif
+
+} // namespace my_serial
@@ -0,0 +1,107 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file spsc.h
+ * @brief Lock-free queue between exactly one producer and one consumer
+ *
+ * The real-time control task must never wait for a lock held by a network task, and the
+ * other way round. Between two tasks a ring buffer with one index written by each side is
+ * enough: The producer only writes `tail`, the consumer only writes `head`, and the
+ * acquire/release pairs make sure that an element is complete before the other side sees
+ * the new index. Both indices run freely and are only reduced modulo the capacity when
+ * accessing an element, which is why the capacity must be a power of two.
+ *
+ * A full queue does not block the producer. The element is rejected and counted, so the
+ * producer can decide whether to drop it or to keep the newest value elsewhere.
+ */
+
+#pragma once
+
+#include <atomic>           // std::atomic
+#include <cstddef>          // size_t
+#include <cstdint>          // uint32_t
+
+namespace my_spsc {
+
+/**
+ * Fixed-size single-producer single-consumer queue
+ *
+ * @tparam T Element type, should be trivially copyable
+ * @tparam N Capacity, must be a power of two
+ */
+template <typename T, size_t N>
+class Queue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    Queue() noexcept : head(0), tail(0), _dropped(0), elements{} {}
+
+    /**
+     * Append an element. Only to be called by the producer.
+     *
+     * @param[in] element Element to append
+     * @returns false, if the queue is full
+     */
+    bool push(const T& element) noexcept {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+
+        if (t - head.load(std::memory_order_acquire) >= N) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        elements[t % N] = element;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Remove the oldest element. Only to be called by the consumer.
+     *
+     * @param[out] element Removed element
+     * @returns false, if the queue is empty
+     */
+    bool pop(T& element) noexcept {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+
+        element = elements[h % N];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @returns Number of queued elements (exact only for the consumer)
+     */
+    size_t size() const noexcept {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @returns Number of elements rejected because the queue was full
+     */
+    uint32_t dropped() const noexcept { return _dropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @returns Capacity of the queue
+     */
+    static constexpr size_t capacity() noexcept { return N; }
+
+    Queue(const Queue&) = delete;
+    Queue& operator=(const Queue&) = delete;
+
+private:
+    std::atomic<uint32_t> head;             ///< Next element to pop, written by the consumer
+    std::atomic<uint32_t> tail;             ///< Next free element, written by the producer
+    std::atomic<uint32_t> _dropped;         ///< Rejected elements
+    T elements[N];                          ///< Ring buffer
+};
+
+} // namespace my_spsc
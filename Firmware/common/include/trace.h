@@ -0,0 +1,265 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file trace.h
+ * @brief Low-overhead trace points and latency histograms
+ *
+ * Log messages are far too slow to find out where the time goes in the hot paths: A single
+ * `ESP_LOGI` takes longer than handling an input report. Instead a trace point only writes
+ * its id, the cycle counter of the CPU and one argument into a ring buffer of its core,
+ * which can be dumped later. The ring buffers are never locked, so an event read while it
+ * is written may be inconsistent, and the oldest events are overwritten.
+ *
+ * Spans measure a latency from one point to another, e.g. from the timestamp of an input
+ * report until the value has been sent to its destinations. Their durations are counted in
+ * histograms with a fixed relative precision like HdrHistogram: Each power of two is split
+ * into `2^MY_TRACE_SUB_BITS` buckets, so that percentiles are precise to about 12 % from
+ * 1 µs to many seconds with less than 1 kB per span. As the cycle counters of the two
+ * cores of the ESP32 are not synchronized, spans use microseconds of the system timer,
+ * which may be started on one core and finished on the other.
+ *
+ * All trace points and spans are compiled away with `MY_TRACE_ENABLED=0`. Besides the ESP32
+ * and the STM32, this also builds on Linux, so that the same spans can be measured when
+ * the firmware logic is run in a host simulation.
+ */
+
+#pragma once
+
+#include "json.h"           // my_json::Writer
+
+#include <atomic>           // std::atomic
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, uint32_t
+
+#if defined(ESP_PLATFORM)
+#include <esp_cpu.h>            // esp_cpu_get_cycle_count, esp_cpu_get_core_id
+#include <esp_timer.h>          // esp_timer_get_time
+#elif defined(ARDUINO_ARCH_STM32)
+#include <Arduino.h>            // micros
+#elif defined(__linux__)
+#include <chrono>               // std::chrono::steady_clock
+#endif
+
+#ifndef MY_TRACE_ENABLED
+#define MY_TRACE_ENABLED 1          ///< Compile trace points and spans
+#endif
+
+#ifndef MY_TRACE_EVENTS
+#define MY_TRACE_EVENTS 256         ///< Size of the ring buffer of each core
+#endif
+
+#ifndef MY_TRACE_SUB_BITS
+#define MY_TRACE_SUB_BITS 3         ///< Histogram buckets per power of two, as bits
+#endif
+
+#ifndef MY_TRACE_MAX_BITS
+#define MY_TRACE_MAX_BITS 24        ///< Longest distinguished duration, as bits (about 16 s)
+#endif
+
+#if MY_TRACE_ENABLED
+#define MY_TRACE_CONCAT_(a, b) a##b
+#define MY_TRACE_CONCAT(a, b) MY_TRACE_CONCAT_(a, b)
+#define MY_TRACE_POINT(id, arg) my_trace::point(id, arg)                                      ///< Write a trace event
+#define MY_TRACE_RECORD(span, us) my_trace::record(span, us)                                  ///< Count the duration of a span
+#define MY_TRACE_SCOPE(span) my_trace::Scope MY_TRACE_CONCAT(_trace_scope_, __LINE__)(span)  ///< Measure the rest of the block as a span
+#else
+#define MY_TRACE_POINT(id, arg) ((void) 0)
+#define MY_TRACE_RECORD(span, us) ((void) 0)
+#define MY_TRACE_SCOPE(span) ((void) 0)
+#endif
+
+namespace my_trace {
+
+#if defined(ESP_PLATFORM)
+constexpr size_t CORES = 2;                                                 ///< Number of ring buffers
+#else
+constexpr size_t CORES = 1;                                                 ///< Number of ring buffers
+#endif
+
+constexpr size_t SUB_BUCKETS = size_t(1) << MY_TRACE_SUB_BITS;             ///< Buckets per power of two
+constexpr size_t BUCKETS = (MY_TRACE_MAX_BITS - MY_TRACE_SUB_BITS + 1) * SUB_BUCKETS; ///< Buckets per histogram
+
+static_assert(MY_TRACE_MAX_BITS <= 32, "Durations are 32-bit values");
+static_assert((MY_TRACE_EVENTS & (MY_TRACE_EVENTS - 1)) == 0, "Ring buffer size must be a power of two");
+
+/**
+ * Trace point ids
+ */
+enum class Point : uint16_t {
+    bus_read,                       ///< Input report read, argument: board
+    merge,                          ///< Input event merged, argument: board << 8 | slot
+    output,                         ///< Values sent to a destination, argument: control
+    osc_receive,                    ///< OSC packet dispatched, argument: packet size
+};
+
+/**
+ * Measured spans
+ */
+enum class Span : uint8_t {
+    input_to_merge,                 ///< Input timestamp on the sub board until merged on the main board
+    input_to_output,                ///< Input timestamp until the value was sent to its destinations
+    osc_to_feedback,                ///< OSC message received until the control's feedback was sent
+    bus_read,                       ///< Reading and decoding one input report
+};
+
+constexpr size_t SPAN_COUNT = 4;    ///< Number of spans
+
+/**
+ * Trace event
+ */
+struct Event {
+    uint32_t ticks;                 ///< Cycle counter of the core
+    uint16_t id;                    ///< Trace point id
+    uint16_t reserved;              ///< Always zero
+    uint32_t arg;                   ///< Argument of the trace point
+};
+
+/**
+ * Histogram of durations in microseconds with a fixed relative precision
+ */
+class Histogram {
+public:
+    Histogram() noexcept;
+
+    /**
+     * Count a duration. Can be called from any task.
+     *
+     * @param[in] value_us Duration in microseconds
+     */
+    void record(uint32_t value_us) noexcept;
+
+    /**
+     * Forget all durations.
+     */
+    void reset() noexcept;
+
+    /**
+     * @param[in] fraction Fraction of the durations, e.g. 0.99
+     * @returns Duration not exceeded by the given fraction of all durations (upper bucket bound)
+     */
+    uint32_t percentile(double fraction) const noexcept;
+
+    uint32_t count() const noexcept { return _count.load(std::memory_order_relaxed); }
+    uint32_t min() const noexcept { return count() ? _min.load(std::memory_order_relaxed) : 0; }
+    uint32_t max() const noexcept { return _max.load(std::memory_order_relaxed); }
+
+    /**
+     * @returns Bucket of a duration
+     */
+    static size_t bucket(uint32_t value_us) noexcept;
+
+    /**
+     * @returns Smallest duration of a bucket
+     */
+    static uint32_t lower(size_t bucket) noexcept;
+
+private:
+    std::atomic<uint32_t> counts[BUCKETS];  ///< Number of durations per bucket
+    std::atomic<uint32_t> _count;           ///< Number of durations
+    std::atomic<uint32_t> _min;             ///< Shortest duration
+    std::atomic<uint32_t> _max;             ///< Longest duration
+};
+
+/**
+ * @returns Cycle counter of the current core (or another fine-grained counter)
+ */
+inline uint32_t ticks() noexcept {
+#if defined(ESP_PLATFORM)
+    return esp_cpu_get_cycle_count();
+#elif defined(ARDUINO_ARCH_STM32)
+    return micros();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @returns System time in microseconds, the same on all cores (may wrap around)
+ */
+inline uint32_t micros() noexcept {
+#if defined(ESP_PLATFORM)
+    return static_cast<uint32_t>(esp_timer_get_time());
+#elif defined(ARDUINO_ARCH_STM32)
+    return ::micros();
+#else
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @returns Number of ticks per microsecond
+ */
+uint32_t ticks_per_us() noexcept;
+
+/**
+ * Write a trace event into the ring buffer of the current core.
+ *
+ * @param[in] id Trace point
+ * @param[in] arg Argument
+ */
+void point(Point id, uint32_t arg = 0) noexcept;
+
+/**
+ * Count the duration of a span.
+ *
+ * @param[in] span Span
+ * @param[in] duration_us Duration in microseconds
+ */
+void record(Span span, uint32_t duration_us) noexcept;
+
+/**
+ * @returns Histogram of a span
+ */
+const Histogram& histogram(Span span) noexcept;
+
+/**
+ * @returns Name of a span, e.g. `input_to_output`
+ */
+const char* name(Span span) noexcept;
+
+/**
+ * Copy the newest events of a core, oldest first.
+ *
+ * @param[in] core Core
+ * @param[out] events Target buffer
+ * @param[in] max Size of the target buffer
+ * @returns Number of copied events
+ */
+size_t events(size_t core, Event* events, size_t max) noexcept;
+
+/**
+ * Forget all events and durations.
+ */
+void reset() noexcept;
+
+/**
+ * Write all histograms (count, min, max and percentiles in µs) and events as JSON.
+ *
+ * @param[in] writer JSON writer
+ */
+void dump(my_json::Writer& writer) noexcept;
+
+/**
+ * Span measured until the end of the scope
+ */
+class Scope {
+public:
+    Scope(Span span) noexcept : span(span), start(micros()) {}
+    ~Scope() noexcept { record(span, micros() - start); }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    Span span;                      ///< Measured span
+    uint32_t start;                 ///< Start time in microseconds
+};
+
+} // namespace my_trace
@@ -0,0 +1,268 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "bus.h"
+
+#include <cstring>          // std::memcpy, std::memset
+
+namespace my_bus {
+
+/**
+ * Write a zig-zag encoded variable-length integer.
+ *
+ * @returns Pointer behind the written bytes
+ */
+static uint8_t* write_varint(uint8_t* out, int32_t value) noexcept {
+    uint32_t zigzag = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+
+    while (zigzag >= 0x80) {
+        *out++ = static_cast<uint8_t>(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+
+    *out++ = static_cast<uint8_t>(zigzag);
+    return out;
+}
+
+/**
+ * Read a zig-zag encoded variable-length integer.
+ *
+ * @returns Pointer behind the read bytes or `nullptr` if the data ends too early
+ */
+static const uint8_t* read_varint(const uint8_t* in, const uint8_t* end, int32_t& value) noexcept {
+    uint32_t zigzag = 0;
+
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (in >= end) return nullptr;
+
+        uint8_t byte = *in++;
+        zigzag |= static_cast<uint32_t>(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80)) {
+            value = static_cast<int32_t>((zigzag >> 1) ^ -(zigzag & 1));
+            return in;
+        }
+    }
+
+    return nullptr;
+}
+
+uint16_t crc16(const uint8_t* data, size_t size, uint16_t crc) noexcept {
+    while (size--) {
+        crc ^= static_cast<uint16_t>(*data++) << 8;
+
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc) noexcept {
+    crc = ~crc;
+
+    while (size--) {
+        crc ^= *data++;
+
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+    }
+
+    return ~crc;
+}
+
+uint8_t* begin(uint8_t* buffer, Type type, uint8_t board, uint8_t flags, uint16_t sequence) noexcept {
+    Header header = {VERSION, type, board, flags, sequence, 0};
+    std::memcpy(buffer, &header, sizeof(header));
+    return buffer + sizeof(header);
+}
+
+size_t finish(uint8_t* buffer, uint16_t length) noexcept {
+    std::memcpy(buffer + offsetof(Header, length), &length, sizeof(length));
+
+    size_t size = sizeof(Header) + length;
+    uint16_t crc = crc16(buffer, size);
+    std::memcpy(buffer + size, &crc, sizeof(crc));
+
+    return size + CRC_SIZE;
+}
+
+Result parse(const uint8_t* data, size_t size, Header& header, const uint8_t*& payload) noexcept {
+    if (size < sizeof(Header) + CRC_SIZE) return Result::incomplete;
+
+    std::memcpy(&header, data, sizeof(header));
+    if (header.version != VERSION) return Result::bad_version;
+
+    size_t frame = sizeof(Header) + header.length;
+    if (size < frame + CRC_SIZE) return Result::incomplete;
+
+    uint16_t crc;
+    std::memcpy(&crc, data + frame, sizeof(crc));
+    if (crc != crc16(data, frame)) return Result::bad_crc;
+
+    payload = data + sizeof(Header);
+    return Result::ok;
+}
+
+/////////////////////////
+///// class Encoder /////
+/////////////////////////
+
+Encoder::Encoder(uint8_t board, uint8_t inputs) noexcept
+    : _board(board),
+      inputs(inputs > MY_BUS_MAX_INPUTS ? MY_BUS_MAX_INPUTS : inputs),
+      absolute(true),
+      sequence(0),
+      changed_us(0),
+      current{},
+      sent{}
+{
+}
+
+bool Encoder::changed() const noexcept {
+    if (absolute) return true;
+
+    for (uint8_t i = 0; i < inputs; i++) {
+        if (current[i] != sent[i]) return true;
+    }
+
+    return false;
+}
+
+size_t Encoder::encode(uint8_t* buffer) noexcept {
+    if (!changed()) return 0;
+
+    uint8_t* payload = begin(buffer, Type::input_report, _board, absolute ? FLAG_ABSOLUTE : 0, sequence++);
+    uint8_t* bitmap  = payload + sizeof(changed_us) + 1;
+    uint8_t* out     = bitmap + (inputs + 7) / 8;
+
+    std::memcpy(payload, &changed_us, sizeof(changed_us));
+    payload[sizeof(changed_us)] = inputs;
+    std::memset(bitmap, 0, out - bitmap);
+
+    for (uint8_t i = 0; i < inputs; i++) {
+        if (!absolute && current[i] == sent[i]) continue;
+
+        bitmap[i / 8] |= 1 << (i % 8);
+        // Deltas wrap around like the values, so that jumps across the full range survive
+        int32_t delta = static_cast<int32_t>(static_cast<uint32_t>(current[i]) - static_cast<uint32_t>(sent[i]));
+        out = write_varint(out, absolute ? current[i] : delta);
+        sent[i] = current[i];
+    }
+
+    absolute = false;
+    return finish(buffer, static_cast<uint16_t>(out - payload));
+}
+
+size_t Encoder::encode(uint8_t* buffer, const InputEvent* events, size_t count) noexcept {
+    if (count > MAX_EVENTS) count = MAX_EVENTS;
+
+    uint8_t* payload = begin(buffer, Type::event_report, _board, 0, sequence++);
+    std::memcpy(payload, events, count * sizeof(InputEvent));
+    return finish(buffer, static_cast<uint16_t>(count * sizeof(InputEvent)));
+}
+
+/////////////////////////
+///// class Decoder /////
+/////////////////////////
+
+Decoder::Decoder() noexcept
+    : synced(false),
+      sequence(0),
+      values{}
+{
+}
+
+Result Decoder::decode(const Header& header, const uint8_t* payload, Handler handler, void* context, uint32_t offset) noexcept {
+    if (header.type == Type::event_report) return decode_events(header, payload, handler, context, offset);
+    if (header.type != Type::input_report || header.length < sizeof(uint32_t) + 1) return Result::bad_payload;
+
+    bool absolute = header.flags & FLAG_ABSOLUTE;
+
+    if (!absolute && (!synced || header.sequence != sequence)) {
+        synced = false;
+        return Result::resync;
+    }
+
+    uint32_t time_us;
+    std::memcpy(&time_us, payload, sizeof(time_us));
+    time_us -= offset;
+
+    const uint8_t* end    = payload + header.length;
+    uint8_t count         = payload[sizeof(time_us)];
+    uint8_t inputs        = count > MY_BUS_MAX_INPUTS ? MY_BUS_MAX_INPUTS : count;
+    const uint8_t* bitmap = payload + sizeof(time_us) + 1;
+    const uint8_t* in     = bitmap + (count + 7) / 8;
+
+    if (in > end) return Result::bad_payload;
+
+    // Inputs are ordered by slot, so the changes of a slot can be collected until the next slot begins
+    uint8_t slot    = 0;
+    uint8_t changed = 0;
+
+    for (uint8_t i = 0; i < inputs; i++) {
+        if (!(bitmap[i / 8] & (1 << (i % 8)))) continue;
+
+        int32_t value;
+        in = read_varint(in, end, value);
+
+        if (!in) {
+            synced = false;
+            return Result::bad_payload;
+        }
+
+        values[i] = absolute ? value : static_cast<int32_t>(static_cast<uint32_t>(values[i]) + static_cast<uint32_t>(value));
+
+        if (changed && i / my_control::INPUT_COUNT != slot) {
+            deliver(header.board, slot, changed, time_us, handler, context);
+            changed = 0;
+        }
+
+        slot     = i / my_control::INPUT_COUNT;
+        changed |= 1 << (i % my_control::INPUT_COUNT);
+    }
+
+    if (changed) deliver(header.board, slot, changed, time_us, handler, context);
+
+    synced   = true;
+    sequence = header.sequence + 1;
+    return Result::ok;
+}
+
+void Decoder::deliver(uint8_t board, uint8_t slot, uint8_t changed, uint32_t time_us, Handler handler, void* context) const noexcept {
+    if (slot < MAX_SLOTS) handler(context, board, slot, changed, values + slot * my_control::INPUT_COUNT, time_us);
+}
+
+Result Decoder::decode_events(const Header& header, const uint8_t* payload, Handler handler, void* context, uint32_t offset) noexcept {
+    if (header.length % sizeof(InputEvent)) return Result::bad_payload;
+
+    for (size_t i = 0; i < header.length / sizeof(InputEvent); i++) {
+        InputEvent event;
+        std::memcpy(&event, payload + i * sizeof(InputEvent), sizeof(event));
+        if (event.input >= MY_BUS_MAX_INPUTS) continue;
+
+        values[event.input] = event.value;
+
+        uint8_t slot = event.input / my_control::INPUT_COUNT;
+        deliver(header.board, slot, 1 << (event.input % my_control::INPUT_COUNT), event.time_us - offset, handler, context);
+    }
+
+    // A lost frame may have been an input report, whose deltas are now missing
+    if (header.sequence != sequence) {
+        synced = false;
+        return Result::resync;
+    }
+
+    sequence = header.sequence + 1;
+    return Result::ok;
+}
+
+} // namespace my_bus
@@ -0,0 +1,81 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "clock.h"
+
+namespace my_clock {
+
+///////////////////////////
+///// class Estimator /////
+///////////////////////////
+
+Estimator::Estimator() noexcept
+    : samples{},
+      count(0),
+      next(0),
+      best{},
+      anchor{},
+      drift(0.0f),
+      _jitter(0)
+{
+}
+
+void Estimator::sample(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4) noexcept {
+    // Halve the difference of both directions instead of their sum, which could overflow
+    uint32_t there = t2 - t1;
+    uint32_t back  = t3 - t4;
+    int32_t rtt    = static_cast<int32_t>(t4 - t1) - static_cast<int32_t>(t3 - t2);
+
+    Sample sample;
+    sample.offset   = there + static_cast<uint32_t>(static_cast<int32_t>(back - there) / 2);
+    sample.delay    = rtt > 0 ? static_cast<uint32_t>(rtt) : 0;
+    sample.local_us = t4;
+
+    samples[next] = sample;
+    next = (next + 1) % MY_CLOCK_SAMPLES;
+    if (count < MY_CLOCK_SAMPLES) count++;
+
+    // Clock filter: Trust the sample with the lowest delay
+    const Sample* lowest = &samples[0];
+
+    for (uint8_t i = 1; i < count; i++) {
+        if (samples[i].delay < lowest->delay) lowest = &samples[i];
+    }
+
+    if (count == 1) {
+        best = anchor = *lowest;
+    } else if (static_cast<int32_t>(lowest->local_us - best.local_us) > 0) {
+        best = *lowest;
+
+        // Measure the drift over a longer span, where the timing noise hardly matters
+        int32_t span = static_cast<int32_t>(best.local_us - anchor.local_us);
+
+        if (span >= MY_CLOCK_MIN_SPAN_US) {
+            float measured = static_cast<float>(static_cast<int32_t>(best.offset - anchor.offset)) / span;
+            drift += (measured - drift) / 4;
+            anchor = best;
+        }
+    }
+
+    uint32_t deviation = 0;
+
+    for (uint8_t i = 0; i < count; i++) {
+        int32_t error = static_cast<int32_t>(samples[i].offset - offset(samples[i].local_us));
+        deviation += error < 0 ? -error : error;
+    }
+
+    _jitter = deviation / count;
+}
+
+uint32_t Estimator::offset(uint32_t now_us) const noexcept {
+    int32_t elapsed = static_cast<int32_t>(now_us - best.local_us);
+    return best.offset + static_cast<int32_t>(drift * elapsed);
+}
+
+} // namespace my_clock
@@ -0,0 +1,262 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "format.h"
+
+#include <algorithm>        // std::min, std::max
+#include <cmath>            // std::fabs, std::llround, std::isnan, std::ldexp
+#include <cstring>          // std::memcpy, std::memcmp
+
+namespace my_format {
+
+constexpr uint8_t MAX_DECIMALS = 6;
+constexpr int32_t POW10[MAX_DECIMALS + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+constexpr uint8_t MAX_DIGITS = 10;      ///< Integer digits of a text value, larger values are clamped
+constexpr long long INTEGER_LIMIT = 10000000000LL;  ///< 10^MAX_DIGITS
+
+/**
+ * @returns Text size of a value: sign, integer digits, separator and decimals
+ */
+static constexpr size_t text_size(uint8_t decimals) noexcept {
+    return 1 + MAX_DIGITS + (decimals ? 1 + decimals : 0);
+}
+
+/**
+ * @returns Value of a hexadecimal digit or -1
+ */
+static int hex_digit(char c) noexcept {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+//////////////////////////
+///// class Template /////
+//////////////////////////
+
+Template Template::compile(std::string_view data, Format format, const Placeholder* placeholders) {
+    Template result;
+    result._format = format;
+
+    auto add_literal = [&](uint8_t byte) {
+        if (result.ops.empty() || result.ops.back().kind != Op::literal) {
+            Op op{};
+            op.kind   = Op::literal;
+            op.offset = static_cast<uint16_t>(result.literals.size());
+            result.ops.push_back(op);
+        }
+
+        result.literals.push_back(byte);
+        result.ops.back().length++;
+        result._max_size++;
+    };
+
+    size_t i = 0;
+
+    while (i < data.size()) {
+        // Placeholder
+        bool found = false;
+
+        for (size_t input = 0; input < my_control::INPUT_COUNT; input++) {
+            const Placeholder& placeholder = placeholders[input];
+            if (placeholder.name.empty() || data.substr(i, placeholder.name.size()) != placeholder.name) continue;
+
+            Op op{};
+            op.kind      = Op::value;
+            op.input     = static_cast<uint8_t>(input);
+            op.decimals  = placeholder.decimals > MAX_DECIMALS ? MAX_DECIMALS : placeholder.decimals;
+            op.separator = placeholder.separator ? placeholder.separator : '.';
+
+            // Smallest integer type that can hold the value range
+            float maximum = std::fabs(placeholder.from) > std::fabs(placeholder.to) ? std::fabs(placeholder.from) : std::fabs(placeholder.to);
+            op.is_signed = placeholder.from < 0 || placeholder.to < 0;
+
+            if (maximum <= (op.is_signed ? 127.0f : 255.0f))        op.width = 1;
+            else if (maximum <= (op.is_signed ? 32767.0f : 65535.0f)) op.width = 2;
+            else                                                     op.width = 4;
+
+            result.ops.push_back(op);
+            result._inputs   |= 1 << input;
+            result._max_size += format == Format::binary ? op.width : text_size(op.decimals);
+
+            i += placeholder.name.size();
+            found = true;
+            break;
+        }
+
+        if (found) continue;
+
+        // Hexadecimal byte
+        if (i + 3 < data.size() && data[i] == '0' && (data[i + 1] == 'x' || data[i + 1] == 'X')) {
+            int high = hex_digit(data[i + 2]);
+            int low  = hex_digit(data[i + 3]);
+
+            if (high >= 0 && low >= 0) {
+                add_literal(static_cast<uint8_t>((high << 4) | low));
+                i += 4;
+                continue;
+            }
+        }
+
+        // Anything else
+        if (format == Format::binary && (data[i] == ' ' || data[i] == '\t')) {
+            i++;
+            continue;
+        }
+
+        add_literal(static_cast<uint8_t>(data[i]));
+        i++;
+    }
+
+    return result;
+}
+
+size_t Template::encode(const float* values, uint8_t* buffer, size_t size) const noexcept {
+    if (size < _max_size) return 0;
+    uint8_t* out = buffer;
+
+    for (const Op& op : ops) {
+        if (op.kind == Op::literal) {
+            std::memcpy(out, literals.data() + op.offset, op.length);
+            out += op.length;
+            continue;
+        }
+
+        if (_format == Format::binary) {
+            // Clamped to the integer type chosen by `compile()`, negative values wrap to two's complement
+            int bits    = op.width * 8;
+            double low  = op.is_signed ? -std::ldexp(1.0, bits - 1) : 0.0;
+            double high = op.is_signed ?  std::ldexp(1.0, bits - 1) - 1.0 : std::ldexp(1.0, bits) - 1.0;
+            double input = values[op.input];
+
+            if (std::isnan(input)) input = 0.0;
+            uint32_t value = static_cast<uint32_t>(std::llround(std::min(std::max(input, low), high)));
+
+            for (int shift = (op.width - 1) * 8; shift >= 0; shift -= 8) {
+                *out++ = static_cast<uint8_t>(value >> shift);
+            }
+
+            continue;
+        }
+
+        // Decimal number, written backwards into a scratch buffer. Clamped to the digits
+        // reserved by `compile()`, which also keeps `llround()` from overflowing.
+        long long limit = INTEGER_LIMIT * POW10[op.decimals] - 1;
+        double value = static_cast<double>(values[op.input]) * POW10[op.decimals];
+
+        if (std::isnan(value)) value = 0.0;
+        if (value < -static_cast<double>(limit)) value = -static_cast<double>(limit);
+        if (value >  static_cast<double>(limit)) value =  static_cast<double>(limit);
+
+        long long scaled = std::llround(value);
+        if (scaled < -limit) scaled = -limit;
+        if (scaled >  limit) scaled =  limit;
+        bool negative = scaled < 0;
+        unsigned long long number = negative ? -scaled : scaled;
+
+        char digits[24];
+        size_t count = 0;
+
+        for (uint8_t d = 0; d < op.decimals; d++) {
+            digits[count++] = static_cast<char>('0' + number % 10);
+            number /= 10;
+        }
+
+        if (op.decimals) digits[count++] = op.separator;
+
+        do {
+            digits[count++] = static_cast<char>('0' + number % 10);
+            number /= 10;
+        } while (number && count < sizeof(digits));
+
+        if (negative) *out++ = '-';
+        while (count) *out++ = static_cast<uint8_t>(digits[--count]);
+    }
+
+    return out - buffer;
+}
+
+bool Template::decode(const uint8_t* data, size_t size, float* values, uint8_t& changed) const noexcept {
+    float found[my_control::INPUT_COUNT];
+    uint8_t mask = 0;
+    size_t pos = 0;
+
+    for (const Op& op : ops) {
+        if (op.kind == Op::literal) {
+            if (size - pos < op.length || std::memcmp(data + pos, literals.data() + op.offset, op.length) != 0) return false;
+            pos += op.length;
+            continue;
+        }
+
+        if (_format == Format::binary) {
+            if (size - pos < op.width) return false;
+
+            uint32_t value = 0;
+            for (uint8_t b = 0; b < op.width; b++) value = (value << 8) | data[pos++];
+
+            if (op.is_signed && op.width < 4 && (value & (1u << (op.width * 8 - 1)))) {
+                value |= ~0u << (op.width * 8);
+            }
+
+            found[op.input] = op.is_signed ? static_cast<float>(static_cast<int32_t>(value)) : static_cast<float>(value);
+            mask |= 1 << op.input;
+            continue;
+        }
+
+        // Decimal number
+        bool negative = pos < size && data[pos] == '-';
+        if (negative) pos++;
+
+        size_t start = pos;
+        int64_t integer = 0;
+
+        // Clamped like in `encode()`, which also keeps the integer from overflowing
+        while (pos < size && data[pos] >= '0' && data[pos] <= '9') {
+            if (integer < INTEGER_LIMIT) integer = integer * 10 + (data[pos] - '0');
+            pos++;
+        }
+
+        if (pos == start) return false;
+        if (integer >= INTEGER_LIMIT) integer = INTEGER_LIMIT - 1;
+
+        float value = static_cast<float>(integer);
+
+        if (pos < size && data[pos] == static_cast<uint8_t>(op.separator)) {
+            pos++;
+            int64_t fraction = 0;
+            int32_t scale = 1;
+
+            while (pos < size && data[pos] >= '0' && data[pos] <= '9') {
+                if (scale < POW10[MAX_DECIMALS]) {
+                    fraction = fraction * 10 + (data[pos] - '0');
+                    scale *= 10;
+                }
+
+                pos++;
+            }
+
+            value += static_cast<float>(fraction) / scale;
+        }
+
+        found[op.input] = negative ? -value : value;
+        mask |= 1 << op.input;
+    }
+
+    if (pos != size) return false;
+
+    for (size_t input = 0; input < my_control::INPUT_COUNT; input++) {
+        if (mask & (1 << input)) values[input] = found[input];
+    }
+
+    changed = mask;
+    return true;
+}
+
+} // namespace my_format
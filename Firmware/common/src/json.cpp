@@ -0,0 +1,546 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "json.h"
+
+#include <cmath>            // std::isfinite
+#include <cstdio>           // std::snprintf
+#include <cstdlib>          // std::strtod
+
+namespace my_json {
+
+constexpr char HEX[] = "0123456789abcdef";
+
+/**
+ * @returns Value of a hexadecimal digit or -1
+ */
+static int hex_digit(int c) noexcept {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * @returns true, if the text is a valid JSON number
+ */
+static bool valid_number(std::string_view text) noexcept {
+    size_t i = 0;
+    auto digits = [&]() {
+        size_t start = i;
+        while (i < text.size() && text[i] >= '0' && text[i] <= '9') i++;
+        return i > start;
+    };
+
+    if (i < text.size() && text[i] == '-') i++;
+    if (i < text.size() && text[i] == '0') i++;
+    else if (!digits()) return false;
+
+    if (i < text.size() && text[i] == '.') {
+        i++;
+        if (!digits()) return false;
+    }
+
+    if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+        i++;
+        if (i < text.size() && (text[i] == '+' || text[i] == '-')) i++;
+        if (!digits()) return false;
+    }
+
+    return i == text.size();
+}
+
+////////////////////////
+///// class Writer /////
+////////////////////////
+
+Writer::Writer(Sink sink, void* context) noexcept
+    : sink(sink),
+      context(context),
+      buffer{},
+      used(0),
+      comma(0),
+      depth(0),
+      after_key(false),
+      _ok(true)
+{
+}
+
+void Writer::begin_object() noexcept {
+    separate();
+    push('{');
+
+    if (depth + 1 >= MY_JSON_DEPTH) _ok = false;
+    else comma &= ~(1u << ++depth);
+}
+
+void Writer::end_object() noexcept {
+    push('}');
+    if (depth > 0) depth--;
+}
+
+void Writer::begin_array() noexcept {
+    separate();
+    push('[');
+
+    if (depth + 1 >= MY_JSON_DEPTH) _ok = false;
+    else comma &= ~(1u << ++depth);
+}
+
+void Writer::end_array() noexcept {
+    push(']');
+    if (depth > 0) depth--;
+}
+
+void Writer::key(std::string_view key) noexcept {
+    separate();
+    quote(key);
+    push(':');
+    after_key = true;
+}
+
+void Writer::string(std::string_view value) noexcept {
+    separate();
+    quote(value);
+}
+
+void Writer::integer(int64_t value) noexcept {
+    char text[24];
+    int length = std::snprintf(text, sizeof(text), "%lld", static_cast<long long>(value));
+
+    separate();
+    write({text, static_cast<size_t>(length)});
+}
+
+void Writer::number(double value) noexcept {
+    if (!std::isfinite(value)) {
+        null();
+        return;
+    }
+
+    // Nine digits are enough to restore every float exactly
+    char text[32];
+    int length = std::snprintf(text, sizeof(text), "%.9g", value);
+
+    separate();
+    write({text, static_cast<size_t>(length)});
+}
+
+void Writer::boolean(bool value) noexcept {
+    separate();
+    write(value ? "true" : "false");
+}
+
+void Writer::null() noexcept {
+    separate();
+    write("null");
+}
+
+void Writer::raw(std::string_view value) noexcept {
+    separate();
+    write(value);
+}
+
+bool Writer::flush() noexcept {
+    if (used && _ok) _ok = sink(context, buffer, used);
+    used = 0;
+    return _ok;
+}
+
+void Writer::separate() noexcept {
+    if (after_key) {
+        after_key = false;
+        return;
+    }
+
+    if (depth == 0) return;
+    if (comma & (1u << depth)) push(',');
+    comma |= 1u << depth;
+}
+
+void Writer::push(char c) noexcept {
+    if (used == sizeof(buffer)) flush();
+    buffer[used++] = c;
+}
+
+void Writer::write(std::string_view text) noexcept {
+    for (char c : text) push(c);
+}
+
+void Writer::quote(std::string_view text) noexcept {
+    push('"');
+
+    for (char c : text) {
+        uint8_t byte = static_cast<uint8_t>(c);
+
+        switch (c) {
+            case '"':  write("\\\""); break;
+            case '\\': write("\\\\"); break;
+            case '\n': write("\\n");  break;
+            case '\r': write("\\r");  break;
+            case '\t': write("\\t");  break;
+            default:
+                if (byte < 0x20) {
+                    write("\\u00");
+                    push(HEX[byte >> 4]);
+                    push(HEX[byte & 0x0F]);
+                } else {
+                    push(c);
+                }
+        }
+    }
+
+    push('"');
+}
+
+////////////////////////
+///// class Parser /////
+////////////////////////
+
+Parser::Parser(Source source, void* context) noexcept
+    : source(source),
+      context(context),
+      buffer{},
+      position(0),
+      available(0),
+      eof(false),
+      text{},
+      length(0),
+      overflow(false),
+      _boolean(false),
+      _path{},
+      path_length(0),
+      frames{},
+      _depth(0),
+      expect(Expect::value),
+      _error(nullptr)
+{
+}
+
+Token Parser::next() noexcept {
+    if (_error) return Token::error;
+
+    int c = skip_space();
+
+    switch (expect) {
+        case Expect::done:
+            return c < 0 ? Token::end : fail("Unexpected text after the document");
+
+        case Expect::value:
+            return value(c);
+
+        case Expect::first_value:
+        case Expect::next_value: {
+            if (c == ']') return end(true);
+
+            if (expect == Expect::next_value) {
+                if (c != ',') return fail("Expected , or ]");
+                get();
+                c = skip_space();
+                frames[_depth - 1].index++;
+            }
+
+            set_path(frames[_depth - 1].index);
+            return value(c);
+        }
+
+        case Expect::first_key:
+        case Expect::next_key: {
+            if (c == '}') return end(false);
+
+            if (expect == Expect::next_key) {
+                if (c != ',') return fail("Expected , or }");
+                get();
+                c = skip_space();
+            }
+
+            if (c != '"') return fail("Expected key");
+            get();
+
+            if (!parse_string()) return Token::error;
+            if (skip_space() != ':') return fail("Expected :");
+            get();
+
+            set_path(string());
+            expect = Expect::value;
+            return Token::key;
+        }
+    }
+
+    return fail("Invalid state");
+}
+
+bool Parser::skip() noexcept {
+    size_t target = _depth;
+
+    if (expect == Expect::value) {
+        Token token = next();
+        if (token != Token::begin_object && token != Token::begin_array) return token != Token::error;
+    } else {
+        target--;
+    }
+
+    while (_depth > target) {
+        Token token = next();
+        if (token == Token::error || token == Token::end) return false;
+    }
+
+    return true;
+}
+
+double Parser::number() const noexcept {
+    return std::strtod(text, nullptr);
+}
+
+int Parser::peek() noexcept {
+    if (position >= available) {
+        if (eof) return -1;
+
+        available = source(context, buffer, sizeof(buffer));
+        position  = 0;
+
+        if (!available) {
+            eof = true;
+            return -1;
+        }
+    }
+
+    return static_cast<uint8_t>(buffer[position]);
+}
+
+int Parser::get() noexcept {
+    int c = peek();
+    if (c >= 0) position++;
+    return c;
+}
+
+int Parser::skip_space() noexcept {
+    int c = peek();
+
+    while (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        get();
+        c = peek();
+    }
+
+    return c;
+}
+
+Token Parser::fail(const char* message) noexcept {
+    if (!_error) _error = message;
+    return Token::error;
+}
+
+Token Parser::value(int c) noexcept {
+    switch (c) {
+        case -1:  return fail("Unexpected end of the document");
+        case '{': get(); return begin(false);
+        case '[': get(); return begin(true);
+
+        case '"':
+            get();
+            if (!parse_string()) return Token::error;
+            finish_value();
+            return Token::string;
+
+        case 't':
+        case 'f':
+            if (!parse_literal(c == 't' ? "true" : "false")) return Token::error;
+            _boolean = c == 't';
+            finish_value();
+            return Token::boolean;
+
+        case 'n':
+            if (!parse_literal("null")) return Token::error;
+            finish_value();
+            return Token::null;
+
+        default:
+            if (c != '-' && (c < '0' || c > '9')) return fail("Unexpected character");
+            if (!parse_number()) return Token::error;
+            finish_value();
+            return Token::number;
+    }
+}
+
+Token Parser::begin(bool array) noexcept {
+    if (_depth >= MY_JSON_DEPTH) return fail("Nested too deep");
+
+    frames[_depth++] = {array, 0, static_cast<uint16_t>(path_length)};
+    expect = array ? Expect::first_value : Expect::first_key;
+    return array ? Token::begin_array : Token::begin_object;
+}
+
+Token Parser::end(bool array) noexcept {
+    get();
+
+    path_length = frames[--_depth].path_length;
+    finish_value();
+    return array ? Token::end_array : Token::end_object;
+}
+
+bool Parser::parse_string() noexcept {
+    length   = 0;
+    overflow = false;
+
+    while (true) {
+        int c = get();
+
+        if (c < 0) {
+            fail("Unterminated string");
+            return false;
+        } else if (c == '"') {
+            break;
+        } else if (c < 0x20) {
+            fail("Control character in string");
+            return false;
+        } else if (c != '\\') {
+            append(c);
+            continue;
+        }
+
+        switch (c = get()) {
+            case '"':  append('"');  break;
+            case '\\': append('\\'); break;
+            case '/':  append('/');  break;
+            case 'b':  append('\b'); break;
+            case 'f':  append('\f'); break;
+            case 'n':  append('\n'); break;
+            case 'r':  append('\r'); break;
+            case 't':  append('\t'); break;
+
+            case 'u': {
+                uint32_t code = 0;
+
+                for (int i = 0; i < 4; i++) {
+                    int digit = hex_digit(get());
+                    if (digit < 0) {
+                        fail("Invalid unicode escape");
+                        return false;
+                    }
+                    code = code << 4 | digit;
+                }
+
+                // Surrogate pair
+                if (code >= 0xD800 && code <= 0xDBFF && peek() == '\\') {
+                    get();
+                    uint32_t low = 0;
+
+                    if (get() != 'u') {
+                        fail("Invalid unicode escape");
+                        return false;
+                    }
+
+                    for (int i = 0; i < 4; i++) {
+                        int digit = hex_digit(get());
+                        if (digit < 0) {
+                            fail("Invalid unicode escape");
+                            return false;
+                        }
+                        low = low << 4 | digit;
+                    }
+
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+
+                if (code < 0x80) {
+                    append(code);
+                } else if (code < 0x800) {
+                    append(0xC0 | code >> 6);
+                    append(0x80 | (code & 0x3F));
+                } else if (code < 0x10000) {
+                    append(0xE0 | code >> 12);
+                    append(0x80 | (code >> 6 & 0x3F));
+                    append(0x80 | (code & 0x3F));
+                } else {
+                    append(0xF0 | code >> 18);
+                    append(0x80 | (code >> 12 & 0x3F));
+                    append(0x80 | (code >> 6 & 0x3F));
+                    append(0x80 | (code & 0x3F));
+                }
+
+                break;
+            }
+
+            default:
+                fail("Invalid escape");
+                return false;
+        }
+    }
+
+    text[length] = 0;
+
+    if (overflow) {
+        fail("String too long");
+        return false;
+    }
+
+    return true;
+}
+
+bool Parser::parse_number() noexcept {
+    length   = 0;
+    overflow = false;
+
+    for (int c = peek(); (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'; c = peek()) {
+        append(get());
+    }
+
+    text[length] = 0;
+
+    if (overflow || !valid_number(string())) {
+        fail("Invalid number");
+        return false;
+    }
+
+    return true;
+}
+
+bool Parser::parse_literal(const char* literal) noexcept {
+    for (const char* c = literal; *c; c++) {
+        if (get() != *c) {
+            fail("Unexpected character");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Parser::append(char c) noexcept {
+    if (length < MY_JSON_STRING) text[length++] = c;
+    else overflow = true;
+}
+
+void Parser::set_path(std::string_view key) noexcept {
+    path_length = frames[_depth - 1].path_length;
+
+    if (path_length > 0 && path_length < MY_JSON_PATH) _path[path_length++] = '.';
+
+    for (char c : key) {
+        if (path_length < MY_JSON_PATH) _path[path_length++] = c;
+    }
+}
+
+void Parser::set_path(uint16_t index) noexcept {
+    path_length = frames[_depth - 1].path_length;
+
+    char digits[8];
+    int count = std::snprintf(digits, sizeof(digits), "[%u]", index);
+
+    for (int i = 0; i < count; i++) {
+        if (path_length < MY_JSON_PATH) _path[path_length++] = digits[i];
+    }
+}
+
+void Parser::finish_value() noexcept {
+    if (_depth == 0) expect = Expect::done;
+    else expect = frames[_depth - 1].array ? Expect::next_value : Expect::next_key;
+}
+
+} // namespace my_json
@@ -0,0 +1,323 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "mcp3208.h"
+
+#if defined(ESP_PLATFORM) || defined(ARDUINO_ARCH_STM32) || defined(__linux__)
+
+#if defined(ESP_PLATFORM)
+#include <esp_log.h>        // ESP_LOG…
+#elif defined(__linux__)
+#include <cerrno>           // errno
+#endif
+
+namespace my_mcp3208 {
+
+/////////////////////////
+///// class Mcp3208 /////
+/////////////////////////
+
+Mcp3208 Mcp3208::open(const Config& config) noexcept {
+    return Mcp3208(config);
+}
+
+#if defined(ESP_PLATFORM)
+constexpr char const* TAG = "mcp3208";
+
+Mcp3208::Mcp3208(const Config& config) noexcept
+    : frames{},
+      current(0),
+      running(false),
+      _error(ESP_OK),
+      device(nullptr),
+      transactions{},
+      pending(0)
+{
+    spi_bus_config_t bus = {};
+    bus.mosi_io_num     = config.mosi;
+    bus.miso_io_num     = config.miso;
+    bus.sclk_io_num     = config.sclk;
+    bus.quadwp_io_num   = -1;
+    bus.quadhd_io_num   = -1;
+    bus.max_transfer_sz = 4;
+
+    // The bus may already be initialized for other devices
+    _error = spi_bus_initialize(config.host, &bus, SPI_DMA_CH_AUTO);
+    if (_error == ESP_ERR_INVALID_STATE) _error = ESP_OK;
+
+    spi_device_interface_config_t interface = {};
+    interface.clock_speed_hz = static_cast<int>(config.clock_hz);
+    interface.mode           = 0;
+    interface.spics_io_num   = config.cs;
+    interface.queue_size     = CHANNELS;
+
+    if (_error == ESP_OK) _error = spi_bus_add_device(config.host, &interface, &device);
+
+    if (_error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open SPI device: %s", esp_err_to_name(_error));
+        device = nullptr;
+        return;
+    }
+
+    // The command bytes never change, so the transactions are prepared once
+    for (size_t channel = 0; channel < CHANNELS; channel++) {
+        spi_transaction_t& t = transactions[channel];
+        t.flags  = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA;
+        t.length = 24;
+        command(channel, t.tx_data);
+    }
+}
+
+Mcp3208::~Mcp3208() noexcept {
+    if (!device) return;
+
+    while (pending) {
+        spi_transaction_t* t;
+        if (spi_device_get_trans_result(device, &t, portMAX_DELAY) != ESP_OK) break;
+        pending--;
+    }
+
+    spi_bus_remove_device(device);
+}
+
+bool Mcp3208::start() noexcept {
+    if (!device || running) return false;
+
+    for (size_t channel = 0; channel < CHANNELS; channel++) {
+        if (spi_device_queue_trans(device, &transactions[channel], 0) != ESP_OK) break;
+        pending++;
+    }
+
+    running = pending > 0;
+    return pending == CHANNELS;
+}
+
+bool Mcp3208::poll() noexcept {
+    if (!running) return false;
+
+    while (pending) {
+        spi_transaction_t* t;
+        if (spi_device_get_trans_result(device, &t, 0) != ESP_OK) return false;
+        pending--;
+    }
+
+    running = false;
+
+    // Transactions complete in queue order, so they can be read in one go
+    Frame& back = frames[current ^ 1];
+    for (size_t channel = 0; channel < CHANNELS; channel++) back.values[channel] = result(transactions[channel].rx_data);
+
+    back.sequence = frames[current].sequence + 1;
+    current ^= 1;
+    return true;
+}
+#elif defined(ARDUINO_ARCH_STM32)
+static Mcp3208* active = nullptr;
+
+Mcp3208::Mcp3208(const Config& config) noexcept
+    : spi{},
+      dma_rx{},
+      dma_tx{},
+      frames{},
+      current(0),
+      running(false),
+      _error(HAL_OK),
+      cs(config.cs),
+      channel(0),
+      done(false),
+      tx{},
+      rx{}
+{
+    __HAL_RCC_SPI1_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+
+    // SCK, MISO, MOSI on PB3, PB4, PB5
+    GPIO_InitTypeDef gpio = {};
+    gpio.Pin       = GPIO_PIN_3 | GPIO_PIN_4 | GPIO_PIN_5;
+    gpio.Mode      = GPIO_MODE_AF_PP;
+    gpio.Pull      = GPIO_NOPULL;
+    gpio.Speed     = GPIO_SPEED_FREQ_HIGH;
+    gpio.Alternate = GPIO_AF5_SPI1;
+    HAL_GPIO_Init(GPIOB, &gpio);
+
+    pinMode(pinNametoDigitalPin(cs), OUTPUT);
+    digitalWriteFast(cs, HIGH);
+
+    // Smallest prescaler (2, 4, … 256) that stays below the requested clock
+    uint32_t clock   = HAL_RCC_GetPCLK2Freq() / 2;
+    uint32_t divider = 0;
+
+    while (clock > config.clock_hz && divider < 7) {
+        clock /= 2;
+        divider++;
+    }
+
+    spi.Instance               = SPI1;
+    spi.Init.Mode              = SPI_MODE_MASTER;
+    spi.Init.Direction         = SPI_DIRECTION_2LINES;
+    spi.Init.DataSize          = SPI_DATASIZE_8BIT;
+    spi.Init.CLKPolarity       = SPI_POLARITY_LOW;
+    spi.Init.CLKPhase          = SPI_PHASE_1EDGE;
+    spi.Init.NSS               = SPI_NSS_SOFT;
+    spi.Init.BaudRatePrescaler = divider << SPI_CR1_BR_Pos;
+    spi.Init.FirstBit          = SPI_FIRSTBIT_MSB;
+    spi.Init.TIMode            = SPI_TIMODE_DISABLE;
+    spi.Init.CRCCalculation    = SPI_CRCCALCULATION_DISABLE;
+    spi.Init.NSSPMode          = SPI_NSS_PULSE_DISABLE;
+
+    dma_rx.Instance                 = DMA1_Channel2;
+    dma_rx.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+    dma_rx.Init.PeriphInc           = DMA_PINC_DISABLE;
+    dma_rx.Init.MemInc              = DMA_MINC_ENABLE;
+    dma_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    dma_rx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+    dma_rx.Init.Mode                = DMA_NORMAL;
+    dma_rx.Init.Priority            = DMA_PRIORITY_MEDIUM;
+
+    dma_tx.Instance       = DMA1_Channel3;
+    dma_tx.Init           = dma_rx.Init;
+    dma_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+
+    if ((_error = HAL_SPI_Init(&spi)) != HAL_OK) return;
+    if ((_error = HAL_DMA_Init(&dma_rx)) != HAL_OK) return;
+    if ((_error = HAL_DMA_Init(&dma_tx)) != HAL_OK) return;
+
+    __HAL_LINKDMA(&spi, hdmarx, dma_rx);
+    __HAL_LINKDMA(&spi, hdmatx, dma_tx);
+
+    HAL_NVIC_SetPriority(DMA1_Channel2_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+    HAL_NVIC_SetPriority(DMA1_Channel3_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+
+    active = this;
+}
+
+Mcp3208::~Mcp3208() noexcept {
+    if (active != this) return;
+
+    HAL_SPI_Abort(&spi);
+    HAL_SPI_DeInit(&spi);
+    active = nullptr;
+}
+
+bool Mcp3208::start() noexcept {
+    if (active != this || running) return false;
+
+    running = true;
+    done    = false;
+    channel = 0;
+
+    command(channel, tx);
+    digitalWriteFast(cs, LOW);
+
+    if (HAL_SPI_TransmitReceive_DMA(&spi, tx, rx, sizeof(tx)) != HAL_OK) {
+        digitalWriteFast(cs, HIGH);
+        running = false;
+        return false;
+    }
+
+    return true;
+}
+
+void Mcp3208::transfer_complete() noexcept {
+    digitalWriteFast(cs, HIGH);
+    frames[current ^ 1].values[channel] = result(rx);
+
+    if (++channel >= CHANNELS) {
+        done = true;
+        return;
+    }
+
+    command(channel, tx);
+    digitalWriteFast(cs, LOW);
+
+    if (HAL_SPI_TransmitReceive_DMA(&spi, tx, rx, sizeof(tx)) != HAL_OK) {
+        digitalWriteFast(cs, HIGH);
+        running = false;
+    }
+}
+
+bool Mcp3208::poll() noexcept {
+    if (!done) return false;
+
+    Frame& back = frames[current ^ 1];
+    back.sequence = frames[current].sequence + 1;
+    current ^= 1;
+
+    done    = false;
+    running = false;
+    return true;
+}
+#elif defined(__linux__)
+Mcp3208::Mcp3208(const Config& config) noexcept
+    : frames{},
+      current(0),
+      running(false),
+      _error(0),
+      file(std::fopen(config.path.c_str(), "r"))
+{
+    if (!file) _error = errno;
+}
+
+Mcp3208::~Mcp3208() noexcept {
+    if (file) std::fclose(file);
+}
+
+bool Mcp3208::start() noexcept {
+    if (!file || running) return false;
+    running = true;
+    return true;
+}
+
+bool Mcp3208::poll() noexcept {
+    if (!running) return false;
+
+    Frame& back = frames[current ^ 1];
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        unsigned v[CHANNELS];
+        int count = std::fscanf(file, "%u %u %u %u %u %u %u %u", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+
+        if (count == static_cast<int>(CHANNELS)) {
+            for (size_t channel = 0; channel < CHANNELS; channel++) back.values[channel] = static_cast<uint16_t>(v[channel] & 0x0FFF);
+
+            back.sequence = frames[current].sequence + 1;
+            current ^= 1;
+            running = false;
+            return true;
+        }
+
+        // End of the recording (or garbage): Start over
+        std::rewind(file);
+    }
+
+    running = false;
+    return false;
+}
+#endif
+
+} // namespace my_mcp3208
+
+#if defined(ARDUINO_ARCH_STM32)
+extern "C" void DMA1_Channel2_IRQHandler(void) {
+    if (my_mcp3208::active) HAL_DMA_IRQHandler(&my_mcp3208::active->dma_rx);
+}
+
+extern "C" void DMA1_Channel3_IRQHandler(void) {
+    if (my_mcp3208::active) HAL_DMA_IRQHandler(&my_mcp3208::active->dma_tx);
+}
+
+extern "C" void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef*) {
+    if (my_mcp3208::active) my_mcp3208::active->transfer_complete();
+}
+#endif
+
+#endif
@@ -0,0 +1,578 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "mqtt.h"
+
+#include <algorithm>        // std::min
+#include <cerrno>           // errno
+#include <cstring>          // std::memcpy, std::memmove
+
+#if defined(ESP_PLATFORM) || defined(__linux__)
+#include <netdb.h>          // getaddrinfo
+#include <netinet/in.h>     // IPPROTO_TCP
+#include <netinet/tcp.h>    // TCP_NODELAY
+#include <sys/socket.h>     // socket, connect, recv
+#include <sys/uio.h>        // writev
+#include <unistd.h>         // close
+#endif
+
+namespace my_mqtt {
+
+// Packet types (upper nibble of the first header byte)
+constexpr uint8_t CONNECT    = 0x10;
+constexpr uint8_t CONNACK    = 0x20;
+constexpr uint8_t PUBLISH    = 0x30;
+constexpr uint8_t PUBACK     = 0x40;
+constexpr uint8_t SUBSCRIBE  = 0x82;    // Including the mandatory flags
+constexpr uint8_t SUBACK     = 0x90;
+constexpr uint8_t PINGREQ    = 0xC0;
+constexpr uint8_t PINGRESP   = 0xD0;
+constexpr uint8_t DISCONNECT = 0xE0;
+
+// MQTT 5 properties used by the client
+constexpr uint8_t PROP_TOPIC_ALIAS_MAXIMUM = 0x22;
+constexpr uint8_t PROP_TOPIC_ALIAS         = 0x23;
+
+/**
+ * Encode the remaining length or a property length as variable byte integer.
+ *
+ * @param[in] value Value to encode (max. 268,435,455)
+ * @param[out] buffer At least four bytes
+ * @returns Number of bytes written
+ */
+static size_t encode_varint(uint32_t value, uint8_t* buffer) noexcept {
+    size_t size = 0;
+
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        buffer[size++] = value ? (byte | 0x80) : byte;
+    } while (value && size < 4);
+
+    return size;
+}
+
+/**
+ * Decode a variable byte integer.
+ *
+ * @param[in] data Buffer
+ * @param[in] size Buffer size
+ * @param[out] value Decoded value
+ * @returns Number of bytes read, zero if incomplete or malformed
+ */
+static size_t decode_varint(const uint8_t* data, size_t size, uint32_t& value) noexcept {
+    value = 0;
+
+    for (size_t i = 0; i < 4 && i < size; i++) {
+        value |= uint32_t(data[i] & 0x7F) << (7 * i);
+        if (!(data[i] & 0x80)) return i + 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Read an MQTT 5 property list and return the topic alias maximum, if present.
+ *
+ * @param[in] data First byte after the property length
+ * @param[in] size Property length
+ * @param[out] alias_maximum Topic alias maximum, unchanged if not present
+ * @returns false, if the properties are malformed
+ */
+static bool read_properties(const uint8_t* data, size_t size, uint16_t& alias_maximum) noexcept {
+    size_t offset = 0;
+
+    while (offset < size) {
+        uint8_t id = data[offset++];
+        size_t length = 0;
+
+        switch (id) {
+            case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+                length = 1;
+                break;
+            case 0x13: case 0x21: case 0x22: case 0x23:
+                length = 2;
+                break;
+            case 0x02: case 0x11: case 0x18: case 0x27:
+                length = 4;
+                break;
+            case 0x0B: {
+                uint32_t value;
+                if (offset > size) return false;
+                length = decode_varint(data + offset, size - offset, value);
+                if (!length) return false;
+                break;
+            }
+            case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F: {
+                if (offset + 2 > size) return false;
+                length = 2 + ((data[offset] << 8) | data[offset + 1]);
+                break;
+            }
+            case 0x26: {
+                // String pair
+                if (offset + 2 > size) return false;
+                size_t key = 2 + ((data[offset] << 8) | data[offset + 1]);
+                if (offset + key + 2 > size) return false;
+                length = key + 2 + ((data[offset + key] << 8) | data[offset + key + 1]);
+                break;
+            }
+            default:
+                return false;
+        }
+
+        if (offset + length > size) return false;
+
+        if (id == PROP_TOPIC_ALIAS_MAXIMUM) {
+            alias_maximum = (data[offset] << 8) | data[offset + 1];
+        }
+
+        offset += length;
+    }
+
+    return true;
+}
+
+/**
+ * Append a length-prefixed string to a packet body.
+ */
+static void append_string(std::vector<uint8_t>& body, std::string_view string) {
+    body.push_back(static_cast<uint8_t>(string.size() >> 8));
+    body.push_back(static_cast<uint8_t>(string.size() & 0xFF));
+    body.insert(body.end(), string.begin(), string.end());
+}
+
+#if defined(ESP_PLATFORM) || defined(__linux__)
+/////////////////////////////////
+///// class SocketTransport /////
+/////////////////////////////////
+
+SocketTransport::~SocketTransport() noexcept {
+    close();
+}
+
+bool SocketTransport::connect(const std::string& host, uint16_t port) noexcept {
+    close();
+
+    addrinfo hints{};
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* address = nullptr;
+    std::string service = std::to_string(port);
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &address) != 0 || !address) return false;
+
+    socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+    if (socket >= 0 && ::connect(socket, address->ai_addr, address->ai_addrlen) != 0) {
+        ::close(socket);
+        socket = -1;
+    }
+
+    freeaddrinfo(address);
+    if (socket < 0) return false;
+
+    // Small packets must leave immediately instead of waiting for more data
+    int flag = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    return true;
+}
+
+void SocketTransport::close() noexcept {
+    if (socket < 0) return;
+
+    ::close(socket);
+    socket = -1;
+}
+
+bool SocketTransport::write(const Slice* slices, size_t count) noexcept {
+    if (socket < 0) return false;
+
+    iovec iov[MAX_SLICES];
+
+    // Larger writes than one batch are split instead of being cut off
+    while (count) {
+        size_t batch = std::min(count, MAX_SLICES);
+        size_t total = 0;
+
+        for (size_t i = 0; i < batch; i++) {
+            iov[i].iov_base = const_cast<uint8_t*>(slices[i].data);
+            iov[i].iov_len  = slices[i].size;
+            total += slices[i].size;
+        }
+
+        // Blocking socket: writev only returns early on error
+        if (::writev(socket, iov, batch) != static_cast<ssize_t>(total)) return false;
+
+        slices += batch;
+        count  -= batch;
+    }
+
+    return true;
+}
+
+int SocketTransport::read(uint8_t* buffer, size_t size) noexcept {
+    if (socket < 0) return -1;
+
+    ssize_t result = ::recv(socket, buffer, size, MSG_DONTWAIT);
+
+    if (result > 0) return static_cast<int>(result);
+    if (result == 0) return -1;     // Closed by peer
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+}
+#endif
+
+////////////////////////
+///// class Client /////
+////////////////////////
+
+Client::Client(Transport& transport) noexcept
+    : transport(transport),
+      _state(State::disconnected),
+      version(Version::v5),
+      keep_alive_ms(0),
+      alias_maximum(0),
+      packet_id(0),
+      last_sent_ms(0),
+      now_ms(0),
+      strings{},
+      topics{},
+      rx_buffer{},
+      rx_size(0),
+      rx_discard(0)
+{
+}
+
+topic_t Client::add_topic(std::string_view topic) {
+    Topic entry{};
+    entry.offset = static_cast<uint32_t>(strings.size());
+    entry.length = static_cast<uint16_t>(topic.size());
+
+    strings.append(topic);
+    topics.push_back(entry);
+
+    return static_cast<topic_t>(topics.size() - 1);
+}
+
+void Client::reset_aliases() noexcept {
+    // Aliases are only valid for one connection. Hand them out in registration order.
+    for (size_t i = 0; i < topics.size(); i++) {
+        topics[i].alias      = (version == Version::v5 && i < alias_maximum) ? static_cast<uint16_t>(i + 1) : 0;
+        topics[i].alias_sent = false;
+    }
+}
+
+bool Client::send_packet(uint8_t type, const uint8_t* body, size_t size) noexcept {
+    uint8_t header[5] = {type};
+    size_t header_size = 1 + encode_varint(size, header + 1);
+
+    Slice slices[2] = {
+        {header, header_size},
+        {body,   size},
+    };
+
+    last_sent_ms = now_ms;
+    return transport.write(slices, size ? 2 : 1);
+}
+
+bool Client::connect(const Options& options, uint32_t now_ms) noexcept {
+    this->now_ms  = now_ms;
+    version       = options.version;
+    keep_alive_ms = options.keep_alive * 1000;
+    alias_maximum = 0;
+    rx_size       = 0;
+    rx_discard    = 0;
+
+    if (rx_buffer.empty()) rx_buffer.resize(MY_MQTT_RX_BUFFER);
+    reset_aliases();
+
+    uint8_t flags = 0x02;                                   // Clean start
+    if (!options.username.empty()) flags |= 0x80;
+    if (!options.password.empty()) flags |= 0x40;
+
+    std::vector<uint8_t> body;
+    body.reserve(32 + options.client_id.size() + options.username.size() + options.password.size());
+
+    append_string(body, "MQTT");
+    body.push_back(static_cast<uint8_t>(version));
+    body.push_back(flags);
+    body.push_back(static_cast<uint8_t>(options.keep_alive >> 8));
+    body.push_back(static_cast<uint8_t>(options.keep_alive & 0xFF));
+    if (version == Version::v5) body.push_back(0);          // No properties
+
+    append_string(body, options.client_id);
+    if (!options.username.empty()) append_string(body, options.username);
+    if (!options.password.empty()) append_string(body, options.password);
+
+    if (!send_packet(CONNECT, body.data(), body.size())) {
+        _state = State::disconnected;
+        return false;
+    }
+
+    _state = State::connecting;
+    return true;
+}
+
+void Client::disconnect() noexcept {
+    if (_state == State::disconnected) return;
+
+    send_packet(DISCONNECT, nullptr, 0);
+    _state = State::disconnected;
+}
+
+bool Client::subscribe(std::string_view filter) noexcept {
+    if (_state != State::connected) return false;
+    if (++packet_id == 0) packet_id = 1;
+
+    std::vector<uint8_t> body;
+    body.reserve(8 + filter.size());
+
+    body.push_back(static_cast<uint8_t>(packet_id >> 8));
+    body.push_back(static_cast<uint8_t>(packet_id & 0xFF));
+    if (version == Version::v5) body.push_back(0);          // No properties
+
+    append_string(body, filter);
+    body.push_back(0);                                      // QoS 0
+
+    return send_packet(SUBSCRIBE, body.data(), body.size());
+}
+
+size_t Client::build_publish(Topic& topic, const uint8_t* payload, size_t size, bool retain, PublishHeader& header, Slice* slices) noexcept {
+    // With an alias the topic name is only sent the first time
+    bool send_name = !topic.alias || !topic.alias_sent;
+    size_t name_size = send_name ? topic.length : 0;
+
+    header.properties_size = 0;
+
+    if (version == Version::v5) {
+        if (topic.alias) {
+            header.properties[0] = 3;
+            header.properties[1] = PROP_TOPIC_ALIAS;
+            header.properties[2] = static_cast<uint8_t>(topic.alias >> 8);
+            header.properties[3] = static_cast<uint8_t>(topic.alias & 0xFF);
+            header.properties_size = 4;
+            topic.alias_sent = true;
+        } else {
+            header.properties[0] = 0;
+            header.properties_size = 1;
+        }
+    }
+
+    header.topic_length[0] = static_cast<uint8_t>(name_size >> 8);
+    header.topic_length[1] = static_cast<uint8_t>(name_size & 0xFF);
+
+    size_t remaining = 2 + name_size + header.properties_size + size;
+    header.fixed[0] = PUBLISH | (retain ? 0x01 : 0x00);
+    header.fixed_size = 1 + encode_varint(remaining, header.fixed + 1);
+
+    size_t count = 0;
+    slices[count++] = {header.fixed, header.fixed_size};
+    slices[count++] = {header.topic_length, 2};
+    if (name_size) slices[count++] = {reinterpret_cast<const uint8_t*>(strings.data()) + topic.offset, name_size};
+    if (header.properties_size) slices[count++] = {header.properties, header.properties_size};
+    if (size) slices[count++] = {payload, size};
+
+    return count;
+}
+
+bool Client::publish(topic_t topic, const uint8_t* payload, size_t size, bool retain) noexcept {
+    if (_state != State::connected || topic >= topics.size()) return false;
+
+    PublishHeader header;
+    Slice slices[PUBLISH_SLICES];
+    bool alias_sent = topics[topic].alias_sent;
+
+    size_t count = build_publish(topics[topic], payload, size, retain, header, slices);
+    last_sent_ms = now_ms;
+
+    if (!transport.write(slices, count)) {
+        topics[topic].alias_sent = alias_sent;
+        return false;
+    }
+
+    return true;
+}
+
+bool Client::stage(topic_t topic, const uint8_t* payload, size_t size, bool retain) noexcept {
+    if (topic >= topics.size()) return false;
+    if (size > MY_MQTT_SLOT_SIZE) return publish(topic, payload, size, retain);
+
+    Topic& entry = topics[topic];
+    std::memcpy(entry.slot, payload, size);
+    entry.size   = static_cast<uint8_t>(size);
+    entry.retain = retain;
+    entry.dirty  = true;
+
+    return true;
+}
+
+bool Client::flush() noexcept {
+    if (_state != State::connected) return false;
+
+    PublishHeader headers[MY_MQTT_BATCH_SIZE];
+    Slice slices[MAX_SLICES];
+    topic_t batch[MY_MQTT_BATCH_SIZE];
+    size_t batch_size = 0;
+    size_t slice_count = 0;
+
+    auto write_batch = [&]() noexcept {
+        if (!batch_size) return true;
+
+        last_sent_ms = now_ms;
+        bool ok = transport.write(slices, slice_count);
+
+        for (size_t i = 0; i < batch_size; i++) {
+            if (ok) topics[batch[i]].dirty = false;
+            else    topics[batch[i]].alias_sent = false;    // Resend the name next time
+        }
+
+        batch_size = slice_count = 0;
+        return ok;
+    };
+
+    for (size_t i = 0; i < topics.size(); i++) {
+        Topic& topic = topics[i];
+        if (!topic.dirty) continue;
+
+        slice_count += build_publish(topic, topic.slot, topic.size, topic.retain, headers[batch_size], slices + slice_count);
+        batch[batch_size++] = static_cast<topic_t>(i);
+
+        if (batch_size == MY_MQTT_BATCH_SIZE && !write_batch()) return false;
+    }
+
+    return write_batch();
+}
+
+bool Client::poll(uint32_t now_ms, MessageHandler handler, void* context) noexcept {
+    this->now_ms = now_ms;
+    if (_state == State::disconnected) return false;
+
+    // Read whatever is available
+    int received = transport.read(rx_buffer.data() + rx_size, rx_buffer.size() - rx_size);
+
+    if (received < 0) {
+        _state = State::disconnected;
+        return false;
+    }
+
+    rx_size += received;
+
+    // Drop the rest of an oversized packet
+    if (rx_discard) {
+        size_t drop = std::min(rx_discard, rx_size);
+        std::memmove(rx_buffer.data(), rx_buffer.data() + drop, rx_size - drop);
+        rx_size    -= drop;
+        rx_discard -= drop;
+    }
+
+    // Handle all complete packets
+    size_t offset = 0;
+
+    while (!rx_discard && rx_size - offset >= 2) {
+        uint32_t remaining = 0;
+        size_t length_size = decode_varint(rx_buffer.data() + offset + 1, rx_size - offset - 1, remaining);
+        if (!length_size) break;
+
+        size_t total = 1 + length_size + remaining;
+
+        if (total > rx_buffer.size()) {
+            rx_discard = total - (rx_size - offset);
+            offset = rx_size;
+            break;
+        }
+
+        if (rx_size - offset < total) break;
+
+        uint8_t type = rx_buffer[offset];
+        if (!handle_packet(type, rx_buffer.data() + offset + 1 + length_size, remaining, handler, context)) {
+            _state = State::disconnected;
+            return false;
+        }
+
+        offset += total;
+    }
+
+    std::memmove(rx_buffer.data(), rx_buffer.data() + offset, rx_size - offset);
+    rx_size -= offset;
+
+    // Keep the connection alive
+    if (_state == State::connected && keep_alive_ms && now_ms - last_sent_ms >= keep_alive_ms / 2) {
+        if (!send_packet(PINGREQ, nullptr, 0)) {
+            _state = State::disconnected;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Client::handle_packet(uint8_t type, const uint8_t* data, size_t size, MessageHandler handler, void* context) noexcept {
+    switch (type & 0xF0) {
+        case CONNACK: {
+            if (size < 2 || data[1] != 0) return false;    // Connection refused
+
+            if (version == Version::v5 && size > 2) {
+                uint32_t length = 0;
+                size_t length_size = decode_varint(data + 2, size - 2, length);
+                if (!length_size || 2 + length_size + length > size) return false;
+                if (!read_properties(data + 2 + length_size, length, alias_maximum)) return false;
+            }
+
+            reset_aliases();
+            _state = State::connected;
+            return true;
+        }
+        case PUBLISH: {
+            uint8_t qos = (type >> 1) & 0x03;
+            if (size < 2) return false;
+
+            size_t topic_length = (data[0] << 8) | data[1];
+            size_t offset = 2 + topic_length;
+            uint16_t id = 0;
+
+            if (offset > size) return false;
+
+            if (qos > 0) {
+                if (offset + 2 > size) return false;
+                id = (data[offset] << 8) | data[offset + 1];
+                offset += 2;
+            }
+
+            if (version == Version::v5) {
+                uint32_t length = 0;
+                size_t length_size = decode_varint(data + offset, size - offset, length);
+                if (!length_size) return false;
+                offset += length_size + length;
+            }
+
+            if (offset > size) return false;
+
+            if (handler) {
+                std::string_view topic{reinterpret_cast<const char*>(data + 2), topic_length};
+                handler(context, topic, data + offset, size - offset);
+            }
+
+            // We only subscribe with QoS 0, but the broker may still send QoS 1
+            if (qos == 1) {
+                uint8_t ack[2] = {static_cast<uint8_t>(id >> 8), static_cast<uint8_t>(id & 0xFF)};
+                return send_packet(PUBACK, ack, sizeof(ack));
+            }
+
+            return true;
+        }
+        case DISCONNECT:
+            return false;
+        case SUBACK:
+        case PINGRESP:
+        default:
+            return true;
+    }
+}
+
+} // namespace my_mqtt
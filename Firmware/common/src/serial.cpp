@@ -0,0 +1,360 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "serial.h"
+
+#if defined(ESP_PLATFORM) || defined(__linux__)
+
+#include <algorithm>        // std::stable_sort, std::max, std::clamp
+#include <cerrno>           // errno
+#include <cstdlib>          // std::atoi
+#include <cstring>          // std::memchr, std::memmove
+
+#if defined(ESP_PLATFORM)
+#include <driver/uart.h>    // uart_…
+#include <esp_log.h>        // ESP_LOG…
+#else
+#include <fcntl.h>          // open
+#include <termios.h>        // tcsetattr, cfmakeraw, cfsetspeed
+#include <unistd.h>         // read, write, close
+#endif
+
+namespace my_serial {
+
+//////////////////////
+///// class Port /////
+//////////////////////
+
+Port Port::open(const std::string& device, Settings settings) noexcept {
+    return Port(device, settings);
+}
+
+Port::~Port() noexcept {
+    close();
+}
+
+#if defined(ESP_PLATFORM)
+constexpr char const* TAG = "serial";
+
+Port::Port(const std::string& device, Settings settings) noexcept
+    : handle(-1),
+      _error(ESP_OK)
+{
+    uart_port_t uart = static_cast<uart_port_t>(std::atoi(device.c_str()));
+
+    uart_config_t config = {
+        .baud_rate           = static_cast<int>(settings.speed),
+        .data_bits           = static_cast<uart_word_length_t>(UART_DATA_5_BITS + (std::clamp<uint8_t>(settings.word_length, 5, 8) - 5)),
+        .parity              = settings.parity == Parity::even ? UART_PARITY_EVEN : settings.parity == Parity::odd ? UART_PARITY_ODD : UART_PARITY_DISABLE,
+        .stop_bits           = settings.stop_bits == StopBits::two ? UART_STOP_BITS_2 : settings.stop_bits == StopBits::one_half ? UART_STOP_BITS_1_5 : UART_STOP_BITS_1,
+        .flow_ctrl           = UART_HW_FLOWCTRL_DISABLE,
+        .rx_flow_ctrl_thresh = 0,
+        .source_clk          = UART_SCLK_DEFAULT,
+    };
+
+    // The transmit buffer lets uart_write_bytes() return immediately while the
+    // interrupt handler refills the hardware FIFO in the background.
+    _error = uart_driver_install(uart, MY_SERIAL_RX_BUFFER * 2, MY_SERIAL_TX_BUFFER, 0, nullptr, 0);
+    if (_error == ESP_OK) _error = uart_param_config(uart, &config);
+
+    if (_error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open UART %s: %s", device.c_str(), esp_err_to_name(_error));
+        uart_driver_delete(uart);
+        return;
+    }
+
+    handle = uart;
+}
+
+void Port::close() noexcept {
+    if (handle < 0) return;
+
+    uart_driver_delete(static_cast<uart_port_t>(handle));
+    handle = -1;
+}
+
+bool Port::write(const uint8_t* data, size_t size) noexcept {
+    if (handle < 0) return false;
+
+    size_t free = 0;
+    uart_get_tx_buffer_free_size(static_cast<uart_port_t>(handle), &free);
+    if (free < size) return false;
+
+    return uart_write_bytes(static_cast<uart_port_t>(handle), data, size) == static_cast<int>(size);
+}
+
+size_t Port::read(uint8_t* buffer, size_t size) noexcept {
+    if (handle < 0) return 0;
+
+    int result = uart_read_bytes(static_cast<uart_port_t>(handle), buffer, size, 0);
+    return result > 0 ? result : 0;
+}
+#else
+/**
+ * @returns termios constant for the given baud rate, standard rates only
+ */
+static speed_t baud_rate(uint32_t speed) noexcept {
+    switch (speed) {
+        case 1200:    return B1200;
+        case 2400:    return B2400;
+        case 4800:    return B4800;
+        case 9600:    return B9600;
+        case 19200:   return B19200;
+        case 38400:   return B38400;
+        case 57600:   return B57600;
+        case 230400:  return B230400;
+        case 460800:  return B460800;
+        case 921600:  return B921600;
+        case 115200:
+        default:      return B115200;
+    }
+}
+
+Port::Port(const std::string& device, Settings settings) noexcept
+    : handle(-1),
+      _error(0),
+      backlog{}
+{
+    int fd = ::open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if (fd < 0) {
+        _error = errno;
+        return;
+    }
+
+    termios tty{};
+    tcgetattr(fd, &tty);
+    cfmakeraw(&tty);
+    cfsetspeed(&tty, baud_rate(settings.speed));
+
+    tty.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB);
+    tty.c_cflag |= CLOCAL | CREAD;
+
+    switch (settings.word_length) {
+        case 5:  tty.c_cflag |= CS5; break;
+        case 6:  tty.c_cflag |= CS6; break;
+        case 7:  tty.c_cflag |= CS7; break;
+        default: tty.c_cflag |= CS8; break;
+    }
+
+    if (settings.parity != Parity::none) tty.c_cflag |= PARENB;
+    if (settings.parity == Parity::odd)  tty.c_cflag |= PARODD;
+    if (settings.stop_bits != StopBits::one) tty.c_cflag |= CSTOPB;
+
+    if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+        _error = errno;
+        ::close(fd);
+        return;
+    }
+
+    handle = fd;
+}
+
+void Port::close() noexcept {
+    if (handle < 0) return;
+
+    ::close(handle);
+    handle = -1;
+}
+
+ssize_t Port::drain() noexcept {
+    if (backlog.empty()) return 0;
+
+    ssize_t result = ::write(handle, backlog.data(), backlog.size());
+    if (result > 0) backlog.erase(backlog.begin(), backlog.begin() + result);
+
+    return result < 0 && errno != EAGAIN ? result : 0;
+}
+
+bool Port::write(const uint8_t* data, size_t size) noexcept {
+    if (handle < 0 || drain() < 0) return false;
+
+    // Like the UART driver, either the whole message fits into the buffer or nothing is written
+    if (backlog.size() + size > MY_SERIAL_TX_BUFFER) return false;
+
+    size_t written = 0;
+
+    if (backlog.empty()) {
+        ssize_t result = ::write(handle, data, size);
+
+        if (result < 0 && errno != EAGAIN) return false;
+        if (result > 0) written = result;
+    }
+
+    backlog.insert(backlog.end(), data + written, data + size);
+    return true;
+}
+
+size_t Port::read(uint8_t* buffer, size_t size) noexcept {
+    if (handle < 0) return 0;
+    drain();
+
+    ssize_t result = ::read(handle, buffer, size);
+    return result > 0 ? result : 0;
+}
+#endif
+
+////////////////////////
+///// class Engine /////
+////////////////////////
+
+Engine::Engine(Port& port) noexcept
+    : port(port),
+      messages{},
+      control_first{},
+      tx_buffer{},
+      rx_buffer{},
+      rx_size(0),
+      binary_size(0),
+      receive_text(false)
+{
+}
+
+void Engine::add(uint16_t control, my_format::Template message, bool send, bool receive) {
+    messages.push_back({control, send, receive, std::move(message)});
+}
+
+void Engine::compile() {
+    std::stable_sort(messages.begin(), messages.end(), [](const Message& a, const Message& b) {
+        return a.control < b.control;
+    });
+
+    uint16_t control_count = messages.empty() ? 0 : messages.back().control + 1;
+    control_first.assign(control_count + 1, 0);
+
+    size_t tx_size = 0;
+    binary_size  = 0;
+    receive_text = false;
+
+    for (auto& message : messages) {
+        control_first[message.control + 1]++;
+
+        // All messages of a control might be sent at once
+        tx_size += message.data.max_size() + 1;
+
+        if (message.receive && message.data.format() == my_format::Format::binary) {
+            binary_size = std::max(binary_size, message.data.max_size());
+        } else if (message.receive) {
+            receive_text = true;
+        }
+    }
+
+    for (size_t i = 1; i < control_first.size(); i++) control_first[i] += control_first[i - 1];
+
+    tx_buffer.assign(tx_size, 0);
+    rx_size = 0;
+}
+
+size_t Engine::send(uint16_t control, uint8_t changed, const float* values) noexcept {
+    if (control + 1u >= control_first.size()) return 0;
+    size_t size = 0;
+
+    for (uint32_t i = control_first[control]; i < control_first[control + 1]; i++) {
+        const Message& message = messages[i];
+        if (!message.send || !(message.data.inputs() & changed)) continue;
+
+        size += message.data.encode(values, tx_buffer.data() + size, tx_buffer.size() - size);
+        if (message.data.format() == my_format::Format::text) tx_buffer[size++] = '\n';
+    }
+
+    if (!size) return 0;
+    return port.write(tx_buffer.data(), size) ? size : 0;
+}
+
+uint8_t Engine::inputs(uint16_t control) const noexcept {
+    if (control + 1u >= control_first.size()) return 0;
+    uint8_t result = 0;
+
+    for (uint32_t i = control_first[control]; i < control_first[control + 1]; i++) {
+        if (messages[i].send) result |= messages[i].data.inputs();
+    }
+
+    return result;
+}
+
+size_t Engine::sender(void* context, uint16_t control, uint8_t changed, const float* values) noexcept {
+    return static_cast<Engine*>(context)->send(control, changed, values);
+}
+
+bool Engine::match_line(const uint8_t* data, size_t size, Handler handler, void* context) noexcept {
+    if (size && data[size - 1] == '\r') size--;
+    bool found = false;
+
+    for (auto& message : messages) {
+        if (!message.receive || message.data.format() != my_format::Format::text) continue;
+
+        float values[my_control::INPUT_COUNT] = {};
+        uint8_t changed = 0;
+
+        if (message.data.decode(data, size, values, changed)) {
+            handler(context, message.control, changed, values);
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+size_t Engine::match_binary(Handler handler, void* context) noexcept {
+    for (auto& message : messages) {
+        if (!message.receive || message.data.format() != my_format::Format::binary) continue;
+
+        size_t size = message.data.max_size();
+        if (rx_size < size) continue;
+
+        float values[my_control::INPUT_COUNT] = {};
+        uint8_t changed = 0;
+
+        if (message.data.decode(rx_buffer, size, values, changed)) {
+            handler(context, message.control, changed, values);
+            return size;
+        }
+    }
+
+    return 0;
+}
+
+void Engine::poll(Handler handler, void* context) noexcept {
+    rx_size += port.read(rx_buffer + rx_size, sizeof(rx_buffer) - rx_size);
+
+    while (rx_size) {
+        size_t consumed = binary_size ? match_binary(handler, context) : 0;
+
+        if (!consumed && receive_text) {
+            auto newline = static_cast<const uint8_t*>(std::memchr(rx_buffer, '\n', rx_size));
+
+            if (newline) {
+                size_t length = newline - rx_buffer;
+                bool found = match_line(rx_buffer, length, handler, context);
+
+                // Unknown lines are only skipped as a whole if no binary message could start inside
+                if (found || !binary_size) consumed = length + 1;
+            }
+        }
+
+        if (!consumed) {
+            bool full = rx_size == sizeof(rx_buffer);
+
+            if (binary_size && rx_size >= binary_size) {
+                consumed = 1;           // No binary message starts here, resynchronize
+            } else if (full) {
+                consumed = rx_size;     // Overlong garbage
+            } else {
+                break;                  // Wait for more data
+            }
+        }
+
+        std::memmove(rx_buffer, rx_buffer + consumed, rx_size - consumed);
+        rx_size -= consumed;
+    }
+}
+
+} // namespace my_serial
+
+#endif
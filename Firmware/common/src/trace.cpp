@@ -0,0 +1,221 @@
+/* Modular Music Controller - Firmware Common Library
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "trace.h"
+
+#include <algorithm>        // std::min
+#include <cmath>            // std::ceil
+
+#if defined(ESP_PLATFORM)
+#include <esp_rom_sys.h>    // esp_rom_get_cpu_ticks_per_us
+#endif
+
+namespace my_trace {
+
+/**
+ * Ring buffer of the trace events of one core
+ */
+struct Ring {
+    std::atomic<uint32_t> next;             ///< Number of events written so far
+    Event events[MY_TRACE_EVENTS];          ///< Newest events
+};
+
+static Ring rings[CORES];                   ///< Ring buffer of each core
+static Histogram histograms[SPAN_COUNT];    ///< Histogram of each span
+
+constexpr const char* span_names[SPAN_COUNT] = {
+    "input_to_merge",
+    "input_to_output",
+    "osc_to_feedback",
+    "bus_read",
+};
+
+/**
+ * @returns Index of the current core
+ */
+static inline size_t core() noexcept {
+#if defined(ESP_PLATFORM)
+    return esp_cpu_get_core_id();
+#else
+    return 0;
+#endif
+}
+
+///////////////////////////
+///// class Histogram /////
+///////////////////////////
+
+Histogram::Histogram() noexcept
+    : counts{},
+      _count(0),
+      _min(UINT32_MAX),
+      _max(0)
+{
+}
+
+size_t Histogram::bucket(uint32_t value_us) noexcept {
+    if (value_us < SUB_BUCKETS) return value_us;
+
+    size_t exponent = 31 - __builtin_clz(value_us);
+    if (exponent >= MY_TRACE_MAX_BITS) return BUCKETS - 1;
+
+    size_t shift = exponent - MY_TRACE_SUB_BITS;
+    return (shift + 1) * SUB_BUCKETS + (value_us >> shift) - SUB_BUCKETS;
+}
+
+uint32_t Histogram::lower(size_t bucket) noexcept {
+    size_t row = bucket / SUB_BUCKETS;
+    size_t sub = bucket % SUB_BUCKETS;
+
+    if (!row) return sub;
+    return static_cast<uint32_t>(SUB_BUCKETS + sub) << (row - 1);
+}
+
+void Histogram::record(uint32_t value_us) noexcept {
+    counts[bucket(value_us)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t current = _min.load(std::memory_order_relaxed);
+    while (value_us < current && !_min.compare_exchange_weak(current, value_us, std::memory_order_relaxed));
+
+    current = _max.load(std::memory_order_relaxed);
+    while (value_us > current && !_max.compare_exchange_weak(current, value_us, std::memory_order_relaxed));
+}
+
+void Histogram::reset() noexcept {
+    for (auto& count : counts) count.store(0, std::memory_order_relaxed);
+
+    _count.store(0, std::memory_order_relaxed);
+    _min.store(UINT32_MAX, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+uint32_t Histogram::percentile(double fraction) const noexcept {
+    uint32_t total = count();
+    if (!total) return 0;
+
+    uint32_t target = std::max<uint32_t>(1, static_cast<uint32_t>(std::ceil(fraction * total)));
+    uint32_t seen = 0;
+
+    for (size_t i = 0; i < BUCKETS - 1; i++) {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen >= target) return std::min(lower(i + 1) - 1, max());
+    }
+
+    return max();
+}
+
+/////////////////////
+///// Functions /////
+/////////////////////
+
+uint32_t ticks_per_us() noexcept {
+#if defined(ESP_PLATFORM)
+    return esp_rom_get_cpu_ticks_per_us();
+#elif defined(ARDUINO_ARCH_STM32)
+    return 1;
+#else
+    return 1000;
+#endif
+}
+
+void point(Point id, uint32_t arg) noexcept {
+    Ring& ring = rings[core()];
+    uint32_t index = ring.next.fetch_add(1, std::memory_order_relaxed) % MY_TRACE_EVENTS;
+
+    ring.events[index] = {ticks(), static_cast<uint16_t>(id), 0, arg};
+}
+
+void record(Span span, uint32_t duration_us) noexcept {
+    size_t index = static_cast<size_t>(span);
+    if (index < SPAN_COUNT) histograms[index].record(duration_us);
+}
+
+const Histogram& histogram(Span span) noexcept {
+    return histograms[std::min(static_cast<size_t>(span), SPAN_COUNT - 1)];
+}
+
+const char* name(Span span) noexcept {
+    size_t index = static_cast<size_t>(span);
+    return index < SPAN_COUNT ? span_names[index] : "";
+}
+
+size_t events(size_t core, Event* events, size_t max) noexcept {
+    if (core >= CORES) return 0;
+
+    Ring& ring = rings[core];
+    uint32_t next = ring.next.load(std::memory_order_acquire);
+    size_t count = std::min<size_t>({next, MY_TRACE_EVENTS, max});
+
+    for (size_t i = 0; i < count; i++) {
+        events[i] = ring.events[(next - count + i) % MY_TRACE_EVENTS];
+    }
+
+    return count;
+}
+
+void reset() noexcept {
+    for (auto& ring : rings) ring.next.store(0, std::memory_order_relaxed);
+    for (auto& histogram : histograms) histogram.reset();
+}
+
+void dump(my_json::Writer& writer) noexcept {
+    writer.begin_object();
+    writer.key("ticks_per_us");
+    writer.integer(ticks_per_us());
+
+    writer.key("spans");
+    writer.begin_array();
+
+    for (size_t i = 0; i < SPAN_COUNT; i++) {
+        const Histogram& histogram = histograms[i];
+
+        writer.begin_object();
+        writer.key("name");     writer.string(span_names[i]);
+        writer.key("count");    writer.integer(histogram.count());
+        writer.key("min");      writer.integer(histogram.min());
+        writer.key("p50");      writer.integer(histogram.percentile(0.5));
+        writer.key("p90");      writer.integer(histogram.percentile(0.9));
+        writer.key("p99");      writer.integer(histogram.percentile(0.99));
+        writer.key("p999");     writer.integer(histogram.percentile(0.999));
+        writer.key("max");      writer.integer(histogram.max());
+        writer.end_object();
+    }
+
+    writer.end_array();
+
+    // One array per core with [ticks, id, arg] per event, to keep the dump small
+    writer.key("events");
+    writer.begin_array();
+
+    for (size_t core = 0; core < CORES; core++) {
+        writer.begin_array();
+
+        Ring& ring = rings[core];
+        uint32_t next = ring.next.load(std::memory_order_acquire);
+        size_t count = std::min<size_t>(next, MY_TRACE_EVENTS);
+
+        for (size_t i = 0; i < count; i++) {
+            const Event& event = ring.events[(next - count + i) % MY_TRACE_EVENTS];
+
+            writer.begin_array();
+            writer.integer(event.ticks);
+            writer.integer(event.id);
+            writer.integer(event.arg);
+            writer.end_array();
+        }
+
+        writer.end_array();
+    }
+
+    writer.end_array();
+    writer.end_object();
+}
+
+} // namespace my_trace
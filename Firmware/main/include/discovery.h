@@ -0,0 +1,114 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file discovery.h
+ * @brief Discovery of the plugged sub boards and their controls
+ *
+ * At boot all board addresses are probed once. Each board found is asked for its identity,
+ * which contains a hash of its descriptor (see `bus.h`). Descriptors are cached on the
+ * `var` partition under their hash, so that the full descriptor must only be read when a
+ * board is seen for the first time or when its controls have been changed. Thus the boot
+ * time barely grows with the number of boards.
+ *
+ * During operation a board that has been plugged in announces itself with an attention
+ * message. Additionally one address is probed per call of `loop()`, so that removed boards
+ * are noticed, too. Only one board is enumerated per call, so that the other boards can
+ * be serviced in between.
+ *
+ * Boards with CV/gate slots are given a higher priority on the system bus, so that their
+ * gate edges are not held up by boards with knobs and faders.
+ */
+
+#pragma once
+
+#include "bus.h"            // my_bus::SlotDescriptor
+#include "system_bus.h"     // my_system_bus::SystemBus
+
+#include <cstdint>          // uint8_t, uint32_t
+#include <string>           // std::string
+#include <vector>           // std::vector
+
+namespace my_discovery {
+
+#ifndef MY_DISCOVERY_INTERVAL_MS
+#define MY_DISCOVERY_INTERVAL_MS 50 ///< Time between two hot-plug probes
+#endif
+
+#ifndef MY_DISCOVERY_CV_GATE_PRIORITY
+#define MY_DISCOVERY_CV_GATE_PRIORITY 1 ///< Bus priority of boards with CV/gate slots
+#endif
+
+/**
+ * Enumerated sub board
+ */
+struct Board {
+    bool present = false;                       ///< Board is plugged in
+    uint32_t hash = 0;                          ///< Descriptor hash
+    std::vector<my_bus::SlotDescriptor> slots;  ///< Descriptor
+};
+
+/**
+ * Keeps track of the plugged sub boards.
+ */
+class Discovery {
+public:
+    /**
+     * @param[in] bus System bus
+     * @param[in] cache Directory of the cached descriptors
+     */
+    Discovery(my_system_bus::SystemBus& bus, std::string cache = "/var/boards") noexcept;
+
+    /**
+     * Probe all addresses and enumerate the boards found. Called once at boot.
+     */
+    void scan() noexcept;
+
+    /**
+     * Enumerate boards that announced themselves and probe the next address, if the
+     * probe interval has passed. Must be called from the task that services the bus.
+     *
+     * @param[in] now_ms Current time in milliseconds
+     */
+    void loop(uint32_t now_ms) noexcept;
+
+    /**
+     * @param[in] board Board number
+     * @returns Board state
+     */
+    const Board& board(uint8_t board) const noexcept { return boards[board]; }
+
+    /**
+     * Take the boards that have been plugged, removed or changed since the last call.
+     *
+     * @returns Bit mask of the board numbers
+     */
+    uint32_t take_changed() noexcept {
+        uint32_t result = changed;
+        changed = 0;
+        return result;
+    }
+
+private:
+    bool enumerate(uint8_t board) noexcept;
+    void remove(uint8_t board) noexcept;
+    bool load(uint32_t hash, std::vector<my_bus::SlotDescriptor>& slots) noexcept;
+    void store(uint32_t hash, const std::vector<my_bus::SlotDescriptor>& slots) noexcept;
+    std::string filename(uint32_t hash) const;
+
+    my_system_bus::SystemBus& bus;              ///< System bus
+    std::string cache;                          ///< Cache directory
+    Board boards[MY_BUS_MAX_BOARDS];            ///< State of all boards
+    uint32_t waiting;                           ///< Boards waiting for enumeration
+    uint32_t changed;                           ///< Boards changed since the last `take_changed()`
+    uint32_t last_probe_ms;                     ///< Time of the last hot-plug probe
+    uint8_t next_probe;                         ///< Next board address to probe
+};
+
+} // namespace my_discovery
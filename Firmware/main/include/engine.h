@@ -0,0 +1,209 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file engine.h
+ * @brief State of all control inputs with takeover of external values
+ *
+ * Every input has two values: The physical position reported by the sub board and the
+ * logical value that is sent to the outside world. Usually both are the same. But when a
+ * value is received from outside (all message types have a `receive` flag), the logical
+ * value changes while a knob without motor stays where it is. What happens when the knob
+ * is moved the next time depends on the takeover mode of the input:
+ *
+ * - `jump`: The value jumps to the knob position right away.
+ * - `pickup`: The value stays until the knob passes it, then follows the knob.
+ * - `scale`: The value moves into the same direction as the knob, proportionally faster
+ *   or slower, until both meet at one end of the value range or at the value itself.
+ *
+ * Received values that equal a value we just sent are echoes of our own messages (many DAWs
+ * send them back) and are ignored, so that they cannot start a feedback loop. As the echo
+ * may arrive after the knob has moved on, the last few sent values of every input are
+ * remembered, not only the newest one.
+ *
+ * All values, positions and value ranges are normalized: The control task scales the raw
+ * readings of the sub boards to 0…1 before they reach the store, and received values must
+ * be scaled the same way. `from` and `to` are thus fractions of the full range of the input,
+ * e.g. 0.25…0.75 to use only its middle half.
+ *
+ * The state is kept as a structure of arrays over all inputs of all controls, so that the
+ * control task can process large batches of updates with very few cache misses.
+ *
+ * Inputs that change together, like the axes of a joystick, can be moved as one vector
+ * update. The result then contains all changed logical values of the control at once, so
+ * that they can be handed to the outputs in a single step.
+ */
+
+#pragma once
+
+#include "control.h"        // my_control::InputRef, my_control::INPUT_COUNT
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint32_t
+#include <vector>           // std::vector
+
+namespace my_engine {
+
+/**
+ * Takeover mode for received values
+ */
+enum class Takeover : uint8_t {
+    jump,                           ///< Jump to the physical position on the next move
+    pickup,                         ///< Follow the physical position once it passes the value
+    scale,                          ///< Move proportionally until both values meet
+};
+
+/**
+ * Index of an input in the state store, see `InputStore::index()`
+ */
+typedef uint32_t input_t;
+
+/**
+ * Value update for a single input
+ */
+struct Update {
+    input_t input;                  ///< Input index
+    float value;                    ///< New value
+};
+
+/**
+ * Value update for several inputs of the same control
+ */
+struct VectorUpdate {
+    uint16_t control;               ///< Index of the control in the configuration
+    uint8_t changed;                ///< Bit mask of the changed inputs (bit 0 = input a)
+    float values[my_control::INPUT_COUNT]; ///< New values, only those in `changed` are valid
+};
+
+#ifndef MY_ENGINE_ECHO_US
+#define MY_ENGINE_ECHO_US 250000    ///< Time during which a received value may be the echo of a sent value
+#endif
+
+#ifndef MY_ENGINE_ECHO_VALUES
+#define MY_ENGINE_ECHO_VALUES 4     ///< Number of recently sent values per input checked for echoes
+#endif
+
+/**
+ * Structure of arrays with the state of all inputs of all controls.
+ */
+class InputStore {
+public:
+    /**
+     * Allocate the state for the given number of controls. All inputs are reset to jump
+     * mode with the full value range 0…1.
+     *
+     * @param[in] controls Number of controls in the configuration
+     */
+    void resize(size_t controls);
+
+    /**
+     * Configure a single input from its input parameters.
+     *
+     * @param[in] input Input index
+     * @param[in] mode Takeover mode
+     * @param[in] from Lowest value (0…1)
+     * @param[in] to Highest value (0…1)
+     * @param[in] initial Initial value (0…1)
+     */
+    void configure(input_t input, Takeover mode, float from, float to, float initial) noexcept;
+
+    /**
+     * @param[in] ref Control and input
+     * @returns Input index
+     */
+    static constexpr input_t index(my_control::InputRef ref) noexcept {
+        return ref.control * my_control::INPUT_COUNT + static_cast<input_t>(ref.input);
+    }
+
+    /**
+     * Apply a batch of physical movements reported by the sub boards. The indices of all
+     * inputs whose logical value changed are written to `changed` and must be sent.
+     *
+     * @param[in] updates New physical positions (0…1)
+     * @param[in] count Number of updates
+     * @param[out] changed Indices of changed inputs, room for `count` entries
+     * @param[in] now_us Current time in microseconds, used for echo detection
+     * @returns Number of changed inputs
+     */
+    size_t move(const Update* updates, size_t count, input_t* changed, uint32_t now_us) noexcept;
+
+    /**
+     * Apply a batch of physical movements of several inputs of a control at once. For each
+     * control whose logical values changed, an update with the bit mask of the changed
+     * inputs and all logical values of the control is written to `changed`.
+     *
+     * @param[in] updates New physical positions (0…1)
+     * @param[in] count Number of updates
+     * @param[out] changed Changed controls, room for `count` entries
+     * @param[in] now_us Current time in microseconds, used for echo detection
+     * @returns Number of changed controls
+     */
+    size_t move(const VectorUpdate* updates, size_t count, VectorUpdate* changed, uint32_t now_us) noexcept;
+
+    /**
+     * Apply a batch of values received from outside. Echoes of our own values are ignored.
+     * The indices of all inputs whose logical value changed are written to `changed`, e.g.
+     * to move a motor fader or to forward the value to other destinations.
+     *
+     * @param[in] updates Received values (0…1)
+     * @param[in] count Number of updates
+     * @param[out] changed Indices of changed inputs, room for `count` entries
+     * @param[in] now_us Current time in microseconds, used for echo detection
+     * @returns Number of changed inputs
+     */
+    size_t feedback(const Update* updates, size_t count, input_t* changed, uint32_t now_us) noexcept;
+
+    /**
+     * @param[in] input Input index
+     * @returns Logical value
+     */
+    float value(input_t input) const noexcept { return _value[input]; }
+
+    /**
+     * @param[in] input Input index
+     * @returns Physical position
+     */
+    float position(input_t input) const noexcept { return _position[input]; }
+
+    /**
+     * @param[in] input Input index
+     * @returns true, if a received value has not been taken over by the physical control yet
+     */
+    bool pending(input_t input) const noexcept { return state[input] != State::tracking; }
+
+    /**
+     * @returns Pointer to the logical values of all inputs of the control (`INPUT_COUNT` entries)
+     */
+    const float* values(uint16_t control) const noexcept { return _value.data() + control * my_control::INPUT_COUNT; }
+
+private:
+    bool move(input_t input, float position, uint32_t now_us) noexcept;
+    bool echo(input_t input, float value, float epsilon, uint32_t now_us) const noexcept;
+
+    /**
+     * Takeover state
+     */
+    enum class State : uint8_t {
+        tracking,                   ///< Logical value follows the physical position
+        below,                      ///< Waiting, physical position is below the logical value
+        above,                      ///< Waiting, physical position is above the logical value
+    };
+
+    std::vector<float> _position;   ///< Physical position
+    std::vector<float> _value;      ///< Logical value
+    std::vector<float> sent;        ///< Recent logical values caused by physical moves, `MY_ENGINE_ECHO_VALUES` per input
+    std::vector<uint32_t> sent_us;  ///< Times of the recent physical moves, same layout
+    std::vector<uint8_t> sent_next; ///< Slot for the next sent value of each input
+    std::vector<float> from;        ///< Lowest value
+    std::vector<float> to;          ///< Highest value
+    std::vector<Takeover> mode;     ///< Takeover mode
+    std::vector<State> state;       ///< Takeover state
+};
+
+} // namespace my_engine
@@ -0,0 +1,166 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file http.h
+ * @brief HTTP server for the web configuration portal
+ *
+ * The static files of the web configuration portal are Brotli-compressed at build time
+ * and packed into a single bundle by `Webconfig/bin/deploy.ts`, which is written as-is
+ * to the `static` partition. The bundle uses the IFF format of `file.h`: A `dir ` chunk
+ * with one `Entry` per file, sorted by the hash of its path, a `name` chunk with the
+ * paths and MIME types and one `file` chunk per file with its compressed content.
+ *
+ * Instead of going through a filesystem, the server maps the whole partition into the
+ * address space with `esp_partition_mmap()`. Looking up a request is a binary search
+ * over the directory in memory, and the content is passed straight from the mapped flash
+ * to the socket in parts of `MY_HTTP_CHUNK` bytes, without staging it in RAM. The files are
+ * sent byte for byte with `Content-Encoding: br`, so the ESP never needs to decompress
+ * anything.
+ *
+ * The response header is written directly from the directory with a `Content-Length`
+ * instead of chunked transfer encoding, and conditional requests with a matching
+ * `If-None-Match` are answered with `304 Not Modified` without reading the content.
+ * With `Cache-Control: no-cache` browsers revalidate each file on every load, which costs
+ * one round trip but no data, and never show a stale portal after a firmware update.
+ */
+
+#pragma once
+
+#include <esp_http_server.h> // httpd_handle_t, httpd_req_t
+#include <esp_partition.h>  // esp_partition_mmap_handle_t
+#include <esp_system.h>     // esp_err_t
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, uint32_t
+#include <string>           // std::string
+#include <string_view>      // std::string_view
+
+namespace my_http {
+
+#ifndef MY_HTTP_CHUNK
+#define MY_HTTP_CHUNK 4096          ///< Bytes passed to the socket at once
+#endif
+
+#ifndef MY_HTTP_MAX_SOCKETS
+#define MY_HTTP_MAX_SOCKETS 7       ///< Open connections, browsers use up to six in parallel
+#endif
+
+#ifndef MY_HTTP_MAX_HANDLERS
+#define MY_HTTP_MAX_HANDLERS 16     ///< URI handlers registered on `handle()`, the default is eight
+#endif
+
+/**
+ * Directory entry of the bundle. All offsets count from the start of the bundle.
+ */
+struct Entry {
+    uint32_t hash;                  ///< `my_hash::fnv1a()` of the path
+    uint32_t path;                  ///< Offset of the zero-terminated URI path, e.g. `/index.html`
+    uint32_t type;                  ///< Offset of the zero-terminated MIME type
+    uint32_t offset;                ///< Offset of the compressed content
+    uint32_t size;                  ///< Size of the compressed content
+    uint32_t etag;                  ///< Hash of the compressed content
+};
+
+static_assert(sizeof(Entry) == 24, "Entry must match the bundle written by deploy.ts");
+
+/**
+ * Wrapper around the ESP HTTP server, serving the static files of a bundle.
+ *
+ * Further URI handlers can be registered on `handle()` after the server has been started.
+ * They take precedence over the static files, which are served by the not-found handler,
+ * i.e. only looked up after no other handler matched.
+ */
+class Server {
+public:
+    /**
+     * @param[in] partition Label of the partition with the bundle
+     */
+    Server(std::string partition) noexcept;
+
+    /**
+     * Destructor – automatically stops the server.
+     */
+    ~Server() noexcept;
+
+    /**
+     * Map the bundle and start listening.
+     *
+     * @param[in] port TCP port
+     * @returns Error code
+     */
+    esp_err_t start(uint16_t port = 80) noexcept;
+
+    /**
+     * Stop the server and close all connections.
+     */
+    void stop() noexcept;
+
+    /**
+     * @returns Native server handle, `nullptr` if not started
+     */
+    httpd_handle_t handle() const noexcept { return _handle; }
+
+    /**
+     * @returns Number of files in the bundle
+     */
+    size_t count() const noexcept { return _count; }
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+private:
+    /**
+     * Map the partition and check the chunks of the bundle.
+     */
+    esp_err_t map() noexcept;
+
+    /**
+     * Release the mapping.
+     */
+    void unmap() noexcept;
+
+    /**
+     * @returns Directory entry of the given URI path or `nullptr`
+     */
+    const Entry* find(std::string_view path) const noexcept;
+
+    /**
+     * @returns Zero-terminated string at the given offset of the bundle
+     */
+    const char* string(uint32_t offset) const noexcept {
+        return reinterpret_cast<const char*>(bundle + offset);
+    }
+
+    /**
+     * Static trampoline for the native server, which cannot call a member function.
+     */
+    static esp_err_t _not_found_handler(httpd_req_t* request, httpd_err_code_t error) noexcept;
+
+    /**
+     * Answer a GET request with a static file.
+     */
+    esp_err_t get(httpd_req_t* request) noexcept;
+
+    /**
+     * Send raw bytes, until all have been sent or the connection failed.
+     */
+    static bool send(httpd_req_t* request, const char* data, size_t size) noexcept;
+
+    std::string partition;                                  ///< Partition label
+    httpd_handle_t _handle;                                 ///< Native server handle
+    esp_partition_mmap_handle_t mapping;                    ///< Mapping of the partition
+    const uint8_t* bundle;                                  ///< Start of the bundle, `nullptr` if not mapped
+    size_t bundle_size;                                     ///< Size of the partition
+    const Entry* entries;                                   ///< Directory, sorted by hash
+    size_t _count;                                          ///< Number of directory entries
+    char buffer[256];                                       ///< Header buffer, the server runs a single task
+};
+
+} // namespace my_http
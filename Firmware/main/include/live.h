@@ -0,0 +1,150 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file live.h
+ * @brief Live values of all inputs for the web configuration portal
+ *
+ * The configuration portal shows the current values of the controls and lets the user pick
+ * a control by moving it ("choose control"). Instead of being polled, the values are pushed
+ * over a WebSocket. Each binary message contains a `Header` followed by `Value` entries of
+ * the inputs that changed since the previous message of that client (little endian).
+ *
+ * Messages are sent at most `MY_LIVE_RATE_HZ` times per second, no matter how fast the
+ * controls move, and each client has at most one message in flight. The latest value of
+ * every input is kept in one table, and each client only has a bit per input that marks it
+ * as changed. So a slow client, e.g. a tablet with a weak WiFi connection, simply receives
+ * fewer messages with the latest values, instead of a growing backlog of outdated ones,
+ * and the memory needed per client is fixed. A new client first receives all known values.
+ *
+ * `update()` and `loop()` must be called from the same task, e.g. the main loop. Sending
+ * and receiving happens in the task of the HTTP server.
+ *
+ * This needs `CONFIG_HTTPD_WS_SUPPORT`.
+ */
+
+#pragma once
+
+#include "bus.h"            // MY_BUS_MAX_BOARDS, MY_BUS_MAX_INPUTS
+
+#include <esp_http_server.h> // httpd_handle_t, httpd_req_t, httpd_ws_frame_t
+#include <esp_system.h>     // esp_err_t
+
+#include <atomic>           // std::atomic
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, uint32_t
+
+namespace my_live {
+
+#ifndef MY_LIVE_CLIENTS
+#define MY_LIVE_CLIENTS 4           ///< Maximum number of connected clients
+#endif
+
+#ifndef MY_LIVE_RATE_HZ
+#define MY_LIVE_RATE_HZ 30          ///< Maximum number of messages per second and client
+#endif
+
+#ifndef MY_LIVE_BATCH
+#define MY_LIVE_BATCH 128           ///< Maximum number of values per message
+#endif
+
+constexpr uint8_t VERSION = 1;                                          ///< Message format version
+constexpr size_t VALUES   = MY_BUS_MAX_BOARDS * MY_BUS_MAX_INPUTS;      ///< Number of inputs of all boards
+constexpr size_t WORDS    = (VALUES + 31) / 32;                         ///< Size of a bit set over all inputs
+
+/**
+ * Message header
+ */
+struct __attribute__((packed)) Header {
+    uint8_t version;                ///< Message format version
+    uint8_t reserved;               ///< Always zero
+    uint16_t count;                 ///< Number of values following
+};
+
+/**
+ * Value of one input
+ */
+struct __attribute__((packed)) Value {
+    uint8_t board;                  ///< Board address
+    uint8_t slot;                   ///< Slot on the board
+    uint8_t input;                  ///< Input of the slot (`my_control::Input`)
+    uint8_t reserved;               ///< Always zero
+    float value;                    ///< Current value
+};
+
+/**
+ * WebSocket endpoint pushing the live values
+ */
+class Channel {
+public:
+    Channel() noexcept;
+
+    /**
+     * Register the WebSocket endpoint on a running HTTP server.
+     *
+     * @param[in] server HTTP server handle
+     * @param[in] uri Path of the endpoint
+     * @returns Error code
+     */
+    esp_err_t attach(httpd_handle_t server, const char* uri = "/api/live") noexcept;
+
+    /**
+     * Set the value of an input. Cheap enough to be called for every change.
+     *
+     * @param[in] board Board address
+     * @param[in] slot Slot on the board
+     * @param[in] input Input of the slot
+     * @param[in] value New value
+     */
+    void update(uint8_t board, uint8_t slot, uint8_t input, float value) noexcept;
+
+    /**
+     * Send the changed values to all clients that are ready, at most `MY_LIVE_RATE_HZ`
+     * times per second.
+     *
+     * @param[in] now_ms Current time in milliseconds
+     */
+    void loop(uint32_t now_ms) noexcept;
+
+    /**
+     * @returns Number of connected clients
+     */
+    size_t clients() const noexcept;
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+private:
+    /**
+     * Connected client
+     */
+    struct Client {
+        Channel* channel;                               ///< Owner, for the completion callback
+        std::atomic<int> fd;                            ///< Socket, negative if unused
+        std::atomic<bool> fresh;                        ///< Just connected, needs all known values
+        std::atomic<bool> busy;                         ///< Message in flight
+        uint32_t changed[WORDS];                        ///< Inputs changed since the last message
+        httpd_ws_frame_t frame;                         ///< Message in flight
+        uint8_t buffer[sizeof(Header) + MY_LIVE_BATCH * sizeof(Value)]; ///< Payload of the message in flight
+    };
+
+    static esp_err_t _handler(httpd_req_t* request) noexcept;
+    static void _sent(esp_err_t error, int fd, void* arg) noexcept;
+
+    esp_err_t open(int fd) noexcept;
+    void send(Client& client) noexcept;
+
+    httpd_handle_t server;                              ///< HTTP server handle
+    float values[VALUES];                               ///< Latest value of each input
+    uint32_t known[WORDS];                              ///< Inputs with a value
+    Client _clients[MY_LIVE_CLIENTS];                   ///< Client slots
+    uint32_t sent_ms;                                   ///< Time of the last round of messages
+};
+
+} // namespace my_live
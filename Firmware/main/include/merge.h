@@ -0,0 +1,129 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file merge.h
+ * @brief Merge the input events of all sub boards into one ordered stream
+ *
+ * The system bus reads one board after the other, so a knob turned on one board may be
+ * received after a fader moved slightly later on another board. Since all events carry
+ * a timestamp in local time (see `clock.h`), they are kept in a min-heap for a short
+ * hold-back window and released in the order they happened. The window must be longer
+ * than the time to read all boards that may move at once, but adds directly to the
+ * latency. Therefore events arriving after younger events have already been released
+ * are counted, which shows whether the window is long enough.
+ *
+ * Each event holds all changed inputs of one slot, so that the axes of a joystick or
+ * touchpad are released together.
+ */
+
+#pragma once
+
+#include "control.h"        // my_control::INPUT_COUNT
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint32_t, int32_t
+
+namespace my_merge {
+
+#ifndef MY_MERGE_WINDOW_US
+#define MY_MERGE_WINDOW_US 2000     ///< Hold-back time of each event
+#endif
+
+#ifndef MY_MERGE_CAPACITY
+#define MY_MERGE_CAPACITY 256       ///< Maximum number of events held back
+#endif
+
+/**
+ * Changed inputs of a slot of a sub board
+ */
+struct Event {
+    uint32_t time_us;               ///< Time of the change in local time
+    uint8_t board;                  ///< Board number
+    uint8_t slot;                   ///< Slot number on that board
+    uint8_t changed;                ///< Bit mask of the changed inputs (bit 0 = input a)
+    int32_t values[my_control::INPUT_COUNT]; ///< Raw values of all inputs of the slot
+};
+
+/**
+ * Statistics to measure the timing quality
+ */
+struct Statistics {
+    uint32_t late;                  ///< Events older than an already released event
+    uint32_t dropped;               ///< Events dropped because the heap was full
+    uint32_t max_latency_us;        ///< Highest delay between an event and its arrival
+};
+
+/**
+ * Orders events by their timestamps. Events with the same timestamp keep their order.
+ */
+class Merge {
+public:
+    /**
+     * Add a received event.
+     *
+     * @param[in] event Received event
+     * @param[in] now_us Current time
+     * @returns false, if the event has been dropped
+     */
+    bool push(const Event& event, uint32_t now_us) noexcept;
+
+    /**
+     * Take the oldest event, if its hold-back time has passed.
+     *
+     * @param[in] now_us Current time
+     * @param[out] event Oldest event
+     * @returns false, if no event is due
+     */
+    bool pop(uint32_t now_us, Event& event) noexcept;
+
+    /**
+     * @returns Number of held back events
+     */
+    size_t size() const noexcept { return _size; }
+
+    /**
+     * Take the statistics collected since the last call.
+     */
+    Statistics take_statistics() noexcept {
+        Statistics result = statistics;
+        statistics = {};
+        return result;
+    }
+
+    /**
+     * Static trampoline for `my_system_bus::SystemBus::service()`, with the merge as
+     * context pointer.
+     */
+    static void handler(void* context, uint8_t board, uint8_t slot, uint8_t changed, const int32_t* values, uint32_t time_us) noexcept;
+
+private:
+    /**
+     * Heap entry
+     */
+    struct Entry {
+        Event event;                ///< Held back event
+        uint32_t order;             ///< Arrival counter
+    };
+
+    static bool before(const Entry& a, const Entry& b) noexcept {
+        int32_t diff = static_cast<int32_t>(a.event.time_us - b.event.time_us);
+        if (diff) return diff < 0;
+        return static_cast<int32_t>(a.order - b.order) < 0;
+    }
+
+    Entry heap[MY_MERGE_CAPACITY] = {};         ///< Binary heap
+    size_t _size = 0;                           ///< Number of held back events
+    uint32_t order = 0;                         ///< Next arrival counter
+    uint32_t released_us = 0;                   ///< Time of the last released event
+    bool released = false;                      ///< At least one event has been released
+    Statistics statistics = {};                 ///< Statistics since the last `take_statistics()`
+};
+
+} // namespace my_merge
@@ -0,0 +1,218 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file osc.h
+ * @brief Parsing and dispatching of received OSC messages
+ *
+ * Controls that have `receive` enabled in one of their OSC messages must follow the
+ * values sent by the OSC server, e.g. a DAW moving a motor fader. Because a DAW might
+ * send thousands of messages per second (especially when loading a project), looking
+ * at each configured control for each received message is not an option. Instead all
+ * configured addresses (including the server prefix) are compiled into a hash table
+ * when the configuration is loaded, so that a message can be dispatched with a single
+ * pass over its address.
+ *
+ * OSC address patterns (`*`, `?`, `[…]`, `{…}`) are supported in both directions but
+ * take the slow path: Received patterns are matched against all configured addresses
+ * and configured patterns are matched against all received addresses that were not
+ * found in the hash table.
+ */
+
+#pragma once
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, uint32_t, int32_t
+#include <string>           // std::string
+#include <string_view>      // std::string_view
+#include <vector>           // std::vector
+
+namespace my_osc {
+
+/**
+ * Received OSC message. The message does not own any data but points into the
+ * receive buffer, so it is only valid as long as the buffer is not reused.
+ */
+struct Message {
+    std::string_view address;       ///< Address pattern
+    std::string_view types;         ///< Type tags without the leading comma
+    const uint8_t* arguments;       ///< First argument byte
+    size_t arguments_size;          ///< Number of argument bytes
+
+    /**
+     * Parse a single OSC message (not a bundle) from the given buffer.
+     *
+     * @param[in] data Message bytes
+     * @param[in] size Number of bytes
+     * @param[out] message Parsed message
+     * @returns false, if the message is malformed
+     */
+    static bool parse(const uint8_t* data, size_t size, Message& message) noexcept;
+};
+
+/**
+ * Single decoded OSC argument. Only the member matching the type tag is valid.
+ */
+struct Argument {
+    char type;                      ///< Type tag
+    int32_t int32;                  ///< Value for `i`
+    float float32;                  ///< Value for `f`
+    std::string_view string;        ///< Value for `s` and `S`
+    const uint8_t* blob;            ///< Value for `b`
+    size_t blob_size;               ///< Length of the blob
+};
+
+/**
+ * Sequential reader for the arguments of a message.
+ */
+class ArgumentReader {
+public:
+    /**
+     * @param[in] message Message whose arguments shall be read
+     */
+    ArgumentReader(const Message& message) noexcept;
+
+    /**
+     * Read the next argument. Returns false, when all arguments have been read or the
+     * argument data is truncated. Unknown argument types also end the iteration,
+     * because their size cannot be known.
+     *
+     * @param[out] argument Decoded argument
+     * @returns true, if an argument could be read
+     */
+    bool next(Argument& argument) noexcept;
+
+private:
+    const Message& message;         ///< Message being read
+    size_t type_index;              ///< Index of the next type tag
+    size_t offset;                  ///< Offset of the next argument
+};
+
+/**
+ * Check whether an OSC address matches an OSC address pattern. This implements the
+ * matching rules of the OSC 1.0 specification.
+ *
+ * @param[in] pattern Address pattern with `*`, `?`, `[…]` and `{…}`
+ * @param[in] address Plain address without any pattern characters
+ * @returns true, if the address matches the pattern
+ */
+bool pattern_match(std::string_view pattern, std::string_view address) noexcept;
+
+/**
+ * @param[in] address OSC address
+ * @returns true, if the address contains pattern characters
+ */
+bool is_pattern(std::string_view address) noexcept;
+
+/**
+ * Target of a received OSC message.
+ */
+struct Route {
+    uint16_t server;                ///< Index of the OSC server in the configuration
+    uint16_t control;               ///< Index of the control in the configuration
+    uint16_t entry;                 ///< Index of the OSC message in the control's configuration
+};
+
+/**
+ * Callback for dispatched messages. Called once for each matching route.
+ */
+using Handler = void (*)(void* context, const Route& route, const Message& message) noexcept;
+
+#ifndef MY_OSC_BUNDLE_DEPTH
+#define MY_OSC_BUNDLE_DEPTH 4       ///< Maximum depth of nested bundles
+#endif
+
+/**
+ * Compiled lookup table from OSC addresses to the controls listening on them.
+ *
+ * The table is built once when the configuration is loaded by calling `add()` for each
+ * OSC message with `receive` enabled and then `compile()`. Afterwards `dispatch()` can
+ * be called for each received packet without any further memory allocation. Several
+ * controls may listen on the same address, in which case the handler is called for
+ * each of them.
+ */
+class Dispatcher {
+public:
+    /**
+     * Add a route. The server prefix and the address are simply concatenated, just like
+     * they are when sending a message.
+     *
+     * @param[in] prefix Address prefix of the OSC server
+     * @param[in] address Address of the control's OSC message
+     * @param[in] route Route to dispatch matching messages to
+     */
+    void add(std::string_view prefix, std::string_view address, Route route);
+
+    /**
+     * Build the lookup table from all added routes. Must be called before dispatching
+     * and again after routes have been added.
+     */
+    void compile();
+
+    /**
+     * Remove all routes, e.g. before the configuration is reloaded.
+     */
+    void clear() noexcept;
+
+    /**
+     * Dispatch a received OSC packet, which may either be a single message or a bundle.
+     * Bundle time tags are ignored and all messages are dispatched immediately.
+     *
+     * @param[in] data Packet bytes
+     * @param[in] size Number of bytes
+     * @param[in] handler Callback for each matching route
+     * @param[in] context Context pointer passed to the handler
+     * @returns Number of routes the packet was dispatched to
+     */
+    size_t dispatch(const uint8_t* data, size_t size, Handler handler, void* context) const noexcept;
+
+    /**
+     * Dispatch an already parsed message.
+     *
+     * @param[in] message Received message
+     * @param[in] handler Callback for each matching route
+     * @param[in] context Context pointer passed to the handler
+     * @returns Number of routes the message was dispatched to
+     */
+    size_t dispatch(const Message& message, Handler handler, void* context) const noexcept;
+
+private:
+    /**
+     * Compiled address. All routes of the same address are stored next to each other.
+     */
+    struct Key {
+        uint32_t hash;              ///< Hash value of the address
+        uint32_t offset;            ///< Offset of the address in `strings`
+        uint16_t length;            ///< Length of the address
+        uint16_t first_route;       ///< Index of the first route in `routes`
+        uint16_t route_count;       ///< Number of routes
+    };
+
+    /**
+     * Route added but not yet compiled.
+     */
+    struct Pending {
+        std::string address;        ///< Prefix and address
+        Route route;                ///< Target
+    };
+
+    size_t dispatch_packet(const uint8_t* data, size_t size, Handler handler, void* context, size_t depth) const noexcept;
+    size_t dispatch_key(const Key& key, const Message& message, Handler handler, void* context) const noexcept;
+    std::string_view key_address(const Key& key) const noexcept;
+
+    std::vector<Pending> pending;   ///< Routes added since the last compilation
+    std::string strings;            ///< All compiled addresses back to back
+    std::vector<Key> keys;          ///< Compiled addresses without patterns
+    std::vector<Key> patterns;      ///< Compiled addresses with patterns
+    std::vector<Route> routes;      ///< Routes sorted by address
+    std::vector<uint16_t> table;    ///< Hash table with `keys` index + 1 or zero for empty slots
+    uint32_t mask = 0;              ///< Hash table size - 1
+};
+
+} // namespace my_osc
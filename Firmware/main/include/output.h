@@ -0,0 +1,260 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file output.h
+ * @brief Rate limited output of control values to all destinations
+ *
+ * Each control can send its values to several destinations: the MIDI connectors, USB,
+ * one or more OSC and MQTT servers and the serial port. These have vastly different
+ * bandwidth. A classic MIDI cable transfers about 3000 bytes per second, while a UDP
+ * connection to an OSC server can easily handle a hundred times more. A fast fader sweep
+ * produces far more values than the slow links can transfer, and simply queuing all of
+ * them would deliver the last value hundreds of milliseconds late.
+ *
+ * Therefore outgoing values are not queued but written into a slot for each combination
+ * of control and destination, overwriting the previous value. Each destination is flushed
+ * at its own rate and limited by a token bucket, so that only the newest value of each
+ * control is sent, once the link has capacity for it. As the size of a message is only
+ * known after it has been formatted, a message may take more bytes than the bucket holds.
+ * The balance then becomes negative and the debt is repaid by the next refills, before
+ * anything else is sent.
+ *
+ * The slot holds all inputs of the control and the sender formats all of its messages in
+ * one call. When the axes of a joystick or touchpad are updated together as a vector,
+ * they are never split across two flushes: A diagonal move becomes one OSC message with
+ * an argument per axis, one MQTT payload with all axes or a burst of paired MIDI CCs,
+ * instead of one message per axis in different ticks.
+ *
+ * The same slots bridge network outages: While the WiFi is down, the OSC and MQTT
+ * destinations are suspended and their slots just keep the newest values, so that memory
+ * is bounded by the number of routes, not by the length of the outage. When the network
+ * is back, `resume()` queues every input that ever had a value, so that the DAW is brought
+ * back in sync with the physical controls in one burst, without waiting for each knob to
+ * be touched again.
+ */
+
+#pragma once
+
+#include "control.h"        // my_control::Input, my_control::INPUT_COUNT
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, uint32_t, int64_t
+#include <vector>           // std::vector
+
+namespace my_output {
+
+/**
+ * Send callback of a destination. Must format and send all configured messages of the
+ * given control. Returns the number of bytes sent, which are taken from the destination's
+ * token bucket, or zero if the link cannot take any data right now. In that case the
+ * values remain pending and flushing this destination stops until the next tick.
+ *
+ * @param[in] context Context pointer given when adding the destination
+ * @param[in] control Index of the control in the configuration
+ * @param[in] changed Bit mask of the changed inputs (bit 0 = input a)
+ * @param[in] values Newest values of all inputs
+ */
+using Sender = size_t (*)(void* context, uint16_t control, uint8_t changed, const float* values) noexcept;
+
+/**
+ * Bandwidth budget of a destination
+ */
+struct Limits {
+    uint32_t interval_us;           ///< Minimum time between two flushes
+    uint32_t bytes_per_second;      ///< Sustained data rate
+    uint32_t burst_bytes;           ///< Maximum bytes sent at once after an idle phase
+};
+
+/**
+ * Typical limits for a DIN MIDI connection (31.25 kBaud, 10 bits per byte).
+ */
+constexpr Limits MIDI_LIMITS = {
+    .interval_us      = 1000,
+    .bytes_per_second = 3125,
+    .burst_bytes      = 64,
+};
+
+/**
+ * Typical limits for a network connection, where mainly the packet rate matters.
+ */
+constexpr Limits NETWORK_LIMITS = {
+    .interval_us      = 5000,
+    .bytes_per_second = 64000,
+    .burst_bytes      = 1400,
+};
+
+/**
+ * Handle of a destination
+ */
+typedef uint8_t destination_t;
+
+/**
+ * Bit mask of all inputs of a control
+ */
+constexpr uint8_t ALL_INPUTS = (1 << my_control::INPUT_COUNT) - 1;
+
+/**
+ * Central output scheduler. Destinations and routes are added when the configuration is
+ * loaded, followed by `compile()`. Afterwards the control engine calls `update()` for each
+ * changed value and the output task calls `tick()` regularly (ideally at least once per
+ * millisecond). Neither call allocates memory.
+ */
+class Scheduler {
+public:
+    /**
+     * Add a destination.
+     *
+     * @param[in] limits Bandwidth budget
+     * @param[in] sender Send callback
+     * @param[in] context Context pointer for the send callback
+     * @param[in] network Destination is reached over WiFi, see `online()`
+     * @returns Destination handle
+     */
+    destination_t add_destination(Limits limits, Sender sender, void* context, bool network = false);
+
+    /**
+     * Let a control send its values to a destination. Only changes of the given inputs
+     * are queued, so that the sender is never called for values it has no message for.
+     * Adding the same route twice merges the inputs.
+     *
+     * @param[in] control Index of the control in the configuration
+     * @param[in] destination Destination handle
+     * @param[in] inputs Bit mask of the inputs sent to the destination
+     */
+    void add_route(uint16_t control, destination_t destination, uint8_t inputs = ALL_INPUTS);
+
+    /**
+     * Build the slot tables from all added routes. Pending values are discarded.
+     */
+    void compile();
+
+    /**
+     * Remove all destinations and routes, e.g. before the configuration is reloaded.
+     */
+    void clear() noexcept;
+
+    /**
+     * Record a new input value for all destinations of the control. Values not yet
+     * sent are simply overwritten.
+     *
+     * @param[in] control Index of the control in the configuration
+     * @param[in] input Changed input
+     * @param[in] value New value
+     */
+    void update(uint16_t control, my_control::Input input, float value) noexcept;
+
+    /**
+     * Record new values of several inputs of a control at once, e.g. all axes of a
+     * joystick, so that they are sent together.
+     *
+     * @param[in] control Index of the control in the configuration
+     * @param[in] changed Bit mask of the changed inputs (bit 0 = input a)
+     * @param[in] values New values of all inputs, only those in `changed` are used
+     */
+    void update(uint16_t control, uint8_t changed, const float* values) noexcept;
+
+    /**
+     * Flush all destinations that are due and have enough tokens left.
+     *
+     * @param[in] now_us Current time in microseconds (may wrap around)
+     */
+    void tick(uint32_t now_us) noexcept;
+
+    /**
+     * @param[in] destination Destination handle
+     * @returns Number of controls with values not yet sent to the destination
+     */
+    size_t pending(destination_t destination) const noexcept;
+
+    /**
+     * @returns Number of controls with values not yet sent, over all destinations
+     */
+    size_t pending() const noexcept;
+
+    /**
+     * Stop flushing a destination, e.g. while the network is down. New values are still
+     * recorded, overwriting the older ones.
+     *
+     * @param[in] destination Destination handle
+     */
+    void suspend(destination_t destination) noexcept;
+
+    /**
+     * Flush a destination again. With `resync` all inputs of all controls that ever had a
+     * value are sent again, not only the ones changed in the meantime, as the receiver
+     * might have missed values or been restarted during the outage. The token bucket is
+     * refilled, so that the snapshot is sent in one burst.
+     *
+     * @param[in] destination Destination handle
+     * @param[in] resync Send all known values again
+     */
+    void resume(destination_t destination, bool resync = true) noexcept;
+
+    /**
+     * Suspend all network destinations when the network goes down, and resume them with
+     * a full resync when it is back. Calling it with `true` while already online resyncs
+     * again, e.g. after a reconnect too short to be noticed as offline.
+     *
+     * @param[in] online Network is up
+     */
+    void online(bool online) noexcept;
+
+private:
+    /**
+     * Newest values of a control for one destination
+     */
+    struct Slot {
+        uint16_t control;                                   ///< Index of the control
+        destination_t destination;                          ///< Destination handle
+        uint8_t inputs;                                     ///< Bit mask of inputs sent to the destination
+        uint8_t changed;                                    ///< Bit mask of inputs not yet sent
+        uint8_t known;                                      ///< Bit mask of inputs that ever had a value
+        bool queued;                                        ///< Slot is in the destination's queue
+        float values[my_control::INPUT_COUNT];              ///< Newest values of all inputs
+    };
+
+    /**
+     * Destination with its token bucket and queue of changed slots
+     */
+    struct Destination {
+        Limits limits;                                      ///< Bandwidth budget
+        Sender sender;                                      ///< Send callback
+        void* context;                                      ///< Context pointer for the callback
+        uint32_t first_slot;                                ///< Index of the first slot in `slots`
+        uint32_t slot_count;                                ///< Number of slots
+        uint32_t last_flush_us;                             ///< Time of the last flush
+        int64_t tokens;                                     ///< Available bytes times one million, negative while in debt
+        uint32_t queue_head;                                ///< Next queue entry to be sent
+        uint32_t queue_size;                                ///< Number of queued slots
+        bool suspended;                                     ///< Not flushed, e.g. while offline
+        bool network;                                       ///< Suspended while offline
+    };
+
+    /**
+     * Route added but not yet compiled
+     */
+    struct Route {
+        uint16_t control;                                   ///< Index of the control
+        destination_t destination;                          ///< Destination handle
+        uint8_t inputs;                                     ///< Bit mask of inputs sent to the destination
+    };
+
+    void enqueue(uint32_t slot_index) noexcept;
+    bool flush(Destination& destination) noexcept;
+
+    std::vector<Destination> destinations;                  ///< All destinations
+    std::vector<Route> pending_routes;                      ///< Routes added since the last compilation
+    std::vector<Slot> slots;                                ///< Slots grouped by destination
+    std::vector<uint32_t> queue;                            ///< Ring buffers of changed slot indices, same layout as `slots`
+    std::vector<uint32_t> control_first;                    ///< First entry in `control_slots` for each control (plus end marker)
+    std::vector<uint32_t> control_slots;                    ///< Slot indices grouped by control
+};
+
+} // namespace my_output
@@ -0,0 +1,120 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file settings.h
+ * @brief Import and export of all settings as one JSON document
+ *
+ * The web configuration portal exports all settings as one JSON document and imports them
+ * again (`/api/function/export` and `/api/function/import`). On the device the document is
+ * kept as it is in a file on the `var` partition, and both directions are streamed with
+ * `my_json`, so that the size of the configuration is only limited by the flash.
+ *
+ * An import is validated while it is parsed, with the same checks as the mock server in
+ * `Webconfig/server/routes/api/function/import.ts`: Enumerations must have one of their
+ * known values, boards and slots must be integers, and the OSC and MQTT messages of the
+ * controls must refer to existing servers. The rules are kept in a table of paths, like
+ * `controls[].midi[].message`, where `[]` stands for any array index. As the document is
+ * never held in memory, the servers must come before the controls, as in every export.
+ * The document is written to a temporary file while it is parsed, which replaces the
+ * settings with a single rename only after the whole document has been accepted.
+ *
+ * `attach()` registers both endpoints on the HTTP server. The request body is handed to the
+ * importer as it arrives from the socket, and the export is sent in chunks straight from
+ * the file.
+ *
+ * `test/test_settings` runs the importer on the host and shows that its memory use does not
+ * grow with the size of the document.
+ */
+
+#pragma once
+
+#include "json.h"           // my_json::…
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint32_t
+#include <string>           // std::string
+#include <string_view>      // std::string_view
+
+#if defined(ESP_PLATFORM)
+#include <esp_err.h>        // esp_err_t
+#include <esp_http_server.h> // httpd_handle_t
+#endif
+
+namespace my_settings {
+
+#ifndef MY_SETTINGS_MAX_SERVERS
+#define MY_SETTINGS_MAX_SERVERS 16  ///< Maximum number of OSC and of MQTT servers
+#endif
+
+/**
+ * Streaming import of the settings
+ */
+class Importer {
+public:
+    /**
+     * @param[in] filename Settings file, e.g. `/var/settings.json`
+     */
+    Importer(std::string filename) noexcept;
+
+    /**
+     * Parse, validate and save a new settings document. The old settings are kept,
+     * if the document is not accepted.
+     *
+     * @param[in] source Function providing the document, e.g. from the request body
+     * @param[in] context Context pointer passed to the source
+     * @returns false, if the document was not accepted, see `error()`
+     */
+    bool run(my_json::Source source, void* context) noexcept;
+
+    /**
+     * @returns Reason why the document was not accepted, e.g.
+     *          `Invalid value for key 'wifi.mode'`
+     */
+    const std::string& error() const noexcept { return _error; }
+
+private:
+    bool check_value(my_json::Parser& parser, my_json::Token token) noexcept;
+    bool check_object(my_json::Parser& parser) noexcept;
+    bool fail(const char* message, std::string_view path, const char* suffix = "") noexcept;
+
+    std::string filename;                                   ///< Settings file
+    std::string _error;                                     ///< Reason of the last failure
+    size_t osc_servers[MY_SETTINGS_MAX_SERVERS];            ///< Hashes of the OSC server ids
+    size_t osc_server_count;                                ///< Number of OSC servers
+    size_t mqtt_servers[MY_SETTINGS_MAX_SERVERS];           ///< Hashes of the MQTT server ids
+    size_t mqtt_server_count;                               ///< Number of MQTT servers
+    uint32_t seen[MY_JSON_DEPTH];                           ///< Rules matched by the keys of each open object
+};
+
+/**
+ * Send the saved settings as they are, e.g. as response to an export request.
+ *
+ * @param[in] filename Settings file
+ * @param[in] sink Function receiving the document
+ * @param[in] context Context pointer passed to the sink
+ * @returns false, if the file cannot be read or the sink failed
+ */
+bool send(const std::string& filename, my_json::Sink sink, void* context) noexcept;
+
+#if defined(ESP_PLATFORM)
+/**
+ * Serve the import and export of the settings. A successful import is answered with the
+ * saved document, a rejected one with status 400 and the reason, like the mock server.
+ *
+ * @param[in] server HTTP server handle
+ * @param[in] filename Settings file, must stay valid
+ * @param[in] import_uri Path of the import (POST)
+ * @param[in] export_uri Path of the export (GET)
+ * @returns Error code
+ */
+esp_err_t attach(httpd_handle_t server, const char* filename = "/var/settings.json", const char* import_uri = "/api/function/import", const char* export_uri = "/api/function/export") noexcept;
+#endif
+
+} // namespace my_settings
@@ -0,0 +1,274 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file system_bus.h
+ * @brief Event-driven communication with the sub boards
+ *
+ * The sub boards are never polled. Instead they send a one-byte attention message to the
+ * main board when their inputs have changed (see `bus.h`). Both I2C controllers of the
+ * ESP32 are connected to the system bus: One as slave, that receives the attention messages
+ * in its interrupt handler, and one as master, that reads the input reports. As a pin of
+ * the GPIO matrix can only carry the output of one peripheral, each controller has its own
+ * pair of pins, and both pairs are wired to the same SDA and SCL lines. Boards asking
+ * for attention are put into a priority queue, so that boards with time-critical controls
+ * can be serviced first, while boards with the same priority are serviced in the order of
+ * their requests. This keeps the bus silent while nothing moves and makes the latency
+ * independent of the number of boards.
+ *
+ * Additionally one board after the other receives a time request every `MY_SYSTEM_BUS_SYNC_MS`
+ * to estimate its clock offset, so that the timestamps of its input reports can be converted
+ * into the local time of the main board. The same offset converts the time of output
+ * events for CV/gate slots into the time of the sub board, so that they take effect at
+ * the intended moment, regardless of when the frame arrives.
+ */
+
+#pragma once
+
+#include "bus.h"            // my_bus::…
+#include "clock.h"          // my_clock::Estimator
+
+#include <atomic>           // std::atomic
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, uint32_t
+
+#include <driver/i2c_master.h>  // i2c_master_bus_handle_t, i2c_master_dev_handle_t
+#include <driver/i2c_slave.h>   // i2c_slave_dev_handle_t
+#include <esp_err.h>            // esp_err_t
+#include <freertos/FreeRTOS.h>  // TickType_t
+#include <freertos/task.h>      // TaskHandle_t
+
+namespace my_system_bus {
+
+#ifndef MY_SYSTEM_BUS_SDA
+#define MY_SYSTEM_BUS_SDA 21        ///< GPIO of the I2C data line
+#endif
+
+#ifndef MY_SYSTEM_BUS_SCL
+#define MY_SYSTEM_BUS_SCL 22        ///< GPIO of the I2C clock line
+#endif
+
+#ifndef MY_SYSTEM_BUS_ATTENTION_SDA
+#define MY_SYSTEM_BUS_ATTENTION_SDA 32  ///< GPIO of the attention slave, wired to the I2C data line
+#endif
+
+#ifndef MY_SYSTEM_BUS_ATTENTION_SCL
+#define MY_SYSTEM_BUS_ATTENTION_SCL 33  ///< GPIO of the attention slave, wired to the I2C clock line
+#endif
+
+#ifndef MY_SYSTEM_BUS_SPEED
+#define MY_SYSTEM_BUS_SPEED 400000  ///< I2C clock frequency in Hz
+#endif
+
+#ifndef MY_SYSTEM_BUS_SYNC_MS
+#define MY_SYSTEM_BUS_SYNC_MS 100   ///< Time between two time requests (to different boards)
+#endif
+
+static_assert(MY_SYSTEM_BUS_ATTENTION_SDA != MY_SYSTEM_BUS_SDA && MY_SYSTEM_BUS_ATTENTION_SDA != MY_SYSTEM_BUS_SCL
+           && MY_SYSTEM_BUS_ATTENTION_SCL != MY_SYSTEM_BUS_SDA && MY_SYSTEM_BUS_ATTENTION_SCL != MY_SYSTEM_BUS_SCL,
+              "Master and slave must not share a pin");
+static_assert(MY_BUS_MAX_BOARDS <= 32, "Pending boards are tracked in a 32-bit mask");
+
+/**
+ * Priority queue of the boards waiting to be serviced. Each board can only be queued once.
+ * Higher priorities are serviced first, equal priorities in the order of their arrival.
+ */
+class Queue {
+public:
+    /**
+     * Set the priority of a board. Takes effect the next time the board is queued.
+     *
+     * @param[in] board Board number
+     * @param[in] priority Priority, higher values are serviced first
+     */
+    void set_priority(uint8_t board, uint8_t priority) noexcept {
+        if (board < MY_BUS_MAX_BOARDS) priorities[board] = priority;
+    }
+
+    /**
+     * Queue a board, unless it is already waiting.
+     *
+     * @param[in] board Board number
+     */
+    void push(uint8_t board) noexcept;
+
+    /**
+     * Take the next board from the queue.
+     *
+     * @param[out] board Board number
+     * @returns false, if the queue is empty
+     */
+    bool pop(uint8_t& board) noexcept;
+
+    /**
+     * @returns true, if no board is waiting
+     */
+    bool empty() const noexcept { return size == 0; }
+
+private:
+    /**
+     * Heap entry
+     */
+    struct Entry {
+        uint8_t priority;           ///< Priority of the board when it was queued
+        uint8_t board;              ///< Board number
+        uint16_t order;             ///< Arrival counter
+    };
+
+    bool before(const Entry& a, const Entry& b) const noexcept {
+        if (a.priority != b.priority) return a.priority > b.priority;
+        return static_cast<int16_t>(a.order - b.order) < 0;
+    }
+
+    Entry heap[MY_BUS_MAX_BOARDS] = {};         ///< Binary heap
+    uint8_t priorities[MY_BUS_MAX_BOARDS] = {}; ///< Priority of each board
+    uint32_t queued = 0;                        ///< Bit mask of the queued boards
+    uint8_t size = 0;                           ///< Number of queued boards
+    uint16_t order = 0;                         ///< Next arrival counter
+};
+
+/**
+ * Singleton with the I2C connection to the sub boards.
+ */
+class SystemBus : public my_bus::Link {
+public:
+    /**
+     * Get singleton instance.
+     */
+    static SystemBus& instance() noexcept;
+
+    /**
+     * Install the I2C drivers.
+     *
+     * @returns ESP-IDF error code
+     */
+    esp_err_t open() noexcept;
+
+    /**
+     * Wait for attention messages and read the input reports of the waiting boards. Must
+     * always be called from the same task, as this task will be woken by the interrupt
+     * handler. Only one board is read per call, so that boards with a higher priority
+     * can overtake the ones already waiting. When a time request is due, it is sent
+     * instead. The timestamps passed to the handler are already in local time. Until the
+     * clock offset of a board is known, its reports are stamped with the receive time.
+     *
+     * @param[in] timeout Maximum time to wait if no board is waiting
+     * @param[in] handler Callback for changed input values
+     * @param[in] context Context pointer for the callback
+     */
+    void service(TickType_t timeout, my_bus::Handler handler, void* context) noexcept;
+
+    /**
+     * Send a request frame without payload and read the response.
+     *
+     * @param[in] board Board number
+     * @param[in] type Request type
+     * @param[out] header Response header
+     * @param[out] payload Response payload, valid until the next call
+     * @returns false, if no valid response has been received
+     */
+    bool request(uint8_t board, my_bus::Type type, my_bus::Header& header, const uint8_t*& payload) noexcept override;
+
+    /**
+     * Send a frame to all sub boards at once (general call).
+     *
+     * @param[in] type Frame type
+     * @param[in] payload Frame payload
+     * @param[in] length Payload length, at most `MY_BUS_CHUNK` minus header and checksum
+     * @returns false, if no board has acknowledged the frame
+     */
+    bool broadcast(my_bus::Type type, const void* payload, uint16_t length) noexcept override;
+
+    /**
+     * Send output events to a board. Their time is given in local time and converted into
+     * the time of the board. Until the clock offset of the board is known, the events take
+     * effect on arrival. Outputs should be scheduled at least one frame transfer ahead.
+     *
+     * @param[in] board Board number
+     * @param[in] events Output events with local timestamps
+     * @param[in] count Number of events
+     * @returns false, if a frame has not been acknowledged
+     */
+    bool schedule(uint8_t board, const my_bus::OutputEvent* events, size_t count) noexcept;
+
+    /**
+     * Exchange timestamps with a board to update its clock offset.
+     *
+     * @param[in] board Board number
+     * @returns false, if no valid response has been received
+     */
+    bool sync(uint8_t board) noexcept;
+
+    /**
+     * @param[in] board Board number
+     * @returns Clock offset estimate of the board, e.g. to check its jitter
+     */
+    const my_clock::Estimator& clock(uint8_t board) const noexcept { return clocks[board]; }
+
+    /**
+     * Check whether a board answers to its address.
+     *
+     * @param[in] board Board number
+     * @returns true, if the board is plugged in
+     */
+    bool probe(uint8_t board) noexcept;
+
+    /**
+     * Mark a board as enumerated, so that its input reports are read. Otherwise its
+     * attention messages are only collected for `take_unknown()`.
+     *
+     * @param[in] board Board number
+     * @param[in] present Board has been enumerated
+     */
+    void set_present(uint8_t board, bool present) noexcept;
+
+    /**
+     * Take the boards that asked for attention without having been enumerated.
+     *
+     * @returns Bit mask of the board numbers
+     */
+    uint32_t take_unknown() noexcept { return unknown.exchange(0, std::memory_order_relaxed); }
+
+    /**
+     * @returns Priority queue, e.g. to set the board priorities
+     */
+    Queue& queue() noexcept { return _queue; }
+
+    SystemBus(const SystemBus&) = delete;
+    SystemBus& operator=(const SystemBus&) = delete;
+
+private:
+    SystemBus() noexcept;
+
+    static bool on_receive(i2c_slave_dev_handle_t slave, const i2c_slave_rx_done_event_data_t* event, void* context);
+
+    i2c_master_dev_handle_t device(uint8_t board) noexcept;
+    my_bus::Result receive(uint8_t board, my_bus::Header& header, const uint8_t*& payload) noexcept;
+    bool read(uint8_t board, my_bus::Handler handler, void* context) noexcept;
+    bool send(uint8_t board, my_bus::Type type) noexcept;
+    bool transmit(i2c_master_dev_handle_t dev, uint8_t board, my_bus::Type type, const void* payload, uint16_t length, uint8_t flags = 0) noexcept;
+
+    i2c_master_bus_handle_t master;                         ///< I2C master
+    i2c_slave_dev_handle_t slave;                           ///< I2C slave for attention messages
+    i2c_master_dev_handle_t devices[MY_BUS_MAX_BOARDS];     ///< Device handles, created on first use
+    i2c_master_dev_handle_t everyone;                       ///< Device handle of the general call address
+    TaskHandle_t task;                                      ///< Task calling `service()`
+    std::atomic<uint32_t> pending;                          ///< Boards that asked for attention
+    std::atomic<uint32_t> unknown;                          ///< Boards that asked for attention before enumeration
+    uint32_t present;                                       ///< Enumerated boards
+    Queue _queue;                                           ///< Boards waiting to be serviced
+    my_bus::Decoder decoders[MY_BUS_MAX_BOARDS];            ///< Decoder of each board
+    my_clock::Estimator clocks[MY_BUS_MAX_BOARDS];          ///< Clock offset of each board
+    uint32_t last_sync_us;                                  ///< Time of the last time request
+    uint8_t next_sync;                                      ///< Board of the last time request
+    uint16_t sequence;                                      ///< Sequence number of sent frames
+    uint8_t buffer[my_bus::MAX_FRAME];                      ///< Receive buffer
+};
+
+} // namespace my_system_bus
@@ -0,0 +1,174 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file tasks.h
+ * @brief Task layout of the main board and its load and latency counters
+ *
+ * The ESP32 has two cores. The WiFi driver, lwIP and the HTTP server run on the protocol
+ * core (PRO_CPU, core 0), where bursts of network traffic cause unpredictable delays.
+ * Therefore the real-time work, reading the sub boards and running the control engine,
+ * gets its own task with a high priority on the application core (APP_CPU, core 1), that
+ * nothing else may preempt except interrupts. The main loop of `app_main()` stays on the
+ * application core, too, but with the lowest priority, for housekeeping like pushing the
+ * live values to the web portal. `main.cpp` starts both.
+ *
+ * The tasks never share data under a lock. Values cross the cores through
+ * `my_spsc::Queue` (one per direction) or through atomic flags and counters.
+ *
+ * Each task counts its CPU time (FreeRTOS run-time statistics) and a histogram of the
+ * latencies it records, e.g. from the timestamp of an input report until the control
+ * engine has handled it. `attach()` makes both readable as JSON, together with the spans
+ * and trace events of `my_trace`, so that the effect of network traffic on the input
+ * handling can be seen on the device itself.
+ */
+
+#pragma once
+
+#include <esp_err.h>            // esp_err_t
+#include <esp_http_server.h>    // httpd_handle_t, httpd_req_t
+#include <freertos/FreeRTOS.h>  // BaseType_t, UBaseType_t
+#include <freertos/task.h>      // TaskHandle_t
+
+#include <atomic>           // std::atomic
+#include <cstddef>          // size_t
+#include <cstdint>          // uint32_t, uint64_t
+
+namespace my_tasks {
+
+#ifndef MY_TASKS_CONTROL_CORE
+#define MY_TASKS_CONTROL_CORE 1         ///< Core of the real-time control task (APP_CPU)
+#endif
+
+#ifndef MY_TASKS_CONTROL_PRIORITY
+#define MY_TASKS_CONTROL_PRIORITY 20    ///< Priority of the control task
+#endif
+
+#ifndef MY_TASKS_CONTROL_STACK
+#define MY_TASKS_CONTROL_STACK 4096     ///< Stack size of the control task
+#endif
+
+#ifndef MY_TASKS_NETWORK_CORE
+#define MY_TASKS_NETWORK_CORE 0         ///< Core of the network tasks and the HTTP server (PRO_CPU)
+#endif
+
+#ifndef MY_TASKS_NETWORK_PRIORITY
+#define MY_TASKS_NETWORK_PRIORITY 5     ///< Priority of the network tasks, below WiFi and lwIP
+#endif
+
+#ifndef MY_TASKS_NETWORK_STACK
+#define MY_TASKS_NETWORK_STACK 6144     ///< Stack size of the network tasks
+#endif
+
+#ifndef MY_TASKS_MAX
+#define MY_TASKS_MAX 8                  ///< Maximum number of registered tasks
+#endif
+
+#ifndef MY_TASKS_BUCKETS
+#define MY_TASKS_BUCKETS 16             ///< Number of latency histogram buckets
+#endif
+
+/**
+ * Function run by a task. Usually an endless loop, the task is deleted when it returns.
+ */
+using Function = void (*)(void* context) noexcept;
+
+/**
+ * Latency histogram with powers of two. Bucket 0 counts latencies below 1 µs, bucket `i`
+ * latencies from 2^(i-1) µs to below 2^i µs and the last bucket all longer ones.
+ */
+struct Histogram {
+    uint32_t counts[MY_TASKS_BUCKETS];  ///< Number of latencies per bucket
+    uint32_t max_us;                    ///< Longest latency
+};
+
+/**
+ * FreeRTOS task with load and latency counters
+ */
+class Task {
+public:
+    /**
+     * @param[in] name Task name, must stay valid
+     * @param[in] core Core to pin the task to
+     * @param[in] priority Task priority
+     * @param[in] stack Stack size in bytes
+     */
+    Task(const char* name, BaseType_t core, UBaseType_t priority, uint32_t stack) noexcept;
+
+    /**
+     * Create the task and register it for `attach()`.
+     *
+     * @param[in] function Function run by the task
+     * @param[in] context Context pointer passed to the function
+     * @returns Error code
+     */
+    esp_err_t start(Function function, void* context) noexcept;
+
+    /**
+     * Register the calling task instead of creating a new one, e.g. for the main loop.
+     *
+     * @returns Error code
+     */
+    esp_err_t adopt() noexcept;
+
+    /**
+     * Count a latency. Must only be called by the task itself, but is cheap enough to be
+     * called for each event.
+     *
+     * @param[in] latency_us Latency in microseconds
+     */
+    void record(uint32_t latency_us) noexcept;
+
+    /**
+     * @returns Latencies recorded so far
+     */
+    Histogram histogram() const noexcept;
+
+    /**
+     * @returns Share of the CPU time of its core since the previous call in percent
+     */
+    float load() noexcept;
+
+    const char* name() const noexcept { return _name; }
+    BaseType_t core() const noexcept { return _core; }
+    UBaseType_t priority() const noexcept { return _priority; }
+    TaskHandle_t handle() const noexcept { return _handle; }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+private:
+    static void _run(void* arg) noexcept;
+    esp_err_t add() noexcept;
+
+    const char* _name;                                  ///< Task name
+    BaseType_t _core;                                   ///< Core of the task
+    UBaseType_t _priority;                              ///< Task priority
+    uint32_t stack;                                     ///< Stack size in bytes
+    TaskHandle_t _handle;                               ///< FreeRTOS task handle
+    Function function;                                  ///< Function run by the task
+    void* context;                                      ///< Context pointer for the function
+    std::atomic<uint32_t> counts[MY_TASKS_BUCKETS];     ///< Latency histogram
+    std::atomic<uint32_t> max_us;                       ///< Longest latency
+    uint64_t last_runtime;                              ///< Run-time counter at the previous `load()`
+    uint64_t last_time_us;                              ///< Time of the previous `load()`
+};
+
+/**
+ * Serve the counters of all registered tasks and the dump of `my_trace` as JSON. A POST
+ * request to the trace endpoint resets the trace.
+ *
+ * @param[in] server HTTP server handle
+ * @param[in] tasks_uri Path of the task counters
+ * @param[in] trace_uri Path of the trace dump
+ * @returns Error code
+ */
+esp_err_t attach(httpd_handle_t server, const char* tasks_uri = "/api/function/tasks", const char* trace_uri = "/api/function/trace") noexcept;
+
+} // namespace my_tasks
@@ -0,0 +1,193 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file update.h
+ * @brief Firmware update of all sub boards at once
+ *
+ * The sub board firmware is stored as a plain binary file on the `var` partition. When an
+ * update is started, its size and CRC-32 are announced to all boards, followed by the
+ * chunks of the first window, all sent with the general call address (see `bus.h`). Then
+ * each board is asked which chunks it has received, and the union of the missing chunks
+ * is sent again, until all boards have written the window to flash. As every chunk reaches
+ * all boards with the same transfer, the update takes about as long for one board as for
+ * a full rack. Only the status requests grow with the number of boards.
+ *
+ * Boards that have already written a window, e.g. because an update has been interrupted
+ * and is now started again, simply ignore its chunks. The window always starts at the
+ * board lagging the most behind.
+ *
+ * The commit frame can get lost like any other frame. Therefore the boards are asked again
+ * after the commit, and the commit is repeated until no board is still receiving. Boards
+ * that do not answer anymore are installing the image and restarting.
+ *
+ * The updater only sees the system bus as a `my_bus::Link`, so that `test/test_update` can
+ * run it against simulated sub boards that lose frames.
+ *
+ * The web portal starts the update through `attach()`. As only the control task may touch
+ * the bus, the HTTP handler merely raises a flag, which the control task takes with
+ * `requested()`. The control task in turn copies the progress with `publish()` into
+ * atomics, which the handler reads for the status.
+ */
+
+#pragma once
+
+#include "bus.h"            // my_bus::…
+
+#include <cstdint>          // uint8_t, uint16_t, uint32_t
+#include <cstdio>           // std::FILE
+#include <string>           // std::string
+
+#if defined(ESP_PLATFORM)
+#include <esp_err.h>        // esp_err_t
+#include <esp_http_server.h> // httpd_handle_t
+#endif
+
+namespace my_update {
+
+#ifndef MY_UPDATE_BURST
+#define MY_UPDATE_BURST 16          ///< Chunks sent per call of `loop()`
+#endif
+
+#ifndef MY_UPDATE_SETTLE_MS
+#define MY_UPDATE_SETTLE_MS 100     ///< Time for the sub boards to write a window to flash
+#endif
+
+#ifndef MY_UPDATE_RETRIES
+#define MY_UPDATE_RETRIES 5         ///< Unanswered status requests before a board is given up
+#endif
+
+/**
+ * Progress of the update
+ */
+enum class Phase : uint8_t {
+    idle,                           ///< No update running
+    polling,                        ///< Asking the boards for the received chunks
+    sending,                        ///< Sending missing chunks
+    settling,                       ///< Waiting for the boards to write to flash
+    done,                           ///< Image installed on all remaining boards
+    failed,                         ///< All boards have been given up
+};
+
+/**
+ * Sends the sub board firmware to all boards.
+ */
+class Updater {
+public:
+    /**
+     * @param[in] bus System bus, usually `my_system_bus::SystemBus`
+     * @param[in] image Path of the sub board firmware
+     */
+    Updater(my_bus::Link& bus, std::string image = "/var/firmware/sub.bin") noexcept;
+    ~Updater() noexcept;
+
+    Updater(const Updater&) = delete;
+    Updater& operator=(const Updater&) = delete;
+
+    /**
+     * Announce the image to the given boards. Boards that have received a part of the
+     * same image before continue where they have stopped.
+     *
+     * @param[in] boards Bit mask of the board numbers
+     * @param[in] now_ms Current time in milliseconds
+     * @returns false, if the image cannot be read or no board answers
+     */
+    bool start(uint32_t boards, uint32_t now_ms) noexcept;
+
+    /**
+     * Perform the next step of the update. Must be called regularly from the task that
+     * services the bus, until the update is done or failed.
+     *
+     * @param[in] now_ms Current time in milliseconds
+     */
+    void loop(uint32_t now_ms) noexcept;
+
+    /**
+     * @returns Progress of the update
+     */
+    Phase phase() const noexcept { return _phase; }
+
+    /**
+     * @returns true, while `loop()` has work to do
+     */
+    bool running() const noexcept {
+        return _phase == Phase::polling || _phase == Phase::sending || _phase == Phase::settling;
+    }
+
+    /**
+     * @returns Number of chunks received by all boards
+     */
+    uint16_t received() const noexcept { return base; }
+
+    /**
+     * @returns Number of chunks of the image
+     */
+    uint16_t total() const noexcept { return chunks; }
+
+    /**
+     * @returns Bit mask of the boards that have been given up
+     */
+    uint32_t failed() const noexcept { return _failed; }
+
+private:
+    void poll(uint32_t now_ms) noexcept;
+    void send() noexcept;
+    void installed(uint8_t board) noexcept;
+    void give_up(uint8_t board) noexcept;
+    void settle(uint32_t now_ms) noexcept;
+    uint16_t window_chunks() const noexcept;
+
+    my_bus::Link& bus;                          ///< System bus
+    std::string image;                          ///< Path of the firmware image
+    std::FILE* file;                            ///< Open firmware image
+    my_bus::UpdateInfo info;                    ///< Size and checksum of the image
+    uint16_t chunks;                            ///< Number of chunks of the image
+    uint32_t boards;                            ///< Boards receiving the update
+    uint32_t _failed;                           ///< Boards that have been given up
+    uint32_t installing;                        ///< Boards that have received the commit
+    uint8_t retries[MY_BUS_MAX_BOARDS];         ///< Unanswered status requests of each board
+    uint16_t base;                              ///< First chunk of the current window
+    uint16_t next_chunk;                        ///< Next chunk in the window to be checked for sending
+    uint8_t missing[my_bus::UPDATE_WINDOW / 8]; ///< Chunks of the window missing on any board
+    uint32_t settle_ms;                         ///< Start time of the settle phase
+    bool committed;                             ///< Commit frame has been sent
+    Phase _phase;                               ///< Progress of the update
+};
+
+/**
+ * Take the request of the web portal to update all plugged boards. Called by the task
+ * running the updater.
+ *
+ * @returns true once for each request
+ */
+bool requested() noexcept;
+
+/**
+ * Make the progress of the updater readable for the web portal. Called by the task
+ * running the updater after each `loop()`.
+ *
+ * @param[in] updater Updater
+ */
+void publish(const Updater& updater) noexcept;
+
+#if defined(ESP_PLATFORM)
+/**
+ * Serve the update to the web portal. A POST request asks for an update of all plugged
+ * boards and is answered with 202, or with 409 while an update is running. A GET request
+ * returns the progress as `{phase, received, total, failed}`, with the numbers of the
+ * boards given up in `failed`.
+ *
+ * @param[in] server HTTP server handle
+ * @param[in] uri Path of the update
+ * @returns Error code
+ */
+esp_err_t attach(httpd_handle_t server, const char* uri = "/api/function/update") noexcept;
+#endif
+
+} // namespace my_update
@@ -0,0 +1,434 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file wifi.h
+ * @brief Configuration, status and functions for WiFi connectivity
+ *
+ * Scanning for nearby networks takes two to three seconds for all channels. Therefore the
+ * scan runs in the background: `scan()` only starts it, the WiFi driver reports its end with
+ * `WIFI_EVENT_SCAN_DONE`, and the event handler then fetches all records at once into a
+ * preallocated array. `access_points()` returns the records of the last completed scan
+ * together with its time, so that neither the HTTP server nor the main loop ever wait for
+ * the radio, and a scan page that is reloaded shortly after reuses the last result.
+ *
+ * The driver can only scan with the station interface enabled. In access point mode, which
+ * is how the device is first set up, the mode is therefore switched to access point plus
+ * station for the time of the scan and back afterwards. Clients of the access point may
+ * notice a short gap while the radio visits the other channels.
+ *
+ * `attach()` serves the scan as `/api/function/wifi-scan` for the setup page of the web
+ * portal. This is the only place that waits for the radio: The page expects the networks
+ * in the response, so the handler starts a scan (or reuses a recent result) and waits for
+ * it, up to `MY_WIFI_SCAN_TIMEOUT_MS`, like the mock server does.
+ *
+ * On stage the controller shares the network with everything else, while a musician
+ * notices every delayed fader move. The `low_latency` profile therefore keeps the radio
+ * awake (power save lets the access point buffer frames until the next beacon, causing
+ * sporadic delays of 100 ms and more) and enables the roaming assistance of 802.11k/v.
+ * Control sockets should be tagged with `prioritize()` so that the WMM voice or video
+ * queues are used for them, and `Probe` measures the round trip time to the OSC server
+ * to see whether all of this pays off. The WiFi and network tasks run on the protocol
+ * core, the main loop on the application core (see `sdkconfig`).
+ *
+ * Control messages are lost while the station is disconnected, so a short blip of the
+ * access point must not turn into a long gap. The BSSID and channel of the last access
+ * point are kept in `/var/config/wifi-ap`, and the first attempt after a lost connection
+ * (or after booting) connects directly to them, without scanning all channels. Only when
+ * that fails, the station scans again, with exponentially growing and randomly jittered
+ * delays between the attempts, so that an access point is not hammered and several
+ * controllers do not retry in lockstep.
+ *
+ * `online()` and `connections()` can be polled cheaply from any task, e.g. to suspend
+ * the network destinations of `my_output::Scheduler` during an outage and to resume them
+ * with a full resync, once a new IP address has been received.
+ */
+
+#pragma once
+
+#include <esp_event.h>      // esp_event_handler_instance_t
+#include <esp_http_server.h> // httpd_handle_t
+#include <esp_netif.h>      // esp_netif_t
+#include <esp_system.h>     // esp_err_t
+#include <esp_timer.h>      // esp_timer_handle_t
+#include <esp_wifi_types.h> // wifi_ap_record_t
+
+#include <atomic>           // std::atomic
+#include <cstdint>          // int64_t, uint32_t
+#include <mutex>            // std::mutex
+#include <ping/ping_sock.h> // esp_ping_handle_t
+#include <string>           // std::string
+#include <vector>           // std::vector
+
+namespace my_wifi {
+
+#ifndef MY_WIFI_SCAN_MAX
+#define MY_WIFI_SCAN_MAX 32         ///< Maximum number of access points kept from a scan
+#endif
+
+#ifndef MY_WIFI_SCAN_MAX_AGE_MS
+#define MY_WIFI_SCAN_MAX_AGE_MS 10000   ///< Age up to which the scan endpoint reuses the last result
+#endif
+
+#ifndef MY_WIFI_SCAN_TIMEOUT_MS
+#define MY_WIFI_SCAN_TIMEOUT_MS 8000    ///< Time the scan endpoint waits for the result
+#endif
+
+#ifndef MY_WIFI_BACKOFF_MIN_MS
+#define MY_WIFI_BACKOFF_MIN_MS 250  ///< Delay before the first scanning reconnect attempt
+#endif
+
+#ifndef MY_WIFI_BACKOFF_MAX_MS
+#define MY_WIFI_BACKOFF_MAX_MS 30000    ///< Maximum delay between two reconnect attempts
+#endif
+
+#ifndef MY_WIFI_PROBE_INTERVAL_MS
+#define MY_WIFI_PROBE_INTERVAL_MS 1000  ///< Time between two latency probes
+#endif
+
+#ifndef MY_WIFI_SPIKE_MS
+#define MY_WIFI_SPIKE_MS 10         ///< Round trip time counted as spike
+#endif
+
+/**
+ * WiFi mode
+ */
+enum class Mode : uint8_t {
+    disabled,                       ///< WiFi disabled
+    access_point,                   ///< Access point mode – Run a built-in WiFi access point with its own network
+    station,                        ///< Station mode – Connect to a WiFi network nearby
+};
+
+/**
+ * Connection profile
+ */
+enum class Profile : uint8_t {
+    low_latency,                    ///< No power save, roaming assistance – For real-time control
+    power_save,                     ///< Modem sleeps between beacons – Fine for configuration only
+};
+
+/**
+ * Traffic class of a socket, mapped to the WMM access categories
+ */
+enum class Priority : uint8_t {
+    background,                     ///< Bulk transfers, e.g. firmware updates
+    best_effort,                    ///< Everything else
+    video,                          ///< Control values with moderate rates, e.g. MQTT
+    voice,                          ///< Control values that must arrive immediately, e.g. OSC
+};
+
+/**
+ * Connection status
+ */
+enum class State : uint8_t {
+    disconnected,                   ///< Disconnected
+    searching,                      ///< Searching for nearby networks
+    connecting,                     ///< Connecting as station, retrieving IP
+    connected,                      ///< Connected and IP retrieved
+    access_point,                   ///< Serving as access point
+};
+
+struct IPAddress {
+    std::string ip;                 ///< The actual IP address
+    std::string netmask;            ///< Net mask
+    std::string gateway;            ///< Gateway address
+};
+
+/**
+ * WiFi status
+ */
+struct Status {
+    Mode mode;                      ///< Current WiFi mode
+    State state;                    ///< Connection status
+    uint8_t reconnect_count;        ///< Number of failed connection attempts since the last connection
+
+    std::string ssid;               ///< Current station id (access point or station)
+    std::string mac;                ///< MAC address
+    std::string ip4;                ///< IPv4 address
+    std::string netmask;            ///< IPv4 Net mask
+    std::string gateway;            ///< IPv4 Gateway address
+    std::string ip6;                ///< IPv6 address
+};
+
+/**
+ * Authentication required by an access point
+ */
+enum class Security : uint8_t {
+    open,                           ///< No password
+    psk,                            ///< Pre-Shared Key (WPA)
+    enterprise,                     ///< User name and password (EAP)
+};
+
+/**
+ * Nearby access point found during the WiFi scan.
+ */
+struct AccessPoint {
+    std::string ssid;               ///< Station id
+    std::string mac;                ///< MAC address
+    int8_t rssi;                    ///< Signal strength
+    uint8_t channel;                ///< Primary channel
+    Security security;              ///< Authentication
+};
+
+/**
+ * WiFi configuration
+ */
+struct Config {
+    Mode mode;                      ///< WiFi mode
+    Profile profile;                ///< Connection profile
+    std::string ssid;               ///< Station id (access point or station)
+    std::string psk;                ///< Pre-Shared Key (access point or station)
+    std::string username;           ///< User name for EAP
+    std::string password;           ///< Password for EAP
+
+    /**
+     * Read saved WiFi configuration from flash memory or return defaults,
+     * if no configuration has been saved before.
+     *
+     * @returns WiFi configuration
+     */
+    static Config read() noexcept;
+
+    /**
+     * Save current WiFi configuration to flash memory.
+     */
+    void save() noexcept;
+};
+
+/**
+ * Round trip times to a host, measured with ICMP echo requests
+ */
+struct Latency {
+    uint32_t sent;                  ///< Number of requests
+    uint32_t received;              ///< Number of replies
+    uint32_t spikes;                ///< Number of replies slower than `MY_WIFI_SPIKE_MS`
+    uint32_t last_ms;               ///< Last round trip time
+    uint32_t min_ms;                ///< Shortest round trip time
+    uint32_t max_ms;                ///< Longest round trip time
+    uint32_t mean_ms;               ///< Average round trip time
+};
+
+/**
+ * Continuous latency measurement, e.g. to the OSC server. The replies are counted in the
+ * ping task of the ESP-IDF, so that the main loop is not involved.
+ */
+class Probe {
+public:
+    Probe() noexcept;
+    ~Probe() noexcept;
+
+    /**
+     * Start sending a request each `MY_WIFI_PROBE_INTERVAL_MS` and reset the statistics.
+     *
+     * @param[in] host IPv4 address of the host
+     * @returns Error code
+     */
+    esp_err_t start(const std::string& host) noexcept;
+
+    /**
+     * Stop sending requests. The statistics are kept.
+     */
+    void stop() noexcept;
+
+    /**
+     * @returns Current statistics
+     */
+    Latency latency() noexcept;
+
+    Probe(const Probe&) = delete;
+    Probe& operator=(const Probe&) = delete;
+
+private:
+    static void _success(esp_ping_handle_t session, void* arg) noexcept;
+    static void _timeout(esp_ping_handle_t session, void* arg) noexcept;
+
+    esp_ping_handle_t session;                      ///< Ping session
+    std::mutex mutex;                               ///< Guards the statistics
+    Latency _latency;                               ///< Statistics
+    uint64_t total_ms;                              ///< Sum of all round trip times
+};
+
+/**
+ * Set the traffic class of a socket. The WiFi driver derives the WMM access category
+ * from the precedence bits of the IP type of service.
+ *
+ * @param[in] socket Socket
+ * @param[in] priority Traffic class
+ * @returns Error code
+ */
+esp_err_t prioritize(int socket, Priority priority) noexcept;
+
+/**
+ * Serve the nearby networks as JSON array of `{ssid, type, strength}`, with type `open`,
+ * `wpa` or `enterprise` and the strength in dBm. Each SSID is listed once, with its
+ * strongest access point. A POST request scans, unless the last result is younger than
+ * `MY_WIFI_SCAN_MAX_AGE_MS`.
+ *
+ * @param[in] server HTTP server handle
+ * @param[in] uri Path of the endpoint
+ * @returns Error code
+ */
+esp_err_t attach(httpd_handle_t server, const char* uri = "/api/function/wifi-scan") noexcept;
+
+/**
+ * Wrapper around the native ESP WiFi API. A singleton instance of this class initializes
+ * the WiFi stack, configures the ESP as either Access Point or Station, scans the network
+ * for available access points and manages the connection.
+ *
+ * The implementation is deliberately minimal, assuming that most of the time the device
+ * will be connected to a home network (WPA) and only seldom to an enterprise network (EAP).
+ * To be able to initially setup the device, the device can act as a simple access point.
+ * More advanced features might be added in future based on demand.
+ *
+ * NOTE: IPv6 might need more code to actually work.
+ * TODO: For unknown reasons this cannot connect to Fritz! mesh networks.
+ */
+class WiFi {
+public:
+    /**
+     * @returns `WiFi` singleton instance
+     */
+    static WiFi* instance() noexcept;
+
+    /**
+     * Apply the given configuration to make the ESP appear as either an Access Point or
+     * a WiFi station.
+     */
+    esp_err_t connect(Config config) noexcept;
+
+    /**
+     * Start scanning for available access points nearby and return immediately. Note, that
+     * this can only be called after `connect()`, because otherwise the required network
+     * interfaces are not yet initialized. Nothing happens, if a scan is already running or
+     * the last result is not older than `max_age_ms`.
+     *
+     * @param[in] max_age_ms Maximum age of the last result to keep it
+     * @returns Error code
+     */
+    esp_err_t scan(uint32_t max_age_ms = 0) noexcept;
+
+    /**
+     * @returns true, while a scan is running
+     */
+    bool scanning() const noexcept { return _scanning.load(std::memory_order_acquire); }
+
+    /**
+     * Access points found by the last completed scan.
+     *
+     * @param[out] time_us Completion time of the scan (`esp_timer_get_time()`), zero if none
+     * @returns Found access points
+     */
+    std::vector<AccessPoint> access_points(int64_t* time_us = nullptr) noexcept;
+
+    /**
+     * Disable WiFi and uninitialize the WiFi stack.
+     */
+    esp_err_t disconnect() noexcept;
+
+    /**
+     * @returns The last error code
+     */
+    esp_err_t error() noexcept { return _error; }
+
+    /**
+     * @returns Current WiFi status
+     */
+    Status status() noexcept { return _status; }
+
+    /**
+     * @returns true, while the station has an IPv4 address or the access point is running
+     */
+    bool online() const noexcept { return _online.load(std::memory_order_acquire); }
+
+    /**
+     * @returns Number of times the device went online, to notice a reconnect even if
+     *          the time offline was too short to be seen
+     */
+    uint32_t connections() const noexcept { return _connections.load(std::memory_order_acquire); }
+
+private:
+    /**
+     * Constructor.
+     */
+    WiFi() noexcept;
+
+    /**
+     * Static trampoline function because we cannot get a C-style function pointer
+     * on the `event_handler` member function in C++.
+     */
+    static void _event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) noexcept;
+
+    /**
+     * WiFi event handler responding to WiFi connection changes. Updates the WiFi status.
+     */
+    void wifi_event_handler(int32_t event_id, void* event_data) noexcept;
+
+    /**
+     * Timer callback to try reconnecting as a station.
+     */
+    static void sta_reconnect_timer_cb(void* arg) noexcept;
+
+    /**
+     * Connect directly to the last access point or scan all channels.
+     *
+     * @param[in] direct Use the cached BSSID and channel
+     */
+    void sta_reconnect(bool direct) noexcept;
+
+    /**
+     * Try to reconnect after a random delay growing with `reconnect_count`.
+     */
+    void sta_schedule_reconnect() noexcept;
+
+    /**
+     * Read the last access point, if it belongs to the configured SSID.
+     */
+    void sta_load_access_point() noexcept;
+
+    /**
+     * Remember the access point of a new connection.
+     */
+    void sta_save_access_point(const uint8_t* bssid, uint8_t channel) noexcept;
+
+    /**
+     * IP event handler responding to IP address changes. Updates the WiFi status.
+     */
+    void ip_event_handler(int32_t event_id, void* event_data) noexcept;
+
+    /**
+     * Fetch the records of a completed scan.
+     */
+    void scan_done(const wifi_event_sta_scan_done_t* event) noexcept;
+
+    /**
+     * Return to access point mode, if the station was only enabled for the scan.
+     */
+    void scan_stop_station() noexcept;
+
+    static WiFi* _instance;                         ///< Singleton instance
+    Status _status;                                 ///< Current WiFi status
+    esp_netif_t* interface;                         ///< Network interface
+    esp_err_t _error;                               ///< Last error code
+    esp_event_handler_instance_t eh_wifi_event;     ///< WiFi event handler instance
+    esp_event_handler_instance_t eh_ip_event;       ///< IP event handler instance
+    esp_timer_handle_t reconnect_timer;             ///< Timer for delayed reconnect attempts
+    bool ap_cached;                                 ///< BSSID and channel of the last access point known
+    uint8_t ap_bssid[6];                            ///< BSSID of the last access point
+    uint8_t ap_channel;                             ///< Channel of the last access point
+    std::atomic<bool> _online;                      ///< IPv4 address assigned or access point running
+    std::atomic<uint32_t> _connections;             ///< Number of times the device went online
+    std::atomic<bool> _scanning;                    ///< Scan running
+    bool scan_station;                              ///< Station interface enabled only for the scan
+    std::mutex scan_mutex;                          ///< Guards the scan result
+    wifi_ap_record_t records[MY_WIFI_SCAN_MAX];     ///< Records of the last scan
+    uint16_t record_count;                          ///< Number of records of the last scan
+    int64_t scan_time_us;                           ///< Completion time of the last scan
+};
+
+} // namespace my_wifi
\ No newline at end of file
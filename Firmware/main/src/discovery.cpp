@@ -0,0 +1,157 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "discovery.h"
+#include "file.h"           // my_file::IFF_Reader, my_file::IFF_Writer
+#include "hash.h"           // my_hash::fnv1a
+
+#include <cstdio>           // std::snprintf
+#include <cstring>          // std::memcpy
+#include <esp_log.h>        // ESP_LOG…
+#include <sys/stat.h>       // mkdir
+
+namespace my_discovery {
+
+constexpr char const* TAG = "discovery";
+constexpr my_file::FourCC DESCRIPTOR = "DESC";
+
+///////////////////////////
+///// class Discovery /////
+///////////////////////////
+
+Discovery::Discovery(my_system_bus::SystemBus& bus, std::string cache) noexcept
+    : bus(bus),
+      cache(cache),
+      boards{},
+      waiting(0),
+      changed(0),
+      last_probe_ms(0),
+      next_probe(0)
+{
+}
+
+void Discovery::scan() noexcept {
+    mkdir(cache.c_str(), 0775);
+
+    for (uint8_t board = 0; board < MY_BUS_MAX_BOARDS; board++) {
+        if (!bus.probe(board)) continue;
+        if (!enumerate(board)) remove(board);
+    }
+}
+
+void Discovery::loop(uint32_t now_ms) noexcept {
+    waiting |= bus.take_unknown();
+
+    if (waiting) {
+        uint8_t board = static_cast<uint8_t>(__builtin_ctz(waiting));
+        waiting &= ~(1u << board);
+
+        if (!enumerate(board)) remove(board);
+        return;
+    }
+
+    if (now_ms - last_probe_ms < MY_DISCOVERY_INTERVAL_MS) return;
+    last_probe_ms = now_ms;
+
+    uint8_t board = next_probe;
+    next_probe = (next_probe + 1) % MY_BUS_MAX_BOARDS;
+
+    bool found = bus.probe(board);
+
+    if (found && !boards[board].present) {
+        waiting |= 1u << board;
+    } else if (!found && boards[board].present) {
+        remove(board);
+    }
+}
+
+bool Discovery::enumerate(uint8_t board) noexcept {
+    my_bus::Header header;
+    const uint8_t* payload;
+
+    if (!bus.request(board, my_bus::Type::identify, header, payload)) return false;
+    if (header.type != my_bus::Type::identity || header.length < sizeof(my_bus::Identity)) return false;
+
+    my_bus::Identity identity;
+    std::memcpy(&identity, payload, sizeof(identity));
+
+    Board& state = boards[board];
+
+    if (!state.present || state.hash != identity.hash) {
+        std::vector<my_bus::SlotDescriptor> slots;
+
+        if (!load(identity.hash, slots)) {
+            if (!bus.request(board, my_bus::Type::describe, header, payload)) return false;
+            if (header.type != my_bus::Type::descriptor || header.length % sizeof(my_bus::SlotDescriptor)) return false;
+            if (my_hash::fnv1a(payload, header.length) != identity.hash) return false;
+
+            slots.resize(header.length / sizeof(my_bus::SlotDescriptor));
+            std::memcpy(slots.data(), payload, header.length);
+            store(identity.hash, slots);
+
+            ESP_LOGI(TAG, "Board %u enumerated with %u slots", board, static_cast<unsigned>(slots.size()));
+        }
+
+        state.present = true;
+        state.hash    = identity.hash;
+        state.slots   = std::move(slots);
+        changed |= 1u << board;
+
+        uint8_t priority = 0;
+
+        for (const auto& slot : state.slots) {
+            if (slot.type == my_control::ControlType::cv_gate) priority = MY_DISCOVERY_CV_GATE_PRIORITY;
+        }
+
+        bus.queue().set_priority(board, priority);
+    }
+
+    bus.set_present(board, true);
+    return true;
+}
+
+void Discovery::remove(uint8_t board) noexcept {
+    bus.set_present(board, false);
+
+    Board& state = boards[board];
+    if (!state.present) return;
+
+    ESP_LOGI(TAG, "Board %u removed", board);
+
+    state.present = false;
+    state.hash    = 0;
+    state.slots.clear();
+    changed |= 1u << board;
+}
+
+std::string Discovery::filename(uint32_t hash) const {
+    char name[16];
+    std::snprintf(name, sizeof(name), "/%08lx.iff", static_cast<unsigned long>(hash));
+    return cache + name;
+}
+
+bool Discovery::load(uint32_t hash, std::vector<my_bus::SlotDescriptor>& slots) noexcept {
+    my_file::IFF_Reader reader(filename(hash));
+    my_file::ReadChunk header = reader.peek();
+
+    if (!(header.type == DESCRIPTOR) || !header.size || header.size % sizeof(my_bus::SlotDescriptor)) return false;
+
+    slots.resize(header.size / sizeof(my_bus::SlotDescriptor));
+    reader.chunk(reinterpret_cast<char*>(slots.data()), header.size);
+
+    // Ignore damaged cache entries
+    return my_hash::fnv1a(reinterpret_cast<const uint8_t*>(slots.data()), header.size) == hash;
+}
+
+void Discovery::store(uint32_t hash, const std::vector<my_bus::SlotDescriptor>& slots) noexcept {
+    my_file::IFF_Writer writer(filename(hash));
+    writer.chunk(DESCRIPTOR, reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(my_bus::SlotDescriptor));
+}
+
+} // namespace my_discovery
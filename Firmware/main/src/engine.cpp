@@ -0,0 +1,178 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "engine.h"
+
+#include <cmath>            // std::fabs, NAN
+
+namespace my_engine {
+
+/**
+ * Values closer than this fraction of the value range are considered equal
+ */
+constexpr float EPSILON = 0.001f;
+
+////////////////////////////
+///// class InputStore /////
+////////////////////////////
+
+void InputStore::resize(size_t controls) {
+    size_t size = controls * my_control::INPUT_COUNT;
+
+    _position.assign(size, 0.0f);
+    _value.assign(size, 0.0f);
+    sent.assign(size * MY_ENGINE_ECHO_VALUES, NAN);     // Never equal to a received value
+    sent_us.assign(size * MY_ENGINE_ECHO_VALUES, 0);
+    sent_next.assign(size, 0);
+    from.assign(size, 0.0f);
+    to.assign(size, 1.0f);
+    mode.assign(size, Takeover::jump);
+    state.assign(size, State::tracking);
+}
+
+void InputStore::configure(input_t input, Takeover mode, float from, float to, float initial) noexcept {
+    if (input >= _value.size()) return;
+
+    this->mode[input] = mode;
+    this->from[input] = from;
+    this->to[input]   = to;
+
+    // The physical position is unknown until the first report, so the initial
+    // value is taken over by whatever position comes first.
+    _value[input]    = initial;
+    _position[input] = initial;
+    state[input]     = State::tracking;
+
+    // Forget the echoes of the previous configuration
+    for (size_t k = 0; k < MY_ENGINE_ECHO_VALUES; k++) sent[input * MY_ENGINE_ECHO_VALUES + k] = NAN;
+}
+
+size_t InputStore::move(const Update* updates, size_t count, input_t* changed, uint32_t now_us) noexcept {
+    size_t result = 0;
+
+    for (size_t n = 0; n < count; n++) {
+        input_t i = updates[n].input;
+        if (i >= _value.size()) continue;
+
+        if (move(i, updates[n].value, now_us)) changed[result++] = i;
+    }
+
+    return result;
+}
+
+size_t InputStore::move(const VectorUpdate* updates, size_t count, VectorUpdate* changed, uint32_t now_us) noexcept {
+    size_t result = 0;
+
+    for (size_t n = 0; n < count; n++) {
+        const VectorUpdate& update = updates[n];
+        input_t first = update.control * my_control::INPUT_COUNT;
+        if (first >= _value.size()) continue;
+
+        VectorUpdate& out = changed[result];
+        out.control = update.control;
+        out.changed = 0;
+
+        for (size_t k = 0; k < my_control::INPUT_COUNT; k++) {
+            if (!(update.changed & (1 << k))) continue;
+            if (move(first + k, update.values[k], now_us)) out.changed |= 1 << k;
+        }
+
+        if (!out.changed) continue;
+
+        for (size_t k = 0; k < my_control::INPUT_COUNT; k++) out.values[k] = _value[first + k];
+        result++;
+    }
+
+    return result;
+}
+
+bool InputStore::move(input_t i, float position, uint32_t now_us) noexcept {
+    float previous = _position[i];
+    float value    = _value[i];
+    float epsilon  = std::fabs(to[i] - from[i]) * EPSILON;
+
+    _position[i] = position;
+
+    switch (state[i]) {
+        case State::tracking:
+            value = position;
+            break;
+
+        case State::below:
+        case State::above: {
+            bool crossed = state[i] == State::below ? position >= value - epsilon : position <= value + epsilon;
+
+            if (mode[i] == Takeover::jump || crossed) {
+                // Caught up with the logical value
+                value = position;
+                state[i] = State::tracking;
+            } else if (mode[i] == Takeover::scale) {
+                // Move towards the end of the range in the direction of the movement,
+                // so that both values arrive there at the same time.
+                float delta = position - previous;
+                float end   = delta > 0 ? (to[i] > from[i] ? to[i] : from[i]) : (to[i] > from[i] ? from[i] : to[i]);
+                float room  = end - previous;
+
+                if (std::fabs(room) > epsilon) value += delta * (end - value) / room;
+                if (std::fabs(value - position) <= epsilon) state[i] = State::tracking;
+            }
+
+            // Pickup: Nothing changes until the value has been crossed
+            break;
+        }
+    }
+
+    if (value == _value[i]) return false;
+
+    // Remember the value in the ring of recently sent values
+    size_t slot = i * MY_ENGINE_ECHO_VALUES + sent_next[i];
+    sent_next[i] = (sent_next[i] + 1) % MY_ENGINE_ECHO_VALUES;
+
+    _value[i]     = value;
+    sent[slot]    = value;
+    sent_us[slot] = now_us;
+    return true;
+}
+
+bool InputStore::echo(input_t i, float value, float epsilon, uint32_t now_us) const noexcept {
+    for (size_t slot = i * MY_ENGINE_ECHO_VALUES, end = slot + MY_ENGINE_ECHO_VALUES; slot < end; slot++) {
+        if (now_us - sent_us[slot] < MY_ENGINE_ECHO_US && std::fabs(value - sent[slot]) <= epsilon) return true;
+    }
+
+    return false;
+}
+
+size_t InputStore::feedback(const Update* updates, size_t count, input_t* changed, uint32_t now_us) noexcept {
+    size_t result = 0;
+
+    for (size_t n = 0; n < count; n++) {
+        input_t i = updates[n].input;
+        if (i >= _value.size()) continue;
+
+        float value   = updates[n].value;
+        float epsilon = std::fabs(to[i] - from[i]) * EPSILON;
+
+        // Echo of a value we sent recently
+        if (echo(i, value, epsilon, now_us)) continue;
+        if (std::fabs(value - _value[i]) <= epsilon) continue;
+
+        _value[i] = value;
+        changed[result++] = i;
+
+        if (std::fabs(_position[i] - value) <= epsilon) {
+            state[i] = State::tracking;
+        } else {
+            state[i] = _position[i] < value ? State::below : State::above;
+        }
+    }
+
+    return result;
+}
+
+} // namespace my_engine
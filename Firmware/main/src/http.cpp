@@ -0,0 +1,228 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "http.h"
+#include "hash.h"           // my_hash::fnv1a
+#include "tasks.h"          // MY_TASKS_NETWORK_CORE, MY_TASKS_NETWORK_PRIORITY
+
+#include <algorithm>        // std::lower_bound
+#include <cstdio>           // std::snprintf
+#include <cstring>          // std::memcmp, std::memchr, std::strstr
+#include <esp_log.h>        // ESP_LOG…
+
+namespace my_http {
+
+constexpr char const* TAG = "http";
+
+////////////////////////
+///// class Server /////
+////////////////////////
+
+Server::Server(std::string partition) noexcept
+    : partition(partition),
+      _handle(nullptr),
+      mapping{},
+      bundle(nullptr),
+      bundle_size(0),
+      entries(nullptr),
+      _count(0),
+      buffer{}
+{
+}
+
+Server::~Server() noexcept {
+    stop();
+}
+
+esp_err_t Server::start(uint16_t port) noexcept {
+    stop();
+
+    esp_err_t error = map();
+    if (error != ESP_OK) return error;
+
+    ESP_LOGI(TAG, "Serving %u files from partition %s", static_cast<unsigned>(_count), partition.c_str());
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port             = port;
+    config.max_open_sockets        = MY_HTTP_MAX_SOCKETS;
+    config.lru_purge_enable        = true;
+    config.max_uri_handlers        = MY_HTTP_MAX_HANDLERS;
+    config.core_id                 = MY_TASKS_NETWORK_CORE;
+    config.task_priority           = MY_TASKS_NETWORK_PRIORITY;
+    config.global_user_ctx         = this;
+    config.global_user_ctx_free_fn = [](void*) {};     // Owned by the caller, not by the server
+
+    error = httpd_start(&_handle, &config);
+
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start server: %s", esp_err_to_name(error));
+        _handle = nullptr;
+        unmap();
+        return error;
+    }
+
+    return httpd_register_err_handler(_handle, HTTPD_404_NOT_FOUND, &Server::_not_found_handler);
+}
+
+void Server::stop() noexcept {
+    if (_handle) {
+        httpd_stop(_handle);
+        _handle = nullptr;
+    }
+
+    unmap();
+}
+
+esp_err_t Server::map() noexcept {
+    const esp_partition_t* info = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition.c_str());
+
+    if (!info) {
+        ESP_LOGE(TAG, "Partition %s not found", partition.c_str());
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const void* address;
+    esp_err_t error = esp_partition_mmap(info, 0, info->size, ESP_PARTITION_MMAP_DATA, &address, &mapping);
+
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map partition %s: %s", partition.c_str(), esp_err_to_name(error));
+        return error;
+    }
+
+    bundle      = static_cast<const uint8_t*>(address);
+    bundle_size = info->size;
+
+    // Check everything once, so that requests can trust the directory
+    uint32_t dir_size;
+    std::memcpy(&dir_size, bundle + 4, sizeof(dir_size));
+
+    bool valid = std::memcmp(bundle, "dir ", 4) == 0
+              && dir_size % sizeof(Entry) == 0
+              && dir_size <= bundle_size - 8;
+
+    entries = reinterpret_cast<const Entry*>(bundle + 8);
+    _count  = valid ? dir_size / sizeof(Entry) : 0;
+
+    for (size_t i = 0; valid && i < _count; i++) {
+        const Entry& entry = entries[i];
+
+        valid = entry.path < bundle_size
+             && entry.type < bundle_size
+             && std::memchr(bundle + entry.path, 0, bundle_size - entry.path)
+             && std::memchr(bundle + entry.type, 0, bundle_size - entry.type)
+             && entry.offset <= bundle_size
+             && entry.size <= bundle_size - entry.offset
+             && (i == 0 || entries[i - 1].hash < entry.hash);
+    }
+
+    if (!valid) {
+        ESP_LOGE(TAG, "Partition %s contains no valid bundle", partition.c_str());
+        unmap();
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return ESP_OK;
+}
+
+void Server::unmap() noexcept {
+    if (!bundle) return;
+
+    esp_partition_munmap(mapping);
+    bundle      = nullptr;
+    bundle_size = 0;
+    entries     = nullptr;
+    _count      = 0;
+}
+
+const Entry* Server::find(std::string_view path) const noexcept {
+    uint32_t key = my_hash::fnv1a(path);
+
+    const Entry* entry = std::lower_bound(entries, entries + _count, key, [](const Entry& entry, uint32_t key) {
+        return entry.hash < key;
+    });
+
+    // Paths not in the bundle can still share the hash of a file
+    return entry != entries + _count && entry->hash == key && path == string(entry->path) ? entry : nullptr;
+}
+
+esp_err_t Server::_not_found_handler(httpd_req_t* request, httpd_err_code_t) noexcept {
+    Server* server = reinterpret_cast<Server*>(httpd_get_global_user_ctx(request->handle));
+    return server->get(request);
+}
+
+esp_err_t Server::get(httpd_req_t* request) noexcept {
+    std::string_view path = request->uri;
+    path = path.substr(0, path.find_first_of("?#"));
+    if (path == "/") path = "/index.html";
+
+    const Entry* entry = request->method == HTTP_GET ? find(path) : nullptr;
+
+    if (!entry) {
+        httpd_resp_set_status(request, HTTPD_404);
+        httpd_resp_set_type(request, "text/plain");
+        return httpd_resp_send(request, "Not Found", HTTPD_RESP_USE_STRLEN);
+    }
+
+    char etag[12];
+    std::snprintf(etag, sizeof(etag), "\"%08lx\"", static_cast<unsigned long>(entry->etag));
+
+    // Revalidation of an unchanged file, answered from the directory
+    if (httpd_req_get_hdr_value_str(request, "If-None-Match", buffer, sizeof(buffer)) == ESP_OK
+        && std::strstr(buffer, etag)) {
+        int length = std::snprintf(buffer, sizeof(buffer),
+            "HTTP/1.1 304 Not Modified\r\n"
+            "ETag: %s\r\n"
+            "Cache-Control: no-cache\r\n"
+            "\r\n",
+            etag
+        );
+
+        return send(request, buffer, length) ? ESP_OK : ESP_FAIL;
+    }
+
+    // The header is written by hand, as the native server only knows chunked encoding
+    // for responses sent in parts
+    int length = std::snprintf(buffer, sizeof(buffer),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Encoding: br\r\n"
+        "Content-Length: %lu\r\n"
+        "ETag: %s\r\n"
+        "Cache-Control: no-cache\r\n"
+        "\r\n",
+        string(entry->type),
+        static_cast<unsigned long>(entry->size),
+        etag
+    );
+
+    if (length >= static_cast<int>(sizeof(buffer)) || !send(request, buffer, length)) return ESP_FAIL;
+
+    const char* data = reinterpret_cast<const char*>(bundle + entry->offset);
+
+    for (size_t sent = 0; sent < entry->size; sent += MY_HTTP_CHUNK) {
+        size_t size = entry->size - sent < MY_HTTP_CHUNK ? entry->size - sent : MY_HTTP_CHUNK;
+        if (!send(request, data + sent, size)) return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+bool Server::send(httpd_req_t* request, const char* data, size_t size) noexcept {
+    while (size > 0) {
+        int sent = httpd_send(request, data, size);
+        if (sent <= 0) return false;
+
+        data += sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+} // namespace my_http
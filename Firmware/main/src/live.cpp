@@ -0,0 +1,198 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "live.h"
+
+#include <cstring>          // std::memcpy
+#include <esp_log.h>        // ESP_LOG…
+
+namespace my_live {
+
+constexpr char const* TAG = "live";
+
+/////////////////////////
+///// class Channel /////
+/////////////////////////
+
+Channel::Channel() noexcept
+    : server(nullptr),
+      values{},
+      known{},
+      _clients{},
+      sent_ms(0)
+{
+    for (Client& client : _clients) {
+        client.channel = this;
+        client.fd      = -1;
+        client.fresh   = false;
+        client.busy    = false;
+    }
+}
+
+esp_err_t Channel::attach(httpd_handle_t server, const char* uri) noexcept {
+    this->server = server;
+
+    httpd_uri_t handler = {};
+    handler.uri          = uri;
+    handler.method       = HTTP_GET;
+    handler.handler      = &Channel::_handler;
+    handler.user_ctx     = this;
+    handler.is_websocket = true;
+
+    return httpd_register_uri_handler(server, &handler);
+}
+
+void Channel::update(uint8_t board, uint8_t slot, uint8_t input, float value) noexcept {
+    if (board >= MY_BUS_MAX_BOARDS || slot >= my_bus::MAX_SLOTS || input >= my_control::INPUT_COUNT) return;
+    size_t index = board * MY_BUS_MAX_INPUTS + slot * my_control::INPUT_COUNT + input;
+
+    uint32_t bit = 1u << (index % 32);
+    if ((known[index / 32] & bit) && values[index] == value) return;
+
+    values[index] = value;
+    known[index / 32] |= bit;
+
+    for (Client& client : _clients) {
+        if (client.fd.load(std::memory_order_relaxed) >= 0) client.changed[index / 32] |= bit;
+    }
+}
+
+void Channel::loop(uint32_t now_ms) noexcept {
+    if (!server || now_ms - sent_ms < 1000 / MY_LIVE_RATE_HZ) return;
+    sent_ms = now_ms;
+
+    for (Client& client : _clients) {
+        int fd = client.fd.load(std::memory_order_acquire);
+        if (fd < 0) continue;
+
+        if (httpd_ws_get_fd_info(server, fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+            client.fd.store(-1, std::memory_order_release);
+            continue;
+        }
+
+        // A slow client skips this round, while its changes keep being merged
+        if (client.busy.load(std::memory_order_acquire)) continue;
+
+        if (client.fresh.exchange(false, std::memory_order_acq_rel)) {
+            std::memcpy(client.changed, known, sizeof(known));
+        }
+
+        send(client);
+    }
+}
+
+size_t Channel::clients() const noexcept {
+    size_t count = 0;
+
+    for (const Client& client : _clients) {
+        if (client.fd.load(std::memory_order_relaxed) >= 0) count++;
+    }
+
+    return count;
+}
+
+esp_err_t Channel::_handler(httpd_req_t* request) noexcept {
+    Channel* channel = static_cast<Channel*>(request->user_ctx);
+
+    // Handshake
+    if (request->method == HTTP_GET) return channel->open(httpd_req_to_sockfd(request));
+
+    // Clients have nothing to say, but their messages must still be read
+    uint8_t buffer[64];
+    httpd_ws_frame_t frame = {};
+
+    esp_err_t error = httpd_ws_recv_frame(request, &frame, 0);
+    if (error != ESP_OK) return error;
+    if (frame.len > sizeof(buffer)) return ESP_FAIL;
+
+    frame.payload = buffer;
+    return httpd_ws_recv_frame(request, &frame, sizeof(buffer));
+}
+
+void Channel::_sent(esp_err_t error, int fd, void* arg) noexcept {
+    Client* client = static_cast<Client*>(arg);
+
+    if (error != ESP_OK) {
+        ESP_LOGW(TAG, "Closing client %d: %s", fd, esp_err_to_name(error));
+        httpd_sess_trigger_close(client->channel->server, fd);
+    }
+
+    client->busy.store(false, std::memory_order_release);
+}
+
+esp_err_t Channel::open(int fd) noexcept {
+    Client* free = nullptr;
+
+    for (Client& client : _clients) {
+        int current = client.fd.load(std::memory_order_acquire);
+
+        if (current == fd) {
+            free = &client;     // Socket reused before the old client was noticed to be gone
+            break;
+        }
+
+        if (current < 0 && !free) free = &client;
+    }
+
+    if (!free) {
+        ESP_LOGW(TAG, "Rejecting client %d, too many clients", fd);
+        return ESP_FAIL;
+    }
+
+    // The main loop takes the client once its socket is set
+    free->busy.store(false, std::memory_order_relaxed);
+    free->fresh.store(true, std::memory_order_relaxed);
+    free->fd.store(fd, std::memory_order_release);
+
+    ESP_LOGI(TAG, "Client %d connected", fd);
+    return ESP_OK;
+}
+
+void Channel::send(Client& client) noexcept {
+    Value* entries = reinterpret_cast<Value*>(client.buffer + sizeof(Header));
+    uint16_t count = 0;
+
+    for (size_t word = 0; word < WORDS && count < MY_LIVE_BATCH; word++) {
+        while (client.changed[word] && count < MY_LIVE_BATCH) {
+            size_t bit   = __builtin_ctz(client.changed[word]);
+            size_t index = word * 32 + bit;
+            client.changed[word] &= ~(1u << bit);
+
+            size_t input = index % MY_BUS_MAX_INPUTS;
+
+            Value entry;
+            entry.board    = index / MY_BUS_MAX_INPUTS;
+            entry.slot     = input / my_control::INPUT_COUNT;
+            entry.input    = input % my_control::INPUT_COUNT;
+            entry.reserved = 0;
+            entry.value    = values[index];
+
+            std::memcpy(&entries[count++], &entry, sizeof(entry));
+        }
+    }
+
+    if (!count) return;
+
+    Header header = {VERSION, 0, count};
+    std::memcpy(client.buffer, &header, sizeof(header));
+
+    client.frame         = {};
+    client.frame.final   = true;
+    client.frame.type    = HTTPD_WS_TYPE_BINARY;
+    client.frame.payload = client.buffer;
+    client.frame.len     = sizeof(Header) + count * sizeof(Value);
+
+    client.busy.store(true, std::memory_order_release);
+
+    if (httpd_ws_send_data_async(server, client.fd, &client.frame, &Channel::_sent, &client) != ESP_OK) {
+        client.busy.store(false, std::memory_order_release);
+    }
+}
+
+} // namespace my_live
@@ -1,4 +1,229 @@
-#include <esp_log.h>
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
 
-void app_main() {
-}
\ No newline at end of file
+/**
+ * @file main.cpp
+ * @brief Start-up of the main board
+ *
+ * Brings up the task layout of `tasks.h`: The control task on the application core owns
+ * the system bus. It enumerates the sub boards and merges their input reports into one
+ * ordered stream. The merged changes are scaled to 0…1 and run through the takeover of
+ * `my_engine::InputStore`, whose logical values go to the rate limited outputs of
+ * `my_output::Scheduler`. As long as the settings do not define the controls, each slot
+ * becomes the next free control in the order its first change arrives, and no output
+ * destinations are configured. The network destinations are suspended while the WiFi is
+ * down and resynced when it is back. The logical values are also handed to the main loop
+ * through a `my_spsc::Queue`, which pushes them to the live values of the web portal. The
+ * HTTP server runs on the protocol core. The load and latency of both tasks can then be
+ * read from `/api/function/tasks`, and the settings are imported and exported through
+ * `/api/function/import` and `/api/function/export`, the setup page scans for networks
+ * through `/api/function/wifi-scan`, and `/api/function/update` starts the firmware update
+ * of all plugged sub boards, which the control task runs between the bus services.
+ */
+
+#include "bus.h"            // my_bus::SlotDescriptor
+#include "control.h"        // my_control::INPUT_COUNT
+#include "discovery.h"      // my_discovery::Discovery
+#include "engine.h"         // my_engine::InputStore
+#include "fs.h"             // my_fs::Partition
+#include "http.h"           // my_http::Server
+#include "live.h"           // my_live::Channel
+#include "merge.h"          // my_merge::Merge
+#include "output.h"         // my_output::Scheduler
+#include "settings.h"       // my_settings::attach
+#include "spsc.h"           // my_spsc::Queue
+#include "system_bus.h"     // my_system_bus::SystemBus
+#include "tasks.h"          // my_tasks::…
+#include "update.h"         // my_update::Updater
+#include "wifi.h"           // my_wifi::WiFi
+
+#include <esp_event.h>      // esp_event_loop_create_default
+#include <esp_log.h>        // ESP_LOG…
+#include <esp_timer.h>      // esp_timer_get_time
+#include <nvs_flash.h>      // nvs_flash_init
+
+#include <algorithm>        // std::copy, std::fill
+
+#ifndef MY_MAIN_QUEUE
+#define MY_MAIN_QUEUE 64            ///< Changes handed from the control task to the main loop
+#endif
+
+#ifndef MY_MAIN_CONTROLS
+#define MY_MAIN_CONTROLS 64         ///< Controls in the input store, slots beyond bypass the engine
+#endif
+
+#ifndef MY_MAIN_LOOP_MS
+#define MY_MAIN_LOOP_MS 10          ///< Period of the main loop
+#endif
+
+constexpr char const* TAG = "main";
+constexpr uint16_t NO_CONTROL = UINT16_MAX;     ///< Slot without control index
+
+/**
+ * Changed inputs of a slot, scaled by the ranges of the slot descriptor
+ */
+struct Change {
+    uint8_t board;                              ///< Board number
+    uint8_t slot;                               ///< Slot number on that board
+    uint8_t changed;                            ///< Bit mask of the changed inputs
+    float values[my_control::INPUT_COUNT];      ///< Logical values of all inputs from 0 to 1
+};
+
+static my_tasks::Task control_task("control", MY_TASKS_CONTROL_CORE, MY_TASKS_CONTROL_PRIORITY, MY_TASKS_CONTROL_STACK);
+static my_tasks::Task main_task("main", 0, 0, 0);   // Adopted, the parameters are taken from the running task
+static my_spsc::Queue<Change, MY_MAIN_QUEUE> changes;
+
+/**
+ * Control task: Service the system bus, run the merged changes through the engine and
+ * the outputs and hand them to the main loop.
+ */
+static void control(void*) noexcept {
+    my_system_bus::SystemBus& bus = my_system_bus::SystemBus::instance();
+
+    if (bus.open() != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot open the system bus");
+        return;
+    }
+
+    // Too large for the task stack
+    static my_discovery::Discovery discovery(bus);
+    static my_merge::Merge merge;
+    static my_engine::InputStore inputs;
+    static my_output::Scheduler scheduler;
+    static my_update::Updater updater(bus);
+    static uint16_t controls[MY_BUS_MAX_BOARDS][my_bus::MAX_SLOTS];     // Control index of each slot
+    uint16_t control_count = 0;
+
+    inputs.resize(MY_MAIN_CONTROLS);
+    scheduler.compile();
+    std::fill(&controls[0][0], &controls[0][0] + MY_BUS_MAX_BOARDS * my_bus::MAX_SLOTS, NO_CONTROL);
+
+    // Network destinations wait for the first connection
+    my_wifi::WiFi* wifi = my_wifi::WiFi::instance();
+    bool online = false;
+    uint32_t connections = 0;
+    scheduler.online(false);
+
+    discovery.scan();
+
+    while (true) {
+        // Held back events, pending outputs and a running update are handled on the next tick, otherwise only attention messages wake the task
+        bool busy = merge.size() || scheduler.pending() || updater.running();
+        bus.service(busy ? 1 : pdMS_TO_TICKS(MY_DISCOVERY_INTERVAL_MS), my_merge::Merge::handler, &merge);
+
+        uint32_t now_us = esp_timer_get_time();
+        discovery.loop(now_us / 1000);
+
+        my_merge::Event event;
+
+        while (merge.pop(now_us, event)) {
+            const std::vector<my_bus::SlotDescriptor>& slots = discovery.board(event.board).slots;
+            if (event.slot >= slots.size()) continue;
+
+            uint16_t& control = controls[event.board][event.slot];
+            if (control == NO_CONTROL && control_count < MY_MAIN_CONTROLS) control = control_count++;
+
+            my_engine::VectorUpdate update = {control, event.changed, {}};
+
+            for (size_t i = 0; i < my_control::INPUT_COUNT; i++) {
+                uint16_t range = slots[event.slot].range[i];
+                update.values[i] = range ? static_cast<float>(event.values[i]) / range : 0.0f;
+            }
+
+            Change change = {event.board, event.slot, event.changed, {}};
+            std::copy(update.values, update.values + my_control::INPUT_COUNT, change.values);
+
+            if (control != NO_CONTROL) {
+                // E.g. a knob that has not picked up a received value yet
+                my_engine::VectorUpdate result;
+                if (!inputs.move(&update, 1, &result, now_us)) continue;
+
+                scheduler.update(result.control, result.changed, result.values);
+
+                change.changed = result.changed;
+                std::copy(result.values, result.values + my_control::INPUT_COUNT, change.values);
+            }
+
+            // A full queue only delays the live values, the next change of the input repeats it
+            changes.push(change);
+            control_task.record(now_us - event.time_us);
+        }
+
+        // Keep the newest values while offline and resync everything once back online
+        if (wifi->connections() != connections) {
+            connections = wifi->connections();
+            online = true;
+            scheduler.online(true);
+        } else if (online && !wifi->online()) {
+            online = false;
+            scheduler.online(false);
+        }
+
+        scheduler.tick(now_us);
+
+        // Firmware update of the sub boards requested by the web portal
+        if (my_update::requested()) {
+            uint32_t boards = 0;
+
+            for (uint8_t board = 0; board < MY_BUS_MAX_BOARDS; board++) {
+                if (discovery.board(board).present) boards |= 1u << board;
+            }
+
+            updater.start(boards, now_us / 1000);
+        }
+
+        updater.loop(now_us / 1000);
+        my_update::publish(updater);
+    }
+}
+
+extern "C" void app_main() {
+    esp_err_t error = nvs_flash_init();
+
+    if (error == ESP_ERR_NVS_NO_FREE_PAGES || error == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        nvs_flash_erase();
+        nvs_flash_init();
+    }
+
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    main_task.adopt();
+
+    static my_fs::Partition var = my_fs::Partition::mount({.partition = "var", .base_path = "/var", .readonly = false});
+    if (var.error() != ESP_OK) ESP_LOGE(TAG, "Cannot mount the var partition: %s", esp_err_to_name(var.error()));
+
+    my_wifi::WiFi::instance()->connect(my_wifi::Config::read());
+
+    if (control_task.start(control, nullptr) != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot start the control task");
+    }
+
+    static my_http::Server server("static");
+    static my_live::Channel live;
+
+    if (server.start() == ESP_OK) {
+        my_tasks::attach(server.handle());
+        live.attach(server.handle());
+        my_settings::attach(server.handle());
+        my_wifi::attach(server.handle());
+        my_update::attach(server.handle());
+    }
+
+    while (true) {
+        Change change;
+
+        while (changes.pop(change)) {
+            for (uint8_t input = 0; input < my_control::INPUT_COUNT; input++) {
+                if (change.changed & (1 << input)) live.update(change.board, change.slot, input, change.values[input]);
+            }
+        }
+
+        live.loop(esp_timer_get_time() / 1000);
+        vTaskDelay(pdMS_TO_TICKS(MY_MAIN_LOOP_MS));
+    }
+}
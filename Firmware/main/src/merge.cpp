@@ -0,0 +1,94 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "merge.h"
+#include "trace.h"          // MY_TRACE_POINT, MY_TRACE_RECORD
+
+#include <cstring>          // std::memcpy
+#include <esp_timer.h>      // esp_timer_get_time
+
+namespace my_merge {
+
+///////////////////////
+///// class Merge /////
+///////////////////////
+
+bool Merge::push(const Event& event, uint32_t now_us) noexcept {
+    uint32_t latency = now_us - event.time_us;
+
+    if (static_cast<int32_t>(latency) > 0 && latency > statistics.max_latency_us) {
+        statistics.max_latency_us = latency;
+    }
+
+    if (released && static_cast<int32_t>(event.time_us - released_us) < 0) {
+        statistics.late++;
+    }
+
+    if (_size >= MY_MERGE_CAPACITY) {
+        statistics.dropped++;
+        return false;
+    }
+
+    size_t i = _size++;
+    heap[i] = {event, order++};
+
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!before(heap[i], heap[parent])) break;
+
+        Entry swap = heap[i]; heap[i] = heap[parent]; heap[parent] = swap;
+        i = parent;
+    }
+
+    return true;
+}
+
+bool Merge::pop(uint32_t now_us, Event& event) noexcept {
+    if (!_size) return false;
+    if (static_cast<int32_t>(now_us - heap[0].event.time_us) < MY_MERGE_WINDOW_US) return false;
+
+    event = heap[0].event;
+    heap[0] = heap[--_size];
+
+    if (!released || static_cast<int32_t>(event.time_us - released_us) > 0) {
+        released    = true;
+        released_us = event.time_us;
+    }
+
+    size_t i = 0;
+
+    while (true) {
+        size_t left  = 2 * i + 1;
+        size_t right = left + 1;
+        size_t first = i;
+
+        if (left  < _size && before(heap[left],  heap[first])) first = left;
+        if (right < _size && before(heap[right], heap[first])) first = right;
+        if (first == i) break;
+
+        Entry swap = heap[i]; heap[i] = heap[first]; heap[first] = swap;
+        i = first;
+    }
+
+    return true;
+}
+
+void Merge::handler(void* context, uint8_t board, uint8_t slot, uint8_t changed, const int32_t* values, uint32_t time_us) noexcept {
+    Merge* self = static_cast<Merge*>(context);
+    uint32_t now_us = static_cast<uint32_t>(esp_timer_get_time());
+
+    MY_TRACE_POINT(my_trace::Point::merge, board << 8 | slot);
+    MY_TRACE_RECORD(my_trace::Span::input_to_merge, now_us - time_us);
+
+    Event event = {time_us, board, slot, changed, {}};
+    std::memcpy(event.values, values, sizeof(event.values));
+    self->push(event, now_us);
+}
+
+} // namespace my_merge
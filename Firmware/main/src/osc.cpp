@@ -0,0 +1,413 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "osc.h"
+#include "hash.h"           // my_hash::fnv1a
+#include "trace.h"          // MY_TRACE_POINT
+
+#include <algorithm>        // std::stable_sort
+#include <cstring>          // std::memcpy, std::memchr
+
+namespace my_osc {
+
+/**
+ * Read a big-endian 32-bit word.
+ */
+static inline uint32_t read_u32(const uint8_t* data) noexcept {
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+/**
+ * Round up to the next multiple of four, as all OSC data is 32-bit aligned.
+ */
+static inline size_t align4(size_t size) noexcept {
+    return (size + 3) & ~size_t(3);
+}
+
+/**
+ * Read a zero-terminated and zero-padded OSC string.
+ *
+ * @param[in] data Buffer
+ * @param[in] size Buffer size
+ * @param[out] string The string without padding
+ * @returns Number of bytes consumed including the padding or zero on error
+ */
+static size_t read_string(const uint8_t* data, size_t size, std::string_view& string) noexcept {
+    auto end = static_cast<const uint8_t*>(std::memchr(data, 0, size));
+    if (!end) return 0;
+
+    size_t length = end - data;
+    size_t padded = align4(length + 1);
+    if (padded > size) return 0;
+
+    string = {reinterpret_cast<const char*>(data), length};
+    return padded;
+}
+
+//////////////////////////
+///// struct Message /////
+//////////////////////////
+
+bool Message::parse(const uint8_t* data, size_t size, Message& message) noexcept {
+    message = {};
+    if (size < 4 || data[0] != '/') return false;
+
+    size_t offset = read_string(data, size, message.address);
+    if (!offset) return false;
+
+    // Very old implementations don't send type tags
+    if (offset == size) {
+        message.arguments = data + offset;
+        return true;
+    }
+
+    std::string_view types;
+    size_t length = read_string(data + offset, size - offset, types);
+    if (!length || types.empty() || types[0] != ',') return false;
+
+    message.types          = types.substr(1);
+    message.arguments      = data + offset + length;
+    message.arguments_size = size - offset - length;
+    return true;
+}
+
+////////////////////////////////
+///// class ArgumentReader /////
+////////////////////////////////
+
+ArgumentReader::ArgumentReader(const Message& message) noexcept
+    : message(message),
+      type_index(0),
+      offset(0)
+{
+}
+
+bool ArgumentReader::next(Argument& argument) noexcept {
+    if (type_index >= message.types.size()) return false;
+
+    const uint8_t* data = message.arguments + offset;
+    size_t size = message.arguments_size - offset;
+
+    argument = {};
+    argument.type = message.types[type_index];
+
+    switch (argument.type) {
+        case 'i': {
+            if (size < 4) return false;
+            argument.int32 = static_cast<int32_t>(read_u32(data));
+            offset += 4;
+            break;
+        }
+        case 'f': {
+            if (size < 4) return false;
+            uint32_t bits = read_u32(data);
+            std::memcpy(&argument.float32, &bits, sizeof(bits));
+            offset += 4;
+            break;
+        }
+        case 's':
+        case 'S': {
+            size_t length = read_string(data, size, argument.string);
+            if (!length) return false;
+            offset += length;
+            break;
+        }
+        case 'b': {
+            if (size < 4) return false;
+            size_t length = read_u32(data);
+            if (align4(length) > size - 4) return false;
+            argument.blob = data + 4;
+            argument.blob_size = length;
+            offset += 4 + align4(length);
+            break;
+        }
+        case 'T':
+        case 'F':
+        case 'N':
+        case 'I':
+            // No argument data
+            break;
+        default:
+            return false;
+    }
+
+    type_index++;
+    return true;
+}
+
+////////////////////////////
+///// Pattern Matching /////
+////////////////////////////
+
+bool is_pattern(std::string_view address) noexcept {
+    return address.find_first_of("*?[]{}") != std::string_view::npos;
+}
+
+/**
+ * Match a single character against a `[…]` expression.
+ *
+ * @param[in] pattern Pattern starting with the opening bracket
+ * @param[in] c Character to match
+ * @param[out] length Length of the bracket expression including both brackets
+ * @returns true, if the character matches
+ */
+static bool match_set(std::string_view pattern, char c, size_t& length) noexcept {
+    size_t i = 1;
+    bool negate = i < pattern.size() && pattern[i] == '!';
+    if (negate) i++;
+
+    bool found = false;
+
+    for (; i < pattern.size() && pattern[i] != ']'; i++) {
+        if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+            char from = std::min(pattern[i], pattern[i + 2]);
+            char to   = std::max(pattern[i], pattern[i + 2]);
+            if (c >= from && c <= to) found = true;
+            i += 2;
+        } else if (pattern[i] == c) {
+            found = true;
+        }
+    }
+
+    if (i >= pattern.size()) return false;     // Missing closing bracket
+
+    length = i + 1;
+    return found != negate;
+}
+
+bool pattern_match(std::string_view pattern, std::string_view address) noexcept {
+    constexpr size_t npos = std::string_view::npos;
+
+    size_t p = 0, a = 0;
+    size_t star_p = npos, star_a = 0;
+
+    while (a < address.size()) {
+        if (p < pattern.size()) {
+            char c = pattern[p];
+
+            if (c == '*') {
+                star_p = ++p;
+                star_a = a;
+                continue;
+            } else if (c == '?') {
+                if (address[a] != '/') {
+                    p++; a++;
+                    continue;
+                }
+            } else if (c == '[') {
+                size_t length = 0;
+
+                if (address[a] != '/' && match_set(pattern.substr(p), address[a], length)) {
+                    p += length; a++;
+                    continue;
+                }
+            } else if (c == '{') {
+                size_t end = pattern.find('}', p);
+                if (end == npos) return false;
+
+                std::string_view rest = pattern.substr(end + 1);
+                size_t start = p + 1;
+
+                while (start <= end) {
+                    size_t comma = pattern.find(',', start);
+                    if (comma == npos || comma > end) comma = end;
+
+                    std::string_view choice = pattern.substr(start, comma - start);
+
+                    if (address.substr(a, choice.size()) == choice
+                        && pattern_match(rest, address.substr(a + choice.size()))) {
+                        return true;
+                    }
+
+                    start = comma + 1;
+                }
+            } else if (c == address[a]) {
+                p++; a++;
+                continue;
+            }
+        }
+
+        // Mismatch: Let the last star consume one more character, unless it would cross a slash
+        if (star_p != npos && address[star_a] != '/') {
+            p = star_p;
+            a = ++star_a;
+            continue;
+        }
+
+        return false;
+    }
+
+    while (p < pattern.size() && pattern[p] == '*') p++;
+    return p == pattern.size();
+}
+
+////////////////////////////
+///// class Dispatcher /////
+////////////////////////////
+
+void Dispatcher::add(std::string_view prefix, std::string_view address, Route route) {
+    std::string full;
+    full.reserve(prefix.size() + address.size());
+    full.append(prefix);
+    full.append(address);
+
+    pending.push_back({std::move(full), route});
+}
+
+void Dispatcher::clear() noexcept {
+    pending.clear();
+    strings.clear();
+    keys.clear();
+    patterns.clear();
+    routes.clear();
+    table.clear();
+    mask = 0;
+}
+
+void Dispatcher::compile() {
+    strings.clear();
+    keys.clear();
+    patterns.clear();
+    routes.clear();
+    table.clear();
+
+    // Sort by address so that all routes of an address are adjacent
+    std::vector<const Pending*> sorted;
+    sorted.reserve(pending.size());
+    for (auto& entry : pending) sorted.push_back(&entry);
+
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Pending* a, const Pending* b) {
+        return a->address < b->address;
+    });
+
+    routes.reserve(sorted.size());
+
+    for (size_t i = 0; i < sorted.size(); i++) {
+        const std::string& address = sorted[i]->address;
+
+        if (i == 0 || address != sorted[i - 1]->address) {
+            Key key{
+                .hash        = my_hash::fnv1a(address),
+                .offset      = static_cast<uint32_t>(strings.size()),
+                .length      = static_cast<uint16_t>(address.size()),
+                .first_route = static_cast<uint16_t>(routes.size()),
+                .route_count = 0,
+            };
+
+            strings.append(address);
+            (is_pattern(address) ? patterns : keys).push_back(key);
+        }
+
+        (is_pattern(address) ? patterns : keys).back().route_count++;
+        routes.push_back(sorted[i]->route);
+    }
+
+    // Open addressing with linear probing, filled to at most 50%
+    size_t size = 8;
+    while (size < keys.size() * 2) size *= 2;
+
+    table.assign(size, 0);
+    mask = size - 1;
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        uint32_t slot = keys[i].hash & mask;
+        while (table[slot]) slot = (slot + 1) & mask;
+        table[slot] = static_cast<uint16_t>(i + 1);
+    }
+}
+
+std::string_view Dispatcher::key_address(const Key& key) const noexcept {
+    return std::string_view(strings).substr(key.offset, key.length);
+}
+
+size_t Dispatcher::dispatch_key(const Key& key, const Message& message, Handler handler, void* context) const noexcept {
+    for (size_t i = 0; i < key.route_count; i++) {
+        handler(context, routes[key.first_route + i], message);
+    }
+
+    return key.route_count;
+}
+
+size_t Dispatcher::dispatch(const Message& message, Handler handler, void* context) const noexcept {
+    if (table.empty() && patterns.empty()) return 0;
+    size_t count = 0;
+
+    // Slow path: Received pattern, match against all configured addresses
+    if (is_pattern(message.address)) {
+        for (auto& key : keys) {
+            if (pattern_match(message.address, key_address(key))) {
+                count += dispatch_key(key, message, handler, context);
+            }
+        }
+
+        return count;
+    }
+
+    // Fast path: Hash table lookup
+    if (!table.empty()) {
+        uint32_t address_hash = my_hash::fnv1a(message.address);
+        uint32_t slot = address_hash & mask;
+
+        while (table[slot]) {
+            const Key& key = keys[table[slot] - 1];
+
+            if (key.hash == address_hash && key_address(key) == message.address) {
+                count += dispatch_key(key, message, handler, context);
+                break;
+            }
+
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    // Configured patterns, usually none
+    for (auto& key : patterns) {
+        if (pattern_match(key_address(key), message.address)) {
+            count += dispatch_key(key, message, handler, context);
+        }
+    }
+
+    return count;
+}
+
+size_t Dispatcher::dispatch(const uint8_t* data, size_t size, Handler handler, void* context) const noexcept {
+    MY_TRACE_POINT(my_trace::Point::osc_receive, size);
+    return dispatch_packet(data, size, handler, context, 0);
+}
+
+size_t Dispatcher::dispatch_packet(const uint8_t* data, size_t size, Handler handler, void* context, size_t depth) const noexcept {
+    constexpr char bundle_tag[] = "#bundle";
+
+    // Single message
+    if (size < 16 || std::memcmp(data, bundle_tag, sizeof(bundle_tag)) != 0) {
+        Message message;
+        if (!Message::parse(data, size, message)) return 0;
+        return dispatch(message, handler, context);
+    }
+
+    // Bundle: Tag, time tag, list of size-prefixed elements
+    if (depth >= MY_OSC_BUNDLE_DEPTH) return 0;
+
+    size_t count  = 0;
+    size_t offset = 16;
+
+    while (offset + 4 <= size) {
+        size_t length = read_u32(data + offset);
+        offset += 4;
+
+        if (length > size - offset) break;
+
+        count  += dispatch_packet(data + offset, length, handler, context, depth + 1);
+        offset += length;
+    }
+
+    return count;
+}
+
+} // namespace my_osc
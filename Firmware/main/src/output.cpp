@@ -0,0 +1,239 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "output.h"
+#include "trace.h"          // MY_TRACE_POINT
+
+#include <algorithm>        // std::sort, std::min
+
+namespace my_output {
+
+constexpr int64_t MICRO = 1000000;
+
+///////////////////////////
+///// class Scheduler /////
+///////////////////////////
+
+destination_t Scheduler::add_destination(Limits limits, Sender sender, void* context, bool network) {
+    Destination destination{};
+    destination.limits  = limits;
+    destination.sender  = sender;
+    destination.context = context;
+    destination.network = network;
+
+    destinations.push_back(destination);
+    return static_cast<destination_t>(destinations.size() - 1);
+}
+
+void Scheduler::add_route(uint16_t control, destination_t destination, uint8_t inputs) {
+    pending_routes.push_back({control, destination, inputs});
+}
+
+void Scheduler::clear() noexcept {
+    destinations.clear();
+    pending_routes.clear();
+    slots.clear();
+    queue.clear();
+    control_first.clear();
+    control_slots.clear();
+}
+
+void Scheduler::compile() {
+    // Group routes by destination, so that each destination owns a contiguous range of slots
+    std::sort(pending_routes.begin(), pending_routes.end(), [](const Route& a, const Route& b) {
+        return a.destination != b.destination ? a.destination < b.destination : a.control < b.control;
+    });
+
+    // Merge duplicate routes
+    size_t count = 0;
+
+    for (size_t i = 0; i < pending_routes.size(); i++) {
+        Route& route = pending_routes[i];
+
+        if (count && pending_routes[count - 1].destination == route.destination && pending_routes[count - 1].control == route.control) {
+            pending_routes[count - 1].inputs |= route.inputs;
+        } else {
+            pending_routes[count++] = route;
+        }
+    }
+
+    pending_routes.resize(count);
+
+    slots.clear();
+    slots.reserve(pending_routes.size());
+
+    uint16_t control_count = 0;
+
+    for (auto& destination : destinations) {
+        destination.slot_count = 0;
+    }
+
+    for (auto& route : pending_routes) {
+        if (route.destination >= destinations.size()) continue;
+        Destination& destination = destinations[route.destination];
+
+        if (!destination.slot_count) destination.first_slot = slots.size();
+        destination.slot_count++;
+
+        Slot slot{};
+        slot.control     = route.control;
+        slot.destination = route.destination;
+        slot.inputs      = route.inputs;
+        slots.push_back(slot);
+
+        control_count = std::max<uint16_t>(control_count, route.control + 1);
+    }
+
+    for (auto& destination : destinations) {
+        destination.tokens        = int64_t(destination.limits.burst_bytes) * MICRO;
+        destination.queue_head    = 0;
+        destination.queue_size    = 0;
+        destination.last_flush_us = 0;
+    }
+
+    queue.assign(slots.size(), 0);
+
+    // Index from control to its slots (compressed rows)
+    control_first.assign(control_count + 1, 0);
+    for (auto& slot : slots) control_first[slot.control + 1]++;
+    for (size_t i = 1; i < control_first.size(); i++) control_first[i] += control_first[i - 1];
+
+    control_slots.assign(slots.size(), 0);
+    std::vector<uint32_t> fill(control_first.begin(), control_first.end() - 1);
+
+    for (uint32_t i = 0; i < slots.size(); i++) {
+        control_slots[fill[slots[i].control]++] = i;
+    }
+}
+
+void Scheduler::update(uint16_t control, my_control::Input input, float value) noexcept {
+    float values[my_control::INPUT_COUNT] = {};
+    values[static_cast<size_t>(input)] = value;
+
+    update(control, 1 << static_cast<size_t>(input), values);
+}
+
+void Scheduler::update(uint16_t control, uint8_t changed, const float* values) noexcept {
+    if (control + 1u >= control_first.size() || !changed) return;
+
+    for (uint32_t i = control_first[control]; i < control_first[control + 1]; i++) {
+        uint32_t slot_index = control_slots[i];
+        Slot& slot = slots[slot_index];
+
+        uint8_t used = changed & slot.inputs;
+        if (!used) continue;
+
+        for (size_t k = 0; k < my_control::INPUT_COUNT; k++) {
+            if (used & (1 << k)) slot.values[k] = values[k];
+        }
+
+        slot.changed |= used;
+        slot.known   |= used;
+
+        enqueue(slot_index);
+    }
+}
+
+void Scheduler::enqueue(uint32_t slot_index) noexcept {
+    Slot& slot = slots[slot_index];
+    if (slot.queued) return;
+
+    // Each slot is queued at most once, so the queue cannot overflow
+    Destination& destination = destinations[slot.destination];
+    uint32_t tail = (destination.queue_head + destination.queue_size) % destination.slot_count;
+
+    queue[destination.first_slot + tail] = slot_index;
+    destination.queue_size++;
+    slot.queued = true;
+}
+
+bool Scheduler::flush(Destination& destination) noexcept {
+    while (destination.queue_size) {
+        // Wait until the debt of the previous messages has been repaid
+        if (destination.tokens <= 0) return false;
+
+        uint32_t slot_index = queue[destination.first_slot + destination.queue_head];
+        Slot& slot = slots[slot_index];
+
+        size_t sent = destination.sender(destination.context, slot.control, slot.changed, slot.values);
+        if (!sent) return false;
+
+        MY_TRACE_POINT(my_trace::Point::output, slot.control);
+
+        destination.tokens -= int64_t(sent) * MICRO;
+
+        slot.changed = 0;
+        slot.queued  = false;
+
+        destination.queue_head = (destination.queue_head + 1) % destination.slot_count;
+        destination.queue_size--;
+    }
+
+    return true;
+}
+
+void Scheduler::tick(uint32_t now_us) noexcept {
+    for (auto& destination : destinations) {
+        uint32_t elapsed = now_us - destination.last_flush_us;
+        if (destination.suspended || elapsed < destination.limits.interval_us) continue;
+
+        destination.last_flush_us = now_us;
+
+        // Refill the token bucket, which is scaled by one million to avoid rounding errors
+        int64_t burst  = int64_t(destination.limits.burst_bytes) * MICRO;
+        int64_t refill = int64_t(std::min<uint32_t>(elapsed, MICRO)) * destination.limits.bytes_per_second;
+        destination.tokens = std::min(destination.tokens + refill, burst);
+
+        if (destination.queue_size) flush(destination);
+    }
+}
+
+size_t Scheduler::pending(destination_t destination) const noexcept {
+    if (destination >= destinations.size()) return 0;
+    return destinations[destination].queue_size;
+}
+
+size_t Scheduler::pending() const noexcept {
+    size_t result = 0;
+    for (auto& destination : destinations) result += destination.queue_size;
+    return result;
+}
+
+void Scheduler::suspend(destination_t destination) noexcept {
+    if (destination >= destinations.size()) return;
+    destinations[destination].suspended = true;
+}
+
+void Scheduler::resume(destination_t destination, bool resync) noexcept {
+    if (destination >= destinations.size()) return;
+    Destination& dest = destinations[destination];
+
+    dest.suspended = false;
+    dest.tokens    = int64_t(dest.limits.burst_bytes) * MICRO;
+
+    if (!resync) return;
+
+    for (uint32_t i = dest.first_slot; i < dest.first_slot + dest.slot_count; i++) {
+        if (!slots[i].known) continue;
+
+        slots[i].changed = slots[i].known;
+        enqueue(i);
+    }
+}
+
+void Scheduler::online(bool online) noexcept {
+    for (destination_t i = 0; i < destinations.size(); i++) {
+        if (!destinations[i].network) continue;
+
+        if (online) resume(i);
+        else        suspend(i);
+    }
+}
+
+} // namespace my_output
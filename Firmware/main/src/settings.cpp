@@ -0,0 +1,418 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "settings.h"
+
+#include <cmath>            // std::floor
+#include <cstdio>           // std::FILE, std::fopen, …
+#include <cstdlib>          // std::strtol
+#include <functional>       // std::hash
+
+#if defined(ESP_PLATFORM)
+#include <esp_log.h>        // ESP_LOG…
+#include <sys/stat.h>       // stat
+#endif
+
+namespace my_settings {
+
+/**
+ * What to check for a value
+ */
+enum class Check : uint8_t {
+    one_of,                         ///< String from `values`
+    integer,                        ///< Integer number or string
+    osc_server_id,                  ///< Id of an OSC server, remembered
+    mqtt_server_id,                 ///< Id of an MQTT server, remembered
+    osc_server,                     ///< Id of a known OSC server
+    mqtt_server,                    ///< Id of a known MQTT server
+};
+
+/**
+ * Validation rule, see `Webconfig/server/routes/api/function/import.ts`
+ */
+struct Rule {
+    const char* pattern;            ///< Path, with `[]` for any array index
+    Check check;                    ///< What to check
+    bool required;                  ///< Key must exist and not be empty
+    const char* const* values;      ///< Allowed values, terminated by `nullptr`
+};
+
+// Allowed values, see `Webconfig/types`
+constexpr const char* wifi_modes[]          = {"disabled", "access_point", "station", nullptr};
+constexpr const char* serial_word_lengths[] = {"5", "6", "7", "8", nullptr};
+constexpr const char* serial_parities[]     = {"none", "even", "odd", nullptr};
+constexpr const char* serial_stop_bits[]    = {"1", "1.5", "2", nullptr};
+constexpr const char* midi_versions[]       = {"1.0", "2.0", nullptr};
+constexpr const char* osc_protocols[]       = {"udp", "tcp", nullptr};
+constexpr const char* osc_types[]           = {"i", "f", "s", "b", "S", "T", "F", "N", nullptr};
+constexpr const char* mqtt_protocols[]      = {"mqtt", "ws", nullptr};
+constexpr const char* formats[]             = {"text", "binary", nullptr};
+
+constexpr const char* midi_message_types[] = {
+    "80", "90", "A0", "B0", "C0", "D0", "E0", "F0", "F1", "F2", "F3", "F6", "F8", "FA", "FB", "FC", "FF", nullptr,
+};
+
+constexpr Rule rules[] = {
+    {"wifi.mode",                           Check::one_of,         false, wifi_modes},
+    {"connections.usb.serial.word_length",  Check::one_of,         false, serial_word_lengths},
+    {"connections.usb.serial.parity",       Check::one_of,         false, serial_parities},
+    {"connections.usb.serial.stop_bits",    Check::one_of,         false, serial_stop_bits},
+    {"connections.midi.versions[]",         Check::one_of,         true,  midi_versions},
+    {"oscServers[].id",                     Check::osc_server_id,  false, nullptr},
+    {"oscServers[].protocol",               Check::one_of,         true,  osc_protocols},
+    {"mqttServers[].id",                    Check::mqtt_server_id, false, nullptr},
+    {"mqttServers[].protocol",              Check::one_of,         true,  mqtt_protocols},
+    {"controls[].base.general.board",       Check::integer,        true,  nullptr},
+    {"controls[].base.general.slot",        Check::integer,        true,  nullptr},
+    {"controls[].midi[].message",           Check::one_of,         true,  midi_message_types},
+    {"controls[].osc[].server",             Check::osc_server,     true,  nullptr},
+    {"controls[].osc[].arguments[].type",   Check::one_of,         true,  osc_types},
+    {"controls[].osc[].arguments[].format", Check::one_of,         true,  formats},
+    {"controls[].mqtt[].server",            Check::mqtt_server,    true,  nullptr},
+    {"controls[].mqtt[].format",            Check::one_of,         true,  formats},
+    {"controls[].serial[].format",          Check::one_of,         true,  formats},
+};
+
+constexpr size_t RULE_COUNT = sizeof(rules) / sizeof(rules[0]);
+static_assert(RULE_COUNT <= 32, "Rules are tracked as bit mask");
+
+/**
+ * @returns true, if the path matches the pattern, with `[]` matching any index
+ */
+static bool matches(std::string_view pattern, std::string_view path) noexcept {
+    size_t i = 0, j = 0;
+
+    while (i < pattern.size() && j < path.size()) {
+        if (pattern.compare(i, 2, "[]") == 0 && path[j] == '[') {
+            i += 2;
+            while (j < path.size() && path[j] != ']') j++;
+            j++;
+        } else if (pattern[i++] != path[j++]) {
+            return false;
+        }
+    }
+
+    return i == pattern.size() && j == path.size();
+}
+
+/**
+ * @returns Rule for the given path or `nullptr`
+ */
+static const Rule* find_rule(std::string_view path) noexcept {
+    for (const Rule& rule : rules) {
+        if (matches(rule.pattern, path)) return &rule;
+    }
+
+    return nullptr;
+}
+
+static bool write_file(void* context, const char* data, size_t size) noexcept {
+    return std::fwrite(data, 1, size, static_cast<std::FILE*>(context)) == size;
+}
+
+//////////////////////////
+///// class Importer /////
+//////////////////////////
+
+Importer::Importer(std::string filename) noexcept
+    : filename(filename),
+      _error(),
+      osc_servers{},
+      osc_server_count(0),
+      mqtt_servers{},
+      mqtt_server_count(0),
+      seen{}
+{
+}
+
+bool Importer::run(my_json::Source source, void* context) noexcept {
+    using my_json::Token;
+
+    std::string temporary = filename + ".new";
+    std::FILE* file = std::fopen(temporary.c_str(), "wb");
+
+    _error.clear();
+    osc_server_count  = 0;
+    mqtt_server_count = 0;
+
+    if (!file) return fail("Cannot write", filename);
+
+    my_json::Parser parser(source, context);
+    my_json::Writer writer(write_file, file);
+    bool ok = true;
+
+    for (bool first = true; ok; first = false) {
+        Token token = parser.next();
+
+        if (first && token != Token::begin_object) {
+            ok = fail("Settings must be an object", parser.path());
+            break;
+        }
+
+        switch (token) {
+            case Token::end:
+                break;
+
+            case Token::error:
+                ok = fail(parser.error(), parser.path());
+                break;
+
+            case Token::begin_object:
+            case Token::begin_array:
+                if (find_rule(parser.path())) {
+                    ok = fail("Invalid value for key", parser.path());
+                } else if (token == Token::begin_object) {
+                    seen[parser.depth() - 1] = 0;
+                    writer.begin_object();
+                } else {
+                    writer.begin_array();
+                }
+                break;
+
+            case Token::end_object:
+                ok = check_object(parser);
+                writer.end_object();
+                break;
+
+            case Token::end_array:
+                writer.end_array();
+                break;
+
+            case Token::key:
+                for (size_t i = 0; i < RULE_COUNT; i++) {
+                    if (matches(rules[i].pattern, parser.path())) seen[parser.depth() - 1] |= 1u << i;
+                }
+
+                writer.key(parser.string());
+                break;
+
+            default:
+                ok = check_value(parser, token);
+
+                if      (token == Token::string)  writer.string(parser.string());
+                else if (token == Token::number)  writer.raw(parser.string());
+                else if (token == Token::boolean) writer.boolean(parser.boolean());
+                else                              writer.null();
+                break;
+        }
+
+        if (token == Token::end) break;
+    }
+
+    if (ok && !writer.flush()) ok = fail("Cannot write", filename);
+    if (std::fclose(file) != 0 && ok) ok = fail("Cannot write", filename);
+
+    if (!ok) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    // Replaces the old file in one step on LittleFS, so that a reset cannot lose both
+    if (std::rename(temporary.c_str(), filename.c_str()) != 0) return fail("Cannot write", filename);
+    return true;
+}
+
+bool Importer::check_value(my_json::Parser& parser, my_json::Token token) noexcept {
+    using my_json::Token;
+
+    const Rule* rule = find_rule(parser.path());
+    if (!rule) return true;
+
+    std::string_view value = parser.string();
+    bool empty = token == Token::null || (token == Token::string && value.empty());
+
+    if (empty && !rule->required) return true;
+    if (empty) return fail("Invalid value for key", parser.path());
+
+    switch (rule->check) {
+        case Check::one_of:
+            if (token == Token::string) {
+                for (const char* const* allowed = rule->values; *allowed; allowed++) {
+                    if (value == *allowed) return true;
+                }
+            }
+
+            return fail("Invalid value for key", parser.path());
+
+        case Check::integer: {
+            if (token == Token::number) {
+                double number = parser.number();
+                if (number == std::floor(number)) return true;
+            } else if (token == Token::string) {
+                char* end;
+                std::strtol(parser.string().data(), &end, 10);
+                if (end != parser.string().data()) return true;
+            }
+
+            return fail("Invalid value for key", parser.path());
+        }
+
+        case Check::osc_server_id:
+        case Check::mqtt_server_id: {
+            bool osc      = rule->check == Check::osc_server_id;
+            size_t* ids   = osc ? osc_servers : mqtt_servers;
+            size_t& count = osc ? osc_server_count : mqtt_server_count;
+
+            if (count >= MY_SETTINGS_MAX_SERVERS) return fail("Too many servers at key", parser.path());
+            ids[count++] = std::hash<std::string_view>{}(value);
+            return true;
+        }
+
+        case Check::osc_server:
+        case Check::mqtt_server: {
+            bool osc          = rule->check == Check::osc_server;
+            const size_t* ids = osc ? osc_servers : mqtt_servers;
+            size_t count      = osc ? osc_server_count : mqtt_server_count;
+            size_t hash       = std::hash<std::string_view>{}(value);
+
+            for (size_t i = 0; token == Token::string && i < count; i++) {
+                if (ids[i] == hash) return true;
+            }
+
+            return fail("Invalid value for key", parser.path(), " - no such server");
+        }
+    }
+
+    return true;
+}
+
+bool Importer::check_object(my_json::Parser& parser) noexcept {
+    // The object has already been closed, so its rules are one level deeper
+    uint32_t found = seen[parser.depth()];
+
+    for (size_t i = 0; i < RULE_COUNT; i++) {
+        if (!rules[i].required || (found & (1u << i))) continue;
+
+        std::string_view pattern = rules[i].pattern;
+        size_t dot = pattern.rfind('.');
+
+        if (dot == std::string_view::npos || !matches(pattern.substr(0, dot), parser.path())) continue;
+        if (pattern.substr(dot).find("[]") != std::string_view::npos) continue;    // Arrays may be empty
+
+        std::string path{parser.path()};
+        path += pattern.substr(dot);
+        return fail("Missing key", path);
+    }
+
+    return true;
+}
+
+bool Importer::fail(const char* message, std::string_view path, const char* suffix) noexcept {
+    _error  = message;
+    _error += " '";
+    _error += path;
+    _error += "'";
+    _error += suffix;
+    return false;
+}
+
+/////////////////////
+///// Functions /////
+/////////////////////
+
+bool send(const std::string& filename, my_json::Sink sink, void* context) noexcept {
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if (!file) return false;
+
+    char buffer[MY_JSON_BUFFER];
+    size_t size;
+    bool ok = true;
+
+    while (ok && (size = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        ok = sink(context, buffer, size);
+    }
+
+    std::fclose(file);
+    return ok;
+}
+
+#if defined(ESP_PLATFORM)
+constexpr char const* TAG = "settings";
+
+#ifndef MY_SETTINGS_RECV_RETRIES
+#define MY_SETTINGS_RECV_RETRIES 3  ///< Socket timeouts tolerated while receiving an import
+#endif
+
+static size_t receive(void* context, char* buffer, size_t size) noexcept {
+    httpd_req_t* request = static_cast<httpd_req_t*>(context);
+
+    for (int retry = 0; retry <= MY_SETTINGS_RECV_RETRIES; retry++) {
+        int result = httpd_req_recv(request, buffer, size);
+        if (result != HTTPD_SOCK_ERR_TIMEOUT) return result > 0 ? result : 0;
+    }
+
+    // Looks like the end of the document, which the parser rejects as incomplete
+    return 0;
+}
+
+static bool send_chunk(void* context, const char* data, size_t size) noexcept {
+    return httpd_resp_send_chunk(static_cast<httpd_req_t*>(context), data, size) == ESP_OK;
+}
+
+static esp_err_t import_handler(httpd_req_t* request) noexcept {
+    const char* filename = static_cast<const char*>(request->user_ctx);
+
+    httpd_resp_set_type(request, "application/json");
+    httpd_resp_set_hdr(request, "Cache-Control", "no-store");
+
+    Importer importer(filename);
+
+    if (!importer.run(receive, request)) {
+        ESP_LOGW(TAG, "Import rejected: %s", importer.error().c_str());
+        httpd_resp_set_status(request, "400 Bad Request");
+
+        my_json::Writer writer(send_chunk, request);
+        writer.begin_object();
+        writer.key("error");    writer.string("invalid-value");
+        writer.key("message");  writer.string(importer.error());
+        writer.end_object();
+
+        if (!writer.flush()) return ESP_FAIL;
+        return httpd_resp_send_chunk(request, nullptr, 0);
+    }
+
+    if (!send(filename, send_chunk, request)) return ESP_FAIL;
+    return httpd_resp_send_chunk(request, nullptr, 0);
+}
+
+static esp_err_t export_handler(httpd_req_t* request) noexcept {
+    const char* filename = static_cast<const char*>(request->user_ctx);
+    struct stat info;
+
+    if (stat(filename, &info) != 0) {
+        return httpd_resp_send_err(request, HTTPD_404_NOT_FOUND, "No settings saved");
+    }
+
+    httpd_resp_set_type(request, "application/json");
+    httpd_resp_set_hdr(request, "Cache-Control", "no-store");
+    httpd_resp_set_hdr(request, "Content-Disposition", "attachment; filename=\"settings.mmc.json\"");
+
+    if (!send(filename, send_chunk, request)) return ESP_FAIL;
+    return httpd_resp_send_chunk(request, nullptr, 0);
+}
+
+esp_err_t attach(httpd_handle_t server, const char* filename, const char* import_uri, const char* export_uri) noexcept {
+    httpd_uri_t config = {};
+    config.uri      = import_uri;
+    config.method   = HTTP_POST;
+    config.handler  = &import_handler;
+    config.user_ctx = const_cast<char*>(filename);
+
+    esp_err_t error = httpd_register_uri_handler(server, &config);
+    if (error != ESP_OK) return error;
+
+    config.uri     = export_uri;
+    config.method  = HTTP_GET;
+    config.handler = &export_handler;
+
+    return httpd_register_uri_handler(server, &config);
+}
+#endif
+
+} // namespace my_settings
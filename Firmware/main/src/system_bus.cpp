@@ -0,0 +1,388 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "system_bus.h"
+#include "trace.h"          // MY_TRACE_POINT, MY_TRACE_SCOPE
+
+#include <cstring>          // std::memcpy
+
+#include <esp_attr.h>       // IRAM_ATTR
+#include <esp_log.h>        // ESP_LOG…
+#include <esp_timer.h>      // esp_timer_get_time
+
+namespace my_system_bus {
+
+constexpr char const* TAG = "system_bus";
+constexpr int TIMEOUT_MS  = 10;
+
+/**
+ * Time to read one chunk (nine clocks per byte plus address byte). The sub board stamps
+ * a time response when the read begins, but the master only notices its end.
+ */
+constexpr uint32_t CHUNK_US = (MY_BUS_CHUNK + 1) * 9 * 1000000ull / MY_SYSTEM_BUS_SPEED;
+
+static uint32_t now_us() noexcept {
+    return static_cast<uint32_t>(esp_timer_get_time());
+}
+
+/**
+ * Handler of a board whose clock offset is not known yet
+ */
+struct Unsynced {
+    my_bus::Handler handler;        ///< Handler given to `service()`
+    void* context;                  ///< Context pointer for the handler
+    uint32_t receive_us;            ///< Local time when the report has been received
+};
+
+/**
+ * Pass decoded values on with the receive time instead of the time of the sub board.
+ */
+static void stamp_receive_time(void* context, uint8_t board, uint8_t slot, uint8_t changed, const int32_t* values, uint32_t) noexcept {
+    Unsynced& unsynced = *static_cast<Unsynced*>(context);
+    unsynced.handler(unsynced.context, board, slot, changed, values, unsynced.receive_us);
+}
+
+///////////////////////
+///// class Queue /////
+///////////////////////
+
+void Queue::push(uint8_t board) noexcept {
+    if (board >= MY_BUS_MAX_BOARDS || (queued & (1u << board))) return;
+    queued |= 1u << board;
+
+    size_t i = size++;
+    heap[i] = {priorities[board], board, order++};
+
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!before(heap[i], heap[parent])) break;
+
+        Entry swap = heap[i]; heap[i] = heap[parent]; heap[parent] = swap;
+        i = parent;
+    }
+}
+
+bool Queue::pop(uint8_t& board) noexcept {
+    if (!size) return false;
+
+    board = heap[0].board;
+    queued &= ~(1u << board);
+    heap[0] = heap[--size];
+
+    size_t i = 0;
+
+    while (true) {
+        size_t left  = 2 * i + 1;
+        size_t right = left + 1;
+        size_t first = i;
+
+        if (left  < size && before(heap[left],  heap[first])) first = left;
+        if (right < size && before(heap[right], heap[first])) first = right;
+        if (first == i) break;
+
+        Entry swap = heap[i]; heap[i] = heap[first]; heap[first] = swap;
+        i = first;
+    }
+
+    return true;
+}
+
+///////////////////////////
+///// class SystemBus /////
+///////////////////////////
+
+SystemBus& SystemBus::instance() noexcept {
+    static SystemBus instance;
+    return instance;
+}
+
+SystemBus::SystemBus() noexcept
+    : master(nullptr),
+      slave(nullptr),
+      devices{},
+      everyone(nullptr),
+      task(nullptr),
+      pending(0),
+      unknown(0),
+      present(0),
+      last_sync_us(0),
+      next_sync(0),
+      sequence(0),
+      buffer{}
+{
+}
+
+esp_err_t SystemBus::open() noexcept {
+    i2c_master_bus_config_t master_config = {};
+    master_config.i2c_port          = I2C_NUM_0;
+    master_config.sda_io_num        = static_cast<gpio_num_t>(MY_SYSTEM_BUS_SDA);
+    master_config.scl_io_num        = static_cast<gpio_num_t>(MY_SYSTEM_BUS_SCL);
+    master_config.clk_source        = I2C_CLK_SRC_DEFAULT;
+    master_config.glitch_ignore_cnt = 7;
+
+    esp_err_t error = i2c_new_master_bus(&master_config, &master);
+
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create I2C master: %s", esp_err_to_name(error));
+        return error;
+    }
+
+    // Second controller on its own pins, wired to the same bus lines, only to receive
+    // attention messages. Sharing the master's pins would take them away from the master.
+    i2c_slave_config_t slave_config = {};
+    slave_config.i2c_port          = I2C_NUM_1;
+    slave_config.sda_io_num        = static_cast<gpio_num_t>(MY_SYSTEM_BUS_ATTENTION_SDA);
+    slave_config.scl_io_num        = static_cast<gpio_num_t>(MY_SYSTEM_BUS_ATTENTION_SCL);
+    slave_config.clk_source        = I2C_CLK_SRC_DEFAULT;
+    slave_config.send_buf_depth    = 32;
+    slave_config.receive_buf_depth = 32;
+    slave_config.slave_addr        = my_bus::MAIN_ADDRESS;
+    slave_config.addr_bit_len      = I2C_ADDR_BIT_LEN_7;
+
+    error = i2c_new_slave_device(&slave_config, &slave);
+
+    if (error == ESP_OK) {
+        i2c_slave_event_callbacks_t callbacks = {};
+        callbacks.on_receive = on_receive;
+        error = i2c_slave_register_event_callbacks(slave, &callbacks, this);
+    }
+
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create I2C slave: %s", esp_err_to_name(error));
+    }
+
+    return error;
+}
+
+bool IRAM_ATTR SystemBus::on_receive(i2c_slave_dev_handle_t, const i2c_slave_rx_done_event_data_t* event, void* context) {
+    SystemBus* self = static_cast<SystemBus*>(context);
+    uint32_t boards = 0;
+
+    for (uint32_t i = 0; i < event->length; i++) {
+        if (event->buffer[i] < MY_BUS_MAX_BOARDS) boards |= 1u << event->buffer[i];
+    }
+
+    if (!boards) return false;
+    self->pending.fetch_or(boards, std::memory_order_relaxed);
+
+    BaseType_t woken = pdFALSE;
+    if (self->task) vTaskNotifyGiveFromISR(self->task, &woken);
+    return woken == pdTRUE;
+}
+
+void SystemBus::service(TickType_t timeout, my_bus::Handler handler, void* context) noexcept {
+    task = xTaskGetCurrentTaskHandle();
+
+    if (present && now_us() - last_sync_us >= MY_SYSTEM_BUS_SYNC_MS * 1000) {
+        last_sync_us = now_us();
+
+        for (uint8_t i = 1; i <= MY_BUS_MAX_BOARDS; i++) {
+            uint8_t board = (next_sync + i) % MY_BUS_MAX_BOARDS;
+            if (!(present & (1u << board))) continue;
+
+            next_sync = board;
+            sync(board);
+            return;
+        }
+    }
+
+    if (present && timeout > pdMS_TO_TICKS(MY_SYSTEM_BUS_SYNC_MS)) {
+        timeout = pdMS_TO_TICKS(MY_SYSTEM_BUS_SYNC_MS);
+    }
+
+    if (_queue.empty() && !pending.load(std::memory_order_relaxed)) {
+        ulTaskNotifyTake(pdTRUE, timeout);
+    }
+
+    uint32_t boards = pending.exchange(0, std::memory_order_relaxed);
+
+    while (boards) {
+        _queue.push(static_cast<uint8_t>(__builtin_ctz(boards)));
+        boards &= boards - 1;
+    }
+
+    uint8_t board;
+    if (!_queue.pop(board)) return;
+
+    // Boards that have not been enumerated yet are handed to the discovery
+    if (present & (1u << board)) {
+        read(board, handler, context);
+    } else {
+        unknown.fetch_or(1u << board, std::memory_order_relaxed);
+    }
+}
+
+i2c_master_dev_handle_t SystemBus::device(uint8_t board) noexcept {
+    if (devices[board]) return devices[board];
+
+    i2c_device_config_t config = {};
+    config.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+    config.device_address  = my_bus::BOARD_ADDRESS + board;
+    config.scl_speed_hz    = MY_SYSTEM_BUS_SPEED;
+
+    if (i2c_master_bus_add_device(master, &config, &devices[board]) != ESP_OK) return nullptr;
+    return devices[board];
+}
+
+my_bus::Result SystemBus::receive(uint8_t board, my_bus::Header& header, const uint8_t*& payload) noexcept {
+    i2c_master_dev_handle_t dev = device(board);
+    if (!dev) return my_bus::Result::incomplete;
+
+    if (i2c_master_receive(dev, buffer, MY_BUS_CHUNK, TIMEOUT_MS) != ESP_OK) return my_bus::Result::incomplete;
+
+    if (buffer[0] == 0) {
+        header = {};    // Nothing to report
+        return my_bus::Result::ok;
+    }
+
+    my_bus::Result result = my_bus::parse(buffer, MY_BUS_CHUNK, header, payload);
+    if (result != my_bus::Result::incomplete || header.version != my_bus::VERSION) return result;
+
+    size_t size = sizeof(my_bus::Header) + header.length + my_bus::CRC_SIZE;
+    if (size > sizeof(buffer)) return my_bus::Result::bad_payload;
+
+    for (size_t offset = MY_BUS_CHUNK; offset < size; offset += MY_BUS_CHUNK) {
+        size_t chunk = MY_BUS_CHUNK < sizeof(buffer) - offset ? MY_BUS_CHUNK : sizeof(buffer) - offset;
+        if (i2c_master_receive(dev, buffer + offset, chunk, TIMEOUT_MS) != ESP_OK) return my_bus::Result::incomplete;
+    }
+
+    return my_bus::parse(buffer, size, header, payload);
+}
+
+bool SystemBus::read(uint8_t board, my_bus::Handler handler, void* context) noexcept {
+    MY_TRACE_POINT(my_trace::Point::bus_read, board);
+    MY_TRACE_SCOPE(my_trace::Span::bus_read);
+
+    my_bus::Header header;
+    const uint8_t* payload;
+    my_bus::Result result = receive(board, header, payload);
+
+    if (result == my_bus::Result::ok && header.version == 0) return true;
+
+    if (result == my_bus::Result::ok) {
+        const my_clock::Estimator& clock = clocks[board];
+        uint32_t receive_us = now_us();
+
+        if (clock.valid()) {
+            result = decoders[board].decode(header, payload, handler, context, clock.offset(receive_us));
+        } else {
+            // The raw time of the sub board may lie far in the future. As on the output
+            // path, the time of arrival is used until the offset is known.
+            Unsynced unsynced = {handler, context, receive_us};
+            result = decoders[board].decode(header, payload, stamp_receive_time, &unsynced);
+        }
+    }
+
+    if (result != my_bus::Result::ok) {
+        ESP_LOGW(TAG, "Resync board %u after error %u", board, static_cast<unsigned>(result));
+        send(board, my_bus::Type::resync);
+        return false;
+    }
+
+    return true;
+}
+
+bool SystemBus::request(uint8_t board, my_bus::Type type, my_bus::Header& header, const uint8_t*& payload) noexcept {
+    if (!send(board, type)) return false;
+    return receive(board, header, payload) == my_bus::Result::ok && header.version == my_bus::VERSION;
+}
+
+bool SystemBus::schedule(uint8_t board, const my_bus::OutputEvent* events, size_t count) noexcept {
+    if (board >= MY_BUS_MAX_BOARDS) return false;
+
+    const my_clock::Estimator& clock = clocks[board];
+    uint8_t flags   = clock.valid() ? 0 : my_bus::FLAG_IMMEDIATE;
+    uint32_t offset = clock.offset(now_us());
+
+    while (count) {
+        my_bus::OutputEvent frame[my_bus::MAX_OUTPUT_EVENTS];
+        size_t size = count < my_bus::MAX_OUTPUT_EVENTS ? count : my_bus::MAX_OUTPUT_EVENTS;
+
+        for (size_t i = 0; i < size; i++) {
+            frame[i] = events[i];
+            frame[i].time_us += offset;
+        }
+
+        if (!transmit(device(board), board, my_bus::Type::output_events, frame, size * sizeof(frame[0]), flags)) return false;
+
+        events += size;
+        count  -= size;
+    }
+
+    return true;
+}
+
+bool SystemBus::sync(uint8_t board) noexcept {
+    if (!send(board, my_bus::Type::time_request)) return false;
+    uint32_t t1 = now_us();     // Request has been received when the transmission ends
+
+    my_bus::Header header;
+    const uint8_t* payload;
+    my_bus::Result result = receive(board, header, payload);
+    uint32_t t4 = now_us() - CHUNK_US;
+
+    if (result != my_bus::Result::ok || header.type != my_bus::Type::time_response) return false;
+    if (header.length < sizeof(my_bus::TimeResponse)) return false;
+
+    my_bus::TimeResponse response;
+    std::memcpy(&response, payload, sizeof(response));
+    clocks[board].sample(t1, response.receive_us, response.transmit_us, t4);
+    return true;
+}
+
+bool SystemBus::probe(uint8_t board) noexcept {
+    return i2c_master_probe(master, my_bus::BOARD_ADDRESS + board, TIMEOUT_MS) == ESP_OK;
+}
+
+void SystemBus::set_present(uint8_t board, bool present) noexcept {
+    if (board >= MY_BUS_MAX_BOARDS) return;
+
+    if (present) {
+        if (!(this->present & (1u << board))) {
+            clocks[board].reset();
+            sync(board);
+        }
+
+        this->present |= 1u << board;
+        decoders[board] = my_bus::Decoder();
+    } else {
+        this->present &= ~(1u << board);
+    }
+}
+
+bool SystemBus::send(uint8_t board, my_bus::Type type) noexcept {
+    return transmit(device(board), board, type, nullptr, 0);
+}
+
+bool SystemBus::broadcast(my_bus::Type type, const void* payload, uint16_t length) noexcept {
+    if (!everyone) {
+        i2c_device_config_t config = {};
+        config.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+        config.device_address  = my_bus::GENERAL_CALL;
+        config.scl_speed_hz    = MY_SYSTEM_BUS_SPEED;
+
+        if (i2c_master_bus_add_device(master, &config, &everyone) != ESP_OK) return false;
+    }
+
+    return transmit(everyone, my_bus::ALL_BOARDS, type, payload, length);
+}
+
+bool SystemBus::transmit(i2c_master_dev_handle_t dev, uint8_t board, my_bus::Type type, const void* payload, uint16_t length, uint8_t flags) noexcept {
+    // The Wire library of the sub boards cannot receive more at once
+    uint8_t frame[MY_BUS_CHUNK];
+    if (!dev || sizeof(my_bus::Header) + length + my_bus::CRC_SIZE > sizeof(frame)) return false;
+
+    uint8_t* data = my_bus::begin(frame, type, board, flags, sequence++);
+    if (length) std::memcpy(data, payload, length);
+    size_t size = my_bus::finish(frame, length);
+
+    return i2c_master_transmit(dev, frame, size, TIMEOUT_MS) == ESP_OK;
+}
+
+} // namespace my_system_bus
@@ -0,0 +1,203 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "tasks.h"
+#include "json.h"           // my_json::Writer
+#include "trace.h"          // my_trace::dump, my_trace::reset
+
+#include <esp_log.h>        // ESP_LOG…
+#include <esp_timer.h>      // esp_timer_get_time
+
+namespace my_tasks {
+
+constexpr char const* TAG = "tasks";
+
+static Task* tasks[MY_TASKS_MAX] = {};              ///< Registered tasks
+static std::atomic<size_t> task_count{0};           ///< Number of registered tasks
+
+//////////////////////
+///// class Task /////
+//////////////////////
+
+Task::Task(const char* name, BaseType_t core, UBaseType_t priority, uint32_t stack) noexcept
+    : _name(name),
+      _core(core),
+      _priority(priority),
+      stack(stack),
+      _handle(nullptr),
+      function(nullptr),
+      context(nullptr),
+      counts{},
+      max_us(0),
+      last_runtime(0),
+      last_time_us(0)
+{
+}
+
+esp_err_t Task::start(Function function, void* context) noexcept {
+    if (_handle) return ESP_ERR_INVALID_STATE;
+
+    this->function = function;
+    this->context  = context;
+    last_time_us   = esp_timer_get_time();
+
+    if (xTaskCreatePinnedToCore(&Task::_run, _name, stack, this, _priority, &_handle, _core) != pdPASS) {
+        ESP_LOGE(TAG, "Cannot create task %s", _name);
+        _handle = nullptr;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return add();
+}
+
+esp_err_t Task::adopt() noexcept {
+    if (_handle) return ESP_ERR_INVALID_STATE;
+
+    _handle   = xTaskGetCurrentTaskHandle();
+    _core     = xPortGetCoreID();
+    _priority = uxTaskPriorityGet(nullptr);
+
+    last_runtime = ulTaskGetRunTimeCounter(_handle);
+    last_time_us = esp_timer_get_time();
+
+    return add();
+}
+
+esp_err_t Task::add() noexcept {
+    size_t index = task_count.load(std::memory_order_acquire);
+    if (index >= MY_TASKS_MAX) return ESP_ERR_NO_MEM;
+
+    tasks[index] = this;
+    task_count.store(index + 1, std::memory_order_release);
+
+    ESP_LOGI(TAG, "Task %s on core %d with priority %u", _name, static_cast<int>(_core), static_cast<unsigned>(_priority));
+    return ESP_OK;
+}
+
+void Task::_run(void* arg) noexcept {
+    Task* task = static_cast<Task*>(arg);
+    task->function(task->context);
+
+    ESP_LOGW(TAG, "Task %s finished", task->_name);
+    vTaskDelete(nullptr);
+}
+
+void Task::record(uint32_t latency_us) noexcept {
+    size_t bucket = latency_us ? 32 - __builtin_clz(latency_us) : 0;
+    if (bucket >= MY_TASKS_BUCKETS) bucket = MY_TASKS_BUCKETS - 1;
+
+    // Only the task itself writes, so no read-modify-write is needed
+    counts[bucket].store(counts[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (latency_us > max_us.load(std::memory_order_relaxed)) max_us.store(latency_us, std::memory_order_relaxed);
+}
+
+Histogram Task::histogram() const noexcept {
+    Histogram result;
+
+    for (size_t i = 0; i < MY_TASKS_BUCKETS; i++) {
+        result.counts[i] = counts[i].load(std::memory_order_relaxed);
+    }
+
+    result.max_us = max_us.load(std::memory_order_relaxed);
+    return result;
+}
+
+float Task::load() noexcept {
+    if (!_handle) return 0.0f;
+
+    // The run-time counter uses the same microsecond time base as esp_timer
+    uint64_t runtime = ulTaskGetRunTimeCounter(_handle);
+    uint64_t now_us  = esp_timer_get_time();
+
+    uint64_t busy    = runtime - last_runtime;
+    uint64_t elapsed = now_us - last_time_us;
+
+    last_runtime = runtime;
+    last_time_us = now_us;
+
+    return elapsed ? 100.0f * busy / elapsed : 0.0f;
+}
+
+/////////////////////
+///// Functions /////
+/////////////////////
+
+static bool send_chunk(void* context, const char* data, size_t size) noexcept {
+    return httpd_resp_send_chunk(static_cast<httpd_req_t*>(context), data, size) == ESP_OK;
+}
+
+static esp_err_t handler(httpd_req_t* request) noexcept {
+    httpd_resp_set_type(request, "application/json");
+    httpd_resp_set_hdr(request, "Cache-Control", "no-store");
+
+    my_json::Writer writer(send_chunk, request);
+    writer.begin_array();
+
+    for (size_t i = 0; i < task_count.load(std::memory_order_acquire); i++) {
+        Task& task = *tasks[i];
+        Histogram histogram = task.histogram();
+
+        writer.begin_object();
+        writer.key("name");         writer.string(task.name());
+        writer.key("core");         writer.integer(task.core());
+        writer.key("priority");     writer.integer(task.priority());
+        writer.key("load");         writer.number(task.load());
+        writer.key("stack_free");   writer.integer(uxTaskGetStackHighWaterMark(task.handle()));
+        writer.key("latency_max");  writer.integer(histogram.max_us);
+        writer.key("latency");
+
+        writer.begin_array();
+        for (uint32_t count : histogram.counts) writer.integer(count);
+        writer.end_array();
+
+        writer.end_object();
+    }
+
+    writer.end_array();
+
+    if (!writer.flush()) return ESP_FAIL;
+    return httpd_resp_send_chunk(request, nullptr, 0);
+}
+
+static esp_err_t trace_handler(httpd_req_t* request) noexcept {
+    if (request->method == HTTP_POST) {
+        my_trace::reset();
+        return httpd_resp_send(request, nullptr, 0);
+    }
+
+    httpd_resp_set_type(request, "application/json");
+    httpd_resp_set_hdr(request, "Cache-Control", "no-store");
+
+    my_json::Writer writer(send_chunk, request);
+    my_trace::dump(writer);
+
+    if (!writer.flush()) return ESP_FAIL;
+    return httpd_resp_send_chunk(request, nullptr, 0);
+}
+
+esp_err_t attach(httpd_handle_t server, const char* tasks_uri, const char* trace_uri) noexcept {
+    httpd_uri_t config = {};
+    config.uri     = tasks_uri;
+    config.method  = HTTP_GET;
+    config.handler = &handler;
+
+    esp_err_t error = httpd_register_uri_handler(server, &config);
+    if (error != ESP_OK) return error;
+
+    config.uri     = trace_uri;
+    config.handler = &trace_handler;
+
+    error = httpd_register_uri_handler(server, &config);
+    if (error != ESP_OK) return error;
+
+    config.method = HTTP_POST;
+    return httpd_register_uri_handler(server, &config);
+}
+
+} // namespace my_tasks
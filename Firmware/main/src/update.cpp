@@ -0,0 +1,343 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "update.h"
+
+#include <atomic>           // std::atomic
+#include <cstring>          // std::memcpy, std::memset
+#include <esp_log.h>        // ESP_LOG…
+
+#if defined(ESP_PLATFORM)
+#include "json.h"           // my_json::Writer
+#endif
+
+namespace my_update {
+
+constexpr char const* TAG = "update";
+
+/////////////////////////
+///// class Updater /////
+/////////////////////////
+
+Updater::Updater(my_bus::Link& bus, std::string image) noexcept
+    : bus(bus),
+      image(image),
+      file(nullptr),
+      info{},
+      chunks(0),
+      boards(0),
+      _failed(0),
+      installing(0),
+      retries{},
+      base(0),
+      next_chunk(0),
+      missing{},
+      settle_ms(0),
+      committed(false),
+      _phase(Phase::idle)
+{
+}
+
+Updater::~Updater() noexcept {
+    if (file) std::fclose(file);
+}
+
+bool Updater::start(uint32_t boards, uint32_t now_ms) noexcept {
+    if (file) std::fclose(file);
+    file = std::fopen(image.c_str(), "rb");
+
+    if (!file) {
+        ESP_LOGE(TAG, "Cannot open firmware image %s", image.c_str());
+        _phase = Phase::failed;
+        return false;
+    }
+
+    info = {};
+    uint8_t buffer[256];
+    size_t size;
+
+    while ((size = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        info.crc   = my_bus::crc32(buffer, size, info.crc);
+        info.size += size;
+    }
+
+    if (!info.size || info.size > 0xFFFF * my_bus::UPDATE_CHUNK) {
+        ESP_LOGE(TAG, "Invalid firmware image size %lu", static_cast<unsigned long>(info.size));
+        _phase = Phase::failed;
+        return false;
+    }
+
+    chunks       = (info.size + my_bus::UPDATE_CHUNK - 1) / my_bus::UPDATE_CHUNK;
+    this->boards = boards;
+    _failed      = 0;
+    installing   = 0;
+    base         = 0;
+    committed    = false;
+    std::memset(retries, 0, sizeof(retries));
+
+    if (!bus.broadcast(my_bus::Type::update_begin, &info, sizeof(info))) {
+        ESP_LOGE(TAG, "No board acknowledged the update");
+        _phase = Phase::failed;
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Updating boards %08lx with %lu bytes", static_cast<unsigned long>(boards), static_cast<unsigned long>(info.size));
+    settle(now_ms);
+    return true;
+}
+
+void Updater::loop(uint32_t now_ms) noexcept {
+    switch (_phase) {
+        case Phase::polling:
+            poll(now_ms);
+            break;
+        case Phase::sending:
+            send();
+            break;
+        case Phase::settling:
+            if (now_ms - settle_ms >= MY_UPDATE_SETTLE_MS) _phase = Phase::polling;
+            break;
+        default:
+            break;
+    }
+}
+
+uint16_t Updater::window_chunks() const noexcept {
+    return static_cast<size_t>(chunks - base) < my_bus::UPDATE_WINDOW ? chunks - base : my_bus::UPDATE_WINDOW;
+}
+
+void Updater::settle(uint32_t now_ms) noexcept {
+    settle_ms = now_ms;
+    _phase    = Phase::settling;
+}
+
+void Updater::installed(uint8_t board) noexcept {
+    boards     &= ~(1u << board);
+    installing |= 1u << board;
+}
+
+void Updater::give_up(uint8_t board) noexcept {
+    ESP_LOGW(TAG, "Giving up board %u", board);
+    boards  &= ~(1u << board);
+    _failed |= 1u << board;
+}
+
+void Updater::poll(uint32_t now_ms) noexcept {
+    my_bus::UpdateReport reports[MY_BUS_MAX_BOARDS];
+    uint32_t receiving = 0;
+    uint16_t lowest    = chunks;
+    bool waiting       = false;
+    bool announce      = false;
+
+    for (uint8_t board = 0; board < MY_BUS_MAX_BOARDS; board++) {
+        if (!(boards & (1u << board))) continue;
+
+        my_bus::Header header;
+        const uint8_t* payload;
+
+        if (!bus.request(board, my_bus::Type::update_status, header, payload)
+            || header.type != my_bus::Type::update_report
+            || header.length < sizeof(my_bus::UpdateReport)) {
+            // Boards are not reachable while they write to flash or install the image
+            if (committed) installed(board);
+            else if (++retries[board] >= MY_UPDATE_RETRIES) give_up(board);
+            else waiting = true;
+            continue;
+        }
+
+        retries[board] = 0;
+        my_bus::UpdateReport& report = reports[board];
+        std::memcpy(&report, payload, sizeof(report));
+
+        if (committed && report.state != my_bus::UpdateState::receiving && report.state != my_bus::UpdateState::failed) {
+            installed(board);       // Verifying, installing or restarted with the new image
+            continue;
+        }
+
+        switch (report.state) {
+            case my_bus::UpdateState::idle:
+                announce = true;    // Missed the begin frame or has been reset
+                break;
+            case my_bus::UpdateState::failed:
+                give_up(board);
+                break;
+            case my_bus::UpdateState::busy:
+                waiting = true;
+                if (report.base < lowest) lowest = report.base;
+                break;
+            case my_bus::UpdateState::receiving:
+                receiving |= 1u << board;
+                if (report.base < lowest) lowest = report.base;
+                break;
+            case my_bus::UpdateState::verified:
+                break;
+        }
+    }
+
+    if (committed && !boards && installing) {
+        ESP_LOGI(TAG, "Update installed");
+        _phase = Phase::done;
+        return;
+    }
+
+    if (!boards) {
+        ESP_LOGE(TAG, "Update failed on all boards");
+        _phase = Phase::failed;
+        return;
+    }
+
+    if (committed) {
+        // The commit frame has been lost on the remaining boards
+        bus.broadcast(my_bus::Type::update_commit, nullptr, 0);
+        settle(now_ms);
+        return;
+    }
+
+    if (announce) {
+        bus.broadcast(my_bus::Type::update_begin, &info, sizeof(info));
+        settle(now_ms);
+        return;
+    }
+
+    if (lowest != base) ESP_LOGI(TAG, "Received %u of %u chunks", lowest, chunks);
+    base = lowest;
+
+    if (base >= chunks && !waiting) {
+        bus.broadcast(my_bus::Type::update_commit, nullptr, 0);
+        ESP_LOGI(TAG, "Update committed");
+        committed = true;
+        settle(now_ms);
+        return;
+    }
+
+    // Union of the chunks missing on the boards at the current window
+    std::memset(missing, 0, sizeof(missing));
+    bool any = false;
+
+    for (uint8_t board = 0; board < MY_BUS_MAX_BOARDS; board++) {
+        if (!(receiving & (1u << board)) || reports[board].base != base) continue;
+
+        for (uint16_t i = 0; i < window_chunks(); i++) {
+            if (reports[board].received[i / 8] & (1 << (i % 8))) continue;
+            missing[i / 8] |= 1 << (i % 8);
+            any = true;
+        }
+    }
+
+    if (any) {
+        next_chunk = 0;
+        _phase = Phase::sending;
+    } else {
+        settle(now_ms);
+    }
+}
+
+void Updater::send() noexcept {
+    uint16_t count = window_chunks();
+
+    for (uint8_t sent = 0; sent < MY_UPDATE_BURST && next_chunk < count; next_chunk++) {
+        if (!(missing[next_chunk / 8] & (1 << (next_chunk % 8)))) continue;
+
+        my_bus::UpdateChunk chunk;
+        chunk.index = base + next_chunk;
+        std::memset(chunk.data, 0xFF, sizeof(chunk.data));
+
+        std::fseek(file, chunk.index * my_bus::UPDATE_CHUNK, SEEK_SET);
+        std::fread(chunk.data, 1, sizeof(chunk.data), file);
+
+        // Lost frames are noticed by the next status request
+        bus.broadcast(my_bus::Type::update_data, &chunk, sizeof(chunk));
+        sent++;
+    }
+
+    if (next_chunk >= count) _phase = Phase::polling;
+}
+
+/////////////////////
+///// Functions /////
+/////////////////////
+
+static std::atomic<bool> update_request{false};         ///< Web portal asked for an update
+static std::atomic<Phase> status_phase{Phase::idle};    ///< Published progress
+static std::atomic<uint16_t> status_received{0};        ///< Published number of received chunks
+static std::atomic<uint16_t> status_total{0};           ///< Published number of chunks
+static std::atomic<uint32_t> status_failed{0};          ///< Published boards given up
+
+bool requested() noexcept {
+    return update_request.exchange(false, std::memory_order_acquire);
+}
+
+void publish(const Updater& updater) noexcept {
+    status_received.store(updater.received(), std::memory_order_relaxed);
+    status_total.store(updater.total(), std::memory_order_relaxed);
+    status_failed.store(updater.failed(), std::memory_order_relaxed);
+    status_phase.store(updater.phase(), std::memory_order_release);
+}
+
+#if defined(ESP_PLATFORM)
+static bool send_chunk(void* context, const char* data, size_t size) noexcept {
+    return httpd_resp_send_chunk(static_cast<httpd_req_t*>(context), data, size) == ESP_OK;
+}
+
+static esp_err_t handler(httpd_req_t* request) noexcept {
+    Phase phase = status_phase.load(std::memory_order_acquire);
+    bool running = phase == Phase::polling || phase == Phase::sending || phase == Phase::settling;
+
+    if (request->method == HTTP_POST) {
+        // A request not taken yet counts as running, too
+        if (running || update_request.exchange(true, std::memory_order_release)) {
+            httpd_resp_set_status(request, "409 Conflict");
+        } else {
+            httpd_resp_set_status(request, "202 Accepted");
+        }
+
+        return httpd_resp_send(request, nullptr, 0);
+    }
+
+    static const char* const PHASES[] = {"idle", "polling", "sending", "settling", "done", "failed"};
+
+    httpd_resp_set_type(request, "application/json");
+    httpd_resp_set_hdr(request, "Cache-Control", "no-store");
+
+    my_json::Writer writer(send_chunk, request);
+    writer.begin_object();
+    writer.key("phase");    writer.string(PHASES[static_cast<size_t>(phase)]);
+    writer.key("received"); writer.integer(status_received.load(std::memory_order_relaxed));
+    writer.key("total");    writer.integer(status_total.load(std::memory_order_relaxed));
+    writer.key("failed");
+
+    writer.begin_array();
+    uint32_t failed = status_failed.load(std::memory_order_relaxed);
+
+    for (uint8_t board = 0; board < MY_BUS_MAX_BOARDS; board++) {
+        if (failed & (1u << board)) writer.integer(board);
+    }
+
+    writer.end_array();
+    writer.end_object();
+
+    if (!writer.flush()) return ESP_FAIL;
+    return httpd_resp_send_chunk(request, nullptr, 0);
+}
+
+esp_err_t attach(httpd_handle_t server, const char* uri) noexcept {
+    httpd_uri_t config = {};
+    config.uri     = uri;
+    config.method  = HTTP_GET;
+    config.handler = &handler;
+
+    esp_err_t error = httpd_register_uri_handler(server, &config);
+    if (error != ESP_OK) return error;
+
+    config.method = HTTP_POST;
+    return httpd_register_uri_handler(server, &config);
+}
+#endif
+
+} // namespace my_update
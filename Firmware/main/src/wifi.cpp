@@ -0,0 +1,831 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "wifi.h"
+
+#include "file.h"           // my_file::…
+#include "json.h"           // my_json::Writer
+#include <algorithm>        // std::min, std::max
+#include <cstdio>           // std::snprintf
+#include <cstring>          // std::strncpy
+#include <esp_eap_client.h> // esp_wifi_sta_enterprise_…, esp_eap_client_…
+#include <esp_event.h>      // esp_event_…
+#include <esp_log.h>        // ESP_LOG…
+#include <esp_mac.h>        // MAC2STR, MACSTR
+#include <esp_netif.h>      // esp_netif_…
+#include <esp_random.h>     // esp_random
+#include <esp_timer.h>      // esp_timer_…
+#include <esp_wifi.h>       // esp_wifi_…
+#include <freertos/FreeRTOS.h> // pdMS_TO_TICKS
+#include <freertos/task.h>  // vTaskDelay
+#include <lwip/ip_addr.h>   // ipaddr_aton
+#include <lwip/sockets.h>   // setsockopt, IP_TOS
+
+namespace my_wifi {
+constexpr char const* TAG = "wifi";
+
+/////////////////////////
+///// struct Config /////
+/////////////////////////
+
+constexpr const char* config_file   = "/var/config/wifi";
+constexpr const char* ap_cache_file = "/var/config/wifi-ap";
+
+Config Config::read() noexcept {
+    Config config{
+        .mode     = Mode::access_point,
+        .profile  = Profile::low_latency,
+        .ssid     = "Modular-Music-Controller",
+        .psk      = "Modular-Music-Controller",
+        .username = "",
+        .password = "",
+    };
+
+    my_file::IFF_Reader iff_reader{config_file};
+
+    constexpr size_t buffer_size = 257;
+    char buffer[buffer_size] = {};
+
+    while (true) {
+        auto chunk = iff_reader.peek();
+
+        if (chunk.type == "mode") {
+            iff_reader.chunk(reinterpret_cast<char*>(&config.mode), sizeof(config.mode));
+        } else if (chunk.type == "prof") {
+            iff_reader.chunk(reinterpret_cast<char*>(&config.profile), sizeof(config.profile));
+        } else if (chunk.type == "ssid") {
+            iff_reader.chunk(buffer, buffer_size - 1);  // -1 to keep the final zero-byte
+            config.ssid = std::string(buffer);
+        } else if (chunk.type == "psk ") {
+            iff_reader.chunk(buffer, buffer_size - 1);
+            config.psk = std::string(buffer);
+        } else if (chunk.type == "user") {
+            iff_reader.chunk(buffer, buffer_size - 1);
+            config.username = std::string(buffer);
+        } else if (chunk.type == "pass") {
+            iff_reader.chunk(buffer, buffer_size - 1);
+            config.password = std::string(buffer);
+        } else if (chunk.type == "    ") {
+            break;
+        } else {
+            iff_reader.skip();
+        }
+    }
+
+    iff_reader.close();
+    return config;
+}
+
+void Config::save() noexcept {
+    my_file::IFF_Writer iff_writer{config_file};
+
+    iff_writer.chunk("mode", reinterpret_cast<const char *>(&mode), sizeof(mode));
+    iff_writer.chunk("prof", reinterpret_cast<const char *>(&profile), sizeof(profile));
+    iff_writer.chunk("ssid", ssid.c_str(), ssid.size());
+    iff_writer.chunk("psk ", psk.c_str(), psk.size());
+    iff_writer.chunk("user", username.c_str(), username.size());
+    iff_writer.chunk("pass", password.c_str(), password.size());
+
+    iff_writer.close();
+}
+
+///////////////////////
+///// class Probe /////
+///////////////////////
+
+/**
+ * @returns IP type of service for a traffic class. Precedence 1 and 2 map to background,
+ *          4 and 5 to video and 6 and 7 to voice (802.1D user priority).
+ */
+static int type_of_service(Priority priority) noexcept {
+    switch (priority) {
+        case Priority::background: return 0x20;
+        case Priority::video:      return 0xa0;
+        case Priority::voice:      return 0xc0;
+        default:                   return 0x00;
+    }
+}
+
+Probe::Probe() noexcept
+    : session(nullptr),
+      mutex(),
+      _latency{},
+      total_ms(0)
+{
+}
+
+Probe::~Probe() noexcept {
+    stop();
+}
+
+esp_err_t Probe::start(const std::string& host) noexcept {
+    stop();
+
+    esp_ping_config_t config = ESP_PING_DEFAULT_CONFIG();
+    config.count       = ESP_PING_COUNT_INFINITE;
+    config.interval_ms = MY_WIFI_PROBE_INTERVAL_MS;
+    config.tos         = type_of_service(Priority::voice);     // Same queue as the OSC messages
+
+    if (!ipaddr_aton(host.c_str(), &config.target_addr)) return ESP_ERR_INVALID_ARG;
+
+    esp_ping_callbacks_t callbacks = {};
+    callbacks.cb_args         = this;
+    callbacks.on_ping_success = &Probe::_success;
+    callbacks.on_ping_timeout = &Probe::_timeout;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        _latency = {};
+        total_ms = 0;
+    }
+
+    esp_err_t error = esp_ping_new_session(&config, &callbacks, &session);
+    if (error != ESP_OK) return error;
+
+    ESP_LOGI(TAG, "Measuring latency to %s", host.c_str());
+    return esp_ping_start(session);
+}
+
+void Probe::stop() noexcept {
+    if (!session) return;
+
+    esp_ping_stop(session);
+    esp_ping_delete_session(session);
+    session = nullptr;
+}
+
+Latency Probe::latency() noexcept {
+    std::lock_guard<std::mutex> lock(mutex);
+    return _latency;
+}
+
+void Probe::_success(esp_ping_handle_t session, void* arg) noexcept {
+    Probe* probe = static_cast<Probe*>(arg);
+
+    uint32_t elapsed_ms = 0;
+    esp_ping_get_profile(session, ESP_PING_PROF_TIMEGAP, &elapsed_ms, sizeof(elapsed_ms));
+
+    std::lock_guard<std::mutex> lock(probe->mutex);
+    Latency& latency = probe->_latency;
+
+    if (!latency.received || elapsed_ms < latency.min_ms) latency.min_ms = elapsed_ms;
+    if (elapsed_ms > latency.max_ms) latency.max_ms = elapsed_ms;
+    if (elapsed_ms > MY_WIFI_SPIKE_MS) latency.spikes++;
+
+    latency.sent++;
+    latency.received++;
+    latency.last_ms = elapsed_ms;
+
+    probe->total_ms += elapsed_ms;
+    latency.mean_ms = probe->total_ms / latency.received;
+}
+
+void Probe::_timeout(esp_ping_handle_t, void* arg) noexcept {
+    Probe* probe = static_cast<Probe*>(arg);
+
+    std::lock_guard<std::mutex> lock(probe->mutex);
+    probe->_latency.sent++;
+}
+
+/////////////////////
+///// Functions /////
+/////////////////////
+
+esp_err_t prioritize(int socket, Priority priority) noexcept {
+    int tos = type_of_service(priority);
+
+    if (setsockopt(socket, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) != 0) return ESP_FAIL;
+    return ESP_OK;
+}
+
+/**
+ * @returns What is needed to connect to an access point with the given authentication mode
+ */
+static Security security(wifi_auth_mode_t authmode) noexcept {
+    switch (authmode) {
+        case WIFI_AUTH_OPEN:
+        case WIFI_AUTH_OWE:
+            return Security::open;
+
+        case WIFI_AUTH_WPA2_ENTERPRISE:
+        case WIFI_AUTH_WPA3_ENTERPRISE:
+        case WIFI_AUTH_WPA2_WPA3_ENTERPRISE:
+        case WIFI_AUTH_WPA3_ENT_192:
+            return Security::enterprise;
+
+        default:
+            return Security::psk;
+    }
+}
+
+static bool send_chunk(void* context, const char* data, size_t size) noexcept {
+    return httpd_resp_send_chunk(static_cast<httpd_req_t*>(context), data, size) == ESP_OK;
+}
+
+static esp_err_t scan_handler(httpd_req_t* request) noexcept {
+    WiFi* wifi = WiFi::instance();
+
+    esp_err_t error = wifi->scan(MY_WIFI_SCAN_MAX_AGE_MS);
+    if (error != ESP_OK) ESP_LOGW(TAG, "Cannot scan: %s", esp_err_to_name(error));
+
+    for (uint32_t waited_ms = 0; wifi->scanning() && waited_ms < MY_WIFI_SCAN_TIMEOUT_MS; waited_ms += 100) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+
+    std::vector<AccessPoint> access_points = wifi->access_points();
+
+    // Strongest first, so that only the best access point of each SSID is kept
+    std::sort(access_points.begin(), access_points.end(), [](const AccessPoint& a, const AccessPoint& b) {
+        return a.rssi > b.rssi;
+    });
+
+    httpd_resp_set_type(request, "application/json");
+    httpd_resp_set_hdr(request, "Cache-Control", "no-store");
+
+    my_json::Writer writer(send_chunk, request);
+    writer.begin_array();
+
+    for (size_t i = 0; i < access_points.size(); i++) {
+        const AccessPoint& access_point = access_points[i];
+        if (access_point.ssid.empty()) continue;    // Hidden network
+
+        bool duplicate = false;
+        for (size_t j = 0; j < i && !duplicate; j++) duplicate = access_points[j].ssid == access_point.ssid;
+        if (duplicate) continue;
+
+        const char* type = access_point.security == Security::open ? "open"
+                         : access_point.security == Security::enterprise ? "enterprise" : "wpa";
+
+        writer.begin_object();
+        writer.key("ssid");     writer.string(access_point.ssid);
+        writer.key("type");     writer.string(type);
+        writer.key("strength"); writer.integer(access_point.rssi);
+        writer.end_object();
+    }
+
+    writer.end_array();
+
+    if (!writer.flush()) return ESP_FAIL;
+    return httpd_resp_send_chunk(request, nullptr, 0);
+}
+
+esp_err_t attach(httpd_handle_t server, const char* uri) noexcept {
+    httpd_uri_t config = {};
+    config.uri     = uri;
+    config.method  = HTTP_POST;
+    config.handler = &scan_handler;
+
+    return httpd_register_uri_handler(server, &config);
+}
+
+//////////////////////
+///// class WiFi /////
+//////////////////////
+
+WiFi* WiFi::_instance = nullptr;
+
+WiFi* WiFi::instance() noexcept {
+    if (WiFi::_instance == nullptr) WiFi::_instance = new WiFi();
+    return WiFi::_instance;
+}
+
+WiFi::WiFi() noexcept
+    : _status{
+        .mode            =   Mode::disabled,
+        .state           =   State::disconnected,
+        .reconnect_count = 0,
+        .ssid            = "",
+        .mac             = "",
+        .ip4             = "",
+        .netmask         = "",
+        .gateway         = "",
+        .ip6             = "",
+    },
+    interface(nullptr),
+    _error(ESP_OK),
+    eh_wifi_event(0),
+    eh_ip_event(0),
+    reconnect_timer(nullptr),
+    ap_cached(false),
+    ap_bssid{},
+    ap_channel(0),
+    _online(false),
+    _connections(0),
+    _scanning(false),
+    scan_station(false),
+    scan_mutex(),
+    records{},
+    record_count(0),
+    scan_time_us(0)
+{
+}
+
+esp_err_t WiFi::connect(Config config) noexcept {
+    // Initialize network device
+    disconnect();
+
+    _error = esp_netif_init();
+    if (_error != ESP_OK) return _error;
+
+    switch (config.mode) {
+        case Mode::access_point:
+            ESP_LOGI(TAG, "Connecting as WiFi Access Point with SSID %s", config.ssid.c_str());
+            interface = esp_netif_create_default_wifi_ap();
+            break;
+        case Mode::station:
+            ESP_LOGI(TAG, "Connecting as WiFi Station to SSID %s", config.ssid.c_str());
+            interface = esp_netif_create_default_wifi_sta();
+            break;
+        default:
+            _error = ESP_OK;
+            return ESP_OK;
+    }
+
+    _status.mode = config.mode;
+    _status.ssid = config.ssid;
+    _status.reconnect_count = 0;
+
+    if (!reconnect_timer) {
+        const esp_timer_create_args_t timer_args = {
+            .callback              = &WiFi::sta_reconnect_timer_cb,
+            .arg                   = this,
+            .dispatch_method       = ESP_TIMER_TASK,
+            .name                  = "wifi_reconnect",
+            .skip_unhandled_events = true,
+        };
+
+        _error = esp_timer_create(&timer_args, &reconnect_timer);
+        if (_error != ESP_OK) return _error;
+    }
+
+    if (config.mode == Mode::station) sta_load_access_point();
+
+    // Start WiFi
+    wifi_init_config_t wifi_init_config = WIFI_INIT_CONFIG_DEFAULT();
+
+    _error = esp_wifi_init(&wifi_init_config);
+    if (_error != ESP_OK) return _error;
+
+    // Power save delays received frames until the next beacon
+    esp_wifi_set_ps(config.profile == Profile::low_latency ? WIFI_PS_NONE : WIFI_PS_MIN_MODEM);
+
+    // Register event handlers
+    esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &WiFi::_event_handler, this, &eh_wifi_event);
+    esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, &WiFi::_event_handler, this, &eh_ip_event);
+
+    // Setup access point / station
+    wifi_config_t wifi_config{};
+
+    switch (config.mode) {
+        case Mode::access_point: {
+            wifi_config.ap.authmode = config.psk.size() > 0 ? WIFI_AUTH_WPA2_WPA3_PSK : WIFI_AUTH_OPEN;
+            wifi_config.ap.max_connection = 255;
+            wifi_config.ap.sae_pwe_h2e = WPA3_SAE_PWE_BOTH;
+            wifi_config.ap.bss_max_idle_cfg.period = WIFI_AP_DEFAULT_MAX_IDLE_PERIOD;
+            wifi_config.ap.bss_max_idle_cfg.protected_keep_alive = 1;
+
+            std::strncpy(
+                /* dst */ reinterpret_cast<char*>(&wifi_config.ap.ssid),
+                /* src */ config.ssid.c_str(),
+                /* len */ std::min(config.ssid.size(), static_cast<std::size_t>(MAX_SSID_LEN))
+            );
+
+            std::strncpy(
+                /* dst */ reinterpret_cast<char*>(&wifi_config.ap.password),
+                /* src */ config.psk.c_str(),
+                /* len */ std::min(config.psk.size(), static_cast<std::size_t>(MAX_PASSPHRASE_LEN))
+            );
+
+            _error = esp_wifi_set_mode(WIFI_MODE_AP);
+            if (_error != ESP_OK) return _error;
+
+            _error = esp_wifi_set_config(WIFI_IF_AP, &wifi_config);
+            if (_error != ESP_OK) return _error;
+
+            _status.state = State::access_point;
+            break;
+        }
+        case Mode::station: {
+            wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK; //WIFI_AUTH_OPEN;
+            wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+            wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+
+            // Enable roaming assistance, disable fast transition / WPA3 / OWE features
+            wifi_config.sta.rm_enabled       = true;         // 802.11k - OK, neighbor reports shorten roaming scans
+            wifi_config.sta.btm_enabled      = true;         // 802.11v - OK, helps Fritz!Mesh suggest roaming
+            wifi_config.sta.mbo_enabled      = true;         // 802.11k/v add-on, Fritz!Box ignores
+            wifi_config.sta.ft_enabled       = false;        // 802.11r - disable (breaks WPA2 handshake)
+            wifi_config.sta.owe_enabled      = false;        // disable open network enhancements
+            wifi_config.sta.pmf_cfg.capable  = true;
+            wifi_config.sta.pmf_cfg.required = false;
+            wifi_config.sta.sae_pwe_h2e      = WPA3_SAE_PWE_UNSPECIFIED;
+            wifi_config.sta.sae_pk_mode      = WPA3_SAE_PK_MODE_DISABLED;
+
+            std::strncpy(
+                /* dst */ reinterpret_cast<char*>(&wifi_config.sta.ssid),
+                /* src */ config.ssid.c_str(),
+                /* len */ std::min(config.ssid.size(), static_cast<std::size_t>(MAX_SSID_LEN))
+            );
+
+            std::strncpy(
+                /* dst */ reinterpret_cast<char*>(&wifi_config.sta.password),
+                /* src */ config.psk.c_str(),
+                /* len */ std::min(config.psk.size(), static_cast<std::size_t>(MAX_PASSPHRASE_LEN))
+            );
+
+            _error = esp_wifi_set_mode(WIFI_MODE_STA);
+            if (_error != ESP_OK) return _error;
+
+            _error = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+            if (_error != ESP_OK) return _error;
+
+            _error = esp_wifi_set_bandwidth(WIFI_IF_STA, WIFI_BW_HT20);
+            if (_error != ESP_OK) return _error;
+
+            _error = esp_wifi_set_protocol(WIFI_IF_STA, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N);
+            if (_error != ESP_OK) return _error;
+
+            // Enable enterprise authentication
+            if (config.username.size() > 0) {
+                ESP_LOGI(TAG, "Enabling EAP authentication with username %s", config.username.c_str());
+
+                _error = esp_eap_client_set_username(reinterpret_cast<const unsigned char*>(config.username.c_str()), config.username.size());
+                if (_error != ESP_OK) return _error;
+
+                if (config.password.size() > 0) {
+                    _error = esp_eap_client_set_password(reinterpret_cast<const unsigned char*>(config.password.c_str()), config.password.size());
+                    if (_error != ESP_OK) return _error;
+                }
+
+                esp_eap_client_set_disable_time_check(true);
+                esp_eap_client_use_default_cert_bundle(true);
+
+                _error = esp_wifi_sta_enterprise_enable();
+                if (_error != ESP_OK) return _error;
+            }
+
+            _status.state = State::connecting;
+            break;
+        }
+        default:
+            // Nothig to do – Surpress compilation error
+            break;
+    }
+
+    _error = esp_wifi_start();
+    if (_error != ESP_OK) return _error;
+
+    return ESP_OK;
+}
+
+void WiFi::_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) noexcept {
+    WiFi* wifi = reinterpret_cast<WiFi*>(arg);
+
+    if (event_base == WIFI_EVENT) {
+        wifi->wifi_event_handler(event_id, event_data);
+    } else if (event_base == IP_EVENT) {
+        wifi->ip_event_handler(event_id, event_data);
+    }
+}
+
+void WiFi::wifi_event_handler(int32_t event_id, void* event_data) noexcept {
+    char buffer[128] = {};
+
+    switch (event_id) {
+        case WIFI_EVENT_STA_START: {
+            // Not when the station is only enabled to scan
+            if (_status.mode == Mode::station) sta_reconnect(ap_cached);
+            break;
+        }
+        case WIFI_EVENT_STA_DISCONNECTED: {
+            auto event = reinterpret_cast<wifi_event_sta_disconnected_t*>(event_data);
+            ESP_LOGW(TAG, "Disconnected from access point, reason: %d, signal strength %i dBm, MAC " MACSTR, event->reason, event->rssi, MAC2STR(event->bssid));
+
+            _online.store(false, std::memory_order_release);
+
+            // A connection that just broke is most likely back on the same access point
+            bool was_connected = _status.state == State::connected;
+            if (_status.reconnect_count < UINT8_MAX) _status.reconnect_count++;
+
+            if (was_connected && ap_cached) {
+                sta_reconnect(true);
+            } else {
+                sta_schedule_reconnect();
+            }
+
+            break;
+        }
+        case WIFI_EVENT_STA_CONNECTED: {
+            auto event = reinterpret_cast<wifi_event_sta_connected_t*>(event_data);
+
+            std::snprintf(buffer, sizeof(buffer), MACSTR, MAC2STR(event->bssid));
+            _status.mac = buffer;
+
+            _status.state = State::connected;
+            _status.reconnect_count = 0;
+
+            ESP_LOGI(TAG, "Connected to access point %s on channel %u", _status.mac.c_str(), event->channel);
+            sta_save_access_point(event->bssid, event->channel);
+            break;
+        }
+        case WIFI_EVENT_AP_START: {
+            _connections.fetch_add(1, std::memory_order_acq_rel);
+            _online.store(true, std::memory_order_release);
+            break;
+        }
+        case WIFI_EVENT_AP_STOP: {
+            _online.store(false, std::memory_order_release);
+            break;
+        }
+        case WIFI_EVENT_AP_STACONNECTED: {
+            auto event = reinterpret_cast<wifi_event_ap_staconnected_t*>(event_data);
+            ESP_LOGI(TAG, "Station " MACSTR " connected to access point", MAC2STR(event->mac));
+            break;
+        }
+        case WIFI_EVENT_AP_STADISCONNECTED: {
+            auto event = reinterpret_cast<wifi_event_ap_stadisconnected_t*>(event_data);
+            ESP_LOGI(TAG, "Station " MACSTR " disconnected from access point", MAC2STR(event->mac));
+            break;
+        }
+        case WIFI_EVENT_SCAN_DONE: {
+            scan_done(reinterpret_cast<wifi_event_sta_scan_done_t*>(event_data));
+            break;
+        }
+    }
+}
+
+void WiFi::sta_reconnect_timer_cb(void* arg) noexcept {
+    reinterpret_cast<WiFi*>(arg)->sta_reconnect(false);
+}
+
+void WiFi::sta_reconnect(bool direct) noexcept {
+    wifi_config_t wifi_config{};
+    esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+
+    if (direct) {
+        ESP_LOGI(TAG, "Connecting directly to " MACSTR " on channel %u", MAC2STR(ap_bssid), ap_channel);
+        std::memcpy(wifi_config.sta.bssid, ap_bssid, sizeof(ap_bssid));
+    } else {
+        ESP_LOGI(TAG, "Trying to connect ...");
+    }
+
+    wifi_config.sta.bssid_set   = direct;
+    wifi_config.sta.channel     = direct ? ap_channel : 0;
+    wifi_config.sta.scan_method = direct ? WIFI_FAST_SCAN : WIFI_ALL_CHANNEL_SCAN;
+
+    _status.state = State::connecting;
+    _error = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    if (_error == ESP_OK) _error = esp_wifi_connect();
+
+    // E.g. while a scan is running
+    if (_error != ESP_OK) {
+        if (_status.reconnect_count < UINT8_MAX) _status.reconnect_count++;
+        sta_schedule_reconnect();
+    }
+}
+
+void WiFi::sta_schedule_reconnect() noexcept {
+    uint32_t delay_ms = MY_WIFI_BACKOFF_MAX_MS;
+    uint8_t attempt = std::max(_status.reconnect_count, static_cast<uint8_t>(1)) - 1;
+
+    if (attempt < 16) delay_ms = std::min(delay_ms, static_cast<uint32_t>(MY_WIFI_BACKOFF_MIN_MS) << attempt);
+
+    // Somewhere between half and the full delay
+    delay_ms = delay_ms / 2 + esp_random() % (delay_ms / 2 + 1);
+
+    ESP_LOGI(TAG, "Scheduling reconnect in %lu ms", static_cast<unsigned long>(delay_ms));
+
+    esp_timer_stop(reconnect_timer);
+    esp_timer_start_once(reconnect_timer, delay_ms * 1000ULL);
+}
+
+void WiFi::sta_load_access_point() noexcept {
+    my_file::IFF_Reader iff_reader{ap_cache_file};
+
+    char ssid[MAX_SSID_LEN + 1] = {};
+    bool bssid_read = false, channel_read = false;
+
+    while (true) {
+        auto chunk = iff_reader.peek();
+
+        if (chunk.type == "ssid") {
+            iff_reader.chunk(ssid, sizeof(ssid) - 1);
+        } else if (chunk.type == "bssi") {
+            bssid_read = iff_reader.chunk(reinterpret_cast<char*>(ap_bssid), sizeof(ap_bssid)).size == sizeof(ap_bssid);
+        } else if (chunk.type == "chan") {
+            channel_read = iff_reader.chunk(reinterpret_cast<char*>(&ap_channel), sizeof(ap_channel)).size == sizeof(ap_channel);
+        } else if (chunk.type == "    ") {
+            break;
+        } else {
+            iff_reader.skip();
+        }
+    }
+
+    iff_reader.close();
+    ap_cached = bssid_read && channel_read && _status.ssid == ssid;
+}
+
+void WiFi::sta_save_access_point(const uint8_t* bssid, uint8_t channel) noexcept {
+    if (ap_cached && ap_channel == channel && std::memcmp(ap_bssid, bssid, sizeof(ap_bssid)) == 0) return;
+
+    std::memcpy(ap_bssid, bssid, sizeof(ap_bssid));
+    ap_channel = channel;
+    ap_cached  = true;
+
+    my_file::IFF_Writer iff_writer{ap_cache_file};
+
+    iff_writer.chunk("ssid", _status.ssid.c_str(), _status.ssid.size());
+    iff_writer.chunk("bssi", reinterpret_cast<const char*>(ap_bssid), sizeof(ap_bssid));
+    iff_writer.chunk("chan", reinterpret_cast<const char*>(&ap_channel), sizeof(ap_channel));
+
+    iff_writer.close();
+}
+
+void WiFi::ip_event_handler(int32_t event_id, void* event_data) noexcept {
+    char buffer[128] = {};
+
+    switch (event_id) {
+        case IP_EVENT_STA_GOT_IP: {
+            auto event = reinterpret_cast<ip_event_got_ip_t*>(event_data);
+
+            _status.state = State::connected;
+            _status.reconnect_count = 0;
+
+            std::snprintf(buffer, sizeof(buffer), IPSTR, IP2STR(&event->ip_info.ip));
+            _status.ip4 = buffer;
+
+            std::snprintf(buffer, sizeof(buffer), IPSTR, IP2STR(&event->ip_info.netmask));
+            _status.netmask = buffer;
+
+            std::snprintf(buffer, sizeof(buffer), IPSTR, IP2STR(&event->ip_info.gw));
+            _status.gateway = buffer;
+
+            ESP_LOGI(TAG, "Got IPv4 address %s", _status.ip4.c_str());
+
+            _connections.fetch_add(1, std::memory_order_acq_rel);
+            _online.store(true, std::memory_order_release);
+            break;
+        }
+        case IP_EVENT_GOT_IP6: {
+            auto event = reinterpret_cast<ip_event_got_ip6_t*>(event_data);
+
+            _status.state = State::connected;
+            _status.reconnect_count = 0;
+
+            std::snprintf(buffer, sizeof(buffer), IPV6STR, IPV62STR(event->ip6_info.ip));
+            _status.ip6 = buffer;
+
+            ESP_LOGI(TAG, "Got IPv6 address %s", _status.ip6.c_str());
+            break;
+        }
+        case IP_EVENT_STA_LOST_IP: {
+            _status.ip4     = "";
+            _status.netmask = "";
+            _status.gateway = "";
+
+            _online.store(false, std::memory_order_release);
+            ESP_LOGI(TAG, "Lost IPv4 address");
+            break;
+        }
+    }
+}
+
+esp_err_t WiFi::scan(uint32_t max_age_ms) noexcept {
+    if (_scanning.load(std::memory_order_acquire)) return ESP_OK;
+
+    {
+        std::lock_guard<std::mutex> lock(scan_mutex);
+        if (scan_time_us && max_age_ms && esp_timer_get_time() - scan_time_us <= max_age_ms * 1000LL) return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Starting WiFi scan");
+    _scanning.store(true, std::memory_order_release);
+
+    // The access point alone cannot scan
+    wifi_mode_t mode = WIFI_MODE_NULL;
+    esp_wifi_get_mode(&mode);
+
+    if (mode == WIFI_MODE_AP) {
+        _error = esp_wifi_set_mode(WIFI_MODE_APSTA);
+
+        if (_error != ESP_OK) {
+            _scanning.store(false, std::memory_order_release);
+            return _error;
+        }
+
+        scan_station = true;
+    }
+
+    _error = esp_wifi_scan_start(
+        /* config */ NULL,      // Default scan configuration
+        /* block  */ false
+    );
+
+    if (_error != ESP_OK) {
+        scan_stop_station();
+        _scanning.store(false, std::memory_order_release);
+    }
+
+    return _error;
+}
+
+void WiFi::scan_stop_station() noexcept {
+    if (!scan_station) return;
+
+    scan_station = false;
+    esp_wifi_set_mode(WIFI_MODE_AP);
+}
+
+void WiFi::scan_done(const wifi_event_sta_scan_done_t* event) noexcept {
+    if (event->status != 0) {
+        ESP_LOGW(TAG, "WiFi scan failed");
+        esp_wifi_clear_ap_list();
+    } else {
+        std::lock_guard<std::mutex> lock(scan_mutex);
+
+        // Also frees the records held by the driver
+        record_count = MY_WIFI_SCAN_MAX;
+        esp_err_t error = esp_wifi_scan_get_ap_records(&record_count, records);
+
+        if (error != ESP_OK) record_count = 0;
+        scan_time_us = esp_timer_get_time();
+
+        ESP_LOGI(TAG, "WiFi scan found %u access points", event->number);
+    }
+
+    scan_stop_station();
+    _scanning.store(false, std::memory_order_release);
+}
+
+std::vector<AccessPoint> WiFi::access_points(int64_t* time_us) noexcept {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+
+    std::vector<AccessPoint> result{};
+    result.reserve(record_count);
+
+    for (uint16_t i = 0; i < record_count; i++) {
+        char mac_address[18];
+        std::snprintf(mac_address, sizeof(mac_address), MACSTR, MAC2STR(records[i].bssid));
+
+        result.push_back(AccessPoint{
+            .ssid     = reinterpret_cast<char const*>(records[i].ssid),
+            .mac      = mac_address,
+            .rssi     = records[i].rssi,
+            .channel  = records[i].primary,
+            .security = security(records[i].authmode),
+        });
+    }
+
+    if (time_us) *time_us = scan_time_us;
+    return result;
+}
+
+esp_err_t WiFi::disconnect() noexcept {
+    // Unregister event handlers
+    if (!interface) return ESP_OK;
+    ESP_LOGI(TAG, "Disconnecting from WiFi");
+
+    if (eh_wifi_event) {
+        esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, eh_wifi_event);
+        eh_wifi_event = 0;
+    }
+
+    if (eh_ip_event) {
+        esp_event_handler_instance_unregister(IP_EVENT, ESP_EVENT_ANY_ID, eh_ip_event);
+        eh_ip_event = 0;
+    }
+
+    // Stop WiFi
+    esp_timer_stop(reconnect_timer);
+
+    if (_status.mode == Mode::station) {
+        esp_wifi_sta_enterprise_disable();
+
+        _error = esp_wifi_disconnect();
+        if (_error != ESP_OK) return _error;
+    }
+
+    _error = esp_wifi_stop();
+    if (_error != ESP_OK) return _error;
+
+    _error = esp_wifi_deinit();
+    if (_error != ESP_OK) return _error;
+
+    // Destroy network interface
+    esp_netif_destroy_default_wifi(interface);
+    interface = nullptr;
+
+    _status.state = State::disconnected;
+    _online.store(false, std::memory_order_release);
+    _scanning.store(false, std::memory_order_release);
+    scan_station = false;
+    return ESP_OK;
+}
+
+} // namespace my_wifi
\ No newline at end of file
@@ -0,0 +1,26 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file esp_log.h
+ * @brief ESP-IDF logging for the host tests
+ *
+ * Lets the hardware-independent modules of the main board be built with `[env:native]`.
+ * Errors and warnings are printed, everything else is dropped to keep the test output short.
+ */
+
+#pragma once
+
+#include <cstdio>           // std::printf
+
+#define ESP_LOGE(tag, format, ...) std::printf("E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) std::printf("W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ((void) 0)
+#define ESP_LOGD(tag, format, ...) ((void) 0)
+#define ESP_LOGV(tag, format, ...) ((void) 0)
@@ -0,0 +1,230 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file test_bus.cpp
+ * @brief Host tests, fuzzing and benchmark of the bus wire format
+ *
+ * Run with `pio test -e native -f test_bus`. The fuzz test feeds randomly mutated frames
+ * into the parser and decoder, so it is best run with `-fsanitize=address` added to the
+ * build flags. The benchmark prints the average frame size and encode/decode time of
+ * typical input reports.
+ */
+
+#include "bus.h"            // my_bus::…
+
+#include <unity.h>          // TEST_…
+
+#include <chrono>           // std::chrono::steady_clock
+#include <cstdio>           // std::snprintf
+#include <cstring>          // std::memcpy
+#include <random>           // std::mt19937
+
+constexpr uint8_t BOARD  = 3;
+constexpr uint8_t INPUTS = my_bus::MAX_SLOTS * my_control::INPUT_COUNT;
+
+/**
+ * Values delivered to the handler, per input
+ */
+struct Received {
+    int32_t values[MY_BUS_MAX_INPUTS];
+    uint32_t time_us;
+    size_t calls;
+};
+
+static void handler(void* context, uint8_t, uint8_t slot, uint8_t changed, const int32_t* values, uint32_t time_us) noexcept {
+    Received& received = *static_cast<Received*>(context);
+
+    for (size_t i = 0; i < my_control::INPUT_COUNT; i++) {
+        if (changed & (1 << i)) received.values[slot * my_control::INPUT_COUNT + i] = values[i];
+    }
+
+    received.time_us = time_us;
+    received.calls++;
+}
+
+static my_bus::Result decode(my_bus::Decoder& decoder, const uint8_t* frame, size_t size, Received& received) {
+    my_bus::Header header;
+    const uint8_t* payload;
+
+    my_bus::Result result = my_bus::parse(frame, size, header, payload);
+    if (result != my_bus::Result::ok) return result;
+
+    return decoder.decode(header, payload, handler, &received);
+}
+
+void setUp() {}
+void tearDown() {}
+
+/**
+ * Random changes of random inputs arrive unchanged, with deltas after the first report.
+ */
+void test_round_trip() {
+    std::mt19937 random(1);
+    my_bus::Encoder encoder(BOARD, INPUTS);
+    my_bus::Decoder decoder;
+    Received received = {};
+    int32_t expected[MY_BUS_MAX_INPUTS] = {};
+    uint8_t frame[my_bus::MAX_FRAME];
+
+    for (uint32_t round = 0; round < 10000; round++) {
+        size_t changes = random() % 8;
+
+        for (size_t i = 0; i < changes; i++) {
+            uint8_t input = random() % INPUTS;
+
+            // Mostly small steps, sometimes jumps over the full 32-bit range
+            int32_t value = random() % 16 ? static_cast<int32_t>(int64_t(expected[input]) + random() % 65 - 32) : static_cast<int32_t>(random());
+            expected[input] = value;
+            encoder.set(input, value, round);
+        }
+
+        size_t size = encoder.encode(frame);
+        if (!size) continue;
+
+        TEST_ASSERT_LESS_OR_EQUAL(my_bus::MAX_FRAME, size);
+        TEST_ASSERT_EQUAL(my_bus::Result::ok, decode(decoder, frame, size, received));
+        TEST_ASSERT_EQUAL_MEMORY(expected, received.values, sizeof(expected));
+        TEST_ASSERT_EQUAL_UINT32(round, received.time_us);
+    }
+}
+
+/**
+ * A lost delta report asks for a resync, after which the absolute values are correct again.
+ */
+void test_sequence_gap() {
+    my_bus::Encoder encoder(BOARD, INPUTS);
+    my_bus::Decoder decoder;
+    Received received = {};
+    uint8_t frame[my_bus::MAX_FRAME];
+
+    encoder.set(0, 100, 1);
+    TEST_ASSERT_EQUAL(my_bus::Result::ok, decode(decoder, frame, encoder.encode(frame), received));
+
+    encoder.set(0, 110, 2);
+    encoder.encode(frame);      // Lost
+
+    encoder.set(0, 120, 3);
+    TEST_ASSERT_EQUAL(my_bus::Result::resync, decode(decoder, frame, encoder.encode(frame), received));
+    TEST_ASSERT_EQUAL_INT32(100, received.values[0]);
+
+    encoder.resync();
+    TEST_ASSERT_EQUAL(my_bus::Result::ok, decode(decoder, frame, encoder.encode(frame), received));
+    TEST_ASSERT_EQUAL_INT32(120, received.values[0]);
+}
+
+/**
+ * Every single bit error is caught by the checksum (or the version and length checks).
+ */
+void test_crc_rejection() {
+    my_bus::Encoder encoder(BOARD, INPUTS);
+    uint8_t frame[my_bus::MAX_FRAME];
+
+    for (uint8_t i = 0; i < INPUTS; i++) encoder.set(i, i * 1000 - 20000, 42);
+    size_t size = encoder.encode(frame);
+
+    for (size_t bit = 0; bit < size * 8; bit++) {
+        uint8_t corrupt[my_bus::MAX_FRAME];
+        std::memcpy(corrupt, frame, size);
+        corrupt[bit / 8] ^= 1 << (bit % 8);
+
+        my_bus::Header header;
+        const uint8_t* payload;
+        TEST_ASSERT_NOT_EQUAL(my_bus::Result::ok, my_bus::parse(corrupt, size, header, payload));
+    }
+}
+
+/**
+ * Frames cut off at any byte are incomplete, not accepted.
+ */
+void test_truncated_frames() {
+    my_bus::Encoder encoder(BOARD, INPUTS);
+    uint8_t frame[my_bus::MAX_FRAME];
+
+    for (uint8_t i = 0; i < INPUTS; i++) encoder.set(i, i, 1);
+    size_t size = encoder.encode(frame);
+
+    for (size_t length = 0; length < size; length++) {
+        my_bus::Header header;
+        const uint8_t* payload;
+        TEST_ASSERT_EQUAL(my_bus::Result::incomplete, my_bus::parse(frame, length, header, payload));
+    }
+}
+
+/**
+ * Payloads that do not match their length are rejected by the decoder, even with a valid
+ * checksum, and never read beyond the frame.
+ */
+void test_fuzz_decoder() {
+    std::mt19937 random(2);
+
+    for (uint32_t round = 0; round < 100000; round++) {
+        // Exactly sized heap buffer, so that the address sanitizer notices overreads
+        size_t length = random() % 48;
+        uint8_t* frame = new uint8_t[sizeof(my_bus::Header) + length + my_bus::CRC_SIZE];
+
+        uint8_t* payload = my_bus::begin(frame, random() % 4 ? my_bus::Type::input_report : my_bus::Type::event_report, BOARD, random() % 2, 0);
+        for (size_t i = 0; i < length; i++) payload[i] = random();
+        size_t size = my_bus::finish(frame, length);
+
+        my_bus::Decoder decoder;
+        Received received = {};
+        decode(decoder, frame, size, received);
+
+        delete[] frame;
+    }
+}
+
+/**
+ * Average size and time of reports with a few changed inputs, as with knobs being turned.
+ */
+void test_benchmark() {
+    std::mt19937 random(3);
+    my_bus::Encoder encoder(BOARD, INPUTS);
+    my_bus::Decoder decoder;
+    Received received = {};
+    int32_t values[MY_BUS_MAX_INPUTS] = {};
+    uint8_t frame[my_bus::MAX_FRAME];
+
+    constexpr uint32_t rounds = 100000;
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < 3; i++) {
+            uint8_t input = random() % INPUTS;
+            values[input] += static_cast<int32_t>(random() % 9) - 4;
+            encoder.set(input, values[input], round);
+        }
+
+        size_t size = encoder.encode(frame);
+        bytes += size;
+        decode(decoder, frame, size, received);
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    char message[128];
+    std::snprintf(message, sizeof(message), "%u inputs, 3 changes: %.1f bytes and %.0f ns per report",
+        INPUTS, static_cast<double>(bytes) / rounds, static_cast<double>(elapsed) / rounds);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_EQUAL_MEMORY(values, received.values, sizeof(values));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_sequence_gap);
+    RUN_TEST(test_crc_rejection);
+    RUN_TEST(test_truncated_frames);
+    RUN_TEST(test_fuzz_decoder);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
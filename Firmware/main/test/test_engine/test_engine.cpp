@@ -0,0 +1,188 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file test_engine.cpp
+ * @brief Host tests of the takeover modes and echo suppression of the input store
+ *
+ * Run with `pio test -e native -f test_engine`. A single input is moved and receives values
+ * from outside, like a knob without motor whose value is also changed by a DAW.
+ */
+
+#include "engine.h"         // my_engine::…
+
+#include <unity.h>          // TEST_…
+
+constexpr my_engine::input_t INPUT = 0;
+constexpr float TOLERANCE = 0.0001f;
+
+/**
+ * Store with one control whose first input uses the given mode
+ */
+static my_engine::InputStore store(my_engine::Takeover mode, float from = 0.0f, float to = 1.0f) {
+    my_engine::InputStore store;
+    store.resize(1);
+    store.configure(INPUT, mode, from, to, from);
+    return store;
+}
+
+/**
+ * Move the knob and return whether the logical value changed.
+ */
+static bool move(my_engine::InputStore& store, float position, uint32_t now_us) {
+    my_engine::Update update = {INPUT, position};
+    my_engine::input_t changed[1];
+    return store.move(&update, 1, changed, now_us) == 1;
+}
+
+/**
+ * Receive a value and return whether it was taken over.
+ */
+static bool receive(my_engine::InputStore& store, float value, uint32_t now_us) {
+    my_engine::Update update = {INPUT, value};
+    my_engine::input_t changed[1];
+    return store.feedback(&update, 1, changed, now_us) == 1;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+/**
+ * In jump mode the next move takes over the knob position right away.
+ */
+void test_jump() {
+    my_engine::InputStore inputs = store(my_engine::Takeover::jump);
+
+    TEST_ASSERT_TRUE(move(inputs, 0.2f, 0));
+    TEST_ASSERT_TRUE(receive(inputs, 0.8f, 1000000));
+    TEST_ASSERT_EQUAL_FLOAT(0.8f, inputs.value(INPUT));
+    TEST_ASSERT_TRUE(inputs.pending(INPUT));
+
+    TEST_ASSERT_TRUE(move(inputs, 0.25f, 1100000));
+    TEST_ASSERT_EQUAL_FLOAT(0.25f, inputs.value(INPUT));
+    TEST_ASSERT_FALSE(inputs.pending(INPUT));
+}
+
+/**
+ * In pickup mode the value stays until the knob passes it.
+ */
+void test_pickup() {
+    my_engine::InputStore inputs = store(my_engine::Takeover::pickup);
+
+    move(inputs, 0.2f, 0);
+    TEST_ASSERT_TRUE(receive(inputs, 0.8f, 1000000));
+
+    TEST_ASSERT_FALSE(move(inputs, 0.5f, 1100000));
+    TEST_ASSERT_EQUAL_FLOAT(0.8f, inputs.value(INPUT));
+    TEST_ASSERT_TRUE(inputs.pending(INPUT));
+
+    TEST_ASSERT_TRUE(move(inputs, 0.85f, 1200000));
+    TEST_ASSERT_EQUAL_FLOAT(0.85f, inputs.value(INPUT));
+    TEST_ASSERT_FALSE(inputs.pending(INPUT));
+
+    // Passing the value from above works the same
+    TEST_ASSERT_TRUE(receive(inputs, 0.3f, 2000000));
+    TEST_ASSERT_FALSE(move(inputs, 0.6f, 2100000));
+    TEST_ASSERT_TRUE(move(inputs, 0.2f, 2200000));
+    TEST_ASSERT_EQUAL_FLOAT(0.2f, inputs.value(INPUT));
+}
+
+/**
+ * In scale mode the value moves proportionally, so that both arrive at the end of the
+ * range at the same time.
+ */
+void test_scale() {
+    my_engine::InputStore inputs = store(my_engine::Takeover::scale);
+
+    move(inputs, 0.2f, 0);
+    TEST_ASSERT_TRUE(receive(inputs, 0.8f, 1000000));
+
+    // A fifth of the distance to the upper end: 0.8 + 0.2 * (1.0 - 0.8) / (1.0 - 0.2)
+    TEST_ASSERT_TRUE(move(inputs, 0.4f, 1100000));
+    TEST_ASSERT_FLOAT_WITHIN(TOLERANCE, 0.85f, inputs.value(INPUT));
+    TEST_ASSERT_TRUE(inputs.pending(INPUT));
+
+    // Moving down approaches the lower end: 0.85 - 0.2 * (0.85 - 0.0) / (0.4 - 0.0)
+    TEST_ASSERT_TRUE(move(inputs, 0.2f, 1200000));
+    TEST_ASSERT_FLOAT_WITHIN(TOLERANCE, 0.425f, inputs.value(INPUT));
+
+    // Both meet at the end
+    TEST_ASSERT_TRUE(move(inputs, 0.0f, 1300000));
+    TEST_ASSERT_FLOAT_WITHIN(TOLERANCE, 0.0f, inputs.value(INPUT));
+    TEST_ASSERT_FALSE(inputs.pending(INPUT));
+}
+
+/**
+ * Scaling respects a value range smaller than the full range of the knob.
+ */
+void test_scale_range() {
+    my_engine::InputStore inputs = store(my_engine::Takeover::scale, 0.25f, 0.75f);
+
+    move(inputs, 0.25f, 0);
+    TEST_ASSERT_TRUE(receive(inputs, 0.6f, 1000000));
+
+    // 0.6 + 0.1 * (0.75 - 0.6) / (0.75 - 0.25)
+    TEST_ASSERT_TRUE(move(inputs, 0.35f, 1100000));
+    TEST_ASSERT_FLOAT_WITHIN(TOLERANCE, 0.63f, inputs.value(INPUT));
+
+    TEST_ASSERT_TRUE(move(inputs, 0.75f, 1200000));
+    TEST_ASSERT_FLOAT_WITHIN(TOLERANCE, 0.75f, inputs.value(INPUT));
+    TEST_ASSERT_FALSE(inputs.pending(INPUT));
+}
+
+/**
+ * Echoes of older values arriving after the knob has moved on are ignored, too, as long
+ * as they are within the echo window.
+ */
+void test_delayed_echo() {
+    my_engine::InputStore inputs = store(my_engine::Takeover::jump);
+
+    move(inputs, 0.1f, 1000);
+    move(inputs, 0.2f, 2000);
+    move(inputs, 0.3f, 3000);
+
+    TEST_ASSERT_FALSE(receive(inputs, 0.1f, 10000));
+    TEST_ASSERT_FALSE(receive(inputs, 0.2f, 11000));
+    TEST_ASSERT_FALSE(receive(inputs, 0.3f, 12000));
+    TEST_ASSERT_EQUAL_FLOAT(0.3f, inputs.value(INPUT));
+
+    // Any other value is taken over
+    TEST_ASSERT_TRUE(receive(inputs, 0.15f, 13000));
+    TEST_ASSERT_EQUAL_FLOAT(0.15f, inputs.value(INPUT));
+
+    // After the window the old value is a real change
+    TEST_ASSERT_TRUE(receive(inputs, 0.2f, 2000 + MY_ENGINE_ECHO_US));
+}
+
+/**
+ * Only the last `MY_ENGINE_ECHO_VALUES` sent values are remembered.
+ */
+void test_echo_ring() {
+    my_engine::InputStore inputs = store(my_engine::Takeover::jump);
+
+    for (int n = 1; n <= MY_ENGINE_ECHO_VALUES + 1; n++) move(inputs, n / 10.0f, n * 1000);
+
+    TEST_ASSERT_TRUE(receive(inputs, 0.1f, 20000));
+    TEST_ASSERT_FALSE(receive(inputs, (MY_ENGINE_ECHO_VALUES + 1) / 10.0f, 21000));
+    TEST_ASSERT_FALSE(receive(inputs, 0.2f, 22000));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_jump);
+    RUN_TEST(test_pickup);
+    RUN_TEST(test_scale);
+    RUN_TEST(test_scale_range);
+    RUN_TEST(test_delayed_echo);
+    RUN_TEST(test_echo_ring);
+    return UNITY_END();
+}
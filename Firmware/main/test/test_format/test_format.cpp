@@ -0,0 +1,207 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file test_format.cpp
+ * @brief Host tests of the compiled message templates
+ *
+ * Run with `pio test -e native -f test_format`. Messages are encoded and decoded again in
+ * both formats, and values and messages out of range must be clamped or rejected without
+ * overflowing, which is best run with `-fsanitize=undefined` added to the build flags.
+ */
+
+#include "format.h"         // my_format::…
+
+#include <unity.h>          // TEST_…
+
+#include <cmath>            // NAN
+#include <cstring>          // std::strlen
+
+using my_format::Format;
+using my_format::Template;
+
+constexpr size_t A0 = 3;            ///< Index of input A0
+
+/**
+ * Compile a template whose only placeholder is `{A0}` with the given range.
+ */
+static Template compile(const char* data, Format format, float from = 0.0f, float to = 1.0f, uint8_t decimals = 2, char separator = '.') {
+    my_format::Placeholder placeholders[my_control::INPUT_COUNT] = {};
+    placeholders[A0] = {"{A0}", from, to, decimals, separator};
+
+    return Template::compile(data, format, placeholders);
+}
+
+/**
+ * Encode a single value of input A0.
+ */
+static std::string encode(const Template& message, float value) {
+    float values[my_control::INPUT_COUNT] = {};
+    values[A0] = value;
+
+    uint8_t buffer[64];
+    size_t size = message.encode(values, buffer, sizeof(buffer));
+    return std::string(reinterpret_cast<const char*>(buffer), size);
+}
+
+/**
+ * Decode a message. Returns whether it matched and the value of input A0 in `value`.
+ */
+static bool decode(const Template& message, const std::string& data, float& value) {
+    float values[my_control::INPUT_COUNT] = {};
+    values[A0] = value;
+    uint8_t changed = 0;
+
+    bool result = message.decode(reinterpret_cast<const uint8_t*>(data.data()), data.size(), values, changed);
+    if (result) TEST_ASSERT_EQUAL_HEX8(1 << A0, changed);
+
+    value = values[A0];
+    return result;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+/**
+ * Text values are written with the decimals and separator of the input and read back.
+ */
+void test_text_round_trip() {
+    Template message = compile("Volume {A0}", Format::text, -10.0f, 10.0f, 2, ',');
+    TEST_ASSERT_EQUAL_HEX8(1 << A0, message.inputs());
+
+    const float values[] = {0.5f, -3.25f, 7.0f, 0.0f};
+    const char* texts[]  = {"Volume 0,50", "Volume -3,25", "Volume 7,00", "Volume 0,00"};
+
+    for (size_t i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_STRING(texts[i], encode(message, values[i]).c_str());
+
+        float value = 99.0f;
+        TEST_ASSERT_TRUE(decode(message, texts[i], value));
+        TEST_ASSERT_FLOAT_WITHIN(0.0001f, values[i], value);
+    }
+
+    // Without decimals, and with more decimals than configured
+    Template integer = compile("{A0}", Format::text, 0.0f, 127.0f, 0);
+    TEST_ASSERT_EQUAL_STRING("64", encode(integer, 63.5f).c_str());
+
+    float value = 0.0f;
+    TEST_ASSERT_TRUE(decode(integer, "12", value));
+    TEST_ASSERT_EQUAL_FLOAT(12.0f, value);
+    TEST_ASSERT_TRUE(decode(message, "Volume 1,125", value));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 1.125f, value);
+}
+
+/**
+ * Binary values use the smallest big-endian integer of the value range.
+ */
+void test_binary_round_trip() {
+    Template cc = compile("0xB0 0x07 {A0}", Format::binary, 0.0f, 127.0f);
+    TEST_ASSERT_EQUAL(3, cc.max_size());
+    TEST_ASSERT_EQUAL_STRING("\xB0\x07\x40", encode(cc, 64.4f).c_str());
+
+    float value = 0.0f;
+    TEST_ASSERT_TRUE(decode(cc, "\xB0\x07\x40", value));
+    TEST_ASSERT_EQUAL_FLOAT(64.0f, value);
+
+    Template pitch = compile("0xE0{A0}", Format::binary, -1000.0f, 1000.0f);
+    TEST_ASSERT_EQUAL(3, pitch.max_size());
+    TEST_ASSERT_TRUE(encode(pitch, -2.0f) == std::string("\xE0\xFF\xFE", 3));
+    TEST_ASSERT_TRUE(decode(pitch, std::string("\xE0\xFF\xFE", 3), value));
+    TEST_ASSERT_EQUAL_FLOAT(-2.0f, value);
+
+    Template wide = compile("{A0}", Format::binary, 0.0f, 100000.0f);
+    TEST_ASSERT_TRUE(encode(wide, 70000.0f) == std::string("\x00\x01\x11\x70", 4));
+    TEST_ASSERT_TRUE(decode(wide, std::string("\x00\x01\x11\x70", 4), value));
+    TEST_ASSERT_EQUAL_FLOAT(70000.0f, value);
+}
+
+/**
+ * Values outside of the integer type or the reserved digits are clamped.
+ */
+void test_encode_clamp() {
+    Template byte = compile("{A0}", Format::binary, 0.0f, 127.0f);
+    TEST_ASSERT_TRUE(encode(byte, 300.0f) == "\xFF");
+    TEST_ASSERT_TRUE(encode(byte, -5.0f) == std::string("\x00", 1));
+    TEST_ASSERT_TRUE(encode(byte, NAN) == std::string("\x00", 1));
+
+    Template word = compile("{A0}", Format::binary, -1000.0f, 1000.0f);
+    TEST_ASSERT_TRUE(encode(word, 1e6f) == "\x7F\xFF");
+    TEST_ASSERT_TRUE(encode(word, -1e6f) == std::string("\x80\x00", 2));
+
+    Template unsigned_long = compile("{A0}", Format::binary, 0.0f, 1e6f);
+    TEST_ASSERT_TRUE(encode(unsigned_long, 5e9f) == "\xFF\xFF\xFF\xFF");
+    TEST_ASSERT_TRUE(encode(unsigned_long, 3e9f) == std::string("\xB2\xD0\x5E\x00", 4));
+
+    Template signed_long = compile("{A0}", Format::binary, -1e6f, 1e6f);
+    TEST_ASSERT_TRUE(encode(signed_long, 1e12f) == "\x7F\xFF\xFF\xFF");
+    TEST_ASSERT_TRUE(encode(signed_long, -1e12f) == std::string("\x80\x00\x00\x00", 4));
+
+    Template text = compile("{A0}", Format::text, 0.0f, 1.0f, 2);
+    TEST_ASSERT_EQUAL_STRING("9999999999.99", encode(text, 1e20f).c_str());
+    TEST_ASSERT_EQUAL_STRING("-9999999999.99", encode(text, -1e20f).c_str());
+    TEST_ASSERT_EQUAL_STRING("0.00", encode(text, NAN).c_str());
+}
+
+/**
+ * Messages that do not match the template are rejected and change no value.
+ */
+void test_bad_input() {
+    Template message = compile("Volume {A0}", Format::text);
+
+    const char* bad[] = {"", "Volume", "Volume ", "Volume x", "Volume -", "Volume 1.2x", "Volum 1", "volume 1", "Volume 1 "};
+
+    for (const char* text : bad) {
+        float value = 42.0f;
+        TEST_ASSERT_FALSE(decode(message, text, value));
+        TEST_ASSERT_EQUAL_FLOAT(42.0f, value);
+    }
+
+    Template cc = compile("0xB0 0x07 {A0}", Format::binary, 0.0f, 127.0f);
+    float value = 42.0f;
+
+    TEST_ASSERT_FALSE(decode(cc, "\xB0\x07", value));
+    TEST_ASSERT_FALSE(decode(cc, "\xB0\x08\x01", value));
+    TEST_ASSERT_FALSE(decode(cc, "\xB0\x07\x01\x02", value));
+    TEST_ASSERT_EQUAL_FLOAT(42.0f, value);
+
+    // Too small output buffer
+    float values[my_control::INPUT_COUNT] = {};
+    uint8_t buffer[2];
+    TEST_ASSERT_EQUAL(0, cc.encode(values, buffer, sizeof(buffer)));
+}
+
+/**
+ * Overlong numbers are clamped to the digits of the encoder instead of overflowing.
+ */
+void test_decode_overflow() {
+    Template message = compile("{A0}", Format::text);
+    float value = 0.0f;
+
+    TEST_ASSERT_TRUE(decode(message, "123456789012345678901234567890", value));
+    TEST_ASSERT_FLOAT_WITHIN(1000.0f, 9999999999.0f, value);
+
+    TEST_ASSERT_TRUE(decode(message, "-99999999999999999999.5", value));
+    TEST_ASSERT_FLOAT_WITHIN(1000.0f, -9999999999.0f, value);
+
+    TEST_ASSERT_TRUE(decode(message, "0.1234567890123456789", value));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.123457f, value);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_text_round_trip);
+    RUN_TEST(test_binary_round_trip);
+    RUN_TEST(test_encode_clamp);
+    RUN_TEST(test_bad_input);
+    RUN_TEST(test_decode_overflow);
+    return UNITY_END();
+}
@@ -0,0 +1,132 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file test_mcp3208.cpp
+ * @brief Host tests of the MCP3208 driver replaying recorded samples
+ *
+ * Run with `pio test -e native -f test_mcp3208`. Only the Linux replay exists on the host,
+ * so the tests are skipped on other systems.
+ */
+
+#include "mcp3208.h"        // my_mcp3208::…
+
+#include <unity.h>          // TEST_…
+
+#include <cerrno>           // ENOENT
+#include <cstdio>           // std::fopen, std::fputs, std::remove
+
+constexpr const char* RECORDING = "test_mcp3208.txt";
+
+#if defined(__linux__)
+static void record(const char* text) {
+    std::FILE* file = std::fopen(RECORDING, "w");
+    std::fputs(text, file);
+    std::fclose(file);
+}
+
+static my_mcp3208::Config config(const char* path = RECORDING) {
+    my_mcp3208::Config config;
+    config.path = path;
+    return config;
+}
+#endif
+
+void setUp() {
+}
+
+void tearDown() {
+    std::remove(RECORDING);
+}
+
+#if defined(__linux__)
+/**
+ * Frames are replayed line by line with increasing sequence numbers and start over at the
+ * end of the recording.
+ */
+void test_replay() {
+    record("0 1 2 3 4 5 6 7\n4095 4096 8191 65535 10 20 30 40\n");
+
+    my_mcp3208::Mcp3208 adc = my_mcp3208::Mcp3208::open(config());
+    TEST_ASSERT_EQUAL(0, adc.error());
+
+    const uint16_t expected[3][my_mcp3208::CHANNELS] = {
+        {0, 1, 2, 3, 4, 5, 6, 7},
+        {4095, 0, 4095, 4095, 10, 20, 30, 40},  // Only twelve bits, like the ADC
+        {0, 1, 2, 3, 4, 5, 6, 7},
+    };
+
+    for (uint32_t i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(adc.start());
+        TEST_ASSERT_TRUE(adc.poll());
+        TEST_ASSERT_EQUAL_UINT32(i + 1, adc.front().sequence);
+        TEST_ASSERT_EQUAL_MEMORY(expected[i], adc.front().values, sizeof(expected[i]));
+    }
+}
+
+/**
+ * A new frame is only converted after `start()`, and only one at a time.
+ */
+void test_start_poll() {
+    record("1 2 3 4 5 6 7 8\n");
+
+    my_mcp3208::Mcp3208 adc = my_mcp3208::Mcp3208::open(config());
+
+    TEST_ASSERT_FALSE(adc.poll());
+    TEST_ASSERT_TRUE(adc.start());
+    TEST_ASSERT_FALSE(adc.start());
+    TEST_ASSERT_TRUE(adc.poll());
+    TEST_ASSERT_FALSE(adc.poll());
+    TEST_ASSERT_EQUAL_UINT32(1, adc.front().sequence);
+}
+
+/**
+ * Incomplete lines start the replay over, a recording without any complete frame
+ * delivers nothing.
+ */
+void test_garbage() {
+    record("9 9 9 9 9 9 9 9\n1 2 3\n");
+
+    my_mcp3208::Mcp3208 adc = my_mcp3208::Mcp3208::open(config());
+
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(adc.start());
+        TEST_ASSERT_TRUE(adc.poll());
+        TEST_ASSERT_EQUAL_UINT16(9, adc.front().values[7]);
+    }
+
+    record("no samples\n");
+    my_mcp3208::Mcp3208 empty = my_mcp3208::Mcp3208::open(config());
+
+    TEST_ASSERT_TRUE(empty.start());
+    TEST_ASSERT_FALSE(empty.poll());
+    TEST_ASSERT_EQUAL_UINT32(0, empty.front().sequence);
+}
+
+/**
+ * A missing recording is reported like a missing device.
+ */
+void test_missing_file() {
+    my_mcp3208::Mcp3208 adc = my_mcp3208::Mcp3208::open(config("does/not/exist.txt"));
+
+    TEST_ASSERT_EQUAL(ENOENT, adc.error());
+    TEST_ASSERT_FALSE(adc.start());
+}
+#endif
+
+int main() {
+    UNITY_BEGIN();
+#if defined(__linux__)
+    RUN_TEST(test_replay);
+    RUN_TEST(test_start_poll);
+    RUN_TEST(test_garbage);
+    RUN_TEST(test_missing_file);
+#endif
+    return UNITY_END();
+}
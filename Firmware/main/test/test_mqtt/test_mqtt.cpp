@@ -0,0 +1,320 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file test_mqtt.cpp
+ * @brief Host tests of the MQTT client against a fake broker
+ *
+ * Run with `pio test -e native -f test_mqtt`. The fake broker records everything the
+ * client writes and feeds it prepared packets, including malformed ones, which is best
+ * run with `-fsanitize=address` added to the build flags. On Linux the socket transport
+ * is tested over a loopback connection, too.
+ */
+
+#include "mqtt.h"           // my_mqtt::…
+
+#include <unity.h>          // TEST_…
+
+#include <algorithm>        // std::min
+#include <cstring>          // std::memcpy
+#include <random>           // std::mt19937
+#include <string>           // std::string, std::to_string
+#include <vector>           // std::vector
+
+#if defined(__linux__)
+#include <netinet/in.h>     // sockaddr_in
+#include <sys/socket.h>     // socket, bind, listen, accept, recv
+#include <unistd.h>         // close
+#endif
+
+/**
+ * Transport that records the written bytes and reads prepared ones
+ */
+class Broker : public my_mqtt::Transport {
+public:
+    bool write(const my_mqtt::Slice* slices, size_t count) noexcept override {
+        for (size_t i = 0; i < count; i++) output.insert(output.end(), slices[i].data, slices[i].data + slices[i].size);
+        writes++;
+        return true;
+    }
+
+    int read(uint8_t* buffer, size_t size) noexcept override {
+        size = std::min(size, input.size() - position);
+        std::memcpy(buffer, input.data() + position, size);
+        position += size;
+        return static_cast<int>(size);
+    }
+
+    void send(std::vector<uint8_t> packet) { input.insert(input.end(), packet.begin(), packet.end()); }
+
+    std::vector<uint8_t> output;    ///< Bytes written by the client
+    size_t writes = 0;              ///< Number of writes
+    std::vector<uint8_t> input;     ///< Bytes to be read by the client
+    size_t position = 0;            ///< Next byte to be read
+};
+
+/**
+ * Packet written by the client
+ */
+struct Packet {
+    uint8_t type;
+    std::vector<uint8_t> body;
+};
+
+/**
+ * Split the written bytes into packets.
+ */
+static std::vector<Packet> packets(const std::vector<uint8_t>& stream) {
+    std::vector<Packet> result;
+    size_t offset = 0;
+
+    while (offset < stream.size()) {
+        uint8_t type = stream[offset++];
+        size_t remaining = 0;
+
+        for (int shift = 0; ; shift += 7) {
+            uint8_t byte = stream[offset++];
+            remaining |= (byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+
+        TEST_ASSERT_TRUE(offset + remaining <= stream.size());
+        result.push_back({type, {stream.begin() + offset, stream.begin() + offset + remaining}});
+        offset += remaining;
+    }
+
+    return result;
+}
+
+/**
+ * Connect and let the broker accept with the given topic alias maximum.
+ */
+static void connect(my_mqtt::Client& client, Broker& broker, my_mqtt::Version version, uint16_t alias_maximum = 0) {
+    my_mqtt::Options options;
+    options.version   = version;
+    options.client_id = "test";
+
+    TEST_ASSERT_TRUE(client.connect(options, 0));
+    TEST_ASSERT_EQUAL_HEX8(0x10, broker.output[0]);
+
+    if (version == my_mqtt::Version::v5) {
+        broker.send({0x20, 0x06, 0x00, 0x00, 0x03, 0x22, static_cast<uint8_t>(alias_maximum >> 8), static_cast<uint8_t>(alias_maximum)});
+    } else {
+        broker.send({0x20, 0x02, 0x00, 0x00});
+    }
+
+    TEST_ASSERT_TRUE(client.poll(0));
+    TEST_ASSERT_EQUAL(my_mqtt::State::connected, client.state());
+    broker.output.clear();
+}
+
+static size_t handled = 0;
+
+static void handler(void*, std::string_view, const uint8_t*, size_t) noexcept {
+    handled++;
+}
+
+void setUp() {
+    handled = 0;
+}
+
+void tearDown() {
+}
+
+/**
+ * The topic name is only sent with the first message of a topic with alias.
+ */
+void test_topic_alias() {
+    Broker broker;
+    my_mqtt::Client client(broker);
+
+    my_mqtt::topic_t one   = client.add_topic("mmc/fader/1");
+    my_mqtt::topic_t two   = client.add_topic("mmc/fader/2");
+    my_mqtt::topic_t three = client.add_topic("mmc/fader/3");
+    connect(client, broker, my_mqtt::Version::v5, 2);
+
+    const uint8_t value[] = {'0', '.', '5'};
+
+    for (my_mqtt::topic_t topic : {one, one, two, three, three}) {
+        TEST_ASSERT_TRUE(client.publish(topic, value, sizeof(value)));
+    }
+
+    std::vector<Packet> sent = packets(broker.output);
+    TEST_ASSERT_EQUAL(5, sent.size());
+
+    // Topic length, topic, properties (alias), payload
+    TEST_ASSERT_EQUAL(2 + 11 + 4 + 3, sent[0].body.size());
+    TEST_ASSERT_EQUAL(2 + 0 + 4 + 3, sent[1].body.size());
+    TEST_ASSERT_EQUAL(2 + 11 + 4 + 3, sent[2].body.size());
+
+    // No alias left for the third topic
+    TEST_ASSERT_EQUAL(2 + 11 + 1 + 3, sent[3].body.size());
+    TEST_ASSERT_EQUAL(2 + 11 + 1 + 3, sent[4].body.size());
+}
+
+/**
+ * Staged values are written in batches, with one PUBLISH per topic and only the newest
+ * value.
+ */
+void test_flush_batches() {
+    constexpr size_t TOPICS = 3 * MY_MQTT_BATCH_SIZE + 1;
+
+    Broker broker;
+    my_mqtt::Client client(broker);
+
+    for (size_t i = 0; i < TOPICS; i++) client.add_topic("mmc/control/" + std::to_string(i));
+    connect(client, broker, my_mqtt::Version::v3_1_1);
+
+    for (size_t i = 0; i < TOPICS; i++) {
+        uint8_t old_value = 0xFF, value = static_cast<uint8_t>(i);
+        TEST_ASSERT_TRUE(client.stage(i, &old_value, 1));
+        TEST_ASSERT_TRUE(client.stage(i, &value, 1));
+    }
+
+    broker.writes = 0;
+    TEST_ASSERT_TRUE(client.flush());
+    TEST_ASSERT_EQUAL((TOPICS + MY_MQTT_BATCH_SIZE - 1) / MY_MQTT_BATCH_SIZE, broker.writes);
+
+    std::vector<Packet> sent = packets(broker.output);
+    TEST_ASSERT_EQUAL(TOPICS, sent.size());
+
+    for (size_t i = 0; i < TOPICS; i++) {
+        TEST_ASSERT_EQUAL_HEX8(0x30, sent[i].type);
+        TEST_ASSERT_EQUAL(i, sent[i].body.back());
+    }
+
+    // Nothing is left staged
+    broker.output.clear();
+    TEST_ASSERT_TRUE(client.flush());
+    TEST_ASSERT_EQUAL(0, broker.output.size());
+}
+
+/**
+ * Received messages are passed to the handler.
+ */
+void test_receive() {
+    Broker broker;
+    my_mqtt::Client client(broker);
+    connect(client, broker, my_mqtt::Version::v5);
+
+    broker.send({0x30, 0x08, 0x00, 0x03, 'a', '/', 'b', 0x00, '4', '2'});
+    TEST_ASSERT_TRUE(client.poll(0, handler));
+    TEST_ASSERT_EQUAL(1, handled);
+}
+
+/**
+ * PUBLISH packets whose topic or properties exceed the packet are protocol errors and
+ * never reach the handler.
+ */
+void test_malformed_publish() {
+    const std::vector<std::vector<uint8_t>> malformed = {
+        {0x30, 0x04, 0xFF, 0xFF, 'a', 'b'},                 // Topic longer than the packet
+        {0x30, 0x05, 0x00, 0x03, 'a', '/', 'b'},            // No room for the property length
+        {0x30, 0x07, 0x00, 0x01, 'a', 0x10, 0x23, 0x00, 0x01}, // Properties longer than the packet
+        {0x32, 0x05, 0x00, 0x03, 'a', '/', 'b'},            // QoS 1 without packet identifier
+    };
+
+    for (const auto& packet : malformed) {
+        Broker broker;
+        my_mqtt::Client client(broker);
+        connect(client, broker, my_mqtt::Version::v5);
+
+        broker.send(packet);
+        TEST_ASSERT_FALSE(client.poll(0, handler));
+        TEST_ASSERT_EQUAL(my_mqtt::State::disconnected, client.state());
+    }
+
+    TEST_ASSERT_EQUAL(0, handled);
+}
+
+/**
+ * Random bytes from the broker must not crash the client.
+ */
+void test_fuzz_receive() {
+    std::mt19937 random(42);
+
+    for (int round = 0; round < 2000; round++) {
+        Broker broker;
+        my_mqtt::Client client(broker);
+        connect(client, broker, round % 2 ? my_mqtt::Version::v5 : my_mqtt::Version::v3_1_1);
+
+        std::vector<uint8_t> packet(2 + random() % 64);
+        for (auto& byte : packet) byte = static_cast<uint8_t>(random());
+
+        // Mostly PUBLISH and CONNACK with a plausible length, to get past the framing
+        packet[0] = (random() % 2 ? 0x30 : 0x20) | (random() % 4 << 1);
+        packet[1] = static_cast<uint8_t>(packet.size() - 2 - random() % 3);
+        broker.send(packet);
+
+        for (int i = 0; i < 4 && client.poll(0, handler); i++);
+    }
+}
+
+#if defined(__linux__)
+/**
+ * Writes with more slices than fit into one `writev()` arrive completely and in order.
+ */
+void test_socket_write() {
+    int server = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_size  = sizeof(address);
+
+    TEST_ASSERT_EQUAL(0, ::bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+    TEST_ASSERT_EQUAL(0, ::listen(server, 1));
+    TEST_ASSERT_EQUAL(0, ::getsockname(server, reinterpret_cast<sockaddr*>(&address), &address_size));
+
+    my_mqtt::SocketTransport transport;
+    TEST_ASSERT_TRUE(transport.connect("127.0.0.1", ntohs(address.sin_port)));
+    int peer = ::accept(server, nullptr, nullptr);
+    TEST_ASSERT_TRUE(peer >= 0);
+
+    constexpr size_t COUNT = 3 * my_mqtt::MAX_SLICES + 3;
+    std::vector<uint8_t> data;
+    std::vector<my_mqtt::Slice> slices;
+
+    for (size_t i = 0; i < COUNT; i++) {
+        for (size_t j = 0; j <= i % 7; j++) data.push_back(static_cast<uint8_t>(i));
+    }
+
+    for (size_t i = 0, offset = 0; i < COUNT; offset += i % 7 + 1, i++) {
+        slices.push_back({data.data() + offset, i % 7 + 1});
+    }
+
+    TEST_ASSERT_TRUE(transport.write(slices.data(), slices.size()));
+
+    std::vector<uint8_t> received(data.size());
+    size_t size = 0;
+
+    while (size < received.size()) {
+        ssize_t result = ::recv(peer, received.data() + size, received.size() - size, 0);
+        TEST_ASSERT_TRUE(result > 0);
+        size += result;
+    }
+
+    TEST_ASSERT_EQUAL_MEMORY(data.data(), received.data(), data.size());
+
+    ::close(peer);
+    ::close(server);
+}
+#endif
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_topic_alias);
+    RUN_TEST(test_flush_batches);
+    RUN_TEST(test_receive);
+    RUN_TEST(test_malformed_publish);
+    RUN_TEST(test_fuzz_receive);
+#if defined(__linux__)
+    RUN_TEST(test_socket_write);
+#endif
+    return UNITY_END();
+}
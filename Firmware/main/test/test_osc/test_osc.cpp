@@ -0,0 +1,225 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file test_osc.cpp
+ * @brief Host tests of the OSC dispatcher
+ *
+ * Run with `pio test -e native -f test_osc`. Packets are built like a DAW would send them
+ * and dispatched to a small set of routes, with plain addresses, patterns on both sides,
+ * bundles and arguments of other types than the control expects.
+ */
+
+#include "osc.h"            // my_osc::…
+
+#include <unity.h>          // TEST_…
+
+#include <cstring>          // std::memcpy
+#include <string>           // std::string
+#include <vector>           // std::vector
+
+/**
+ * OSC packet under construction
+ */
+struct Packet {
+    std::vector<uint8_t> data;
+
+    Packet& string(const std::string& value) {
+        data.insert(data.end(), value.begin(), value.end());
+        do data.push_back(0); while (data.size() % 4);
+        return *this;
+    }
+
+    Packet& int32(int32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) data.push_back(static_cast<uint8_t>(value >> shift));
+        return *this;
+    }
+
+    Packet& float32(float value) {
+        int32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return int32(bits);
+    }
+
+    Packet& packet(const Packet& element) {
+        int32(static_cast<int32_t>(element.data.size()));
+        data.insert(data.end(), element.data.begin(), element.data.end());
+        return *this;
+    }
+};
+
+/**
+ * Routes the handler was called for, with the first argument
+ */
+struct Dispatched {
+    my_osc::Route route;
+    std::string types;
+    my_osc::Argument first;
+    std::string string;             ///< Copy of a string argument, which points into the packet
+    bool has_first;
+};
+
+static std::vector<Dispatched> dispatched;
+
+static void handler(void*, const my_osc::Route& route, const my_osc::Message& message) noexcept {
+    Dispatched entry = {route, std::string(message.types), {}, {}, false};
+
+    my_osc::ArgumentReader reader(message);
+    entry.has_first = reader.next(entry.first);
+    entry.string    = std::string(entry.first.string);
+
+    dispatched.push_back(entry);
+}
+
+static size_t dispatch(const my_osc::Dispatcher& dispatcher, const Packet& packet) {
+    return dispatcher.dispatch(packet.data.data(), packet.data.size(), handler, nullptr);
+}
+
+/**
+ * Dispatcher with a fader on two servers, a knob and a pattern route
+ */
+static my_osc::Dispatcher dispatcher() {
+    my_osc::Dispatcher dispatcher;
+    dispatcher.add("/daw", "/track/1/volume", {0, 1, 0});
+    dispatcher.add("/daw", "/track/2/volume", {0, 2, 0});
+    dispatcher.add("/mixer", "/track/1/volume", {1, 1, 1});
+    dispatcher.add("/daw", "/track/1/pan", {0, 3, 0});
+    dispatcher.add("/daw", "/track/*/mute", {0, 4, 0});
+    dispatcher.compile();
+    return dispatcher;
+}
+
+void setUp() {
+    dispatched.clear();
+}
+
+void tearDown() {
+}
+
+/**
+ * Plain addresses are found by their exact address, including the server prefix.
+ */
+void test_exact() {
+    my_osc::Dispatcher osc = dispatcher();
+
+    TEST_ASSERT_EQUAL(1, dispatch(osc, Packet().string("/daw/track/1/volume").string(",f").float32(0.75f)));
+    TEST_ASSERT_EQUAL(1, dispatched[0].route.control);
+    TEST_ASSERT_EQUAL(0, dispatched[0].route.server);
+    TEST_ASSERT_TRUE(dispatched[0].has_first);
+    TEST_ASSERT_EQUAL_FLOAT(0.75f, dispatched[0].first.float32);
+
+    TEST_ASSERT_EQUAL(1, dispatch(osc, Packet().string("/mixer/track/1/volume").string(",f").float32(0.5f)));
+    TEST_ASSERT_EQUAL(1, dispatched[1].route.server);
+
+    // Prefixes and suffixes of known addresses are different addresses
+    TEST_ASSERT_EQUAL(0, dispatch(osc, Packet().string("/daw/track/1").string(",f").float32(0.5f)));
+    TEST_ASSERT_EQUAL(0, dispatch(osc, Packet().string("/daw/track/1/volume/x").string(",f").float32(0.5f)));
+    TEST_ASSERT_EQUAL(0, dispatch(osc, Packet().string("/track/1/volume").string(",f").float32(0.5f)));
+    TEST_ASSERT_EQUAL(2, dispatched.size());
+}
+
+/**
+ * Several controls may listen on the same address.
+ */
+void test_shared_address() {
+    my_osc::Dispatcher osc = dispatcher();
+    osc.add("/daw", "/track/1/volume", {0, 9, 2});
+    osc.compile();
+
+    TEST_ASSERT_EQUAL(2, dispatch(osc, Packet().string("/daw/track/1/volume").string(",f").float32(1.0f)));
+    TEST_ASSERT_EQUAL(1, dispatched[0].route.control);
+    TEST_ASSERT_EQUAL(9, dispatched[1].route.control);
+}
+
+/**
+ * Received patterns are matched against all routes, configured patterns against all
+ * received addresses.
+ */
+void test_wildcard() {
+    my_osc::Dispatcher osc = dispatcher();
+
+    // Received pattern
+    TEST_ASSERT_EQUAL(2, dispatch(osc, Packet().string("/daw/track/[12]/volume").string(",f").float32(0.0f)));
+    TEST_ASSERT_EQUAL(3, dispatch(osc, Packet().string("/*/track/1/*").string(",f").float32(0.0f)));
+    TEST_ASSERT_EQUAL(1, dispatch(osc, Packet().string("/daw/track/?/pan").string(",f").float32(0.0f)));
+    TEST_ASSERT_EQUAL(1, dispatch(osc, Packet().string("/daw/track/1/{pan,width}").string(",f").float32(0.0f)));
+
+    // Configured pattern
+    dispatched.clear();
+    TEST_ASSERT_EQUAL(1, dispatch(osc, Packet().string("/daw/track/17/mute").string(",i").int32(1)));
+    TEST_ASSERT_EQUAL(4, dispatched[0].route.control);
+    TEST_ASSERT_EQUAL(0, dispatch(osc, Packet().string("/daw/track/17/solo").string(",i").int32(1)));
+
+    // `*` does not cross a slash
+    TEST_ASSERT_EQUAL(0, dispatch(osc, Packet().string("/daw/*/volume").string(",f").float32(0.0f)));
+}
+
+/**
+ * Messages are dispatched by address only. Arguments of another type than expected
+ * reach the handler as they are, and unknown or truncated arguments cannot be read.
+ */
+void test_type_mismatch() {
+    my_osc::Dispatcher osc = dispatcher();
+
+    TEST_ASSERT_EQUAL(1, dispatch(osc, Packet().string("/daw/track/1/volume").string(",s").string("loud")));
+    TEST_ASSERT_EQUAL_STRING("s", dispatched[0].types.c_str());
+    TEST_ASSERT_TRUE(dispatched[0].has_first);
+    TEST_ASSERT_EQUAL_STRING("loud", dispatched[0].string.c_str());
+
+    TEST_ASSERT_EQUAL(1, dispatch(osc, Packet().string("/daw/track/1/volume").string(",i").int32(-3)));
+    TEST_ASSERT_EQUAL('i', dispatched[1].first.type);
+    TEST_ASSERT_EQUAL(-3, dispatched[1].first.int32);
+
+    // Unknown type tag and missing argument data
+    TEST_ASSERT_EQUAL(1, dispatch(osc, Packet().string("/daw/track/1/volume").string(",x").int32(0)));
+    TEST_ASSERT_FALSE(dispatched[2].has_first);
+
+    TEST_ASSERT_EQUAL(1, dispatch(osc, Packet().string("/daw/track/1/volume").string(",f")));
+    TEST_ASSERT_FALSE(dispatched[3].has_first);
+
+    // Without type tags, like very old implementations
+    TEST_ASSERT_EQUAL(1, dispatch(osc, Packet().string("/daw/track/1/volume")));
+    TEST_ASSERT_FALSE(dispatched[4].has_first);
+
+    // Malformed type tags are not dispatched at all
+    TEST_ASSERT_EQUAL(0, dispatch(osc, Packet().string("/daw/track/1/volume").string("f").float32(0.0f)));
+    TEST_ASSERT_EQUAL(5, dispatched.size());
+}
+
+/**
+ * All messages of a bundle are dispatched, also from nested bundles.
+ */
+void test_bundle() {
+    my_osc::Dispatcher osc = dispatcher();
+
+    Packet inner = Packet().string("#bundle").int32(0).int32(1)
+        .packet(Packet().string("/daw/track/2/volume").string(",f").float32(0.25f));
+
+    Packet outer = Packet().string("#bundle").int32(0).int32(1)
+        .packet(Packet().string("/daw/track/1/pan").string(",f").float32(0.5f))
+        .packet(inner);
+
+    TEST_ASSERT_EQUAL(2, dispatch(osc, outer));
+    TEST_ASSERT_EQUAL(3, dispatched[0].route.control);
+    TEST_ASSERT_EQUAL(2, dispatched[1].route.control);
+
+    // Element sizes beyond the packet
+    Packet broken = Packet().string("#bundle").int32(0).int32(1).int32(1000);
+    TEST_ASSERT_EQUAL(0, dispatch(osc, broken));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_exact);
+    RUN_TEST(test_shared_address);
+    RUN_TEST(test_wildcard);
+    RUN_TEST(test_type_mismatch);
+    RUN_TEST(test_bundle);
+    return UNITY_END();
+}
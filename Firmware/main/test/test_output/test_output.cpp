@@ -0,0 +1,226 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file test_output.cpp
+ * @brief Host tests of the rate limited output scheduler
+ *
+ * Run with `pio test -e native -f test_output`. The scheduler is ticked once per simulated
+ * millisecond while the controls change faster than the destinations may send, and the
+ * bytes sent in every window must stay within the rate and burst of the destination.
+ */
+
+#include "output.h"         // my_output::…
+
+#include <unity.h>          // TEST_…
+
+#include <vector>           // std::vector
+
+/**
+ * Destination recording what has been sent and when
+ */
+struct Recorder {
+    size_t message_size = 6;        ///< Bytes per control
+    bool offline = false;           ///< Link cannot take any data
+    uint32_t now_us = 0;            ///< Current simulated time
+
+    struct Message {
+        uint32_t time_us;
+        uint16_t control;
+        uint8_t changed;
+        float values[my_control::INPUT_COUNT];
+    };
+
+    std::vector<Message> messages;
+};
+
+static size_t send(void* context, uint16_t control, uint8_t changed, const float* values) noexcept {
+    Recorder& recorder = *static_cast<Recorder*>(context);
+    if (recorder.offline) return 0;
+
+    Recorder::Message message = {recorder.now_us, control, changed, {}};
+    for (size_t i = 0; i < my_control::INPUT_COUNT; i++) message.values[i] = values[i];
+
+    recorder.messages.push_back(message);
+    return recorder.message_size;
+}
+
+/**
+ * Check that no window of the recording exceeds what the limits allow. A single message
+ * may overdraw the bucket once, which is repaid before the next one.
+ *
+ * @returns Bytes sent in total
+ */
+static size_t assert_within_limits(const Recorder& recorder, const my_output::Limits& limits) {
+    const auto& messages = recorder.messages;
+
+    for (size_t first = 0; first < messages.size(); first++) {
+        size_t bytes = 0;
+
+        for (size_t last = first; last < messages.size(); last++) {
+            bytes += recorder.message_size;
+
+            uint64_t window_us = messages[last].time_us - messages[first].time_us;
+            uint64_t allowed   = limits.burst_bytes + recorder.message_size + window_us * limits.bytes_per_second / 1000000;
+            TEST_ASSERT_LESS_OR_EQUAL(allowed, bytes);
+        }
+    }
+
+    return messages.size() * recorder.message_size;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+/**
+ * One control changing every millisecond on a MIDI link sends no more than 3125 bytes
+ * per second.
+ */
+void test_rate_limit() {
+    Recorder recorder;
+    my_output::Scheduler scheduler;
+
+    my_output::destination_t midi = scheduler.add_destination(my_output::MIDI_LIMITS, send, &recorder);
+    scheduler.add_route(0, midi);
+    scheduler.compile();
+
+    for (uint32_t ms = 1; ms <= 1000; ms++) {
+        recorder.now_us = ms * 1000;
+        scheduler.update(0, my_control::Input::a, ms / 1000.0f);
+        scheduler.tick(recorder.now_us);
+    }
+
+    size_t bytes = assert_within_limits(recorder, my_output::MIDI_LIMITS);
+    TEST_ASSERT_LESS_OR_EQUAL(my_output::MIDI_LIMITS.bytes_per_second + my_output::MIDI_LIMITS.burst_bytes + recorder.message_size, bytes);
+
+    // The link is used, not starved
+    TEST_ASSERT_GREATER_OR_EQUAL(my_output::MIDI_LIMITS.bytes_per_second - recorder.message_size, bytes);
+}
+
+/**
+ * Messages larger than the burst still go out, but at the sustained rate.
+ */
+void test_large_messages() {
+    Recorder recorder;
+    recorder.message_size = 100;
+
+    my_output::Scheduler scheduler;
+    my_output::destination_t midi = scheduler.add_destination(my_output::MIDI_LIMITS, send, &recorder);
+
+    for (uint16_t control = 0; control < 8; control++) scheduler.add_route(control, midi);
+    scheduler.compile();
+
+    for (uint32_t ms = 1; ms <= 2000; ms++) {
+        recorder.now_us = ms * 1000;
+        scheduler.update(ms % 8, my_control::Input::a, 0.5f);
+        scheduler.tick(recorder.now_us);
+    }
+
+    size_t bytes = assert_within_limits(recorder, my_output::MIDI_LIMITS);
+    TEST_ASSERT_LESS_OR_EQUAL(2 * my_output::MIDI_LIMITS.bytes_per_second + my_output::MIDI_LIMITS.burst_bytes + recorder.message_size, bytes);
+    TEST_ASSERT_GREATER_THAN(0, bytes);
+}
+
+/**
+ * Values that change faster than the link are coalesced, and the newest one always
+ * arrives.
+ */
+void test_newest_value() {
+    Recorder recorder;
+    my_output::Scheduler scheduler;
+
+    my_output::destination_t midi = scheduler.add_destination(my_output::MIDI_LIMITS, send, &recorder);
+    scheduler.add_route(3, midi);
+    scheduler.compile();
+
+    for (uint32_t ms = 1; ms <= 100; ms++) {
+        recorder.now_us = ms * 1000;
+        scheduler.update(3, my_control::Input::b, ms / 100.0f);
+        scheduler.tick(recorder.now_us);
+    }
+
+    for (uint32_t ms = 101; ms <= 200; ms++) scheduler.tick(recorder.now_us = ms * 1000);
+
+    TEST_ASSERT_EQUAL(0, scheduler.pending(midi));
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, recorder.messages.back().values[1]);
+}
+
+/**
+ * While offline, only the newest value of each control is kept. Going back online sends
+ * every known input again, including those that did not change during the outage.
+ */
+void test_suspend_resume() {
+    Recorder network, midi;
+    my_output::Scheduler scheduler;
+
+    my_output::destination_t osc  = scheduler.add_destination(my_output::NETWORK_LIMITS, send, &network, true);
+    my_output::destination_t wire = scheduler.add_destination(my_output::MIDI_LIMITS, send, &midi);
+
+    for (uint16_t control = 0; control < 3; control++) {
+        scheduler.add_route(control, osc);
+        scheduler.add_route(control, wire);
+    }
+
+    scheduler.compile();
+
+    uint32_t ms = 0;
+    auto run = [&](uint32_t duration_ms) {
+        for (uint32_t end = ms + duration_ms; ms < end; ms++) {
+            network.now_us = midi.now_us = ms * 1000;
+            scheduler.tick(ms * 1000);
+        }
+    };
+
+    scheduler.update(0, my_control::Input::a, 0.1f);
+    scheduler.update(1, my_control::Input::a, 0.2f);
+    run(50);
+    TEST_ASSERT_EQUAL(2, network.messages.size());
+
+    // Offline: Many changes of one control are coalesced, the wired destination goes on
+    scheduler.online(false);
+
+    for (int i = 1; i <= 100; i++) {
+        scheduler.update(0, my_control::Input::a, i / 100.0f);
+        run(1);
+    }
+
+    run(50);
+    TEST_ASSERT_EQUAL(2, network.messages.size());
+    TEST_ASSERT_EQUAL(1, scheduler.pending(osc));
+    TEST_ASSERT_EQUAL(0, scheduler.pending(wire));
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, midi.messages.back().values[0]);
+
+    // Online: One message per known control, with the newest values
+    network.messages.clear();
+    scheduler.online(true);
+    run(50);
+
+    TEST_ASSERT_EQUAL(2, network.messages.size());
+    TEST_ASSERT_EQUAL(0, scheduler.pending(osc));
+
+    for (const auto& message : network.messages) {
+        if (message.control == 0) TEST_ASSERT_EQUAL_FLOAT(1.0f, message.values[0]);
+        else                      TEST_ASSERT_EQUAL_FLOAT(0.2f, message.values[0]);
+
+        TEST_ASSERT_EQUAL_HEX8(0x01, message.changed);
+        TEST_ASSERT_TRUE(message.control < 2);  // Control 2 never had a value
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_rate_limit);
+    RUN_TEST(test_large_messages);
+    RUN_TEST(test_newest_value);
+    RUN_TEST(test_suspend_resume);
+    return UNITY_END();
+}
@@ -0,0 +1,239 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file test_serial.cpp
+ * @brief Host tests of the serial engine over a pseudo terminal
+ *
+ * Run with `pio test -e native -f test_serial`. The port is opened on the slave side of a
+ * pseudo terminal with the Linux TTY back-end, and the test plays the device on the master
+ * side. Only Linux has the back-end, so the tests are skipped on other systems.
+ */
+
+#include "serial.h"         // my_serial::…
+
+#include <unity.h>          // TEST_…
+
+#include <string>           // std::string
+#include <vector>           // std::vector
+
+#if defined(__linux__)
+#include <fcntl.h>          // O_RDWR, O_NOCTTY, O_NONBLOCK
+#include <stdlib.h>         // posix_openpt, grantpt, unlockpt, ptsname
+#include <unistd.h>         // read, write, close
+#endif
+
+constexpr size_t A0 = 3;            ///< Index of input A0
+
+#if defined(__linux__)
+static int master = -1;
+
+/**
+ * Open a pseudo terminal and return the path of its slave side.
+ */
+static std::string open_terminal() {
+    master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    TEST_ASSERT_TRUE(master >= 0);
+    TEST_ASSERT_EQUAL(0, grantpt(master));
+    TEST_ASSERT_EQUAL(0, unlockpt(master));
+
+    return ptsname(master);
+}
+
+/**
+ * Read everything the port has sent so far.
+ */
+static std::string received() {
+    std::string result;
+    char buffer[256];
+    ssize_t size;
+
+    while ((size = ::read(master, buffer, sizeof(buffer))) > 0) result.append(buffer, size);
+    return result;
+}
+
+static my_format::Template compile(const char* data, my_format::Format format) {
+    my_format::Placeholder placeholders[my_control::INPUT_COUNT] = {};
+    placeholders[A0] = {"{A0}", 0.0f, 127.0f, 2, '.'};
+
+    return my_format::Template::compile(data, format, placeholders);
+}
+
+/**
+ * Values passed to the handler
+ */
+struct Received {
+    uint16_t control;
+    uint8_t changed;
+    float value;
+};
+
+static std::vector<Received> handled;
+
+static void handler(void*, uint16_t control, uint8_t changed, const float* values) noexcept {
+    handled.push_back({control, changed, values[A0]});
+}
+#endif
+
+void setUp() {
+#if defined(__linux__)
+    handled.clear();
+#endif
+}
+
+void tearDown() {
+#if defined(__linux__)
+    if (master >= 0) ::close(master);
+    master = -1;
+#endif
+}
+
+#if defined(__linux__)
+/**
+ * Text messages are terminated with a newline, and controls without a message for the
+ * changed inputs send nothing.
+ */
+void test_send() {
+    my_serial::Port port = my_serial::Port::open(open_terminal(), {});
+    TEST_ASSERT_EQUAL(0, port.error());
+
+    my_serial::Engine engine(port);
+    engine.add(0, compile("Volume {A0}", my_format::Format::text), true, false);
+    engine.add(0, compile("0xB0 0x07 {A0}", my_format::Format::binary), true, false);
+    engine.add(1, compile("Mute {A0}", my_format::Format::text), false, true);
+    engine.compile();
+
+    TEST_ASSERT_EQUAL_HEX8(1 << A0, engine.inputs(0));
+    TEST_ASSERT_EQUAL_HEX8(0, engine.inputs(1));
+    TEST_ASSERT_EQUAL_HEX8(0, engine.inputs(2));
+
+    float values[my_control::INPUT_COUNT] = {};
+    values[A0] = 64.0f;
+
+    TEST_ASSERT_EQUAL(13 + 3, engine.send(0, 1 << A0, values));
+    TEST_ASSERT_TRUE(received() == "Volume 64.00\n\xB0\x07\x40");
+
+    // Nothing to send
+    TEST_ASSERT_EQUAL(0, engine.send(0, 1, values));
+    TEST_ASSERT_EQUAL(0, engine.send(1, 1 << A0, values));
+    TEST_ASSERT_EQUAL(0, engine.send(7, 1 << A0, values));
+    TEST_ASSERT_TRUE(received().empty());
+}
+
+/**
+ * Received lines are matched against the text templates, with or without carriage
+ * return, and unknown lines are skipped.
+ */
+void test_match_line() {
+    my_serial::Port port = my_serial::Port::open(open_terminal(), {});
+
+    my_serial::Engine engine(port);
+    engine.add(0, compile("Volume {A0}", my_format::Format::text), false, true);
+    engine.add(1, compile("Pan {A0}", my_format::Format::text), false, true);
+    engine.compile();
+
+    const char input[] = "Volume 0.25\r\nGarbage\nPan 12.5\nVolume x\nVolume 100";
+    TEST_ASSERT_EQUAL(sizeof(input) - 1, ::write(master, input, sizeof(input) - 1));
+
+    engine.poll(handler, nullptr);
+
+    TEST_ASSERT_EQUAL(2, handled.size());
+    TEST_ASSERT_EQUAL(0, handled[0].control);
+    TEST_ASSERT_EQUAL_HEX8(1 << A0, handled[0].changed);
+    TEST_ASSERT_EQUAL_FLOAT(0.25f, handled[0].value);
+    TEST_ASSERT_EQUAL(1, handled[1].control);
+    TEST_ASSERT_EQUAL_FLOAT(12.5f, handled[1].value);
+
+    // The incomplete last line waits for its newline
+    TEST_ASSERT_EQUAL(1, ::write(master, "\n", 1));
+    engine.poll(handler, nullptr);
+
+    TEST_ASSERT_EQUAL(3, handled.size());
+    TEST_ASSERT_EQUAL_FLOAT(100.0f, handled[2].value);
+}
+
+/**
+ * Binary messages are found in a stream with garbage in between.
+ */
+void test_match_binary() {
+    my_serial::Port port = my_serial::Port::open(open_terminal(), {});
+
+    my_serial::Engine engine(port);
+    engine.add(2, compile("0xB0 0x07 {A0}", my_format::Format::binary), false, true);
+    engine.compile();
+
+    const char input[] = "\x01\xB0\x07\x10\xB0\xB0\x07\x7F";
+    TEST_ASSERT_EQUAL(sizeof(input) - 1, ::write(master, input, sizeof(input) - 1));
+
+    engine.poll(handler, nullptr);
+
+    TEST_ASSERT_EQUAL(2, handled.size());
+    TEST_ASSERT_EQUAL(2, handled[0].control);
+    TEST_ASSERT_EQUAL_FLOAT(16.0f, handled[0].value);
+    TEST_ASSERT_EQUAL_FLOAT(127.0f, handled[1].value);
+}
+
+/**
+ * A message is either queued completely or not at all, even if the kernel takes only a
+ * part of it, and everything queued arrives in order.
+ */
+void test_write_all_or_none() {
+    my_serial::Port port = my_serial::Port::open(open_terminal(), {});
+
+    std::string expected;
+    bool rejected = false;
+
+    for (int i = 0; i < 10000 && !rejected; i++) {
+        std::string message(97 + i % 7, static_cast<char>('a' + i % 26));
+
+        if (port.write(reinterpret_cast<const uint8_t*>(message.data()), message.size())) {
+            expected += message;
+        } else {
+            rejected = true;
+        }
+    }
+
+    TEST_ASSERT_TRUE(rejected);
+
+    // Reading lets the port write the rest
+    std::string result;
+    uint8_t scratch[16];
+
+    for (int i = 0; i < 100000 && result.size() < expected.size(); i++) {
+        result += received();
+        port.read(scratch, sizeof(scratch));
+    }
+
+    TEST_ASSERT_EQUAL(expected.size(), result.size());
+    TEST_ASSERT_TRUE(result == expected);
+}
+
+/**
+ * A missing device is reported with its errno.
+ */
+void test_missing_device() {
+    my_serial::Port port = my_serial::Port::open("/dev/does-not-exist", {});
+    const uint8_t data[] = {1, 2, 3};
+
+    TEST_ASSERT_NOT_EQUAL(0, port.error());
+    TEST_ASSERT_FALSE(port.write(data, sizeof(data)));
+}
+#endif
+
+int main() {
+    UNITY_BEGIN();
+#if defined(__linux__)
+    RUN_TEST(test_send);
+    RUN_TEST(test_match_line);
+    RUN_TEST(test_match_binary);
+    RUN_TEST(test_write_all_or_none);
+    RUN_TEST(test_missing_device);
+#endif
+    return UNITY_END();
+}
@@ -0,0 +1,220 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file test_settings.cpp
+ * @brief Host tests and benchmark of the settings import
+ *
+ * Run with `pio test -e native -f test_settings -v`. The benchmark imports documents with
+ * up to ten thousand controls and prints the peak heap use during the import, counted by
+ * the replaced `operator new`, together with the throughput. The peak must be the same for
+ * all sizes.
+ */
+
+#include "settings.h"       // my_settings::…
+
+#include <unity.h>          // TEST_…
+
+#include <algorithm>        // std::max, std::min
+#include <chrono>           // std::chrono::steady_clock
+#include <cstdio>           // std::remove, std::snprintf
+#include <cstdlib>          // std::malloc, std::free
+#include <cstring>          // std::memcpy
+#include <new>              // std::bad_alloc
+#include <string>           // std::string
+
+constexpr const char* SETTINGS = "test_settings.json";
+
+///// Heap accounting /////
+
+static size_t heap_used = 0;        ///< Bytes currently allocated
+static size_t heap_peak = 0;        ///< Highest value of `heap_used`
+constexpr size_t PREFIX = alignof(std::max_align_t);
+
+void* operator new(size_t size) {
+    void* block = std::malloc(size + PREFIX);
+    if (!block) throw std::bad_alloc();
+
+    *static_cast<size_t*>(block) = size;
+    heap_used += size;
+    heap_peak  = std::max(heap_peak, heap_used);
+    return static_cast<char*>(block) + PREFIX;
+}
+
+void operator delete(void* pointer) noexcept {
+    if (!pointer) return;
+
+    void* block = static_cast<char*>(pointer) - PREFIX;
+    heap_used -= *static_cast<size_t*>(block);
+    std::free(block);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+///// Helpers /////
+
+/**
+ * Document read in pieces, like a request body
+ */
+struct Reader {
+    const std::string& text;
+    size_t position;
+};
+
+static size_t read(void* context, char* buffer, size_t size) noexcept {
+    Reader& reader = *static_cast<Reader*>(context);
+    size = std::min(size, reader.text.size() - reader.position);
+
+    std::memcpy(buffer, reader.text.data() + reader.position, size);
+    reader.position += size;
+    return size;
+}
+
+static bool append(void* context, const char* data, size_t size) noexcept {
+    static_cast<std::string*>(context)->append(data, size);
+    return true;
+}
+
+/**
+ * @returns Settings with the given number of controls, as exported by the web portal
+ */
+static std::string document(size_t controls, const char* server = "s1") {
+    std::string text = "{\"wifi\":{\"mode\":\"station\",\"ssid\":\"Studio\"},"
+        "\"oscServers\":[{\"id\":\"s1\",\"protocol\":\"udp\",\"host\":\"10.0.0.2\",\"port\":9000}],"
+        "\"mqttServers\":[{\"id\":\"m1\",\"protocol\":\"mqtt\",\"host\":\"10.0.0.3\",\"port\":1883}],"
+        "\"controls\":[";
+
+    for (size_t i = 0; i < controls; i++) {
+        if (i) text += ",";
+        text += "{\"base\":{\"general\":{\"name\":\"Fader " + std::to_string(i) + "\",\"board\":" + std::to_string(i / 32)
+            + ",\"slot\":" + std::to_string(i % 32) + "}},"
+            "\"midi\":[{\"message\":\"B0\",\"channel\":1,\"controller\":" + std::to_string(i % 128) + "}],"
+            "\"osc\":[{\"server\":\"" + server + "\",\"address\":\"/fader/" + std::to_string(i) + "\","
+            "\"arguments\":[{\"type\":\"f\",\"format\":\"binary\"}]}],"
+            "\"mqtt\":[{\"server\":\"m1\",\"topic\":\"fader/" + std::to_string(i) + "\",\"format\":\"text\"}]}";
+    }
+
+    return text + "]}";
+}
+
+static bool import(const std::string& text, std::string* error = nullptr) {
+    my_settings::Importer importer(SETTINGS);
+    Reader reader{text, 0};
+
+    bool ok = importer.run(read, &reader);
+    if (error) *error = importer.error();
+    return ok;
+}
+
+static std::string exported() {
+    std::string text;
+    TEST_ASSERT_TRUE(my_settings::send(SETTINGS, append, &text));
+    return text;
+}
+
+void setUp() {
+    std::remove(SETTINGS);
+}
+
+void tearDown() {
+    std::remove(SETTINGS);
+}
+
+///// Tests /////
+
+/**
+ * An accepted document is exported exactly as it was imported.
+ */
+void test_accepted() {
+    std::string text = document(3);
+
+    TEST_ASSERT_TRUE(import(text));
+    TEST_ASSERT_EQUAL_STRING(text.c_str(), exported().c_str());
+}
+
+/**
+ * A new import replaces the existing settings file.
+ */
+void test_replaced() {
+    TEST_ASSERT_TRUE(import(document(1)));
+    TEST_ASSERT_TRUE(import(document(2)));
+    TEST_ASSERT_EQUAL_STRING(document(2).c_str(), exported().c_str());
+}
+
+/**
+ * A rejected document leaves the previous settings and no temporary file behind.
+ */
+void test_rejected() {
+    std::string error;
+
+    TEST_ASSERT_TRUE(import(document(2)));
+    TEST_ASSERT_FALSE(import(document(2, "s9"), &error));
+    TEST_ASSERT_EQUAL_STRING("Invalid value for key 'controls[0].osc[0].server' - no such server", error.c_str());
+    TEST_ASSERT_EQUAL_STRING(document(2).c_str(), exported().c_str());
+
+    std::FILE* temporary = std::fopen((std::string(SETTINGS) + ".new").c_str(), "rb");
+    TEST_ASSERT_NULL(temporary);
+}
+
+/**
+ * Required keys are reported with their full path.
+ */
+void test_missing_key() {
+    std::string error;
+    std::string text = document(1);
+    text.replace(text.find(",\"slot\":0"), 9, "");
+
+    TEST_ASSERT_FALSE(import(text, &error));
+    TEST_ASSERT_EQUAL_STRING("Missing key 'controls[0].base.general.slot'", error.c_str());
+}
+
+/**
+ * Peak heap use and throughput for growing documents
+ */
+void test_benchmark() {
+    size_t first_peak = 0;
+
+    for (size_t controls : {1, 10, 100, 1000, 10000}) {
+        std::string text = document(controls);
+
+        heap_peak = heap_used;
+        size_t before = heap_used;
+        auto start = std::chrono::steady_clock::now();
+
+        TEST_ASSERT_TRUE(import(text));
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        size_t peak = heap_peak - before;
+        if (controls == 1) first_peak = peak;
+
+        char message[128];
+        std::snprintf(message, sizeof(message), "%5zu controls: %8zu bytes, %4zu bytes heap, %6.2f MB/s",
+            controls, text.size(), peak, text.size() / seconds / 1e6);
+        TEST_MESSAGE(message);
+
+        TEST_ASSERT_EQUAL_size_t(first_peak, peak);
+    }
+
+    char message[128];
+    std::snprintf(message, sizeof(message), "Stack: %zu bytes importer, parser and writer",
+        sizeof(my_settings::Importer) + sizeof(my_json::Parser) + sizeof(my_json::Writer));
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_accepted);
+    RUN_TEST(test_replaced);
+    RUN_TEST(test_rejected);
+    RUN_TEST(test_missing_key);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
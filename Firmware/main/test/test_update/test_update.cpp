@@ -0,0 +1,315 @@
+/* Modular Music Controller - Main Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file test_update.cpp
+ * @brief Firmware update of simulated sub boards
+ *
+ * Runs the `Updater` of the main board against any number of `Receiver`s of the sub board,
+ * each with its own simulated flash. Every frame is lost with a given probability, for each
+ * board on its own, like on a noisy bus. The benchmark prints the simulated update time
+ * (bus transfers at `MY_SYSTEM_BUS_SPEED` plus the settle times) as the number of boards
+ * grows. Run with `pio test -e native -f test_update -v` to see it.
+ */
+
+// The header of the sub board has the same name as the one of the main board, which comes
+// first on the include path. So it is included explicitly, before its source.
+#include "../../../sub/include/update.h"
+#include "../../../sub/src/update.cpp"
+
+#include "update.h"         // my_update::Updater
+
+#include <unity.h>          // TEST_…
+
+#include <cstdio>           // std::FILE, std::fopen, std::remove, std::snprintf
+#include <memory>           // std::unique_ptr
+#include <random>           // std::mt19937
+#include <vector>           // std::vector
+
+constexpr const char* IMAGE   = "test_update.bin";
+constexpr uint32_t BUS_SPEED  = 400000;         ///< I2C clock frequency in Hz
+constexpr uint32_t STEP_US    = 200;            ///< Time per step besides the bus transfers
+
+/**
+ * Internal flash of a sub board in RAM
+ */
+class SimulatedFlash : public my_update::Flash {
+public:
+    SimulatedFlash() : memory(MY_UPDATE_STATE_ADDRESS + MY_UPDATE_PAGE_SIZE - MY_UPDATE_APP_ADDRESS, 0xFF) {}
+
+    const uint8_t* read(uint32_t address) noexcept override {
+        return memory.data() + (address - MY_UPDATE_APP_ADDRESS);
+    }
+
+    bool erase(uint32_t address) noexcept override {
+        if ((address - MY_UPDATE_APP_ADDRESS) % MY_UPDATE_PAGE_SIZE) return false;
+
+        std::memset(memory.data() + (address - MY_UPDATE_APP_ADDRESS), 0xFF, MY_UPDATE_PAGE_SIZE);
+        erased++;
+        return true;
+    }
+
+    bool program(uint32_t address, const void* data, size_t size) noexcept override {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        uint8_t* target = memory.data() + (address - MY_UPDATE_APP_ADDRESS);
+
+        for (size_t i = 0; i < size; i += 2) {
+            uint16_t value   = bytes[i] | (i + 1 < size ? bytes[i + 1] << 8 : 0xFF00);
+            uint16_t current = target[i] | target[i + 1] << 8;
+
+            // Like the STM32: Only erased half-words can be programmed, except with zero
+            if (current != 0xFFFF && value != 0) return false;
+
+            target[i]     = static_cast<uint8_t>(value);
+            target[i + 1] = static_cast<uint8_t>(value >> 8);
+        }
+
+        return true;
+    }
+
+    void install(uint32_t size) noexcept override {
+        std::memcpy(memory.data(), read(MY_UPDATE_STAGING_ADDRESS), size);
+        erase(MY_UPDATE_STATE_ADDRESS);
+        installed = size;
+    }
+
+    std::vector<uint8_t> memory;    ///< Flash contents from the application address on
+    uint32_t installed = 0;         ///< Size of the installed image
+    uint32_t erased = 0;            ///< Number of page erases
+};
+
+/**
+ * Sub board with its flash, which survives a reset of the receiver
+ */
+struct Board {
+    SimulatedFlash flash;
+    std::unique_ptr<my_update::Receiver> receiver{new my_update::Receiver(flash)};
+
+    void reset() { receiver.reset(new my_update::Receiver(flash)); }
+};
+
+/**
+ * System bus with simulated sub boards, that lose frames
+ */
+class SimulatedBus : public my_bus::Link {
+public:
+    SimulatedBus(size_t count, double loss, uint32_t seed) : loss(loss), random(seed) {
+        for (size_t i = 0; i < count; i++) boards.emplace_back(new Board());
+    }
+
+    bool request(uint8_t board, my_bus::Type type, my_bus::Header& header, const uint8_t*& payload) noexcept override {
+        transfer(0);
+        if (board >= boards.size() || type != my_bus::Type::update_status || lost()) return false;
+
+        report = boards[board]->receiver->report();
+        transfer(sizeof(report));
+
+        header  = {my_bus::VERSION, my_bus::Type::update_report, board, 0, 0, sizeof(report)};
+        payload = reinterpret_cast<const uint8_t*>(&report);
+        return !lost();
+    }
+
+    bool broadcast(my_bus::Type type, const void* payload, uint16_t length) noexcept override {
+        my_bus::Header header = {my_bus::VERSION, type, my_bus::ALL_BOARDS, 0, 0, length};
+        transfer(length);
+
+        if (type == my_bus::Type::update_data) chunks++;
+
+        for (auto& board : boards) {
+            if (!lost()) board->receiver->receive(header, static_cast<const uint8_t*>(payload));
+        }
+
+        return true;
+    }
+
+    /**
+     * Let the boards write to flash and advance the time.
+     */
+    void step() {
+        for (auto& board : boards) board->receiver->loop();
+        now_us += STEP_US;
+    }
+
+    uint32_t mask() const { return boards.size() >= 32 ? 0xFFFFFFFF : (1u << boards.size()) - 1; }
+
+    std::vector<std::unique_ptr<Board>> boards;
+    uint64_t now_us = 0;            ///< Simulated time
+    uint32_t frames = 0;            ///< Frames on the bus
+    uint32_t chunks = 0;            ///< Sent image chunks
+
+private:
+    bool lost() { return std::uniform_real_distribution<double>(0, 1)(random) < loss; }
+
+    void transfer(size_t length) {
+        // Address byte, header, payload and checksum with nine clocks per byte
+        size_t bytes = 1 + sizeof(my_bus::Header) + length + my_bus::CRC_SIZE;
+        now_us += bytes * 9 * 1000000ull / BUS_SPEED;
+        frames++;
+    }
+
+    double loss;
+    std::mt19937 random;
+    my_bus::UpdateReport report;
+};
+
+static std::vector<uint8_t> image;
+
+/**
+ * Run an update until it is done or has failed.
+ *
+ * @returns Final phase
+ */
+static my_update::Phase run(my_update::Updater& updater, SimulatedBus& bus, uint64_t limit_us = 600000000) {
+    TEST_ASSERT_TRUE(updater.start(bus.mask(), bus.now_us / 1000));
+
+    while (updater.phase() != my_update::Phase::done && updater.phase() != my_update::Phase::failed && bus.now_us < limit_us) {
+        updater.loop(bus.now_us / 1000);
+        bus.step();
+    }
+
+    return updater.phase();
+}
+
+static void assert_installed(SimulatedBus& bus) {
+    for (auto& board : bus.boards) {
+        TEST_ASSERT_EQUAL_UINT32(image.size(), board->flash.installed);
+        TEST_ASSERT_EQUAL_MEMORY(image.data(), board->flash.memory.data(), image.size());
+    }
+}
+
+void setUp() {
+    // Largest image that fits, with an odd size to pad the last chunk
+    std::mt19937 random(1);
+    image.resize(my_update::MAX_IMAGE_SIZE - 7);
+    for (auto& byte : image) byte = static_cast<uint8_t>(random());
+
+    std::FILE* file = std::fopen(IMAGE, "wb");
+    std::fwrite(image.data(), 1, image.size(), file);
+    std::fclose(file);
+}
+
+void tearDown() {
+    std::remove(IMAGE);
+}
+
+/**
+ * Without lost frames every chunk is sent exactly once.
+ */
+void test_single_board() {
+    SimulatedBus bus(1, 0.0, 1);
+    my_update::Updater updater(bus, IMAGE);
+
+    TEST_ASSERT_EQUAL(my_update::Phase::done, run(updater, bus));
+    TEST_ASSERT_EQUAL_UINT32(updater.total(), bus.chunks);
+    assert_installed(bus);
+}
+
+/**
+ * Every board gets the complete image, although each loses other frames, including the
+ * begin, status and commit frames.
+ */
+void test_lost_frames() {
+    SimulatedBus bus(8, 0.1, 2);
+    my_update::Updater updater(bus, IMAGE);
+
+    TEST_ASSERT_EQUAL(my_update::Phase::done, run(updater, bus));
+    TEST_ASSERT_EQUAL_UINT32(0, updater.failed());
+    assert_installed(bus);
+}
+
+/**
+ * After a reset of all boards in the middle of the update, the update is started again and
+ * continues after the last window written to flash.
+ */
+void test_resume() {
+    SimulatedBus bus(4, 0.05, 3);
+
+    {
+        my_update::Updater updater(bus, IMAGE);
+        TEST_ASSERT_TRUE(updater.start(bus.mask(), 0));
+
+        while (updater.received() < updater.total() / 2) {
+            updater.loop(bus.now_us / 1000);
+            bus.step();
+        }
+    }
+
+    uint32_t first = bus.chunks;
+    uint32_t erased = bus.boards[0]->flash.erased;
+    for (auto& board : bus.boards) board->reset();
+
+    my_update::Updater updater(bus, IMAGE);
+    TEST_ASSERT_EQUAL(my_update::Phase::done, run(updater, bus, bus.now_us + 600000000));
+    assert_installed(bus);
+
+    // The second run only sends the second half (plus some repeated chunks)
+    TEST_ASSERT_LESS_THAN(updater.total(), bus.chunks - first);
+    TEST_ASSERT_GREATER_THAN(erased + 1, bus.boards[0]->flash.erased);
+}
+
+/**
+ * Boards that are offered an image larger than their staging area report the failure and
+ * are given up, before anything is written to flash.
+ */
+void test_image_too_large() {
+    image.resize(my_update::MAX_IMAGE_SIZE + 1, 0x5A);
+
+    std::FILE* file = std::fopen(IMAGE, "wb");
+    std::fwrite(image.data(), 1, image.size(), file);
+    std::fclose(file);
+
+    SimulatedBus bus(2, 0.0, 4);
+    my_update::Updater updater(bus, IMAGE);
+
+    TEST_ASSERT_EQUAL(my_update::Phase::failed, run(updater, bus));
+    TEST_ASSERT_EQUAL_UINT32(bus.mask(), updater.failed());
+    TEST_ASSERT_EQUAL_UINT32(0, bus.chunks);
+}
+
+/**
+ * A missing image fails the update right away, so that the web portal can show it.
+ */
+void test_missing_image() {
+    SimulatedBus bus(1, 0.0, 6);
+    my_update::Updater updater(bus, "does/not/exist.bin");
+
+    TEST_ASSERT_FALSE(updater.start(bus.mask(), 0));
+    TEST_ASSERT_EQUAL(my_update::Phase::failed, updater.phase());
+    TEST_ASSERT_FALSE(updater.running());
+    TEST_ASSERT_EQUAL_UINT32(0, bus.frames);
+}
+
+/**
+ * Update time and frames with 5 % lost frames as the number of boards grows
+ */
+void test_benchmark() {
+    for (size_t count : {1, 2, 4, 8, 16, 32}) {
+        SimulatedBus bus(count, 0.05, 5);
+        my_update::Updater updater(bus, IMAGE);
+
+        TEST_ASSERT_EQUAL(my_update::Phase::done, run(updater, bus));
+        assert_installed(bus);
+
+        char message[128];
+        std::snprintf(message, sizeof(message), "%2zu boards: %5.2f s, %5u frames, %5u chunks for %u",
+            count, bus.now_us / 1e6, bus.frames, bus.chunks, updater.total());
+        TEST_MESSAGE(message);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_single_board);
+    RUN_TEST(test_lost_frames);
+    RUN_TEST(test_resume);
+    RUN_TEST(test_image_too_large);
+    RUN_TEST(test_missing_image);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
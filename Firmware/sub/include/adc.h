@@ -0,0 +1,209 @@
+/* Modular Music Controller - Sub Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file adc.h
+ * @brief Continuous scanning of the analog inputs
+ *
+ * Instead of calling `analogRead()` for each input, the ADC converts all configured
+ * channels in scan mode, triggered by a hardware timer, and the DMA controller writes the
+ * results into a circular buffer. The buffer is split into two halves with `MY_ADC_OVERSAMPLING`
+ * scans each. While the DMA fills one half, the half/full transfer interrupt averages the
+ * other half into one 12-bit value per channel. So the CPU is only woken once per output
+ * sample and has nothing to do with the individual conversions.
+ *
+ * Each sample is conditioned by the pipeline of its control type (see `pipeline.h`), so
+ * that the filters run at the full sample rate. Each channel then runs through an
+ * adaptive hysteresis: The noise of the channel is
+ * measured while the input rests, and a new value is only reported when it leaves the
+ * noise band. Thus a resting knob never floods the main board with updates, while a
+ * moving knob is still reported with full resolution.
+ *
+ * Each reported value is stamped with the center of the scans it has been averaged from,
+ * so that its timestamp does not depend on when the main loop picks it up.
+ *
+ * The analog inputs of a joystick or touchpad are the axes of one position. When one of
+ * them leaves its noise band, the others of the same slot are reported with it, so that
+ * the main board always receives the whole position at once.
+ *
+ * This uses the HAL directly and needs `HAL_ADC_MODULE_ONLY`, so that the Arduino core
+ * leaves the ADC alone.
+ */
+
+#pragma once
+
+#include "control.h"        // my_control::ControlType
+#include "pipeline.h"       // my_pipeline::Conditioner
+
+#include <atomic>           // std::atomic
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, uint32_t
+
+#include <Arduino.h>        // PinName, ADC_HandleTypeDef, …
+
+namespace my_adc {
+
+#ifndef MY_ADC_MAX_CHANNELS
+#define MY_ADC_MAX_CHANNELS 16      ///< Maximum number of scanned channels (ADC sequence length)
+#endif
+
+#ifndef MY_ADC_OVERSAMPLING
+#define MY_ADC_OVERSAMPLING 16      ///< Number of scans averaged into one output sample
+#endif
+
+#ifndef MY_ADC_RATE_HZ
+#define MY_ADC_RATE_HZ 1000         ///< Output samples per second and channel
+#endif
+
+#ifndef MY_ADC_HYSTERESIS_MIN
+#define MY_ADC_HYSTERESIS_MIN 2     ///< Smallest hysteresis in LSB
+#endif
+
+#ifndef MY_ADC_HYSTERESIS_MAX
+#define MY_ADC_HYSTERESIS_MAX 32    ///< Largest hysteresis in LSB
+#endif
+
+static_assert(MY_ADC_MAX_CHANNELS <= 16, "The ADC sequencer can only scan 16 channels");
+static_assert(MY_ADC_MAX_CHANNELS <= MY_PIPELINE_CHANNELS, "Each channel needs a pipeline");
+
+/**
+ * Analog channel
+ */
+struct Channel {
+    PinName pin;                    ///< Input pin
+    uint32_t channel;               ///< ADC channel (`ADC_CHANNEL_x`) of the pin
+    uint8_t input;                  ///< Input number on the system bus
+};
+
+/**
+ * Adaptive hysteresis of a single channel
+ */
+struct Hysteresis {
+    uint16_t output = 0;            ///< Last reported value
+    uint16_t noise = 0;             ///< Measured noise in 1/16 LSB
+
+    /**
+     * @param[in] sample New sample
+     * @returns true, if the sample must be reported
+     */
+    bool update(uint16_t sample) noexcept {
+        uint16_t diff = sample > output ? sample - output : output - sample;
+        uint16_t band = threshold();
+
+        if (diff <= band) {
+            // Input rests, so the difference is noise. Exponential average with α = 1/16.
+            noise = static_cast<uint16_t>(noise + diff - (noise >> 4));
+            return false;
+        }
+
+        output = sample;
+        return true;
+    }
+
+    /**
+     * @returns Current hysteresis in LSB: twice the average noise, within the limits
+     */
+    uint16_t threshold() const noexcept {
+        uint16_t band = noise >> 3;
+        if (band < MY_ADC_HYSTERESIS_MIN) return MY_ADC_HYSTERESIS_MIN;
+        if (band > MY_ADC_HYSTERESIS_MAX) return MY_ADC_HYSTERESIS_MAX;
+        return band;
+    }
+};
+
+/**
+ * Singleton with the DMA-driven ADC, as the interrupt handlers have no context pointer.
+ */
+class Adc {
+public:
+    /**
+     * Get singleton instance.
+     */
+    static Adc& instance() noexcept;
+
+    /**
+     * Configure the ADC, DMA and trigger timer and start scanning.
+     *
+     * @param[in] channels Channels to scan, must stay valid
+     * @param[in] count Number of channels
+     * @returns false, if the hardware could not be initialized
+     */
+    bool begin(const Channel* channels, size_t count) noexcept;
+
+    /**
+     * Select the signal conditioning of a channel and whether it is reported together with
+     * the other channels of its slot.
+     *
+     * @param[in] index Channel index
+     * @param[in] type Control type of the slot
+     */
+    void configure(size_t index, my_control::ControlType type) noexcept;
+
+    /**
+     * Set the calibration table of a channel, if its conditioning uses one.
+     *
+     * @param[in] index Channel index
+     * @param[in] points `MY_PIPELINE_CALIBRATION_POINTS` output values
+     */
+    void calibrate(size_t index, const int16_t* points) noexcept;
+
+    /**
+     * Take the channels that changed since the last call.
+     *
+     * @returns Bit mask of the changed channels
+     */
+    uint32_t take_changed() noexcept { return changed.exchange(0, std::memory_order_acquire); }
+
+    /**
+     * @param[in] index Channel index
+     * @returns Latest reported 12-bit value
+     */
+    uint16_t value(size_t index) const noexcept { return filters[index].output; }
+
+    /**
+     * @param[in] index Channel index
+     * @returns Time when the latest reported value has been sampled (`micros()`)
+     */
+    uint32_t time(size_t index) const noexcept { return times[index]; }
+
+    /**
+     * @param[in] index Channel index
+     * @returns Channel configuration
+     */
+    const Channel& channel(size_t index) const noexcept { return channels[index]; }
+
+    /**
+     * Process one half of the DMA buffer, called from the DMA interrupt.
+     *
+     * @param[in] half Buffer half (0 or 1)
+     */
+    void process(size_t half) noexcept;
+
+    ADC_HandleTypeDef adc;                                      ///< ADC handle
+    DMA_HandleTypeDef dma;                                      ///< DMA handle
+    TIM_HandleTypeDef timer;                                    ///< Trigger timer handle
+
+    Adc(const Adc&) = delete;
+    Adc& operator=(const Adc&) = delete;
+
+private:
+    Adc() noexcept;
+
+    const Channel* channels;                                    ///< Scanned channels
+    size_t count;                                               ///< Number of channels
+    std::atomic<uint32_t> changed;                              ///< Channels with new values
+    my_pipeline::Conditioner conditioner;                       ///< Signal conditioning per channel
+    Hysteresis filters[MY_ADC_MAX_CHANNELS];                    ///< Hysteresis per channel
+    uint32_t vectors;                                           ///< Channels of multi-axis controls
+    uint32_t groups[MY_ADC_MAX_CHANNELS];                       ///< Channels reported together with each channel
+    uint32_t times[MY_ADC_MAX_CHANNELS];                        ///< Sample time of the reported value per channel
+    uint16_t buffer[2 * MY_ADC_OVERSAMPLING * MY_ADC_MAX_CHANNELS]; ///< DMA buffer, two halves of scans
+};
+
+} // namespace my_adc
@@ -0,0 +1,209 @@
+/* Modular Music Controller - Sub Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file cv_gate.h
+ * @brief Sample-accurate CV/gate inputs and outputs
+ *
+ * Unlike a knob, a gate input is all about timing: A trigger of a few milliseconds must
+ * not be lost, and the note it starts should follow it with constant latency. Therefore
+ * the gate inputs are connected to the input capture channels of TIM2, which runs freely
+ * at 1 MHz. The timer latches its counter on every edge in hardware, so the timestamp is
+ * exact no matter how late the interrupt runs. The edges are queued with their timestamps
+ * and sent as event reports (see `bus.h`), so that none is lost between two reads of the
+ * main board. The CV inputs are regular analog inputs, sampled by `my_adc::Adc`.
+ *
+ * The outputs work the other way around. The main board sends output events with the
+ * time at which they shall take effect, a little in the future. They are kept sorted in
+ * a queue and applied by a periodic tick, which is driven by the fourth compare channel
+ * of the same timer. Therefore their jitter is one tick, regardless of the I2C traffic.
+ * CV outputs are slew limited: Each tick moves the output towards its target by at most
+ * the given rate, which avoids clicks and allows portamento. They are written to the DAC
+ * or to a 12-bit PWM channel of TIM3, which needs an RC low-pass filter.
+ *
+ * TIM2 counts at the same clock as `micros()`, so both are locked by a fixed offset that
+ * is measured once. The timestamps thus share the time base of the clock sync.
+ *
+ * This uses the HAL directly and needs `HAL_TIM_MODULE_ONLY`, so that the Arduino core
+ * leaves the timer interrupts alone.
+ */
+
+#pragma once
+
+#include "bus.h"            // my_bus::…
+
+#include <atomic>           // std::atomic
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, uint32_t, int32_t
+
+#include <Arduino.h>        // PinName, TIM_HandleTypeDef, DAC_HandleTypeDef, …
+
+namespace my_cv_gate {
+
+#ifndef MY_CV_GATE_MAX_GATES
+#define MY_CV_GATE_MAX_GATES 3      ///< Maximum number of gate inputs (capture channels 1-3 of TIM2)
+#endif
+
+#ifndef MY_CV_GATE_MAX_OUTPUTS
+#define MY_CV_GATE_MAX_OUTPUTS 8    ///< Maximum number of CV and gate outputs
+#endif
+
+#ifndef MY_CV_GATE_EVENTS
+#define MY_CV_GATE_EVENTS 32        ///< Capacity of the gate edge queue (power of two)
+#endif
+
+#ifndef MY_CV_GATE_QUEUE
+#define MY_CV_GATE_QUEUE 32         ///< Capacity of the output event queue
+#endif
+
+#ifndef MY_CV_GATE_RATE_HZ
+#define MY_CV_GATE_RATE_HZ 10000    ///< Output ticks per second
+#endif
+
+#ifndef MY_CV_GATE_HORIZON_US
+#define MY_CV_GATE_HORIZON_US 1000000   ///< Output events further in the future are applied right away
+#endif
+
+static_assert(MY_CV_GATE_MAX_GATES <= 3, "Capture channel 4 drives the output tick");
+static_assert((MY_CV_GATE_EVENTS & (MY_CV_GATE_EVENTS - 1)) == 0, "Edge queue capacity must be a power of two");
+static_assert(MY_CV_GATE_RATE_HZ % 1000 == 0, "Slew rates are given per millisecond");
+
+/**
+ * Gate input
+ */
+struct GateInput {
+    PinName pin;                    ///< Input pin, with TIM2 on alternate function 1
+    uint32_t channel;               ///< Capture channel (`TIM_CHANNEL_x`)
+    uint8_t input;                  ///< Input number on the system bus
+};
+
+/**
+ * Output hardware
+ */
+enum class Kind : uint8_t {
+    gate,                           ///< Digital output pin
+    dac,                            ///< DAC1 channel
+    pwm,                            ///< TIM3 PWM channel, on alternate function 2
+};
+
+/**
+ * CV or gate output
+ */
+struct Output {
+    PinName pin;                    ///< Output pin
+    Kind kind;                      ///< Output hardware
+    uint32_t channel;               ///< `DAC_CHANNEL_x` or `TIM_CHANNEL_x`, unused for gates
+    uint8_t output;                 ///< Output number on the system bus
+};
+
+/**
+ * Singleton with the capture and output timers, as the interrupt handlers have no
+ * context pointer.
+ */
+class CvGate {
+public:
+    /**
+     * Get singleton instance.
+     */
+    static CvGate& instance() noexcept;
+
+    /**
+     * Configure the timers, DAC and pins and start capturing.
+     *
+     * @param[in] gates Gate inputs, must stay valid
+     * @param[in] gate_count Number of gate inputs
+     * @param[in] outputs CV and gate outputs, must stay valid
+     * @param[in] output_count Number of outputs
+     * @returns false, if the hardware could not be initialized
+     */
+    bool begin(const GateInput* gates, size_t gate_count, const Output* outputs, size_t output_count) noexcept;
+
+    /**
+     * Schedule the events of an output events frame. Called by the system bus from its
+     * interrupt handler.
+     *
+     * @param[in] header Frame header
+     * @param[in] payload Frame payload
+     */
+    void receive(const my_bus::Header& header, const uint8_t* payload) noexcept;
+
+    /**
+     * @returns true, if gate edges are waiting to be sent
+     */
+    bool pending() const noexcept {
+        return head.load(std::memory_order_acquire) != tail.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Take the oldest gate edges. Called by the system bus from its interrupt handler.
+     *
+     * @param[out] events Room for `max` events
+     * @param[in] max Maximum number of events
+     * @returns Number of events
+     */
+    size_t take(my_bus::InputEvent* events, size_t max) noexcept;
+
+    /**
+     * Queue the current level of all gate inputs, after the main board lost a report.
+     */
+    void resync() noexcept { resync_requested = true; }
+
+    /**
+     * @returns Number of gate edges lost, because the queue was full or the edges came too
+     *          fast for the interrupt handler
+     */
+    uint32_t lost() const noexcept { return _lost; }
+
+    /**
+     * Handle the capture and compare interrupts of TIM2.
+     */
+    void on_timer() noexcept;
+
+    TIM_HandleTypeDef timer;                                    ///< Capture and tick timer handle
+    TIM_HandleTypeDef pwm;                                      ///< PWM timer handle
+    DAC_HandleTypeDef dac;                                      ///< DAC handle
+
+    CvGate(const CvGate&) = delete;
+    CvGate& operator=(const CvGate&) = delete;
+
+private:
+    /**
+     * Current state of a CV or gate output
+     */
+    struct Channel {
+        int32_t current;            ///< Current value with eight fractional bits
+        int32_t target;             ///< Target value with eight fractional bits
+        int32_t step;               ///< Maximum change per tick with eight fractional bits, zero to jump
+    };
+
+    CvGate() noexcept;
+
+    uint32_t now() const noexcept { return base_us + timer.Instance->CNT; }
+    void push(uint32_t time_us, uint8_t input, int32_t value) noexcept;
+    void tick(uint32_t now_us) noexcept;
+    void apply(const my_bus::OutputEvent& event) noexcept;
+    void write(size_t index, uint16_t value) noexcept;
+
+    const GateInput* gates;                                     ///< Gate inputs
+    size_t gate_count;                                          ///< Number of gate inputs
+    const Output* outputs;                                      ///< CV and gate outputs
+    size_t output_count;                                        ///< Number of outputs
+    uint32_t base_us;                                           ///< `micros()` when TIM2 was zero
+    uint8_t levels[MY_CV_GATE_MAX_GATES];                       ///< Current level of each gate input
+    my_bus::InputEvent edges[MY_CV_GATE_EVENTS];                ///< Gate edges (ring buffer)
+    std::atomic<size_t> head;                                   ///< Next edge to be written (timer interrupt)
+    std::atomic<size_t> tail;                                   ///< Next edge to be read (I2C interrupt)
+    volatile bool resync_requested;                             ///< Gate levels must be queued with the next tick
+    uint32_t _lost;                                             ///< Number of lost edges
+    my_bus::OutputEvent queue[MY_CV_GATE_QUEUE];                ///< Output events sorted by time
+    size_t queued;                                              ///< Number of queued output events
+    Channel channels[MY_CV_GATE_MAX_OUTPUTS];                   ///< State of each output
+};
+
+} // namespace my_cv_gate
@@ -0,0 +1,317 @@
+/* Modular Music Controller - Sub Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file pipeline.h
+ * @brief Signal conditioning of the analog inputs
+ *
+ * Each analog input runs through a chain of processing stages before its value is sent
+ * to the main board: median filters against spikes, one-pole low-pass filters against
+ * noise, calibration tables for non-linear sensors, response curves and dead zones. The
+ * stages needed depend on the control type. A fader needs little more than a light filter
+ * and dead zones at its ends, while a joystick needs a dead zone around its center and a
+ * ribbon needs a median filter against contact bounce.
+ *
+ * The stages are template classes, whose parameters are known at compile time, and a
+ * pipeline is a tuple of stages called one after the other. So the compiler can inline
+ * the whole chain, fold the constants into it and drop stages that do nothing, like a
+ * `DeadZone<0>` or a linear `Curve`. Stateless stages take no memory at all. One pipeline
+ * type is defined per control type and input, and a `std::variant` of all of them holds
+ * the pipeline of each channel, which is selected at runtime when the control type of
+ * the slot is known.
+ *
+ * All values are 12-bit, from zero to `MAX_VALUE`.
+ */
+
+#pragma once
+
+#include "control.h"        // my_control::ControlType, my_control::INPUT_COUNT
+
+#include <cstddef>          // size_t
+#include <cstdint>          // int16_t, int32_t, int64_t, uint8_t
+#include <cstring>          // std::memcpy
+#include <tuple>            // std::tuple, std::get
+#include <type_traits>      // std::is_same_v
+#include <utility>          // std::index_sequence
+#include <variant>          // std::variant, std::visit
+
+namespace my_pipeline {
+
+#ifndef MY_PIPELINE_CHANNELS
+#define MY_PIPELINE_CHANNELS 16     ///< Number of conditioned channels
+#endif
+
+#ifndef MY_PIPELINE_CALIBRATION_POINTS
+#define MY_PIPELINE_CALIBRATION_POINTS 9 ///< Points of the calibration tables
+#endif
+
+constexpr int32_t MAX_VALUE = 4095;                 ///< Highest value
+constexpr int32_t CENTER    = (MAX_VALUE + 1) / 2;  ///< Center position of sprung controls
+
+constexpr int32_t clamp(int32_t value) noexcept {
+    return value < 0 ? 0 : value > MAX_VALUE ? MAX_VALUE : value;
+}
+
+/**
+ * One-pole low-pass filter: y += (x - y) / 2^Shift. The state has eight fractional bits,
+ * so that slow movements are not lost in the division.
+ */
+template <unsigned Shift>
+struct OnePole {
+    static_assert(Shift < 16, "Filter would never settle");
+
+    int32_t state = -1;             ///< Filter state with eight fractional bits, negative until the first sample
+
+    int32_t process(int32_t value) noexcept {
+        if constexpr (Shift == 0) {
+            return value;
+        } else {
+            if (state < 0) state = value << 8;
+            state += ((value << 8) - state) >> Shift;
+            return (state + 128) >> 8;
+        }
+    }
+};
+
+/**
+ * Median of the last N samples, which removes single spikes without smearing edges
+ */
+template <size_t N>
+struct Median {
+    static_assert(N % 2 == 1, "Median needs an odd number of samples");
+
+    int16_t history[N] = {};        ///< Recent samples (ring buffer)
+    uint8_t next = 0;               ///< Next entry in the ring buffer
+    uint8_t count = 0;              ///< Number of valid samples
+
+    int32_t process(int32_t value) noexcept {
+        if constexpr (N == 1) {
+            return value;
+        } else {
+            history[next] = static_cast<int16_t>(value);
+            next = (next + 1) % N;
+            if (count < N) count++;
+
+            // Insertion sort, as N is tiny
+            int16_t sorted[N];
+
+            for (uint8_t i = 0; i < count; i++) {
+                int16_t sample = history[i];
+                uint8_t j = i;
+
+                for (; j > 0 && sorted[j - 1] > sample; j--) sorted[j] = sorted[j - 1];
+                sorted[j] = sample;
+            }
+
+            return sorted[count / 2];
+        }
+    }
+};
+
+/**
+ * Piecewise linear calibration table with N evenly spaced points. Identity until the
+ * table has been set, e.g. from values measured at the end stops of a ribbon.
+ */
+template <size_t N>
+struct Calibrate {
+    static_assert(N >= 2, "Calibration needs at least two points");
+
+    int16_t table[N];               ///< Output value at each point
+
+    constexpr Calibrate() noexcept : table{} {
+        for (size_t i = 0; i < N; i++) table[i] = static_cast<int16_t>(i * MAX_VALUE / (N - 1));
+    }
+
+    void set(const int16_t* points) noexcept {
+        std::memcpy(table, points, sizeof(table));
+    }
+
+    int32_t process(int32_t value) const noexcept {
+        int32_t position = clamp(value) * static_cast<int32_t>(N - 1);
+        size_t i         = position / MAX_VALUE;
+        int32_t fraction = position % MAX_VALUE;
+
+        if (i >= N - 1) return table[N - 1];
+        return table[i] + (table[i + 1] - table[i]) * fraction / MAX_VALUE;
+    }
+};
+
+/**
+ * Shape of a response curve
+ */
+enum class Shape : uint8_t {
+    linear,                         ///< Unchanged
+    audio,                          ///< x², fine control at the low end (audio taper)
+    fine,                           ///< x³, even finer control at the low end
+    fast,                           ///< 1 - (1 - x)², fine control at the high end
+    s_curve,                        ///< 3x² - 2x³, fine control at both ends
+};
+
+/**
+ * Response curve. Bipolar curves are applied to the distance from the center, mirrored
+ * for both directions, e.g. for fine control of a joystick around its rest position.
+ */
+template <Shape S, bool Bipolar = false>
+struct Curve {
+    static constexpr int32_t shape(int32_t x) noexcept {
+        int64_t v = x;
+        int64_t m = MAX_VALUE;
+
+        switch (S) {
+            case Shape::audio:   return static_cast<int32_t>(v * v / m);
+            case Shape::fine:    return static_cast<int32_t>(v * v * v / (m * m));
+            case Shape::fast:    return static_cast<int32_t>(m - (m - v) * (m - v) / m);
+            case Shape::s_curve: return static_cast<int32_t>((3 * v * v * m - 2 * v * v * v) / (m * m));
+            default:             return x;
+        }
+    }
+
+    static constexpr int32_t process(int32_t value) noexcept {
+        value = clamp(value);
+
+        if constexpr (S == Shape::linear) {
+            return value;
+        } else if constexpr (Bipolar) {
+            int32_t distance = value - CENTER;
+            int32_t range    = distance < 0 ? CENTER : MAX_VALUE - CENTER;
+            int32_t shaped   = shape((distance < 0 ? -distance : distance) * MAX_VALUE / range) * range / MAX_VALUE;
+            return distance < 0 ? CENTER - shaped : CENTER + shaped;
+        } else {
+            return shape(value);
+        }
+    }
+};
+
+/**
+ * Dead zones at both ends, so that the end stops are reliably reached, and optionally
+ * around the center, so that a sprung control reliably returns to its rest position.
+ * The remaining range is stretched to the full range.
+ */
+template <int32_t Low, int32_t High = Low, int32_t Center = 0>
+struct DeadZone {
+    static_assert(Low >= 0 && High >= 0 && Center >= 0 && Low + High + Center < MAX_VALUE, "Dead zones too large");
+
+    static constexpr int32_t stretch(int32_t value, int32_t from, int32_t to, int32_t out_from, int32_t out_to) noexcept {
+        if (value <= from) return out_from;
+        if (value >= to) return out_to;
+        return out_from + (value - from) * (out_to - out_from) / (to - from);
+    }
+
+    static constexpr int32_t process(int32_t value) noexcept {
+        if constexpr (Low == 0 && High == 0 && Center == 0) {
+            return value;
+        } else if constexpr (Center == 0) {
+            return stretch(value, Low, MAX_VALUE - High, 0, MAX_VALUE);
+        } else {
+            if (value < CENTER - Center / 2) return stretch(value, Low, CENTER - Center / 2, 0, CENTER);
+            if (value > CENTER + Center / 2) return stretch(value, CENTER + Center / 2, MAX_VALUE - High, CENTER, MAX_VALUE);
+            return CENTER;
+        }
+    }
+};
+
+/**
+ * Chain of processing stages, called from left to right.
+ */
+template <typename... Stages>
+class Pipeline {
+public:
+    /**
+     * @param[in] value Raw value
+     * @returns Conditioned value
+     */
+    int32_t process(int32_t value) noexcept {
+        return run(value, std::index_sequence_for<Stages...>{});
+    }
+
+    /**
+     * @returns Stage of the given type, e.g. to set a calibration table
+     */
+    template <typename Stage>
+    Stage& stage() noexcept { return std::get<Stage>(stages); }
+
+    /**
+     * @returns true, if the pipeline contains a stage of the given type
+     */
+    template <typename Stage>
+    static constexpr bool has() noexcept { return (std::is_same_v<Stage, Stages> || ...); }
+
+private:
+    template <size_t... I>
+    int32_t run(int32_t value, std::index_sequence<I...>) noexcept {
+        ((value = std::get<I>(stages).process(value)), ...);
+        return value;
+    }
+
+    std::tuple<Stages...> stages;   ///< Processing stages
+};
+
+using Calibration = Calibrate<MY_PIPELINE_CALIBRATION_POINTS>;
+
+using Raw      = Pipeline<>;
+using Knob     = Pipeline<Median<3>, OnePole<2>, DeadZone<24>>;
+using Fader    = Pipeline<Median<3>, OnePole<2>, DeadZone<32>>;
+using Ribbon   = Pipeline<Median<5>, Calibration, OnePole<1>, DeadZone<8>>;
+using Wheel    = Pipeline<OnePole<2>, Calibration, DeadZone<16, 16, 96>>;
+using Joystick = Pipeline<Median<3>, OnePole<2>, Calibration, DeadZone<16, 16, 128>, Curve<Shape::audio, true>>;
+using Touchpad = Pipeline<Median<3>, OnePole<1>, Calibration>;
+using CvInput  = Pipeline<OnePole<1>, Calibration>;
+
+/**
+ * Pipeline of one channel, selected at runtime
+ */
+using Processor = std::variant<Raw, Knob, Fader, Ribbon, Wheel, Joystick, Touchpad, CvInput>;
+
+/**
+ * Select the pipeline for an input of a control type.
+ *
+ * @param[in] type Control type of the slot
+ * @param[in] input Input of the slot
+ * @returns Fresh pipeline
+ */
+Processor make(my_control::ControlType type, my_control::Input input) noexcept;
+
+/**
+ * Pipelines of all analog channels
+ */
+class Conditioner {
+public:
+    /**
+     * Select the pipeline of a channel. Must not run concurrently to `process()`.
+     *
+     * @param[in] channel Channel index
+     * @param[in] type Control type of the slot
+     * @param[in] input Input of the slot
+     */
+    void configure(size_t channel, my_control::ControlType type, my_control::Input input) noexcept {
+        if (channel < MY_PIPELINE_CHANNELS) processors[channel] = make(type, input);
+    }
+
+    /**
+     * Set the calibration table of a channel, if its pipeline has one.
+     *
+     * @param[in] channel Channel index
+     * @param[in] points `MY_PIPELINE_CALIBRATION_POINTS` output values
+     */
+    void calibrate(size_t channel, const int16_t* points) noexcept;
+
+    /**
+     * @param[in] channel Channel index
+     * @param[in] value Raw value
+     * @returns Conditioned value
+     */
+    int32_t process(size_t channel, int32_t value) noexcept {
+        return std::visit([value](auto& pipeline) { return pipeline.process(value); }, processors[channel]);
+    }
+
+private:
+    Processor processors[MY_PIPELINE_CHANNELS];     ///< Pipeline of each channel
+};
+
+} // namespace my_pipeline
@@ -0,0 +1,128 @@
+/* Modular Music Controller - Sub Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file system_bus.h
+ * @brief Connection of the sub board to the main board
+ *
+ * The sub board is an I2C slave on the system bus, with its address set by the address
+ * selector. When an input changes, it briefly becomes bus master to send an attention
+ * message to the main board, which then reads the input report (see `bus.h`). If the main
+ * board does not react, e.g. because the attention message got lost, it is repeated
+ * after `MY_ATTENTION_RETRY_MS`.
+ *
+ * When the main board asks for the identity or the descriptor of the board, the response
+ * is prepared in the receive callback and served instead of the next input report. The
+ * same happens for time requests, except that the send time is filled in at the last
+ * possible moment, when the main board starts reading the response.
+ *
+ * Gate edges queued by `my_cv_gate::CvGate` are sent as event reports before the next input
+ * report, and output events are passed on to it, to be scheduled for their time.
+ *
+ * Frames of a firmware update are passed to `my_update::Receiver`. As they are sent to all
+ * boards at once, the general call address is enabled, too.
+ */
+
+#pragma once
+
+#include "bus.h"            // my_bus::…
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint32_t
+
+namespace my_system_bus {
+
+#ifndef MY_CONFIG_LATCH
+#define MY_CONFIG_LATCH PA8         ///< Latch pin of the address selector shift register
+#endif
+
+#ifndef MY_CONFIG_CLOCK
+#define MY_CONFIG_CLOCK PF1         ///< Clock pin of the address selector shift register
+#endif
+
+#ifndef MY_CONFIG_DATA
+#define MY_CONFIG_DATA PF0          ///< Data pin of the address selector shift register
+#endif
+
+#ifndef MY_ATTENTION_RETRY_MS
+#define MY_ATTENTION_RETRY_MS 20    ///< Time after which an unanswered attention message is repeated
+#endif
+
+/**
+ * Singleton with the I2C connection to the main board. There can be only one instance,
+ * because the Wire callbacks have no context pointer.
+ */
+class SystemBus {
+public:
+    /**
+     * Get singleton instance.
+     */
+    static SystemBus& instance() noexcept;
+
+    /**
+     * Read the board address and start listening on the system bus.
+     *
+     * @param[in] inputs Number of inputs of the board
+     */
+    void begin(uint8_t inputs) noexcept;
+
+    /**
+     * Set the descriptor of the plugged controls, that is sent when the main board enumerates
+     * the board. Must be called again when a control is exchanged.
+     *
+     * @param[in] slots One descriptor per slot
+     * @param[in] count Number of slots
+     */
+    void describe(const my_bus::SlotDescriptor* slots, uint8_t count) noexcept;
+
+    /**
+     * Set the current value of an input.
+     *
+     * @param[in] input Input number (`slot * INPUT_COUNT + input`)
+     * @param[in] value Current value
+     * @param[in] time_us Time when the value has been read (`micros()`)
+     */
+    void set(uint8_t input, int32_t value, uint32_t time_us) noexcept { encoder.set(input, value, time_us); }
+
+    /**
+     * Send an attention message, if inputs have changed or gate edges are waiting. Must be
+     * called regularly.
+     *
+     * @param[in] now_ms Current time in milliseconds
+     */
+    void loop(uint32_t now_ms) noexcept;
+
+    /**
+     * @returns Board address from the address selector
+     */
+    uint8_t board() const noexcept { return encoder.board(); }
+
+    SystemBus(const SystemBus&) = delete;
+    SystemBus& operator=(const SystemBus&) = delete;
+
+private:
+    SystemBus() noexcept;
+
+    static uint8_t read_address() noexcept;
+    static void on_request() noexcept;
+    static void on_receive(int count) noexcept;
+    void respond(my_bus::Type type, const void* data, size_t size) noexcept;
+
+    my_bus::Encoder encoder;                    ///< Input report encoder
+    uint8_t frame[my_bus::MAX_FRAME];           ///< Report currently being read
+    volatile size_t frame_size;                 ///< Size of the report, zero if none
+    volatile size_t offset;                     ///< Bytes of the report already read
+    volatile bool notified;                     ///< Attention message has been sent
+    volatile bool response;                     ///< Frame is a response instead of a report
+    my_bus::SlotDescriptor slots[my_bus::MAX_SLOTS]; ///< Descriptor of the plugged controls
+    my_bus::Identity identity;                  ///< Descriptor hash and number of slots
+    uint32_t notified_ms;                       ///< Time of the attention message
+};
+
+} // namespace my_system_bus
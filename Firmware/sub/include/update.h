@@ -0,0 +1,172 @@
+/* Modular Music Controller - Sub Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/**
+ * @file update.h
+ * @brief Reception of firmware updates from the main board
+ *
+ * The flash memory is split into three areas: the running application in the lower half,
+ * the staging area for the new image above it, and the last page, which holds the state
+ * of the update. The state page contains the `UpdateInfo` of the image being received,
+ * followed by one half-word per flash page of the staging area, which is set to zero once
+ * the page has been written. Because erased flash reads as 0xFFFF and a half-word can be
+ * programmed without erasing the page first, the progress survives a reset and costs only
+ * one write per page.
+ *
+ * The chunks of a window are collected in RAM by the I2C interrupt handler. When all are
+ * there, `loop()` writes them into the staging area. When the main board commits the
+ * update, the image is checked against its CRC-32 and copied over the application by a
+ * routine running from RAM, followed by a reset. The copy only takes a moment, but as the
+ * board has no separate bootloader, a power loss during that moment requires flashing the
+ * board with PlatformIO again.
+ *
+ * The receiver accesses the flash through `Flash`, so that the main board's
+ * `test/test_update` can run many receivers with simulated flash on the host.
+ */
+
+#pragma once
+
+#include "bus.h"            // my_bus::…
+
+#include <cstddef>          // size_t
+#include <cstdint>          // uint8_t, uint16_t, uint32_t
+
+namespace my_update {
+
+#ifndef MY_UPDATE_APP_ADDRESS
+#define MY_UPDATE_APP_ADDRESS 0x08000000        ///< Start of the running application
+#endif
+
+#ifndef MY_UPDATE_STAGING_ADDRESS
+#define MY_UPDATE_STAGING_ADDRESS 0x08008000    ///< Start of the staging area
+#endif
+
+#ifndef MY_UPDATE_STATE_ADDRESS
+#define MY_UPDATE_STATE_ADDRESS 0x0800F800      ///< Flash page with the update state, end of the staging area
+#endif
+
+#ifndef MY_UPDATE_PAGE_SIZE
+#define MY_UPDATE_PAGE_SIZE 2048                ///< Size of a flash page
+#endif
+
+/**
+ * Largest image that can be received. `board_upload.maximum_size` in `platformio.ini` must
+ * not be larger, or a valid build could never be updated.
+ */
+constexpr uint32_t MAX_IMAGE_SIZE = MY_UPDATE_STATE_ADDRESS - MY_UPDATE_STAGING_ADDRESS;
+
+static_assert(my_bus::UPDATE_WINDOW * my_bus::UPDATE_CHUNK == MY_UPDATE_PAGE_SIZE, "Each window must fill one flash page");
+
+/**
+ * Flash memory of the board, addressed like the internal flash of the STM32
+ */
+class Flash {
+public:
+    virtual ~Flash() noexcept = default;
+
+    /**
+     * @param[in] address Flash address
+     * @returns Pointer to the flash contents at the address
+     */
+    virtual const uint8_t* read(uint32_t address) noexcept = 0;
+
+    /**
+     * Erase one page to 0xFF.
+     *
+     * @param[in] address Start of the page
+     * @returns false, if the page cannot be erased
+     */
+    virtual bool erase(uint32_t address) noexcept = 0;
+
+    /**
+     * Program erased flash half-word by half-word. An odd size is padded with 0xFF.
+     *
+     * @param[in] address Even flash address
+     * @param[in] data Data to be written
+     * @param[in] size Number of bytes
+     * @returns false, if the flash cannot be programmed
+     */
+    virtual bool program(uint32_t address, const void* data, size_t size) noexcept = 0;
+
+    /**
+     * Copy the staging area over the application, forget the update state and reset.
+     * Does not return on the board.
+     *
+     * @param[in] size Image size
+     */
+    virtual void install(uint32_t size) noexcept = 0;
+};
+
+/**
+ * Receives a firmware update. Frames are handed over by the system bus from its interrupt
+ * handler, flash is only written in `loop()`.
+ */
+class Receiver {
+public:
+    /**
+     * @param[in] flash Flash memory with the staging area and the state page
+     */
+    Receiver(Flash& flash) noexcept;
+
+#if defined(ARDUINO_ARCH_STM32)
+    /**
+     * Get singleton instance, which writes the internal flash.
+     */
+    static Receiver& instance() noexcept;
+#endif
+
+    /**
+     * Handle an update frame. Called by the system bus from its interrupt handler.
+     *
+     * @param[in] header Frame header
+     * @param[in] payload Frame payload
+     */
+    void receive(const my_bus::Header& header, const uint8_t* payload) noexcept;
+
+    /**
+     * @returns Current state for the main board
+     */
+    my_bus::UpdateReport report() const noexcept;
+
+    /**
+     * Write completed windows to flash and install verified images. Must be called
+     * regularly.
+     */
+    void loop() noexcept;
+
+    Receiver(const Receiver&) = delete;
+    Receiver& operator=(const Receiver&) = delete;
+
+private:
+    /**
+     * Flash work requested by the interrupt handler
+     */
+    enum Work : uint8_t {
+        WORK_BEGIN  = 0x01,         ///< Start or resume an update
+        WORK_WINDOW = 0x02,         ///< Write the completed window
+        WORK_COMMIT = 0x04,         ///< Verify and install the image
+    };
+
+    void begin() noexcept;
+    void write_window() noexcept;
+    void commit() noexcept;
+    uint16_t window_chunks() const noexcept;
+
+    Flash& flash;                               ///< Flash memory
+    my_bus::UpdateInfo info;                    ///< Image being received
+    my_bus::UpdateInfo next_info;               ///< Image announced by the last begin frame
+    uint16_t chunks;                            ///< Number of chunks of the image
+    uint16_t base;                              ///< First chunk of the current window
+    volatile my_bus::UpdateState state;         ///< Update state
+    volatile uint8_t work;                      ///< Pending flash work
+    uint8_t received[my_bus::UPDATE_WINDOW / 8];                ///< Bitmap of the received chunks
+    uint8_t window[my_bus::UPDATE_WINDOW * my_bus::UPDATE_CHUNK];   ///< Chunks of the current window
+};
+
+} // namespace my_update
@@ -0,0 +1,211 @@
+/* Modular Music Controller - Sub Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "adc.h"
+
+namespace my_adc {
+
+/////////////////////
+///// class Adc /////
+/////////////////////
+
+Adc& Adc::instance() noexcept {
+    static Adc instance;
+    return instance;
+}
+
+Adc::Adc() noexcept
+    : adc{},
+      dma{},
+      timer{},
+      channels(nullptr),
+      count(0),
+      changed(0),
+      conditioner(),
+      filters{},
+      vectors(0),
+      groups{},
+      times{},
+      buffer{}
+{
+}
+
+bool Adc::begin(const Channel* channels, size_t count) noexcept {
+    if (!count || count > MY_ADC_MAX_CHANNELS) return false;
+
+    this->channels = channels;
+    this->count    = count;
+
+    __HAL_RCC_ADC12_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    __HAL_RCC_TIM15_CLK_ENABLE();
+
+    for (size_t i = 0; i < count; i++) {
+        GPIO_TypeDef* port = set_GPIO_Port_Clock(STM_PORT(channels[i].pin));
+
+        GPIO_InitTypeDef gpio = {};
+        gpio.Pin  = STM_GPIO_PIN(channels[i].pin);
+        gpio.Mode = GPIO_MODE_ANALOG;
+        gpio.Pull = GPIO_NOPULL;
+        HAL_GPIO_Init(port, &gpio);
+    }
+
+    // DMA: Circular over both buffer halves
+    dma.Instance                 = DMA1_Channel1;
+    dma.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+    dma.Init.PeriphInc           = DMA_PINC_DISABLE;
+    dma.Init.MemInc              = DMA_MINC_ENABLE;
+    dma.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    dma.Init.MemDataAlignment    = DMA_MDATAALIGN_HALFWORD;
+    dma.Init.Mode                = DMA_CIRCULAR;
+    dma.Init.Priority            = DMA_PRIORITY_HIGH;
+
+    if (HAL_DMA_Init(&dma) != HAL_OK) return false;
+    __HAL_LINKDMA(&adc, DMA_Handle, dma);
+
+    HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+
+    // ADC: One scan of all channels per timer event
+    adc.Instance                   = ADC1;
+    adc.Init.ClockPrescaler        = ADC_CLOCK_SYNC_PCLK_DIV2;
+    adc.Init.Resolution            = ADC_RESOLUTION_12B;
+    adc.Init.DataAlign             = ADC_DATAALIGN_RIGHT;
+    adc.Init.ScanConvMode          = ADC_SCAN_ENABLE;
+    adc.Init.EOCSelection          = ADC_EOC_SEQ_CONV;
+    adc.Init.LowPowerAutoWait      = DISABLE;
+    adc.Init.ContinuousConvMode    = DISABLE;
+    adc.Init.NbrOfConversion       = count;
+    adc.Init.DiscontinuousConvMode = DISABLE;
+    adc.Init.ExternalTrigConv      = ADC_EXTERNALTRIGCONV_T15_TRGO;
+    adc.Init.ExternalTrigConvEdge  = ADC_EXTERNALTRIGCONVEDGE_RISING;
+    adc.Init.DMAContinuousRequests = ENABLE;
+    adc.Init.Overrun               = ADC_OVR_DATA_OVERWRITTEN;
+
+    if (HAL_ADC_Init(&adc) != HAL_OK) return false;
+    if (HAL_ADCEx_Calibration_Start(&adc, ADC_SINGLE_ENDED) != HAL_OK) return false;
+
+    for (size_t i = 0; i < count; i++) {
+        ADC_ChannelConfTypeDef config = {};
+        config.Channel      = channels[i].channel;
+        config.Rank         = i + 1;
+        config.SingleDiff   = ADC_SINGLE_ENDED;
+        config.SamplingTime = ADC_SAMPLETIME_61CYCLES_5;
+        config.OffsetNumber = ADC_OFFSET_NONE;
+
+        if (HAL_ADC_ConfigChannel(&adc, &config) != HAL_OK) return false;
+    }
+
+    // Timer: One trigger per scan, counting in microseconds. The timer clock is
+    // twice the bus clock, if the APB2 prescaler is not 1.
+    uint32_t clock = HAL_RCC_GetPCLK2Freq();
+    if (RCC->CFGR & RCC_CFGR_PPRE2_2) clock *= 2;
+
+    timer.Instance               = TIM15;
+    timer.Init.Prescaler         = clock / 1000000 - 1;
+    timer.Init.CounterMode       = TIM_COUNTERMODE_UP;
+    timer.Init.Period            = 1000000 / (MY_ADC_RATE_HZ * MY_ADC_OVERSAMPLING) - 1;
+    timer.Init.ClockDivision     = TIM_CLOCKDIVISION_DIV1;
+    timer.Init.RepetitionCounter = 0;
+    timer.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+
+    if (HAL_TIM_Base_Init(&timer) != HAL_OK) return false;
+
+    TIM_MasterConfigTypeDef master = {};
+    master.MasterOutputTrigger = TIM_TRGO_UPDATE;
+    master.MasterSlaveMode     = TIM_MASTERSLAVEMODE_DISABLE;
+
+    if (HAL_TIMEx_MasterConfigSynchronization(&timer, &master) != HAL_OK) return false;
+
+    if (HAL_ADC_Start_DMA(&adc, reinterpret_cast<uint32_t*>(buffer), 2 * MY_ADC_OVERSAMPLING * count) != HAL_OK) return false;
+    return HAL_TIM_Base_Start(&timer) == HAL_OK;
+}
+
+void Adc::configure(size_t index, my_control::ControlType type) noexcept {
+    if (index >= count) return;
+    auto input = static_cast<my_control::Input>(channels[index].input % my_control::INPUT_COUNT);
+
+    // The pipeline and groups are used by the DMA interrupt
+    HAL_NVIC_DisableIRQ(DMA1_Channel1_IRQn);
+    conditioner.configure(index, type, input);
+
+    if (my_control::is_vector(type)) vectors |= 1u << index;
+    else vectors &= ~(1u << index);
+
+    for (size_t i = 0; i < count; i++) {
+        groups[i] = 0;
+        if (!(vectors & (1u << i))) continue;
+
+        for (size_t j = 0; j < count; j++) {
+            bool same_slot = channels[i].input / my_control::INPUT_COUNT == channels[j].input / my_control::INPUT_COUNT;
+            if (j != i && same_slot && (vectors & (1u << j))) groups[i] |= 1u << j;
+        }
+    }
+
+    HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+}
+
+void Adc::calibrate(size_t index, const int16_t* points) noexcept {
+    HAL_NVIC_DisableIRQ(DMA1_Channel1_IRQn);
+    conditioner.calibrate(index, points);
+    HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+}
+
+void Adc::process(size_t half) noexcept {
+    const uint16_t* scan = buffer + half * MY_ADC_OVERSAMPLING * count;
+    uint32_t sum[MY_ADC_MAX_CHANNELS] = {};
+
+    for (size_t s = 0; s < MY_ADC_OVERSAMPLING; s++) {
+        for (size_t i = 0; i < count; i++) sum[i] += *scan++;
+    }
+
+    // The scans of this half have been taken over the last output sample period
+    uint32_t time_us = micros() - 1000000 / MY_ADC_RATE_HZ / 2;
+    uint32_t mask    = 0;
+
+    uint16_t samples[MY_ADC_MAX_CHANNELS];
+
+    for (size_t i = 0; i < count; i++) {
+        uint16_t sample = static_cast<uint16_t>((sum[i] + MY_ADC_OVERSAMPLING / 2) / MY_ADC_OVERSAMPLING);
+        samples[i] = static_cast<uint16_t>(conditioner.process(i, sample));
+
+        if (filters[i].update(samples[i])) {
+            times[i] = time_us;
+            mask |= 1u << i;
+        }
+    }
+
+    // Report the other axes of moved multi-axis controls, too
+    for (uint32_t moved = mask & vectors; moved; moved &= moved - 1) {
+        uint32_t others = groups[__builtin_ctz(moved)] & ~mask;
+
+        for (; others; others &= others - 1) {
+            size_t j = __builtin_ctz(others);
+            filters[j].output = samples[j];
+            times[j] = time_us;
+            mask |= 1u << j;
+        }
+    }
+
+    if (mask) changed.fetch_or(mask, std::memory_order_release);
+}
+
+} // namespace my_adc
+
+extern "C" void DMA1_Channel1_IRQHandler(void) {
+    HAL_DMA_IRQHandler(&my_adc::Adc::instance().dma);
+}
+
+extern "C" void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef*) {
+    my_adc::Adc::instance().process(0);
+}
+
+extern "C" void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef*) {
+    my_adc::Adc::instance().process(1);
+}
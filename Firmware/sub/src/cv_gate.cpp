@@ -0,0 +1,345 @@
+/* Modular Music Controller - Sub Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "cv_gate.h"
+
+#include <cstring>          // std::memcpy, std::memmove
+
+namespace my_cv_gate {
+
+constexpr uint32_t TICK_US  = 1000000 / MY_CV_GATE_RATE_HZ;
+constexpr int32_t MAX_VALUE = 4095;
+
+////////////////////////
+///// class CvGate /////
+////////////////////////
+
+CvGate& CvGate::instance() noexcept {
+    static CvGate instance;
+    return instance;
+}
+
+CvGate::CvGate() noexcept
+    : timer{},
+      pwm{},
+      dac{},
+      gates(nullptr),
+      gate_count(0),
+      outputs(nullptr),
+      output_count(0),
+      base_us(0),
+      levels{},
+      edges{},
+      head(0),
+      tail(0),
+      resync_requested(false),
+      _lost(0),
+      queue{},
+      queued(0),
+      channels{}
+{
+}
+
+bool CvGate::begin(const GateInput* gates, size_t gate_count, const Output* outputs, size_t output_count) noexcept {
+    if (gate_count > MY_CV_GATE_MAX_GATES || output_count > MY_CV_GATE_MAX_OUTPUTS) return false;
+
+    this->gates        = gates;
+    this->gate_count   = gate_count;
+    this->outputs      = outputs;
+    this->output_count = output_count;
+
+    __HAL_RCC_TIM2_CLK_ENABLE();
+    __HAL_RCC_TIM3_CLK_ENABLE();
+    __HAL_RCC_DAC1_CLK_ENABLE();
+
+    // Outputs first, so that they are defined before the tick starts
+    for (size_t i = 0; i < output_count; i++) {
+        const Output& output = outputs[i];
+        GPIO_TypeDef* port   = set_GPIO_Port_Clock(STM_PORT(output.pin));
+
+        GPIO_InitTypeDef gpio = {};
+        gpio.Pin   = STM_GPIO_PIN(output.pin);
+        gpio.Pull  = GPIO_NOPULL;
+        gpio.Speed = GPIO_SPEED_FREQ_LOW;
+
+        switch (output.kind) {
+            case Kind::gate:
+                gpio.Mode = GPIO_MODE_OUTPUT_PP;
+                HAL_GPIO_Init(port, &gpio);
+                break;
+
+            case Kind::dac: {
+                gpio.Mode = GPIO_MODE_ANALOG;
+                HAL_GPIO_Init(port, &gpio);
+
+                dac.Instance = DAC1;
+                if (dac.State == HAL_DAC_STATE_RESET && HAL_DAC_Init(&dac) != HAL_OK) return false;
+
+                DAC_ChannelConfTypeDef config = {};
+                config.DAC_Trigger      = DAC_TRIGGER_NONE;
+                config.DAC_OutputBuffer = DAC_OUTPUTBUFFER_ENABLE;
+
+                if (HAL_DAC_ConfigChannel(&dac, &config, output.channel) != HAL_OK) return false;
+                if (HAL_DAC_Start(&dac, output.channel) != HAL_OK) return false;
+                break;
+            }
+
+            case Kind::pwm: {
+                gpio.Mode      = GPIO_MODE_AF_PP;
+                gpio.Alternate = GPIO_AF2_TIM3;
+                HAL_GPIO_Init(port, &gpio);
+
+                // 12-bit resolution at the full timer clock, e.g. 17.6 kHz at 72 MHz
+                pwm.Instance               = TIM3;
+                pwm.Init.Prescaler         = 0;
+                pwm.Init.CounterMode       = TIM_COUNTERMODE_UP;
+                pwm.Init.Period            = MAX_VALUE;
+                pwm.Init.ClockDivision     = TIM_CLOCKDIVISION_DIV1;
+                pwm.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+
+                if (pwm.State == HAL_TIM_STATE_RESET && HAL_TIM_PWM_Init(&pwm) != HAL_OK) return false;
+
+                TIM_OC_InitTypeDef config = {};
+                config.OCMode     = TIM_OCMODE_PWM1;
+                config.Pulse      = 0;
+                config.OCPolarity = TIM_OCPOLARITY_HIGH;
+                config.OCFastMode = TIM_OCFAST_DISABLE;
+
+                if (HAL_TIM_PWM_ConfigChannel(&pwm, &config, output.channel) != HAL_OK) return false;
+                if (HAL_TIM_PWM_Start(&pwm, output.channel) != HAL_OK) return false;
+                break;
+            }
+        }
+
+        channels[i] = {};
+        write(i, 0);
+    }
+
+    // TIM2: 32-bit counter in microseconds. The timer clock is twice the bus clock,
+    // if the APB1 prescaler is not 1.
+    uint32_t clock = HAL_RCC_GetPCLK1Freq();
+    if (RCC->CFGR & RCC_CFGR_PPRE1_2) clock *= 2;
+
+    timer.Instance               = TIM2;
+    timer.Init.Prescaler         = clock / 1000000 - 1;
+    timer.Init.CounterMode       = TIM_COUNTERMODE_UP;
+    timer.Init.Period            = 0xFFFFFFFF;
+    timer.Init.ClockDivision     = TIM_CLOCKDIVISION_DIV1;
+    timer.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+
+    if (HAL_TIM_IC_Init(&timer) != HAL_OK) return false;
+
+    for (size_t i = 0; i < gate_count; i++) {
+        GPIO_TypeDef* port = set_GPIO_Port_Clock(STM_PORT(gates[i].pin));
+
+        GPIO_InitTypeDef gpio = {};
+        gpio.Pin       = STM_GPIO_PIN(gates[i].pin);
+        gpio.Mode      = GPIO_MODE_AF_PP;
+        gpio.Pull      = GPIO_NOPULL;
+        gpio.Speed     = GPIO_SPEED_FREQ_LOW;
+        gpio.Alternate = GPIO_AF1_TIM2;
+        HAL_GPIO_Init(port, &gpio);
+
+        // Both edges, with a short digital filter against ringing on long patch cables
+        TIM_IC_InitTypeDef config = {};
+        config.ICPolarity  = TIM_INPUTCHANNELPOLARITY_BOTHEDGE;
+        config.ICSelection = TIM_ICSELECTION_DIRECTTI;
+        config.ICPrescaler = TIM_ICPSC_DIV1;
+        config.ICFilter    = 4;
+
+        if (HAL_TIM_IC_ConfigChannel(&timer, &config, gates[i].channel) != HAL_OK) return false;
+        levels[i] = digitalReadFast(gates[i].pin);
+    }
+
+    // Fourth channel as free-running compare for the output tick
+    TIM_OC_InitTypeDef tick = {};
+    tick.OCMode = TIM_OCMODE_TIMING;
+    tick.Pulse  = TICK_US;
+
+    if (HAL_TIM_OC_ConfigChannel(&timer, &tick, TIM_CHANNEL_4) != HAL_OK) return false;
+
+    HAL_NVIC_SetPriority(TIM2_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(TIM2_IRQn);
+
+    for (size_t i = 0; i < gate_count; i++) {
+        if (HAL_TIM_IC_Start_IT(&timer, gates[i].channel) != HAL_OK) return false;
+    }
+
+    if (HAL_TIM_OC_Start_IT(&timer, TIM_CHANNEL_4) != HAL_OK) return false;
+
+    noInterrupts();
+    base_us = micros() - timer.Instance->CNT;
+    interrupts();
+
+    return true;
+}
+
+void CvGate::receive(const my_bus::Header& header, const uint8_t* payload) noexcept {
+    if (header.type != my_bus::Type::output_events) return;
+
+    size_t count = header.length / sizeof(my_bus::OutputEvent);
+    uint32_t now_us = now();
+
+    // The queue is also used by the timer interrupt
+    HAL_NVIC_DisableIRQ(TIM2_IRQn);
+
+    for (size_t i = 0; i < count && queued < MY_CV_GATE_QUEUE; i++) {
+        my_bus::OutputEvent event;
+        std::memcpy(&event, payload + i * sizeof(event), sizeof(event));
+
+        int32_t ahead = static_cast<int32_t>(event.time_us - now_us);
+        if ((header.flags & my_bus::FLAG_IMMEDIATE) || ahead > MY_CV_GATE_HORIZON_US) event.time_us = now_us;
+
+        // Insert behind all events with the same time, so that their order is kept
+        size_t j = queued++;
+
+        for (; j > 0 && static_cast<int32_t>(queue[j - 1].time_us - event.time_us) > 0; j--) {
+            queue[j] = queue[j - 1];
+        }
+
+        queue[j] = event;
+    }
+
+    HAL_NVIC_EnableIRQ(TIM2_IRQn);
+}
+
+size_t CvGate::take(my_bus::InputEvent* events, size_t max) noexcept {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    size_t count = 0;
+
+    for (; t != h && count < max; t++) {
+        events[count++] = edges[t % MY_CV_GATE_EVENTS];
+    }
+
+    tail.store(t, std::memory_order_release);
+    return count;
+}
+
+void CvGate::push(uint32_t time_us, uint8_t input, int32_t value) noexcept {
+    size_t h = head.load(std::memory_order_relaxed);
+
+    if (h - tail.load(std::memory_order_acquire) >= MY_CV_GATE_EVENTS) {
+        _lost++;
+        return;
+    }
+
+    my_bus::InputEvent& edge = edges[h % MY_CV_GATE_EVENTS];
+    edge.time_us = time_us;
+    edge.input   = input;
+    edge.value   = value;
+
+    head.store(h + 1, std::memory_order_release);
+}
+
+void CvGate::on_timer() noexcept {
+    TIM_TypeDef* tim = timer.Instance;
+    uint32_t status  = tim->SR;
+
+    for (size_t i = 0; i < gate_count; i++) {
+        uint32_t index = gates[i].channel / 4;     // TIM_CHANNEL_1 = 0, TIM_CHANNEL_2 = 4, …
+        if (!(status & (TIM_SR_CC1IF << index))) continue;
+
+        // Reading the captured time clears the interrupt flag
+        uint32_t count = (&tim->CCR1)[index];
+
+        if (status & (TIM_SR_CC1OF << index)) {
+            // Edges came faster than this handler, so the level cannot be inferred
+            tim->SR   = ~(TIM_SR_CC1OF << index);
+            levels[i] = digitalReadFast(gates[i].pin);
+            _lost++;
+        } else {
+            levels[i] ^= 1;
+        }
+
+        push(base_us + count, gates[i].input, levels[i]);
+    }
+
+    if (status & TIM_SR_CC4IF) {
+        tim->SR    = ~TIM_SR_CC4IF;
+        tim->CCR4 += TICK_US;
+        tick(now());
+    }
+}
+
+void CvGate::tick(uint32_t now_us) noexcept {
+    if (resync_requested) {
+        resync_requested = false;
+        for (size_t i = 0; i < gate_count; i++) push(now_us, gates[i].input, levels[i]);
+    }
+
+    size_t due = 0;
+    while (due < queued && static_cast<int32_t>(now_us - queue[due].time_us) >= 0) apply(queue[due++]);
+
+    if (due) {
+        queued -= due;
+        std::memmove(queue, queue + due, queued * sizeof(queue[0]));
+    }
+
+    // Slew limiting
+    for (size_t i = 0; i < output_count; i++) {
+        Channel& channel = channels[i];
+        if (channel.current == channel.target) continue;
+
+        int32_t diff = channel.target - channel.current;
+        if (diff >  channel.step) diff =  channel.step;
+        if (diff < -channel.step) diff = -channel.step;
+
+        channel.current += diff;
+        write(i, static_cast<uint16_t>((channel.current + 128) >> 8));
+    }
+}
+
+void CvGate::apply(const my_bus::OutputEvent& event) noexcept {
+    for (size_t i = 0; i < output_count; i++) {
+        if (outputs[i].output != event.output) continue;
+
+        Channel& channel = channels[i];
+        int32_t value    = event.value > MAX_VALUE ? MAX_VALUE : event.value;
+
+        if (outputs[i].kind == Kind::gate) {
+            value = event.value ? 1 : 0;
+            channel.step = 0;
+        } else {
+            channel.step = event.slew * 256 / (MY_CV_GATE_RATE_HZ / 1000);
+            if (event.slew && !channel.step) channel.step = 1;
+        }
+
+        channel.target = value << 8;
+
+        if (!channel.step) {
+            channel.current = channel.target;
+            write(i, static_cast<uint16_t>(value));
+        }
+
+        return;
+    }
+}
+
+void CvGate::write(size_t index, uint16_t value) noexcept {
+    const Output& output = outputs[index];
+
+    switch (output.kind) {
+        case Kind::gate:
+            digitalWriteFast(output.pin, value ? HIGH : LOW);
+            break;
+        case Kind::dac:
+            HAL_DAC_SetValue(&dac, output.channel, DAC_ALIGN_12B_R, value);
+            break;
+        case Kind::pwm:
+            __HAL_TIM_SET_COMPARE(&pwm, output.channel, value);
+            break;
+    }
+}
+
+} // namespace my_cv_gate
+
+extern "C" void TIM2_IRQHandler(void) {
+    my_cv_gate::CvGate::instance().on_timer();
+}
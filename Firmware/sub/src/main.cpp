@@ -0,0 +1,120 @@
+/* Modular Music Controller - Sub Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "adc.h"            // my_adc::Adc, my_adc::Channel
+#include "cv_gate.h"        // my_cv_gate::CvGate, my_cv_gate::GateInput, my_cv_gate::Output
+#include "system_bus.h"     // my_system_bus::SystemBus
+#include "update.h"         // my_update::Receiver
+
+#include <Arduino.h>        // millis
+#include "control.h"        // my_control::ControlType, my_control::INPUT_COUNT
+
+#ifndef MY_SLOT_COUNT
+#define MY_SLOT_COUNT 8     ///< Number of control slots on the board
+#endif
+
+/**
+ * Analog inputs A0 and A1 of the slots. These are the ADC1 pins of the Nucleo board,
+ * so only the first slots can be tested there.
+ */
+static const my_adc::Channel analog_inputs[] = {
+    {PA_0, ADC_CHANNEL_1,  0 * my_control::INPUT_COUNT + 3},
+    {PA_1, ADC_CHANNEL_2,  0 * my_control::INPUT_COUNT + 4},
+    {PA_3, ADC_CHANNEL_4,  1 * my_control::INPUT_COUNT + 3},
+    {PB_0, ADC_CHANNEL_11, 1 * my_control::INPUT_COUNT + 4},
+    {PB_1, ADC_CHANNEL_12, 2 * my_control::INPUT_COUNT + 3},
+};
+
+/**
+ * Gate inputs (input A) of the CV/gate slots, on the capture channels of TIM2
+ */
+static const my_cv_gate::GateInput gate_inputs[] = {
+    {PA_15, TIM_CHANNEL_1, 2 * my_control::INPUT_COUNT + 0},
+};
+
+/**
+ * Gate outputs (input B) and CV outputs (input A1) of the CV/gate slots
+ */
+static const my_cv_gate::Output cv_gate_outputs[] = {
+    {PB_5, my_cv_gate::Kind::gate, 0,             2 * my_control::INPUT_COUNT + 1},
+    {PA_4, my_cv_gate::Kind::dac,  DAC_CHANNEL_1, 2 * my_control::INPUT_COUNT + 4},
+    {PB_4, my_cv_gate::Kind::pwm,  TIM_CHANNEL_1, 3 * my_control::INPUT_COUNT + 4},
+};
+
+/**
+ * Control type of each slot. Fixed until the Typ0-3 pins of the slots are read.
+ */
+static const my_control::ControlType slot_types[MY_SLOT_COUNT] = {
+    my_control::ControlType::knob,
+    my_control::ControlType::knob,
+    my_control::ControlType::cv_gate,
+    my_control::ControlType::cv_gate,
+    my_control::ControlType::knob,
+    my_control::ControlType::knob,
+    my_control::ControlType::knob,
+    my_control::ControlType::knob,
+};
+
+/**
+ * Describe the plugged controls and select the signal conditioning of their analog inputs.
+ */
+static void configure_slots() {
+    my_bus::SlotDescriptor slots[MY_SLOT_COUNT] = {};
+
+    for (size_t i = 0; i < MY_SLOT_COUNT; i++) {
+        slots[i].type = slot_types[i];
+    }
+
+    for (size_t i = 0; i < sizeof(analog_inputs) / sizeof(analog_inputs[0]); i++) {
+        auto& slot = slots[analog_inputs[i].input / my_control::INPUT_COUNT];
+        slot.range[analog_inputs[i].input % my_control::INPUT_COUNT] = 4095;
+
+        my_adc::Adc::instance().configure(i, slot.type);
+    }
+
+    for (auto& gate : gate_inputs) {
+        slots[gate.input / my_control::INPUT_COUNT].range[gate.input % my_control::INPUT_COUNT] = 1;
+    }
+
+    my_system_bus::SystemBus::instance().describe(slots, MY_SLOT_COUNT);
+}
+
+void setup() {
+    my_system_bus::SystemBus::instance().begin(MY_SLOT_COUNT * my_control::INPUT_COUNT);
+    my_adc::Adc::instance().begin(analog_inputs, sizeof(analog_inputs) / sizeof(analog_inputs[0]));
+
+    my_cv_gate::CvGate::instance().begin(
+        gate_inputs, sizeof(gate_inputs) / sizeof(gate_inputs[0]),
+        cv_gate_outputs, sizeof(cv_gate_outputs) / sizeof(cv_gate_outputs[0])
+    );
+
+    configure_slots();
+}
+
+void loop() {
+    auto& bus = my_system_bus::SystemBus::instance();
+    auto& adc = my_adc::Adc::instance();
+
+    uint32_t changed = adc.take_changed();
+
+    // Not interrupted by a report, so that all axes of a joystick end up in the same one
+    noInterrupts();
+
+    while (changed) {
+        size_t i = __builtin_ctz(changed);
+        changed &= changed - 1;
+
+        bus.set(adc.channel(i).input, adc.value(i), adc.time(i));
+    }
+
+    interrupts();
+
+    bus.loop(millis());
+    my_update::Receiver::instance().loop();
+}
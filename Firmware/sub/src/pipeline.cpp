@@ -0,0 +1,48 @@
+/* Modular Music Controller - Sub Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "pipeline.h"
+
+namespace my_pipeline {
+
+Processor make(my_control::ControlType type, my_control::Input input) noexcept {
+    using my_control::ControlType;
+
+    switch (type) {
+        case ControlType::knob:     return Knob();
+        case ControlType::fader:    return Fader();
+        case ControlType::wheel:    return Wheel();
+        case ControlType::joystick: return Joystick();
+        case ControlType::touchpad: return Touchpad();
+        case ControlType::cv_gate:  return CvInput();
+
+        // The second analog input of a ribbon measures the pressure
+        case ControlType::ribbon:
+            return input == my_control::Input::a0 ? Processor(Ribbon()) : Processor(Touchpad());
+
+        default:
+            return Raw();
+    }
+}
+
+/////////////////////////////
+///// class Conditioner /////
+/////////////////////////////
+
+void Conditioner::calibrate(size_t channel, const int16_t* points) noexcept {
+    if (channel >= MY_PIPELINE_CHANNELS) return;
+
+    std::visit([points](auto& pipeline) {
+        if constexpr (std::decay_t<decltype(pipeline)>::template has<Calibration>()) {
+            pipeline.template stage<Calibration>().set(points);
+        }
+    }, processors[channel]);
+}
+
+} // namespace my_pipeline
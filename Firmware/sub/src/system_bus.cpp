@@ -0,0 +1,188 @@
+/* Modular Music Controller - Sub Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "system_bus.h"
+#include "cv_gate.h"        // my_cv_gate::CvGate
+#include "hash.h"           // my_hash::fnv1a
+#include "update.h"         // my_update::Receiver
+
+#include <Arduino.h>        // pinMode, digitalWrite, shiftIn, micros
+#include <Wire.h>           // Wire
+
+#include <cstddef>          // offsetof
+#include <cstring>          // std::memcpy
+
+namespace my_system_bus {
+
+///////////////////////////
+///// class SystemBus /////
+///////////////////////////
+
+SystemBus& SystemBus::instance() noexcept {
+    static SystemBus instance;
+    return instance;
+}
+
+SystemBus::SystemBus() noexcept
+    : encoder(0, 0),
+      frame{},
+      frame_size(0),
+      offset(0),
+      notified(false),
+      response(false),
+      slots{},
+      identity{my_hash::fnv1a(nullptr, 0), 0},
+      notified_ms(0)
+{
+}
+
+uint8_t SystemBus::read_address() noexcept {
+    pinMode(MY_CONFIG_LATCH, OUTPUT);
+    pinMode(MY_CONFIG_CLOCK, OUTPUT);
+    pinMode(MY_CONFIG_DATA, INPUT);
+
+    // Parallel load, then shift out the eight address bits
+    digitalWrite(MY_CONFIG_CLOCK, LOW);
+    digitalWrite(MY_CONFIG_LATCH, LOW);
+    delayMicroseconds(1);
+    digitalWrite(MY_CONFIG_LATCH, HIGH);
+
+    return shiftIn(MY_CONFIG_DATA, MY_CONFIG_CLOCK, MSBFIRST) % MY_BUS_MAX_BOARDS;
+}
+
+void SystemBus::begin(uint8_t inputs) noexcept {
+    encoder = my_bus::Encoder(read_address(), inputs);
+
+    // General call for firmware updates sent to all boards at once
+    Wire.begin(static_cast<uint8_t>(my_bus::BOARD_ADDRESS + encoder.board()), true);
+    Wire.onRequest(on_request);
+    Wire.onReceive(on_receive);
+}
+
+void SystemBus::describe(const my_bus::SlotDescriptor* slots, uint8_t count) noexcept {
+    if (count > my_bus::MAX_SLOTS) count = my_bus::MAX_SLOTS;
+
+    noInterrupts();
+    std::memcpy(this->slots, slots, count * sizeof(my_bus::SlotDescriptor));
+    identity.slots = count;
+    identity.hash  = my_hash::fnv1a(reinterpret_cast<const uint8_t*>(this->slots), count * sizeof(my_bus::SlotDescriptor));
+    interrupts();
+}
+
+void SystemBus::loop(uint32_t now_ms) noexcept {
+    if (notified && now_ms - notified_ms < MY_ATTENTION_RETRY_MS) return;
+    if (offset || !(encoder.changed() || my_cv_gate::CvGate::instance().pending())) return;
+
+    // Arbitration against other boards and the main board is done by the I2C hardware.
+    // If we lose, the message is simply repeated on the next call.
+    Wire.beginTransmission(my_bus::MAIN_ADDRESS);
+    Wire.write(encoder.board());
+
+    if (Wire.endTransmission() == 0) {
+        notified    = true;
+        notified_ms = now_ms;
+    }
+}
+
+void SystemBus::on_request() noexcept {
+    SystemBus& self = instance();
+
+    // Stamp time responses when their first chunk is read, as close to the transfer as possible
+    if (!self.offset && self.response && self.frame[offsetof(my_bus::Header, type)] == static_cast<uint8_t>(my_bus::Type::time_response)) {
+        uint32_t now_us = micros();
+        std::memcpy(self.frame + sizeof(my_bus::Header) + offsetof(my_bus::TimeResponse, transmit_us), &now_us, sizeof(now_us));
+        my_bus::finish(self.frame, sizeof(my_bus::TimeResponse));
+    }
+
+    // Encode the report when its first chunk is read, so that it has the latest values.
+    // Gate edges go first, as they are the most time-critical.
+    if (!self.offset && !self.response) {
+        my_bus::InputEvent events[my_bus::MAX_EVENTS];
+        size_t count = my_cv_gate::CvGate::instance().take(events, my_bus::MAX_EVENTS);
+        for (size_t i = 0; i < count; i++) self.encoder.track(events[i].input, events[i].value);
+
+        self.frame_size = count ? self.encoder.encode(self.frame, events, count) : self.encoder.encode(self.frame);
+        self.notified   = false;
+
+        if (!self.frame_size) {
+            Wire.write(static_cast<uint8_t>(0));
+            return;
+        }
+    }
+
+    size_t size = self.frame_size - self.offset;
+    if (size > MY_BUS_CHUNK) size = MY_BUS_CHUNK;
+
+    Wire.write(self.frame + self.offset, size);
+    self.offset += size;
+
+    if (self.offset >= self.frame_size) {
+        self.offset   = 0;
+        self.response = false;
+    }
+}
+
+void SystemBus::on_receive(int) noexcept {
+    uint32_t now_us = micros();
+    SystemBus& self = instance();
+    uint8_t buffer[MY_BUS_CHUNK];
+    size_t size = 0;
+
+    while (Wire.available() && size < sizeof(buffer)) buffer[size++] = Wire.read();
+    while (Wire.available()) Wire.read();
+
+    my_bus::Header header;
+    const uint8_t* payload;
+    if (my_bus::parse(buffer, size, header, payload) != my_bus::Result::ok) return;
+
+    switch (header.type) {
+        case my_bus::Type::resync:
+            self.offset = 0;
+            self.encoder.resync();
+            my_cv_gate::CvGate::instance().resync();
+            break;
+        case my_bus::Type::identify:
+            self.respond(my_bus::Type::identity, &self.identity, sizeof(self.identity));
+            break;
+        case my_bus::Type::describe:
+            self.respond(my_bus::Type::descriptor, self.slots, self.identity.slots * sizeof(my_bus::SlotDescriptor));
+            break;
+        case my_bus::Type::time_request: {
+            my_bus::TimeResponse response = {now_us, now_us};
+            self.respond(my_bus::Type::time_response, &response, sizeof(response));
+            break;
+        }
+        case my_bus::Type::output_events:
+            my_cv_gate::CvGate::instance().receive(header, payload);
+            break;
+        case my_bus::Type::update_begin:
+        case my_bus::Type::update_data:
+        case my_bus::Type::update_commit:
+            my_update::Receiver::instance().receive(header, payload);
+            break;
+        case my_bus::Type::update_status: {
+            my_bus::UpdateReport report = my_update::Receiver::instance().report();
+            self.respond(my_bus::Type::update_report, &report, sizeof(report));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void SystemBus::respond(my_bus::Type type, const void* data, size_t size) noexcept {
+    uint8_t* payload = my_bus::begin(frame, type, encoder.board(), 0, 0);
+    std::memcpy(payload, data, size);
+
+    frame_size = my_bus::finish(frame, static_cast<uint16_t>(size));
+    offset     = 0;
+    response   = true;
+}
+
+} // namespace my_system_bus
@@ -0,0 +1,273 @@
+/* Modular Music Controller - Sub Board Firmware
+ * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "update.h"
+
+#include <cstring>          // std::memcmp, std::memcpy, std::memset
+
+#if defined(ARDUINO_ARCH_STM32)
+#include <Arduino.h>        // noInterrupts, interrupts, HAL_FLASH…
+#endif
+
+namespace my_update {
+
+constexpr uint32_t MARKS_ADDRESS = MY_UPDATE_STATE_ADDRESS + sizeof(my_bus::UpdateInfo);
+
+#if defined(ARDUINO_ARCH_STM32)
+
+/**
+ * Copy the staging area over the application and reset. Runs from RAM, because the
+ * code in flash is overwritten, and therefore only accesses the flash registers.
+ * Flash must be unlocked.
+ */
+__attribute__((section(".RamFunc"), noinline, long_call))
+static void install(uint32_t size) noexcept {
+    __disable_irq();
+
+    for (uint32_t offset = 0; offset < size; offset += MY_UPDATE_PAGE_SIZE) {
+        FLASH->CR |= FLASH_CR_PER;
+        FLASH->AR  = MY_UPDATE_APP_ADDRESS + offset;
+        FLASH->CR |= FLASH_CR_STRT;
+        while (FLASH->SR & FLASH_SR_BSY) {}
+        FLASH->CR &= ~FLASH_CR_PER;
+    }
+
+    FLASH->CR |= FLASH_CR_PG;
+
+    for (uint32_t offset = 0; offset < size; offset += 2) {
+        *reinterpret_cast<volatile uint16_t*>(MY_UPDATE_APP_ADDRESS + offset) =
+            *reinterpret_cast<const volatile uint16_t*>(MY_UPDATE_STAGING_ADDRESS + offset);
+        while (FLASH->SR & FLASH_SR_BSY) {}
+    }
+
+    FLASH->CR &= ~FLASH_CR_PG;
+
+    // Forget the update, so that it is not resumed by the new firmware
+    FLASH->CR |= FLASH_CR_PER;
+    FLASH->AR  = MY_UPDATE_STATE_ADDRESS;
+    FLASH->CR |= FLASH_CR_STRT;
+    while (FLASH->SR & FLASH_SR_BSY) {}
+    FLASH->CR &= ~FLASH_CR_PER;
+
+    SCB->AIRCR = (0x5FAUL << SCB_AIRCR_VECTKEY_Pos) | SCB_AIRCR_SYSRESETREQ_Msk;
+    while (true) {}
+}
+
+/**
+ * Internal flash of the STM32
+ */
+class InternalFlash : public Flash {
+public:
+    const uint8_t* read(uint32_t address) noexcept override {
+        return reinterpret_cast<const uint8_t*>(address);
+    }
+
+    bool erase(uint32_t address) noexcept override {
+        FLASH_EraseInitTypeDef erase = {};
+        erase.TypeErase   = FLASH_TYPEERASE_PAGES;
+        erase.PageAddress = address;
+        erase.NbPages     = 1;
+
+        uint32_t error;
+        HAL_FLASH_Unlock();
+        bool ok = HAL_FLASHEx_Erase(&erase, &error) == HAL_OK;
+        HAL_FLASH_Lock();
+
+        return ok;
+    }
+
+    bool program(uint32_t address, const void* data, size_t size) noexcept override {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        bool ok = true;
+
+        HAL_FLASH_Unlock();
+
+        for (size_t i = 0; ok && i < size; i += 2) {
+            uint16_t value = bytes[i] | (i + 1 < size ? bytes[i + 1] << 8 : 0xFF00);
+            ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address + i, value) == HAL_OK;
+        }
+
+        HAL_FLASH_Lock();
+        return ok;
+    }
+
+    void install(uint32_t size) noexcept override {
+        HAL_FLASH_Unlock();
+        my_update::install(size);
+    }
+};
+
+#endif
+
+//////////////////////////
+///// class Receiver /////
+//////////////////////////
+
+#if defined(ARDUINO_ARCH_STM32)
+Receiver& Receiver::instance() noexcept {
+    static InternalFlash flash;
+    static Receiver instance(flash);
+    return instance;
+}
+#endif
+
+Receiver::Receiver(Flash& flash) noexcept
+    : flash(flash),
+      info{},
+      next_info{},
+      chunks(0),
+      base(0),
+      state(my_bus::UpdateState::idle),
+      work(0),
+      received{},
+      window{}
+{
+}
+
+uint16_t Receiver::window_chunks() const noexcept {
+    return static_cast<size_t>(chunks - base) < my_bus::UPDATE_WINDOW ? chunks - base : my_bus::UPDATE_WINDOW;
+}
+
+void Receiver::receive(const my_bus::Header& header, const uint8_t* payload) noexcept {
+    switch (header.type) {
+        case my_bus::Type::update_begin:
+            if (header.length < sizeof(my_bus::UpdateInfo)) return;
+            std::memcpy(&next_info, payload, sizeof(next_info));
+            state = my_bus::UpdateState::busy;
+            work |= WORK_BEGIN;
+            break;
+
+        case my_bus::Type::update_data: {
+            if (state != my_bus::UpdateState::receiving || header.length < sizeof(my_bus::UpdateChunk)) return;
+
+            my_bus::UpdateChunk chunk;
+            std::memcpy(&chunk, payload, sizeof(chunk));
+
+            // Chunks of other windows are meant for boards lagging behind
+            uint16_t count = window_chunks();
+            if (chunk.index < base || chunk.index >= base + count) return;
+
+            size_t i = chunk.index - base;
+            if (received[i / 8] & (1 << (i % 8))) return;
+
+            std::memcpy(window + i * my_bus::UPDATE_CHUNK, chunk.data, my_bus::UPDATE_CHUNK);
+            received[i / 8] |= 1 << (i % 8);
+
+            for (i = 0; i < count; i++) {
+                if (!(received[i / 8] & (1 << (i % 8)))) return;
+            }
+
+            state = my_bus::UpdateState::busy;
+            work |= WORK_WINDOW;
+            break;
+        }
+
+        case my_bus::Type::update_commit:
+            if (state != my_bus::UpdateState::receiving || base < chunks) return;
+            state = my_bus::UpdateState::busy;
+            work |= WORK_COMMIT;
+            break;
+
+        default:
+            break;
+    }
+}
+
+my_bus::UpdateReport Receiver::report() const noexcept {
+    my_bus::UpdateReport report;
+    report.state = state;
+    report.base  = base;
+    std::memcpy(report.received, received, sizeof(received));
+    return report;
+}
+
+void Receiver::loop() noexcept {
+#if defined(ARDUINO_ARCH_STM32)
+    noInterrupts();
+#endif
+    uint8_t pending = work;
+    work = 0;
+#if defined(ARDUINO_ARCH_STM32)
+    interrupts();
+#endif
+
+    if (pending & WORK_BEGIN) {
+        begin();
+    } else if (pending & WORK_WINDOW) {
+        write_window();
+    } else if (pending & WORK_COMMIT) {
+        commit();
+    }
+}
+
+void Receiver::begin() noexcept {
+    info = next_info;
+
+    if (!info.size || info.size > MAX_IMAGE_SIZE) {
+        state = my_bus::UpdateState::failed;
+        return;
+    }
+
+    chunks = (info.size + my_bus::UPDATE_CHUNK - 1) / my_bus::UPDATE_CHUNK;
+    base   = 0;
+    bool ok = true;
+
+    if (std::memcmp(flash.read(MY_UPDATE_STATE_ADDRESS), &info, sizeof(info)) == 0) {
+        // Resume after the last written page
+        const uint8_t* marks = flash.read(MARKS_ADDRESS);
+
+        for (size_t page = 0; base < chunks; page++) {
+            uint16_t mark;
+            std::memcpy(&mark, marks + page * sizeof(mark), sizeof(mark));
+            if (mark != 0) break;
+
+            base += window_chunks();
+        }
+    } else {
+        ok = flash.erase(MY_UPDATE_STATE_ADDRESS) && flash.program(MY_UPDATE_STATE_ADDRESS, &info, sizeof(info));
+    }
+
+    std::memset(received, 0, sizeof(received));
+    std::memset(window, 0xFF, sizeof(window));
+    state = ok ? my_bus::UpdateState::receiving : my_bus::UpdateState::failed;
+}
+
+void Receiver::write_window() noexcept {
+    uint32_t address = MY_UPDATE_STAGING_ADDRESS + base * my_bus::UPDATE_CHUNK;
+    uint16_t mark    = 0;
+
+    bool ok = flash.erase(address)
+           && flash.program(address, window, window_chunks() * my_bus::UPDATE_CHUNK)
+           && flash.program(MARKS_ADDRESS + base / my_bus::UPDATE_WINDOW * sizeof(mark), &mark, sizeof(mark));
+
+    if (!ok) {
+        state = my_bus::UpdateState::failed;
+        return;
+    }
+
+    base += window_chunks();
+
+    std::memset(received, 0, sizeof(received));
+    std::memset(window, 0xFF, sizeof(window));
+    state = my_bus::UpdateState::receiving;
+}
+
+void Receiver::commit() noexcept {
+    uint32_t crc = my_bus::crc32(flash.read(MY_UPDATE_STAGING_ADDRESS), info.size);
+
+    if (crc != info.crc) {
+        state = my_bus::UpdateState::failed;
+        return;
+    }
+
+    state = my_bus::UpdateState::verified;
+    flash.install(info.size);
+}
+
+} // namespace my_update
@@ -1,6 +1,6 @@
 /* Modular Music Controller - Web Configuration Portal
  * (C) 2025 Dennis Schulmeister-Zimolong <dennis@windows3.de>
- * 
+ *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
  * the Free Software Foundation; either version 3 of the License, or
@@ -10,34 +10,154 @@
 import { promises as fs } from "node:fs";
 import * as path from "node:path";
 import { brotliCompress } from "node:zlib";
+import { createHash } from "node:crypto";
 import { promisify } from "node:util";
 import glob from "fast-glob";
 
-// Compress all static files with the Brotli algorithm and copy the
-// compressed files into the firmware data directory.
+// Compress all static files with the Brotli algorithm and pack them into a single
+// bundle for the `static` partition of the firmware. The bundle uses the IFF format
+// of `Firmware/main/include/file.h` (little endian) and is mapped into memory by the
+// HTTP server (see `Firmware/main/include/http.h`):
+//
+//   "dir " chunk: One entry per file, sorted by path hash:
+//                 hash, path, type, offset, size, etag (six uint32)
+//   "name" chunk: Zero-terminated paths and MIME types
+//   "file" chunk: Compressed content of one file, once per file
+//
+// All offsets count from the start of the bundle. All chunks are padded to four bytes.
 const brotliCompressAsync = promisify(brotliCompress);
-const [srcDir, outDir] = process.argv.slice(2);
+const [srcDir, outFile] = process.argv.slice(2);
 
-if (!srcDir || !outDir) {
-    console.error("Usage: tsx deploy.ts <source-dir> <output-dir>");
+if (!srcDir || !outFile) {
+    console.error("Usage: tsx deploy.ts <source-dir> <output-file>");
     process.exit(1);
 }
 
+const mimeTypes: Record<string, string> = {
+    ".html":  "text/html; charset=utf-8",
+    ".css":   "text/css; charset=utf-8",
+    ".js":    "text/javascript; charset=utf-8",
+    ".json":  "application/json",
+    ".svg":   "image/svg+xml",
+    ".png":   "image/png",
+    ".jpg":   "image/jpeg",
+    ".ico":   "image/x-icon",
+    ".woff2": "font/woff2",
+    ".txt":   "text/plain; charset=utf-8",
+};
+
+/**
+ * 32-bit FNV-1a hash, must match `my_hash::fnv1a()` of the firmware
+ */
+function fnv1a(data: Buffer): number {
+    let hash = 0x811c9dc5;
+
+    for (const byte of data) {
+        hash ^= byte;
+        hash = Math.imul(hash, 0x01000193) >>> 0;
+    }
+
+    return hash;
+}
+
+function pad(size: number): number {
+    return (size + 3) & ~3;
+}
+
+function chunk(type: string, data: Buffer): Buffer {
+    const header = Buffer.alloc(8);
+    header.write(type, 0, 4, "latin1");
+    header.writeUInt32LE(pad(data.length), 4);
+    return Buffer.concat([header, data, Buffer.alloc(pad(data.length) - data.length)]);
+}
+
+interface Asset {
+    path:  Buffer;
+    type:  Buffer;
+    hash:  number;
+    etag:  number;
+    data:  Buffer;
+}
+
 const srcGlob = path.join(srcDir, "**");
 const files = await glob(srcGlob, { dot: true, onlyFiles: true, absolute: true });
+const assets: Asset[] = [];
 
 for (const file of files) {
     if (file.endsWith(".map")) continue;    // Skip rather large code maps
 
-    const relPath = path.relative(srcDir, file);
-    const outPath = path.join(outDir, relPath);
-
-    await fs.mkdir(path.dirname(outPath), { recursive: true });
+    const relPath = path.relative(srcDir, file).split(path.sep).join("/");
+    const uriPath = Buffer.from(`/${relPath}`, "utf-8");
+    const mimeType = mimeTypes[path.extname(file).toLowerCase()] ?? "application/octet-stream";
 
     const data = await fs.readFile(file);
     const compressed = await brotliCompressAsync(data);
 
-    await fs.writeFile(outPath, compressed);
-    console.log(`Compressed: ${relPath} -> ${outPath}`);
+    assets.push({
+        path: uriPath,
+        type: Buffer.from(mimeType, "utf-8"),
+        hash: fnv1a(uriPath),
+        etag: createHash("sha1").update(compressed).digest().readUInt32BE(0),
+        data: compressed,
+    });
+
+    console.log(`Compressed: ${relPath} (${data.length} -> ${compressed.length} bytes)`);
 }
 
+assets.sort((a, b) => a.hash - b.hash);
+
+for (let i = 1; i < assets.length; i++) {
+    if (assets[i].hash === assets[i - 1].hash) {
+        console.error(`Hash collision: ${assets[i].path} and ${assets[i - 1].path}`);
+        process.exit(1);
+    }
+}
+
+// Names, with the MIME types shared between the files
+const names: Buffer[] = [];
+const nameOffsets = new Map<string, number>();
+let namesSize = 0;
+
+function name(value: Buffer): number {
+    const key = value.toString("utf-8");
+    let offset = nameOffsets.get(key);
+
+    if (offset === undefined) {
+        offset = namesSize;
+        nameOffsets.set(key, offset);
+        names.push(value, Buffer.alloc(1));
+        namesSize += value.length + 1;
+    }
+
+    return offset;
+}
+
+const nameRefs = assets.map(asset => ({path: name(asset.path), type: name(asset.type)}));
+
+// Layout: "dir ", "name", then one "file" chunk per asset
+const dirSize = assets.length * 24;
+const namesStart = 8 + dirSize + 8;
+let fileStart = namesStart + pad(namesSize) + 8;
+
+const dir = Buffer.alloc(dirSize);
+
+assets.forEach((asset, i) => {
+    dir.writeUInt32LE(asset.hash, i * 24);
+    dir.writeUInt32LE(namesStart + nameRefs[i].path, i * 24 + 4);
+    dir.writeUInt32LE(namesStart + nameRefs[i].type, i * 24 + 8);
+    dir.writeUInt32LE(fileStart, i * 24 + 12);
+    dir.writeUInt32LE(asset.data.length, i * 24 + 16);
+    dir.writeUInt32LE(asset.etag, i * 24 + 20);
+
+    fileStart += pad(asset.data.length) + 8;
+});
+
+const bundle = Buffer.concat([
+    chunk("dir ", dir),
+    chunk("name", Buffer.concat(names)),
+    ...assets.map(asset => chunk("file", asset.data)),
+]);
+
+await fs.mkdir(path.dirname(outFile), { recursive: true });
+await fs.writeFile(outFile, bundle);
+console.log(`Packed: ${assets.length} files, ${bundle.length} bytes -> ${outFile}`);